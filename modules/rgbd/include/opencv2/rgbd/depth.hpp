@@ -288,6 +288,95 @@ namespace rgbd
                 InputArray Rt, InputArray unregisteredDepth, const Size& outputImagePlaneSize,
                 OutputArray registeredDepth, bool depthDilation=false);
 
+  /** Object that prepares a raw depth frame in one pass over the image.
+   * The depth is divided by the depth factor to get meters, cleaned with the NIL method of DepthCleaner,
+   * back-projected to 3d points like depthTo3d and, if setRegistration() was called, registered to an
+   * external camera like registerDepth. The image is processed by stripes of rows in parallel so that
+   * every input pixel is read once and no full frame intermediate is allocated.
+   */
+  class CV_EXPORTS_W DepthPreprocessor: public Algorithm
+  {
+  public:
+    DepthPreprocessor()
+        :
+          K_(Matx33f::eye()),
+          depth_factor_(1000.f),
+          clean_(true),
+          registered_size_(),
+          depth_dilation_(false)
+    {
+    }
+
+    /** Constructor
+     * @param K the calibration matrix of the depth camera
+     * @param depth_factor the number of input depth units in a meter (1000 for a Kinect in millimeters)
+     * @param clean whether the depth is cleaned before the back-projection
+     */
+    DepthPreprocessor(InputArray K, float depth_factor = 1000.f, bool clean = true);
+
+    ~DepthPreprocessor();
+
+    CV_WRAP static Ptr<DepthPreprocessor> create(InputArray K, float depth_factor = 1000.f, bool clean = true);
+
+    /** Enables the registration of the depth to an external camera, see registerDepth
+     * @param registeredCameraMatrix the camera matrix of the external camera
+     * @param registeredDistCoeffs the distortion coefficients of the external camera (can be empty)
+     * @param Rt the rigid body transform from the depth camera frame to the external camera frame
+     * @param registeredSize the image plane dimensions of the external camera (width, height)
+     * @param depthDilation whether or not the depth is dilated to avoid holes and occlusion errors
+     */
+    CV_WRAP void
+    setRegistration(InputArray registeredCameraMatrix, InputArray registeredDistCoeffs, InputArray Rt,
+                    const Size& registeredSize, bool depthDilation = false);
+
+    /** Processes a depth frame, only the requested outputs are computed
+     * @param depth the raw depth image, CV_16UC1, CV_32FC1 or CV_64FC1
+     * @param cleanDepth the (cleaned) depth in meters, CV_32FC1 with NaN where there is no depth
+     * @param points3d the resulting 3d points, CV_32FC3 with NaN where there is no depth
+     * @param registeredDepth the depth in meters seen by the external camera, CV_32FC1 with NaN where
+     *        there is no depth. Requires setRegistration()
+     */
+    CV_WRAP_AS(apply) void
+    operator()(InputArray depth, OutputArray cleanDepth, OutputArray points3d,
+               OutputArray registeredDepth = noArray()) const;
+
+    CV_WRAP cv::Mat getK() const
+    {
+        return Mat(K_);
+    }
+    CV_WRAP void setK(const cv::Mat &val)
+    {
+        K_ = val;
+    }
+    CV_WRAP float getDepthFactor() const
+    {
+        return depth_factor_;
+    }
+    CV_WRAP void setDepthFactor(float val)
+    {
+        depth_factor_ = val;
+    }
+    CV_WRAP bool getClean() const
+    {
+        return clean_;
+    }
+    CV_WRAP void setClean(bool val)
+    {
+        clean_ = val;
+    }
+
+  protected:
+    Matx33f K_;
+    float depth_factor_;
+    bool clean_;
+
+    Matx33f registered_K_;
+    Mat registered_dist_coeffs_;
+    Matx44f Rt_;
+    Size registered_size_;
+    bool depth_dilation_;
+  };
+
   /**
    * @param depth the depth image
    * @param in_K
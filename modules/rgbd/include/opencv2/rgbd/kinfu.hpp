@@ -74,6 +74,12 @@ struct CV_EXPORTS_W Params
     */
     CV_WRAP static Ptr<Params> hashTSDFParams(bool isCoarse);
 
+    /** @brief Multi-resolution HashTSDF parameters
+      A set of parameters suitable for use with HashTSDFVolume which voxel size
+      grows with the distance from the camera
+    */
+    CV_WRAP static Ptr<Params> multiResHashTSDFParams(bool isCoarse);
+
     /** @brief frame size in pixels */
     CV_PROP_RW Size frameSize;
 
@@ -155,6 +161,42 @@ struct CV_EXPORTS_W Params
     All depth values beyond this threshold will be set to zero
     */
     CV_PROP_RW float truncateThreshold;
+
+    /** @brief Radius in meters around the camera of HashTSDF volume units kept in memory
+
+    Volume units farther than this are paged out to disk and paged back in
+    when the camera returns. Zero keeps all volume units in memory.
+    Only VolumeType::HASHTSDF supports paging, a non-zero radius is an error for other volume types.
+    */
+    CV_PROP_RW float volumeUnitPagingRadius;
+
+    /** @brief File to keep paged out HashTSDF volume units in
+
+    A temporary file is used if empty.
+    */
+    CV_PROP_RW String volumeUnitPagingPath;
+
+    /** @brief Number of resolution levels of MULTIRES_HASHTSDF volume
+
+    Voxel size and truncation distance are doubled from level to level.
+    */
+    CV_PROP_RW int volumeLevels;
+
+    /** @brief Distance in meters from the camera up to which the finest level is used
+
+    Each next level of MULTIRES_HASHTSDF volume covers twice as far as the previous one,
+    the last level has no far limit.
+    */
+    CV_PROP_RW float volumeLevelDistance;
+
+    /** @brief Process frames in a pipelined way
+
+    Integration and raycasting of a frame run on a worker thread while the next frame
+    is preprocessed, update() returns as soon as the frame is aligned.
+    Methods reading the model wait for the worker to finish.
+    Used with CPU implementation only, builds without thread support process frames sequentially.
+    */
+    CV_PROP_RW bool pipelined;
 };
 
 /** @brief KinectFusion implementation
@@ -226,6 +268,20 @@ public:
      */
     CV_WRAP virtual  void getNormals(InputArray points, OutputArray normals) const = 0;
 
+    /** @brief Gets changes of 3d mesh since the previous call
+
+      The volume is split into blocks and only the blocks changed by frames integrated
+      since the previous call are triangulated again, so a client can keep the mesh of
+      the whole scene and replace the meshes of the returned blocks in it.
+      Not supported when KinFu runs on OpenCL.
+
+        @param blockIndices vector of indices of changed blocks which are 3-int vectors
+        @param blockMeshes vector of meshes of changed blocks, each mesh is a vector of
+        vertices which are 4-float vectors, 3 consecutive vertices per triangle.
+        An empty mesh means that the block has no surface anymore.
+     */
+    CV_WRAP virtual void getMeshUpdates(OutputArray blockIndices, OutputArrayOfArrays blockMeshes) = 0;
+
     /** @brief Resets the algorithm
 
     Clears current model and resets a pose.
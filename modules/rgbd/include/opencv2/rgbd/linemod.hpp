@@ -332,6 +332,24 @@ public:
              OutputArrayOfArrays quantized_images = noArray(),
              const std::vector<Mat>& masks = std::vector<Mat>()) const;
 
+  /**
+   * \brief Detect objects in several images at once.
+   *
+   * Linear memories are computed once per image, then all the templates are matched
+   * against all the images in parallel. Results are the same as of match() called
+   * for each image separately.
+   *
+   * \param      sources   Source images for each image to search in, one for each modality.
+   * \param      threshold Similarity threshold, a percentage between 0 and 100.
+   * \param[out] matches   Template matches for each image, sorted by similarity score.
+   * \param      class_ids If non-empty, only search for the desired object classes.
+   * \param      masks     If non-empty, the masks for each image, see match().
+   */
+  CV_WRAP void matchBatch(const std::vector< std::vector<Mat> >& sources, float threshold,
+                          CV_OUT std::vector< std::vector<Match> >& matches,
+                          const std::vector<String>& class_ids = std::vector<String>(),
+                          const std::vector< std::vector<Mat> >& masks = std::vector< std::vector<Mat> >()) const;
+
   /**
    * \brief Add new object template.
    *
@@ -405,11 +423,27 @@ protected:
   // Indexed as [pyramid level][modality][quantized label]
   typedef std::vector< std::vector<LinearMemories> > LinearMemoryPyramid;
 
+  void computeLinearMemories(const std::vector<Mat>& sources, const std::vector<Mat>& masks,
+                             LinearMemoryPyramid& lm_pyramid, std::vector<Size>& sizes,
+                             OutputArrayOfArrays quantized_images = noArray()) const;
+
+  // Matches all the templates of the given classes against each image in parallel
+  void matchImages(const std::vector<LinearMemoryPyramid>& lm_pyramids,
+                   const std::vector< std::vector<Size> >& sizes,
+                   float threshold, std::vector< std::vector<Match> >& matches,
+                   const std::vector<String>& class_ids) const;
+
   void matchClass(const LinearMemoryPyramid& lm_pyramid,
                   const std::vector<Size>& sizes,
                   float threshold, std::vector<Match>& matches,
                   const String& class_id,
                   const std::vector<TemplatePyramid>& template_pyramids) const;
+
+  void matchTemplate(const LinearMemoryPyramid& lm_pyramid,
+                     const std::vector<Size>& sizes,
+                     float threshold, std::vector<Match>& matches,
+                     const String& class_id, int template_id,
+                     const TemplatePyramid& tp) const;
 };
 
 /**
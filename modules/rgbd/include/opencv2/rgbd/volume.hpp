@@ -35,8 +35,33 @@ class CV_EXPORTS_W Volume
                          cv::OutputArray normals) const                                    = 0;
     virtual void fetchNormals(cv::InputArray points, cv::OutputArray _normals) const       = 0;
     virtual void fetchPointsNormals(cv::OutputArray points, cv::OutputArray normals) const = 0;
+
+    /** @brief Same as fetchPointsNormals(OutputArray, OutputArray) but reuses memory of given buffers
+
+      Buffers become columns of 4-float vectors and are reallocated only when their capacity
+      is not enough for the points, so calling it repeatedly with the same buffers doesn't allocate.
+
+        @param points buffer for points
+        @param normals buffer for normals, not used if needNormals is false
+        @param needNormals whether to compute normals
+     */
+    virtual void fetchPointsNormalsToBuffers(cv::Mat& points, cv::Mat& normals, bool needNormals) const;
     virtual void reset()                                                                   = 0;
 
+    /** @brief Extracts the surface of voxel blocks changed since the previous call
+
+      Only blocks touched by integrate() or reset() since the previous call are polygonized
+      with marching cubes, so the cost depends on the size of the change rather than on the
+      size of the volume. Each changed block is returned with its whole mesh which replaces
+      the one returned for that block before.
+
+        @param blockIndices vector of indices of changed blocks which are 3-int vectors
+        @param blockMeshes vector of meshes of changed blocks in the same order, each mesh is
+        a vector of vertices which are 4-float vectors, 3 consecutive vertices per triangle.
+        An empty mesh means the block has no surface anymore.
+     */
+    virtual void fetchMeshUpdates(cv::OutputArray blockIndices, cv::OutputArrayOfArrays blockMeshes);
+
    public:
     const float voxelSize;
     const float voxelSizeInv;
@@ -46,13 +71,24 @@ class CV_EXPORTS_W Volume
 
 enum class VolumeType
 {
-    TSDF     = 0,
-    HASHTSDF = 1
+    TSDF              = 0,
+    HASHTSDF          = 1,
+    //! HashTSDF with voxel size growing with the distance from the camera
+    MULTIRES_HASHTSDF = 2
 };
 
+struct Params;
+
 CV_EXPORTS_W cv::Ptr<Volume> makeVolume(VolumeType _volumeType, float _voxelSize, cv::Matx44f _pose,
                            float _raycastStepFactor, float _truncDist, int _maxWeight,
                            float _truncateThreshold, Vec3i _resolution);
+
+/** @brief Creates a volume of the type and with the parameters given by KinFu parameters
+
+    Unlike the overload above it also passes Params::volumeLevels and Params::volumeLevelDistance
+    to MULTIRES_HASHTSDF volume.
+ */
+CV_EXPORTS_W cv::Ptr<Volume> makeVolume(const Ptr<Params>& _params);
 }  // namespace kinfu
 }  // namespace cv
 #endif
@@ -14,6 +14,19 @@ template<> struct pyopencvVecConverter<linemod::Match>
     }
 };
 
+template<> struct pyopencvVecConverter<std::vector<linemod::Match> >
+{
+    static bool to(PyObject* obj, std::vector<std::vector<linemod::Match> >& value, const ArgInfo& info)
+    {
+        return pyopencv_to_generic_vec(obj, value, info);
+    }
+
+    static PyObject* from(const std::vector<std::vector<linemod::Match> >& value)
+    {
+        return pyopencv_from_generic_vec(value);
+    }
+};
+
 template<> struct pyopencvVecConverter<linemod::Template>
 {
     static bool to(PyObject* obj, std::vector<linemod::Template>& value, const ArgInfo& info)
@@ -54,6 +67,7 @@ template<> struct pyopencvVecConverter<Ptr<linemod::Modality> >
 };
 
 typedef std::vector<linemod::Match> vector_Match;
+typedef std::vector<std::vector<linemod::Match> > vector_vector_Match;
 typedef std::vector<linemod::Template> vector_Template;
 typedef std::vector<linemod::Feature> vector_Feature;
 typedef std::vector<Ptr<linemod::Modality> > vector_Ptr_Modality;
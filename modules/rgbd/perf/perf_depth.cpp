@@ -0,0 +1,44 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include "perf_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+using namespace cv;
+
+typedef TestBaseWithParam<bool> Perf_DepthPreprocessor;
+
+PERF_TEST_P_(Perf_DepthPreprocessor, apply)
+{
+    const bool clean = GetParam();
+    const Size size(640, 480);
+
+    Matx33f K(525.f,    0, size.width/2 - 0.5f,
+                 0, 525.f, size.height/2 - 0.5f,
+                 0,    0,    1);
+    Matx44f Rt = Matx44f::eye();
+    Rt(0, 3) = 0.025f;
+
+    Mat_<unsigned short> depth(size);
+    RNG rng(0);
+    rng.fill(depth, RNG::UNIFORM, 1400, 1600);
+
+    DepthPreprocessor preprocessor(K, 1000.f, clean);
+    preprocessor.setRegistration(K, Mat(), Rt, size);
+
+    Mat cleanDepth, points, registered;
+    while(next())
+    {
+        startTimer();
+        preprocessor(depth, cleanDepth, points, registered);
+        stopTimer();
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+INSTANTIATE_TEST_CASE_P(/**/, Perf_DepthPreprocessor, ::testing::Bool());
+
+}} // namespace
@@ -0,0 +1,83 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include "perf_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+using namespace cv;
+
+/** Random colored shapes on a gray background */
+static Mat drawShapes(RNG& rng, int nShapes)
+{
+    Mat image(480, 640, CV_8UC3, Scalar::all(96));
+    for(int i = 0; i < nShapes; i++)
+    {
+        Scalar color(rng.uniform(0, 256), rng.uniform(0, 256), rng.uniform(0, 256));
+        Point center(rng.uniform(60, 580), rng.uniform(60, 420));
+        if(rng.uniform(0, 2))
+            circle(image, center, rng.uniform(10, 50), color, FILLED);
+        else
+            rectangle(image, Rect(center, Size(rng.uniform(20, 90), rng.uniform(20, 90))), color, FILLED);
+    }
+    return image;
+}
+
+/** Detector with templates taken from random windows of random images */
+static Ptr<linemod::Detector> makeDetector(RNG& rng, int nTemplates)
+{
+    Ptr<linemod::Detector> detector = linemod::getDefaultLINE();
+    while(detector->numTemplates() < nTemplates)
+    {
+        Mat image = drawShapes(rng, 40);
+        Mat mask = Mat::zeros(image.size(), CV_8U);
+        rectangle(mask, Rect(rng.uniform(0, 480), rng.uniform(0, 320), 160, 160), Scalar::all(255), FILLED);
+        detector->addTemplate(std::vector<Mat>(1, image), "shapes", mask);
+    }
+    return detector;
+}
+
+typedef TestBaseWithParam<int> Perf_Linemod;
+
+PERF_TEST_P_(Perf_Linemod, match)
+{
+    RNG rng(0);
+    Ptr<linemod::Detector> detector = makeDetector(rng, GetParam());
+    std::vector<Mat> sources(1, drawShapes(rng, 40));
+
+    std::vector<linemod::Match> matches;
+    while(next())
+    {
+        startTimer();
+        detector->match(sources, 80.f, matches);
+        stopTimer();
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+PERF_TEST_P_(Perf_Linemod, matchBatch)
+{
+    const int nImages = 4;
+
+    RNG rng(0);
+    Ptr<linemod::Detector> detector = makeDetector(rng, GetParam());
+    std::vector< std::vector<Mat> > sources;
+    for(int i = 0; i < nImages; i++)
+        sources.push_back(std::vector<Mat>(1, drawShapes(rng, 40)));
+
+    std::vector< std::vector<linemod::Match> > matches;
+    while(next())
+    {
+        startTimer();
+        detector->matchBatch(sources, 80.f, matches);
+        stopTimer();
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+INSTANTIATE_TEST_CASE_P(/**/, Perf_Linemod, ::testing::Values(1, 16, 128));
+
+}} // namespace
@@ -0,0 +1,61 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include "perf_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+using namespace cv;
+
+/** Points of a wavy surface about 1.5 meters away */
+static Mat surfacePoints(Size size, const Matx33f& K)
+{
+    Mat_<float> depth(size);
+    for(int y = 0; y < size.height; y++)
+    {
+        for(int x = 0; x < size.width; x++)
+        {
+            float dx = (x - K(0, 2))/K(0, 0), dy = (y - K(1, 2))/K(1, 1);
+            depth(y, x) = 1.5f + 0.1f*std::sin(dx*8.f)*std::cos(dy*6.f) + 0.2f*dx;
+        }
+    }
+
+    Mat points;
+    depthTo3d(depth, Mat(K), points);
+    return points;
+}
+
+typedef tuple<int, Size> NormalsParams;
+typedef TestBaseWithParam<NormalsParams> Perf_RgbdNormals;
+
+PERF_TEST_P_(Perf_RgbdNormals, compute)
+{
+    const int method = get<0>(GetParam());
+    const Size size = get<1>(GetParam());
+
+    Matx33f K(525.f,    0, size.width/2 - 0.5f,
+                 0, 525.f, size.height/2 - 0.5f,
+                 0,    0,    1);
+
+    Mat points = surfacePoints(size, K);
+    RgbdNormals normalsComputer(size.height, size.width, CV_32F, Mat(K), 5, method);
+    normalsComputer.initialize();
+
+    Mat normals;
+    while(next())
+    {
+        startTimer();
+        normalsComputer(points, normals);
+        stopTimer();
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+INSTANTIATE_TEST_CASE_P(/**/, Perf_RgbdNormals,
+    ::testing::Combine(::testing::Values((int)RgbdNormals::RGBD_NORMALS_METHOD_FALS,
+                                         (int)RgbdNormals::RGBD_NORMALS_METHOD_LINEMOD),
+                       ::testing::Values(Size(640, 480), Size(1280, 720))));
+
+}} // namespace
@@ -0,0 +1,138 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include "perf_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+using namespace cv;
+
+static const Size frameSize(640, 480);
+static const float fx = 525.f, fy = 525.f;
+static const float cx = frameSize.width/2 - 0.5f, cy = frameSize.height/2 - 0.5f;
+
+/** Wavy surface seen by a camera shifted by given vector, depth in meters */
+static Mat_<float> surfaceDepth(Vec3f shift)
+{
+    Mat_<float> depth(frameSize);
+    for(int y = 0; y < frameSize.height; y++)
+    {
+        for(int x = 0; x < frameSize.width; x++)
+        {
+            float dx = (x - cx)/fx, dy = (y - cy)/fy;
+            // the surface slope is small enough for fixed-point iterations to converge
+            float z = 1.5f;
+            for(int i = 0; i < 16; i++)
+            {
+                float px = z*dx + shift[0], py = z*dy + shift[1];
+                z = 1.5f + 0.1f*std::sin(px*8.f)*std::cos(py*6.f) + 0.2f*px - shift[2];
+            }
+            depth(y, x) = z;
+        }
+    }
+    return depth;
+}
+
+/** Texture painted on the same surface, so that it moves together with the depth */
+static Mat_<uchar> surfaceImage(const Mat_<float>& depth, Vec3f shift)
+{
+    Mat_<uchar> image(frameSize);
+    for(int y = 0; y < frameSize.height; y++)
+    {
+        for(int x = 0; x < frameSize.width; x++)
+        {
+            float z = depth(y, x);
+            float px = z*(x - cx)/fx + shift[0], py = z*(y - cy)/fy + shift[1];
+            image(y, x) = saturate_cast<uchar>(128.f + 100.f*std::sin(px*40.f)*std::cos(py*30.f));
+        }
+    }
+    return image;
+}
+
+/** Exposes the alignment itself to time it without frame preprocessing */
+struct FastICPOdometryAlign : public FastICPOdometry
+{
+    FastICPOdometryAlign(const Mat& _cameraMatrix, const std::vector<int>& _iterCounts) :
+        FastICPOdometry(_cameraMatrix, 0.1f, (float)(30.*CV_PI/180.), 0.04f, 4.5f, 7, _iterCounts)
+    { }
+
+    bool align(const Ptr<OdometryFrame>& srcFrame, const Ptr<OdometryFrame>& dstFrame, OutputArray Rt) const
+    {
+        return computeImpl(srcFrame, dstFrame, Rt, Mat());
+    }
+};
+
+typedef TestBaseWithParam<int> Perf_FastICPOdometry;
+
+PERF_TEST_P_(Perf_FastICPOdometry, align_level)
+{
+    const int level = GetParam();
+    const int levels = 3;
+
+    Matx33f intr(fx,  0, cx,
+                  0, fy, cy,
+                  0,  0,  1);
+
+    // all the iterations are done at the given pyramid level only
+    std::vector<int> iterCounts(levels, 0);
+    iterCounts[level] = 10;
+
+    FastICPOdometryAlign odometry(Mat(intr), iterCounts);
+
+    Mat srcDepth = surfaceDepth(Vec3f(0.f, 0.f, 0.f));
+    Mat dstDepth = surfaceDepth(Vec3f(0.01f, -0.01f, 0.01f));
+    Ptr<OdometryFrame> srcFrame = OdometryFrame::create(Mat(), srcDepth);
+    Ptr<OdometryFrame> dstFrame = OdometryFrame::create(Mat(), dstDepth);
+    odometry.prepareFrameCache(srcFrame, OdometryFrame::CACHE_SRC);
+    odometry.prepareFrameCache(dstFrame, OdometryFrame::CACHE_DST);
+
+    Mat Rt;
+    while(next())
+    {
+        startTimer();
+        odometry.align(srcFrame, dstFrame, Rt);
+        stopTimer();
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+INSTANTIATE_TEST_CASE_P(/**/, Perf_FastICPOdometry, ::testing::Values(0, 1, 2));
+
+typedef TestBaseWithParam<std::string> Perf_Odometry;
+
+PERF_TEST_P_(Perf_Odometry, compute)
+{
+    Ptr<Odometry> odometry = Odometry::create(GetParam());
+    ASSERT_FALSE(odometry.empty());
+
+    Matx33f intr(fx,  0, cx,
+                  0, fy, cy,
+                  0,  0,  1);
+    odometry->setCameraMatrix(Mat(intr));
+
+    const Vec3f shift(0.01f, -0.01f, 0.01f);
+    Mat_<float> srcDepth = surfaceDepth(Vec3f(0.f, 0.f, 0.f));
+    Mat_<float> dstDepth = surfaceDepth(shift);
+    Ptr<OdometryFrame> srcFrame = OdometryFrame::create(surfaceImage(srcDepth, Vec3f(0.f, 0.f, 0.f)), srcDepth);
+    Ptr<OdometryFrame> dstFrame = OdometryFrame::create(surfaceImage(dstDepth, shift), dstDepth);
+
+    // frame pyramids are computed once by the first call and reused by the others
+    Mat Rt;
+    odometry->compute(srcFrame, dstFrame, Rt);
+
+    while(next())
+    {
+        startTimer();
+        odometry->compute(srcFrame, dstFrame, Rt);
+        stopTimer();
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+INSTANTIATE_TEST_CASE_P(/**/, Perf_Odometry, ::testing::Values("RgbdOdometry", "ICPOdometry",
+                                                              "RgbdICPOdometry", "FastICPOdometry"));
+
+}} // namespace
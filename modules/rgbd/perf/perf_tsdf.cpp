@@ -169,51 +169,206 @@ Ptr<Scene> Scene::create(Size sz, Matx33f _intr, float _depthFactor)
     return makePtr<SemisphereScene>(sz, _intr, _depthFactor);
 }
 
+/** Volume made by given parameters and the scene to integrate into it */
+struct VolumeScene
+{
+    VolumeScene(const Ptr<kinfu::Params>& _params) :
+        params(_params),
+        volume(kinfu::makeVolume(params->volumeType, params->voxelSize, params->volumePose.matrix,
+            params->raycast_step_factor, params->tsdf_trunc_dist, params->tsdf_max_weight,
+            params->truncateThreshold, params->volumeDims)),
+        scene(Scene::create(params->frameSize, params->intr, params->depthFactor)),
+        poses(scene->getPoses())
+    { }
+
+    Ptr<kinfu::Params> params;
+    Ptr<kinfu::Volume> volume;
+    Ptr<Scene> scene;
+    std::vector<Affine3f> poses;
+};
+
 PERF_TEST(Perf_TSDF, integrate)
 {
-    Ptr<kinfu::Params> _params;
-    _params = kinfu::Params::coarseParams();
+    VolumeScene vs(kinfu::Params::coarseParams());
 
-    Ptr<kinfu::Volume> volume = kinfu::makeVolume(_params->volumeType, _params->voxelSize, _params->volumePose.matrix,
-        _params->raycast_step_factor, _params->tsdf_trunc_dist, _params->tsdf_max_weight,
-        _params->truncateThreshold, _params->volumeDims);
+    for (size_t i = 0; i < vs.poses.size(); i++)
+    {
+        Matx44f pose = vs.poses[i].matrix;
+        Mat depth = vs.scene->depth(pose);
+        startTimer();
+        vs.volume->integrate(depth, vs.params->depthFactor, pose, vs.params->intr);
+        stopTimer();
+    }
+    SANITY_CHECK_NOTHING();
+}
 
-    Ptr<Scene> scene = Scene::create(_params->frameSize, _params->intr, _params->depthFactor);
-    std::vector<Affine3f> poses = scene->getPoses();
+PERF_TEST(Perf_TSDF, raycast)
+{
+    VolumeScene vs(kinfu::Params::coarseParams());
 
-    for (size_t i = 0; i < poses.size(); i++)
+    for (size_t i = 0; i < vs.poses.size(); i++)
     {
         UMat _points, _normals;
-        Matx44f pose = poses[i].matrix;
-        Mat depth = scene->depth(pose);
+        Matx44f pose = vs.poses[i].matrix;
+        Mat depth = vs.scene->depth(pose);
+
+        vs.volume->integrate(depth, vs.params->depthFactor, pose, vs.params->intr);
         startTimer();
-        volume->integrate(depth, _params->depthFactor, pose, _params->intr);
+        vs.volume->raycast(pose, vs.params->intr, vs.params->frameSize, _points, _normals);
         stopTimer();
     }
     SANITY_CHECK_NOTHING();
 }
 
-PERF_TEST(Perf_TSDF, raycast)
+PERF_TEST(Perf_HashTSDF, integrate)
+{
+    VolumeScene vs(kinfu::Params::hashTSDFParams(true));
+
+    for (size_t i = 0; i < vs.poses.size(); i++)
+    {
+        Matx44f pose = vs.poses[i].matrix;
+        Mat depth = vs.scene->depth(pose);
+        startTimer();
+        vs.volume->integrate(depth, vs.params->depthFactor, pose, vs.params->intr);
+        stopTimer();
+    }
+    SANITY_CHECK_NOTHING();
+}
+
+PERF_TEST(Perf_HashTSDF, raycast)
 {
-    Ptr<kinfu::Params> _params;
-    _params = kinfu::Params::coarseParams();
+    VolumeScene vs(kinfu::Params::hashTSDFParams(true));
+
+    for (size_t i = 0; i < vs.poses.size(); i++)
+    {
+        UMat _points, _normals;
+        Matx44f pose = vs.poses[i].matrix;
+        Mat depth = vs.scene->depth(pose);
 
-    Ptr<kinfu::Volume> volume = kinfu::makeVolume(_params->volumeType, _params->voxelSize, _params->volumePose.matrix,
-        _params->raycast_step_factor, _params->tsdf_trunc_dist, _params->tsdf_max_weight,
-        _params->truncateThreshold, _params->volumeDims);
+        vs.volume->integrate(depth, vs.params->depthFactor, pose, vs.params->intr);
+        startTimer();
+        vs.volume->raycast(pose, vs.params->intr, vs.params->frameSize, _points, _normals);
+        stopTimer();
+    }
+    SANITY_CHECK_NOTHING();
+}
 
-    Ptr<Scene> scene = Scene::create(_params->frameSize, _params->intr, _params->depthFactor);
-    std::vector<Affine3f> poses = scene->getPoses();
+PERF_TEST(Perf_MultiResHashTSDF, integrate)
+{
+    VolumeScene vs(kinfu::Params::multiResHashTSDFParams(true));
+
+    for (size_t i = 0; i < vs.poses.size(); i++)
+    {
+        Matx44f pose = vs.poses[i].matrix;
+        Mat depth = vs.scene->depth(pose);
+        startTimer();
+        vs.volume->integrate(depth, vs.params->depthFactor, pose, vs.params->intr);
+        stopTimer();
+    }
+    SANITY_CHECK_NOTHING();
+}
+
+PERF_TEST(Perf_MultiResHashTSDF, raycast)
+{
+    VolumeScene vs(kinfu::Params::multiResHashTSDFParams(true));
 
-    for (size_t i = 0; i < poses.size(); i++)
+    for (size_t i = 0; i < vs.poses.size(); i++)
     {
         UMat _points, _normals;
-        Matx44f pose = poses[i].matrix;
-        Mat depth = scene->depth(pose);
+        Matx44f pose = vs.poses[i].matrix;
+        Mat depth = vs.scene->depth(pose);
+
+        vs.volume->integrate(depth, vs.params->depthFactor, pose, vs.params->intr);
+        startTimer();
+        vs.volume->raycast(pose, vs.params->intr, vs.params->frameSize, _points, _normals);
+        stopTimer();
+    }
+    SANITY_CHECK_NOTHING();
+}
+
+PERF_TEST(Perf_TSDF, fetchPointsNormals)
+{
+    VolumeScene vs(kinfu::Params::coarseParams());
+
+    // the cloud is exported every few frames
+    for (size_t i = 0; i < vs.poses.size(); i++)
+    {
+        Matx44f pose = vs.poses[i].matrix;
+        Mat depth = vs.scene->depth(pose);
+        vs.volume->integrate(depth, vs.params->depthFactor, pose, vs.params->intr);
+        if (i % 5 != 4)
+            continue;
+
+        Mat points, normals;
+        startTimer();
+        vs.volume->fetchPointsNormals(points, normals);
+        stopTimer();
+    }
+    SANITY_CHECK_NOTHING();
+}
+
+PERF_TEST(Perf_TSDF, fetchPointsNormals_reuse)
+{
+    VolumeScene vs(kinfu::Params::coarseParams());
+
+    // buffers are kept between calls
+    Mat points, normals;
+
+    // the cloud is exported every few frames
+    for (size_t i = 0; i < vs.poses.size(); i++)
+    {
+        Matx44f pose = vs.poses[i].matrix;
+        Mat depth = vs.scene->depth(pose);
+        vs.volume->integrate(depth, vs.params->depthFactor, pose, vs.params->intr);
+        if (i % 5 != 4)
+            continue;
+
+        startTimer();
+        vs.volume->fetchPointsNormalsToBuffers(points, normals, true);
+        stopTimer();
+    }
+    SANITY_CHECK_NOTHING();
+}
+
+PERF_TEST(Perf_HashTSDF, fetchPointsNormals)
+{
+    VolumeScene vs(kinfu::Params::hashTSDFParams(true));
+
+    // the cloud is exported every few frames
+    for (size_t i = 0; i < vs.poses.size(); i++)
+    {
+        Matx44f pose = vs.poses[i].matrix;
+        Mat depth = vs.scene->depth(pose);
+        vs.volume->integrate(depth, vs.params->depthFactor, pose, vs.params->intr);
+        if (i % 5 != 4)
+            continue;
+
+        Mat points, normals;
+        startTimer();
+        vs.volume->fetchPointsNormals(points, normals);
+        stopTimer();
+    }
+    SANITY_CHECK_NOTHING();
+}
+
+PERF_TEST(Perf_HashTSDF, fetchPointsNormals_reuse)
+{
+    VolumeScene vs(kinfu::Params::hashTSDFParams(true));
+
+    // buffers are kept between calls
+    Mat points, normals;
+
+    // the cloud is exported every few frames
+    for (size_t i = 0; i < vs.poses.size(); i++)
+    {
+        Matx44f pose = vs.poses[i].matrix;
+        Mat depth = vs.scene->depth(pose);
+        vs.volume->integrate(depth, vs.params->depthFactor, pose, vs.params->intr);
+        if (i % 5 != 4)
+            continue;
 
-        volume->integrate(depth, _params->depthFactor, pose, _params->intr);
         startTimer();
-        volume->raycast(pose, _params->intr, _params->frameSize, _points, _normals);
+        vs.volume->fetchPointsNormalsToBuffers(points, normals, true);
         stopTimer();
     }
     SANITY_CHECK_NOTHING();
@@ -0,0 +1,347 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+// This code is also subject to the license terms in the LICENSE_WillowGarage.md file found in this module's directory
+
+#include "precomp.hpp"
+
+#include <atomic>
+
+namespace cv
+{
+namespace rgbd
+{
+  // Number of rows processed by a task, the stripe plus its two halo rows stay in the cache
+  static const int preprocessStripeRows = 16;
+
+  /** Converts a row of raw depth to meters, with NaN where there is no depth
+   */
+  template<typename DepthDepth>
+  static void
+  scaleDepthRow(const DepthDepth* src, float* dst, int cols, float inv_factor)
+  {
+    for (int x = 0; x < cols; ++x)
+    {
+      DepthDepth d = src[x];
+      if (isValidDepth(d) && d > 0)
+        dst[x] = (float)d * inv_factor;
+      else
+        dst[x] = std::numeric_limits<float>::quiet_NaN();
+    }
+  }
+
+  static void
+  scaleDepthRow(const Mat& depth, int y, float* dst, float inv_factor)
+  {
+    switch (depth.depth())
+    {
+      case CV_16U:
+        scaleDepthRow(depth.ptr<unsigned short>(y), dst, depth.cols, inv_factor);
+        break;
+      case CV_32F:
+        scaleDepthRow(depth.ptr<float>(y), dst, depth.cols, inv_factor);
+        break;
+      case CV_64F:
+        scaleDepthRow(depth.ptr<double>(y), dst, depth.cols, inv_factor);
+        break;
+    }
+  }
+
+  /** Cleans a row of depth in meters like DepthCleaner with the NIL method: every pixel becomes the
+   * bilateral average of its 3x3 neighbourhood, with the noise model of
+   * ``Modeling Kinect Sensor Noise for Improved 3d Reconstruction and Tracking``
+   * by C. Nguyen, S. Izadi, D. Lovel
+   * @param prev the previous row, NaN outside of the image
+   * @param cur the row to clean
+   * @param next the next row, NaN outside of the image
+   * @param difference_threshold neighbours further than that in depth are ignored
+   */
+  static void
+  cleanDepthRow(const float* prev, const float* cur, const float* next, float* dst, int cols,
+                float difference_threshold)
+  {
+    const float theta_mean = (float)(30. * CV_PI / 180);
+    const float sigma_L = (float)(0.8 + 0.035 * theta_mean / (CV_PI / 2 - theta_mean));
+    // Spatial weights of the side and of the corner neighbours
+    const float w_side = std::exp(-1.f / (2 * sigma_L * sigma_L));
+    const float w_corner = std::exp(-2.f / (2 * sigma_L * sigma_L));
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+
+    for (int x = 0; x < cols; ++x)
+    {
+      float z = cur[x];
+      if (cvIsNaN(z))
+      {
+        dst[x] = nan;
+        continue;
+      }
+
+      float sigma_z = 0.0012f + 0.0019f * (z - 0.4f) * (z - 0.4f);
+      float inv_2sigma_z2 = 1.f / (2 * sigma_z * sigma_z);
+
+      // The pixel itself has a weight of 1
+      float w_sum = 1.f, Dw_sum = z;
+      int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, cols - 1);
+      for (int i = x0; i <= x1; ++i)
+      {
+        const float zn[3] = { prev[i], cur[i], next[i] };
+        for (int j = 0; j < 3; ++j)
+        {
+          if ((i == x) && (j == 1))
+            continue;
+          float delta_z = std::abs(zn[j] - z);
+          // NaN neighbours fail the comparison as well
+          if (!(delta_z < difference_threshold))
+            continue;
+          float w = ((i == x) || (j == 1) ? w_side : w_corner) * std::exp(-delta_z * delta_z * inv_2sigma_z2);
+          w_sum += w;
+          Dw_sum += zn[j] * w;
+        }
+      }
+      dst[x] = Dw_sum / w_sum;
+    }
+  }
+
+  /** Keeps the closest depth in a cell of the z-buffer of the registered image. The cells hold the bits of
+   * positive floats which are ordered like the integers, +inf meaning no depth yet
+   */
+  static inline void
+  updateRegisteredDepth(std::atomic<int>& cell, float z)
+  {
+    Cv32suf v;
+    v.f = z;
+    int cur = cell.load(std::memory_order_relaxed);
+    while (v.i < cur && !cell.compare_exchange_weak(cur, v.i, std::memory_order_relaxed))
+      ;
+  }
+
+  static inline void
+  registerDepthPoint(std::vector<std::atomic<int> >& zbuffer, const Size& size, float u, float v, float z,
+                     bool dilation)
+  {
+    int px = cvRound(u), py = cvRound(v);
+    if (!(z > 0) || px < 0 || py < 0 || px >= size.width || py >= size.height)
+      return;
+
+    std::atomic<int>* cell = &zbuffer[py * size.width + px];
+    updateRegisteredDepth(*cell, z);
+
+    // Dilate in a 2x2 region with the projected location in the bottom right, like registerDepth
+    if (dilation)
+    {
+      if (px > 0)
+        updateRegisteredDepth(cell[-1], z);
+      if (py > 0)
+        updateRegisteredDepth(cell[-size.width], z);
+      if (px > 0 && py > 0)
+        updateRegisteredDepth(cell[-size.width - 1], z);
+    }
+  }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+  DepthPreprocessor::DepthPreprocessor(InputArray K, float depth_factor, bool clean)
+      :
+        depth_factor_(depth_factor),
+        clean_(clean),
+        registered_size_(),
+        depth_dilation_(false)
+  {
+    CV_Assert(K.rows() == 3 && K.cols() == 3 && (K.depth() == CV_32F || K.depth() == CV_64F));
+    CV_Assert(depth_factor > 0);
+    K_ = K.getMat();
+  }
+
+  DepthPreprocessor::~DepthPreprocessor()
+  {
+  }
+
+  Ptr<DepthPreprocessor>
+  DepthPreprocessor::create(InputArray K, float depth_factor, bool clean)
+  {
+    return makePtr<DepthPreprocessor>(K, depth_factor, clean);
+  }
+
+  void
+  DepthPreprocessor::setRegistration(InputArray registeredCameraMatrix, InputArray registeredDistCoeffs,
+                                     InputArray Rt, const Size& registeredSize, bool depthDilation)
+  {
+    CV_Assert(registeredCameraMatrix.depth() == CV_64F || registeredCameraMatrix.depth() == CV_32F);
+    CV_Assert(registeredDistCoeffs.empty() || registeredDistCoeffs.depth() == CV_64F ||
+              registeredDistCoeffs.depth() == CV_32F);
+    CV_Assert(Rt.depth() == CV_64F || Rt.depth() == CV_32F);
+    CV_Assert(registeredSize.height > 0 && registeredSize.width > 0);
+
+    registered_K_ = registeredCameraMatrix.getMat();
+    registered_dist_coeffs_.release();
+    if (!registeredDistCoeffs.empty() && countNonZero(registeredDistCoeffs) > 0)
+      registeredDistCoeffs.getMat().convertTo(registered_dist_coeffs_, CV_32F);
+    Rt_ = Rt.getMat();
+    registered_size_ = registeredSize;
+    depth_dilation_ = depthDilation;
+  }
+
+  void
+  DepthPreprocessor::operator()(InputArray depth_in, OutputArray cleanDepth_out, OutputArray points3d_out,
+                                OutputArray registeredDepth_out) const
+  {
+    Mat depth = depth_in.getMat();
+    CV_Assert(!depth.empty() && depth.dims == 2);
+    CV_Assert(depth.type() == CV_16UC1 || depth.type() == CV_32FC1 || depth.type() == CV_64FC1);
+
+    const bool needClean = cleanDepth_out.needed();
+    const bool needPoints = points3d_out.needed();
+    const bool needRegistered = registeredDepth_out.needed();
+    if (needRegistered && registered_size_.area() == 0)
+      CV_Error(Error::StsBadArg, "setRegistration() should be called before asking for the registered depth");
+
+    const int rows = depth.rows, cols = depth.cols;
+
+    Mat cleanDepth, points3d;
+    if (needClean)
+    {
+      cleanDepth_out.create(depth.size(), CV_32FC1);
+      cleanDepth = cleanDepth_out.getMat();
+    }
+    if (needPoints)
+    {
+      points3d_out.create(depth.size(), CV_32FC3);
+      points3d = points3d_out.getMat();
+    }
+    // The points are registered into a z-buffer which is converted to the registered depth at the end
+    std::vector<std::atomic<int> > zbuffer(needRegistered ? registered_size_.area() : 0);
+    {
+      Cv32suf inf;
+      inf.f = std::numeric_limits<float>::infinity();
+      for (size_t i = 0; i < zbuffer.size(); i++)
+        zbuffer[i].store(inf.i, std::memory_order_relaxed);
+    }
+
+    const float inv_factor = 1.f / depth_factor_;
+    // The same threshold as DepthCleaner, 10 units of the input depth
+    const float difference_threshold = 10.f * inv_factor;
+
+    // Back-projection tables like in depthTo3d
+    const float inv_fx = 1.f / K_(0, 0), inv_fy = 1.f / K_(1, 1);
+    const float ox = K_(0, 2), oy = K_(1, 2);
+    std::vector<float> x_cache(cols);
+    for (int x = 0; x < cols; ++x)
+      x_cache[x] = (x - ox) * inv_fx;
+
+    // Without distortion the external camera projection is chained with the rigid body transform
+    const bool hasDistortion = !registered_dist_coeffs_.empty();
+    Matx34f projection;
+    {
+      Matx34f Rt34 = Rt_.get_minor<3, 4>(0, 0);
+      projection = hasDistortion ? Rt34 : registered_K_ * Rt34;
+    }
+
+    const int nStripes = (rows + preprocessStripeRows - 1) / preprocessStripeRows;
+    parallel_for_(Range(0, nStripes), [&](const Range& range)
+    {
+      const float nan = std::numeric_limits<float>::quiet_NaN();
+
+      // Scaled depth of the stripe with one halo row above and below
+      AutoBuffer<float> zBuf(clean_ ? (preprocessStripeRows + 2) * cols : 1);
+      AutoBuffer<float> zRowBuf(cols);
+      std::vector<Point3f> toProject;
+      std::vector<Point2f> projected;
+
+      for (int stripe = range.start; stripe < range.end; stripe++)
+      {
+        const int y0 = stripe * preprocessStripeRows;
+        const int y1 = std::min(y0 + preprocessStripeRows, rows);
+
+        float* zStripe = zBuf.data();
+        if (clean_)
+        {
+          for (int y = y0 - 1; y <= y1; ++y)
+          {
+            float* zRow = zStripe + (y - y0 + 1) * cols;
+            if (y < 0 || y >= rows)
+              std::fill(zRow, zRow + cols, nan);
+            else
+              scaleDepthRow(depth, y, zRow, inv_factor);
+          }
+        }
+
+        for (int y = y0; y < y1; ++y)
+        {
+          const float* z;
+          if (clean_)
+          {
+            const float* zRow = zStripe + (y - y0 + 1) * cols;
+            float* dst = needClean ? cleanDepth.ptr<float>(y) : zRowBuf.data();
+            cleanDepthRow(zRow - cols, zRow, zRow + cols, dst, cols, difference_threshold);
+            z = dst;
+          }
+          else
+          {
+            float* dst = needClean ? cleanDepth.ptr<float>(y) : zRowBuf.data();
+            scaleDepthRow(depth, y, dst, inv_factor);
+            z = dst;
+          }
+
+          const float yc = (y - oy) * inv_fy;
+          if (needPoints)
+          {
+            Point3f* pts = points3d.ptr<Point3f>(y);
+            for (int x = 0; x < cols; ++x)
+            {
+              float zx = z[x];
+              pts[x] = Point3f(x_cache[x] * zx, yc * zx, zx);
+            }
+          }
+
+          if (needRegistered)
+          {
+            toProject.clear();
+            for (int x = 0; x < cols; ++x)
+            {
+              float zx = z[x];
+              if (cvIsNaN(zx))
+                continue;
+              Vec4f p(x_cache[x] * zx, yc * zx, zx, 1.f);
+              Vec3f q = projection * p;
+              if (hasDistortion)
+                toProject.push_back(Point3f(q[0], q[1], q[2]));
+              else
+                registerDepthPoint(zbuffer, registered_size_, q[0] / q[2], q[1] / q[2], q[2], depth_dilation_);
+            }
+
+            if (hasDistortion && !toProject.empty())
+            {
+              projectPoints(toProject, Vec3f(0, 0, 0), Vec3f(0, 0, 0), registered_K_,
+                            registered_dist_coeffs_, projected);
+              for (size_t i = 0; i < toProject.size(); ++i)
+                registerDepthPoint(zbuffer, registered_size_, projected[i].x, projected[i].y, toProject[i].z,
+                                   depth_dilation_);
+            }
+          }
+        }
+      }
+    });
+
+    if (needRegistered)
+    {
+      registeredDepth_out.create(registered_size_, CV_32FC1);
+      Mat registered = registeredDepth_out.getMat();
+      parallel_for_(Range(0, registered.rows), [&](const Range& range)
+      {
+        for (int y = range.start; y < range.end; y++)
+        {
+          const std::atomic<int>* cells = &zbuffer[y * registered.cols];
+          float* row = registered.ptr<float>(y);
+          for (int x = 0; x < registered.cols; x++)
+          {
+            Cv32suf v;
+            v.i = cells[x].load(std::memory_order_relaxed);
+            row[x] = cvIsInf(v.f) ? std::numeric_limits<float>::quiet_NaN() : v.f;
+          }
+        }
+      });
+    }
+  }
+}
+}
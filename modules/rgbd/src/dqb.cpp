@@ -1,4 +1,5 @@
 #include "dqb.hpp"
+#include "opencv2/core/hal/intrin.hpp"
 
 namespace cv {
 namespace dynafu {
@@ -182,6 +183,118 @@ Affine3f DQB(std::vector<float>& weights, std::vector<Affine3f>& transforms)
     return blended.getAffine();
 }
 
+void DQB(const std::vector<DualQuaternion>& quats, const std::vector<int>& indices,
+         const std::vector<float>& weights, int k, std::vector<Affine3f>& transforms)
+{
+    CV_Assert(k > 0 && indices.size() == weights.size() && indices.size() % k == 0);
+    const int count = (int)(indices.size() / k);
+    transforms.resize(count);
+
+    // w, i, j, k of the real part then of the dual part for every node
+    std::vector<float> coeffs(8*quats.size() + 8, 0.f);
+    for(size_t n = 0; n < quats.size(); n++)
+    {
+        const Quaternion& q0 = quats[n].getReal();
+        const Quaternion& qe = quats[n].getDual();
+        float* c = &coeffs[8*n];
+        c[0] = q0.w(); c[1] = q0.i(); c[2] = q0.j(); c[3] = q0.k();
+        c[4] = qe.w(); c[5] = qe.i(); c[6] = qe.j(); c[7] = qe.k();
+    }
+    // skipped neighbours point to the zero coefficients at the end
+    const int zeroIdx = (int)quats.size();
+
+    int p = 0;
+#if CV_SIMD
+    const int nlanes = v_float32::nlanes;
+    float CV_DECL_ALIGNED(CV_SIMD_WIDTH) gw[v_float32::nlanes];
+    float CV_DECL_ALIGNED(CV_SIMD_WIDTH) gq[8*v_float32::nlanes];
+    float CV_DECL_ALIGNED(CV_SIMD_WIDTH) res[12*v_float32::nlanes];
+    for(; p <= count - nlanes; p += nlanes)
+    {
+        v_float32 acc[8];
+        for(int c = 0; c < 8; c++)
+            acc[c] = vx_setzero_f32();
+
+        for(int j = 0; j < k; j++)
+        {
+            for(int l = 0; l < nlanes; l++)
+            {
+                int idx = indices[(p + l)*k + j];
+                gw[l] = idx >= 0 ? weights[(p + l)*k + j] : 0.f;
+                const float* q = &coeffs[8*(idx >= 0 ? idx : zeroIdx)];
+                for(int c = 0; c < 8; c++)
+                    gq[c*nlanes + l] = q[c];
+            }
+            v_float32 w = vx_load_aligned(gw);
+            for(int c = 0; c < 8; c++)
+                acc[c] = v_muladd(w, vx_load_aligned(gq + c*nlanes), acc[c]);
+        }
+
+        // normalize both parts by the norm of the real one,
+        // an all-zero blend gives the identity
+        v_float32 n2 = acc[0]*acc[0] + acc[1]*acc[1] + acc[2]*acc[2] + acc[3]*acc[3];
+        v_float32 zero = vx_setzero_f32(), one = vx_setall_f32(1.f), two = vx_setall_f32(2.f);
+        v_float32 valid = n2 > zero;
+        v_float32 inv = v_select(valid, one / v_sqrt(v_select(valid, n2, one)), zero);
+        v_float32 W = v_select(valid, acc[0]*inv, one);
+        v_float32 I = acc[1]*inv, J = acc[2]*inv, K = acc[3]*inv;
+        v_float32 EW = acc[4]*inv, EI = acc[5]*inv, EJ = acc[6]*inv, EK = acc[7]*inv;
+
+        // rotation like in Quaternion::getRotation(), the vector part is negated there
+        v_float32 X = zero - I, Y = zero - J, Z = zero - K;
+        v_float32 xx = X*X, xy = X*Y, xz = X*Z, xw = X*W;
+        v_float32 yy = Y*Y, yz = Y*Z, yw = Y*W, zz = Z*Z, zw = Z*W;
+        v_float32 r[12];
+        r[0] = one - two*(yy + zz); r[1] = two*(xy + zw);       r[2] = two*(xz - yw);
+        r[3] = two*(xy - zw);       r[4] = one - two*(xx + zz); r[5] = two*(yz + xw);
+        r[6] = two*(xz + yw);       r[7] = two*(yz - xw);       r[8] = one - two*(xx + yy);
+        // translation like in DualQuaternion::getAffine()
+        r[9]  = two*(EI*W - EW*I - EJ*K + EK*J);
+        r[10] = two*(EI*K - EW*J + EJ*W - EK*I);
+        r[11] = two*(EJ*I - EW*K - EI*J + EK*W);
+        for(int c = 0; c < 12; c++)
+            v_store_aligned(res + c*nlanes, r[c]);
+
+        for(int l = 0; l < nlanes; l++)
+        {
+            const float* v = res + l;
+            Matx33f R(v[0],        v[nlanes],   v[2*nlanes],
+                      v[3*nlanes], v[4*nlanes], v[5*nlanes],
+                      v[6*nlanes], v[7*nlanes], v[8*nlanes]);
+            transforms[p + l] = Affine3f(R, Vec3f(v[9*nlanes], v[10*nlanes], v[11*nlanes]));
+        }
+    }
+    vx_cleanup();
+#endif
+
+    for(; p < count; p++)
+    {
+        Vec4f q0 = Vec4f::all(0), qe = Vec4f::all(0);
+        for(int j = 0; j < k; j++)
+        {
+            int idx = indices[p*k + j];
+            if(idx < 0)
+                continue;
+            float w = weights[p*k + j];
+            const float* c = &coeffs[8*idx];
+            q0 += w*Vec4f(c[0], c[1], c[2], c[3]);
+            qe += w*Vec4f(c[4], c[5], c[6], c[7]);
+        }
+
+        if(q0.dot(q0) > 0)
+        {
+            Quaternion real(q0[0], q0[1], q0[2], q0[3]), dual(qe[0], qe[1], qe[2], qe[3]);
+            DualQuaternion blended(real, dual);
+            blended.normalize();
+            transforms[p] = blended.getAffine();
+        }
+        else
+        {
+            transforms[p] = Affine3f::Identity();
+        }
+    }
+}
+
 
 } // namespace dynafu
 } // namespace cv
\ No newline at end of file
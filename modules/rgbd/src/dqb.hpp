@@ -83,6 +83,9 @@ public:
 
     Affine3f getAffine() const;
 
+    const Quaternion& getReal() const {return q0;}
+    const Quaternion& getDual() const {return qe;}
+
 private:
     Quaternion q0; // rotation quaternion
     Quaternion qe; // translation quaternion
@@ -92,6 +95,16 @@ DualQuaternion DQB(std::vector<float>& weights, std::vector<DualQuaternion>& qua
 
 Affine3f DQB(std::vector<float>& weights, std::vector<Affine3f>& transforms);
 
+/** Blends the transformations of many points at once, SIMD lanes go over the points
+ * @param quats dual quaternions of the nodes
+ * @param indices k node indices for every point, negative ones are skipped
+ * @param weights k weights for every point
+ * @param k number of nodes for every point
+ * @param transforms blended transformation of every point, identity when all the weights are zero
+ */
+void DQB(const std::vector<DualQuaternion>& quats, const std::vector<int>& indices,
+         const std::vector<float>& weights, int k, std::vector<Affine3f>& transforms);
+
 
 } // namespace dynafu
 } // namespace cv
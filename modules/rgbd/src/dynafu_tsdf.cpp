@@ -239,20 +239,9 @@ struct IntegrateInvoker : ParallelLoopBody
 
                     Point3f volPt = Point3f((float)x, (float)y, (float)z)*volume.voxelSize;
 
-                    if(warpfield->getNodeIndex())
+                    if(warpfield->getNodesLen() > 0)
                     {
-                        std::vector<int> indices(warpfield->k);
-                        std::vector<float> dists(warpfield->k);
-                        warpfield->findNeighbours(volPt, indices, dists);
-
-                        voxel.n = 0;
-                        for(size_t i = 0; i < indices.size(); i++)
-                        {
-                            if(std::isnan(dists[i])) continue;
-
-                            voxel.neighbourDists[voxel.n] = dists[i];
-                            voxel.neighbours[voxel.n++] = indices[i];
-                        }
+                        voxel.n = warpfield->findNeighbours(volPt, voxel.neighbours, voxel.neighbourDists);
                     }
 
                     Point3f camSpacePt =
@@ -764,44 +753,20 @@ struct MarchCubesInvoker : ParallelLoopBody
     MarchCubesInvoker(const TSDFVolumeCPU& _volume,
                       std::vector<Vec4f>& _meshPoints) :
         volume(_volume),
-        meshPoints(_meshPoints),
-        mcNeighbourPts{
-            Point3f(0.f, 0.f, 0.f),
-            Point3f(0.f, 0.f, 1.f),
-            Point3f(0.f, 1.f, 1.f),
-            Point3f(0.f, 1.f, 0.f),
-            Point3f(1.f, 0.f, 0.f),
-            Point3f(1.f, 0.f, 1.f),
-            Point3f(1.f, 1.f, 1.f),
-            Point3f(1.f, 1.f, 0.f)},
-        mcNeighbourCoords(
-            Vec8i(
-            volume.volDims.dot(Vec4i(0, 0, 0)),
-            volume.volDims.dot(Vec4i(0, 0, 1)),
-            volume.volDims.dot(Vec4i(0, 1, 1)),
-            volume.volDims.dot(Vec4i(0, 1, 0)),
-            volume.volDims.dot(Vec4i(1, 0, 0)),
-            volume.volDims.dot(Vec4i(1, 0, 1)),
-            volume.volDims.dot(Vec4i(1, 1, 1)),
-            volume.volDims.dot(Vec4i(1, 1, 0))
-            ))
+        meshPoints(_meshPoints)
     {
         volData = volume.volume.ptr<Voxel>();
-    }
-
-    Point3f interpolate(Point3f p1, Point3f p2, float v1, float v2) const
-    {
-        float dV = 0.5f;
-        if (abs(v1 - v2) > 0.0001f)
-            dV = v1 / (v1 - v2);
-
-        Point3f p = p1 + dV * (p2 - p1);
-        return p;
+        // offsets of cube corners in the order of the marching cubes tables
+        for (int i = 0; i < 8; i++)
+            mcNeighbourCoords[i] = volume.volDims.dot(Vec4i(kinfu::mcCorners[i][0],
+                                                            kinfu::mcCorners[i][1],
+                                                            kinfu::mcCorners[i][2]));
     }
 
     virtual void operator()(const Range &range) const override
     {
         std::vector<Vec4f> points;
+        std::vector<Point3f> triangles;
         for (int x = range.start; x < range.end; x++)
         {
             int coordBaseX = x * volume.volDims[0];
@@ -815,7 +780,7 @@ struct MarchCubesInvoker : ParallelLoopBody
                     if (volData[coordBase].weight == 0)
                         continue;
 
-                    uint8_t cubeIndex = 0;
+                    int cubeIndex = 0;
                     float tsdfValues[8] = {0};
                     for (int i = 0; i < 8; i++)
                     {
@@ -827,58 +792,11 @@ struct MarchCubesInvoker : ParallelLoopBody
                             cubeIndex |= (1 << i);
                     }
 
-                    if (edgeTable[cubeIndex] == 0)
-                        continue;
-
-                    Point3f vertices[12];
-                    Point3f basePt((float)x, (float)y, (float)z);
-
-                    if (edgeTable[cubeIndex] & 1)
-                        vertices[0] = basePt + interpolate(mcNeighbourPts[0], mcNeighbourPts[1],
-                                                           tsdfValues[0], tsdfValues[1]);
-                    if (edgeTable[cubeIndex] & 2)
-                        vertices[1] = basePt + interpolate(mcNeighbourPts[1], mcNeighbourPts[2],
-                                                           tsdfValues[1], tsdfValues[2]);
-                    if (edgeTable[cubeIndex] & 4)
-                        vertices[2] = basePt + interpolate(mcNeighbourPts[2], mcNeighbourPts[3],
-                                                           tsdfValues[2], tsdfValues[3]);
-                    if (edgeTable[cubeIndex] & 8)
-                        vertices[3] = basePt + interpolate(mcNeighbourPts[3], mcNeighbourPts[0],
-                                                           tsdfValues[3], tsdfValues[0]);
-                    if (edgeTable[cubeIndex] & 16)
-                        vertices[4] = basePt + interpolate(mcNeighbourPts[4], mcNeighbourPts[5],
-                                                           tsdfValues[4], tsdfValues[5]);
-                    if (edgeTable[cubeIndex] & 32)
-                        vertices[5] = basePt + interpolate(mcNeighbourPts[5], mcNeighbourPts[6],
-                                                           tsdfValues[5], tsdfValues[6]);
-                    if (edgeTable[cubeIndex] & 64)
-                        vertices[6] = basePt + interpolate(mcNeighbourPts[6], mcNeighbourPts[7],
-                                                           tsdfValues[6], tsdfValues[7]);
-                    if (edgeTable[cubeIndex] & 128)
-                        vertices[7] = basePt + interpolate(mcNeighbourPts[7], mcNeighbourPts[4],
-                                                           tsdfValues[7], tsdfValues[4]);
-                    if (edgeTable[cubeIndex] & 256)
-                        vertices[8] = basePt + interpolate(mcNeighbourPts[0], mcNeighbourPts[4],
-                                                           tsdfValues[0], tsdfValues[4]);
-                    if (edgeTable[cubeIndex] & 512)
-                        vertices[9] = basePt + interpolate(mcNeighbourPts[1], mcNeighbourPts[5],
-                                                           tsdfValues[1], tsdfValues[5]);
-                    if (edgeTable[cubeIndex] & 1024)
-                        vertices[10] = basePt + interpolate(mcNeighbourPts[2], mcNeighbourPts[6],
-                                                            tsdfValues[2], tsdfValues[6]);
-                    if (edgeTable[cubeIndex] & 2048)
-                        vertices[11] = basePt + interpolate(mcNeighbourPts[3], mcNeighbourPts[7],
-                                                            tsdfValues[3], tsdfValues[7]);
-
-                    for (int i = 0; triTable[cubeIndex][i] != -1; i += 3)
+                    triangles.clear();
+                    kinfu::marchCube(Point3f((float)x, (float)y, (float)z), tsdfValues, cubeIndex, triangles);
+                    for (const Point3f& t : triangles)
                     {
-                        Point3f p = volume.pose * (vertices[triTable[cubeIndex][i]] * volume.voxelSize);
-                        points.push_back(Vec4f(p.x, p.y, p.z, 1.f));
-
-                        p = volume.pose * (vertices[triTable[cubeIndex][i + 1]] * volume.voxelSize);
-                        points.push_back(Vec4f(p.x, p.y, p.z, 1.f));
-
-                        p = volume.pose * (vertices[triTable[cubeIndex][i + 2]] * volume.voxelSize);
+                        Point3f p = volume.pose * (t * volume.voxelSize);
                         points.push_back(Vec4f(p.x, p.y, p.z, 1.f));
                     }
                 }
@@ -894,8 +812,7 @@ struct MarchCubesInvoker : ParallelLoopBody
 
     const TSDFVolumeCPU& volume;
     std::vector<Vec4f>& meshPoints;
-    const Point3f mcNeighbourPts[8];
-    const Vec8i mcNeighbourCoords;
+    Vec8i mcNeighbourCoords;
     const Voxel* volData;
     mutable Mutex m;
 };
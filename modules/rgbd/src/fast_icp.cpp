@@ -18,6 +18,25 @@ enum
     UTSIZE = 27
 };
 
+// rows of new frame reduced to one partial sum of [A|b] terms
+static const int getAbTileRows = 8;
+
+//! Unpacks upper triangle of [A^T*A | A^T*b] kept row by row
+static void unpackAb(const float* upperTriangle, Matx66f& A, Vec6f& b)
+{
+    int pos = 0;
+    for(int i = 0; i < 6; i++)
+    {
+        // augment lower triangle of A by symmetry
+        for(int j = i; j < 6; j++)
+        {
+            A(i, j) = A(j, i) = upperTriangle[pos++];
+        }
+
+        b(i) = upperTriangle[pos++];
+    }
+}
+
 ICP::ICP(const Intr _intrinsics, const std::vector<int>& _iterations, float _angleThreshold, float _distanceThreshold) :
     iterations(_iterations), angleThreshold(_angleThreshold), distanceThreshold(_distanceThreshold),
     intrinsics(_intrinsics)
@@ -171,29 +190,41 @@ static inline bool fastCheck(const Point3f& p)
 
 #endif
 
-typedef Matx<float, 6, 7> ABtype;
-
+// Each tile of rows gets its own row of tileSums, so no locking is needed
+// and the result doesn't depend on how tiles are distributed between threads
 struct GetAbInvoker : ParallelLoopBody
 {
-    GetAbInvoker(ABtype& _globalAb, Mutex& _mtx,
+    GetAbInvoker(Mat_<float>& _tileSums,
                  const Points& _oldPts, const Normals& _oldNrm, const Points& _newPts, const Normals& _newNrm,
                  Affine3f _pose, Intr::Projector _proj, float _sqDistanceThresh, float _minCos) :
         ParallelLoopBody(),
-        globalSumAb(_globalAb), mtx(_mtx),
+        tileSums(_tileSums),
         oldPts(_oldPts), oldNrm(_oldNrm), newPts(_newPts), newNrm(_newNrm), pose(_pose),
         proj(_proj), sqDistanceThresh(_sqDistanceThresh), minCos(_minCos)
     { }
 
     virtual void operator ()(const Range& range) const override
+    {
+        for(int tile = range.start; tile < range.end; tile++)
+        {
+            int yStart = tile*getAbTileRows;
+            int yEnd = std::min(yStart + getAbTileRows, newPts.rows);
+            reduceRows(yStart, yEnd, tileSums[tile]);
+        }
+    }
+
+    //! Sums upper triangle of [A^T*A | A^T*b] over given rows
+    void reduceRows(int yStart, int yEnd, float* sums) const
     {
 #if USE_INTRINSICS
         CV_Assert(ptype::channels == 4);
 
-        const size_t utBufferSize = 9;
-        float CV_DECL_ALIGNED(16) upperTriangle[utBufferSize*4];
-        for(size_t i = 0; i < utBufferSize*4; i++)
-            upperTriangle[i] = 0;
-        // how values are kept in upperTriangle
+        const int utBufferSize = 9;
+        // accumulators are kept in registers for the whole tile
+        v_float32x4 vut[utBufferSize];
+        for(int i = 0; i < utBufferSize; i++)
+            vut[i] = v_setzero_f32();
+        // how values are kept in vut
         const int NA = 0;
         const size_t utPos[] =
         {
@@ -217,7 +248,7 @@ struct GetAbInvoker : ParallelLoopBody
         float sqThresh = sqDistanceThresh;
         float cosThresh = minCos;
 
-        for(int y = range.start; y < range.end; y++)
+        for(int y = yStart; y < yEnd; y++)
         {
             const CV_DECL_ALIGNED(16) float* newPtsRow = (const float*)newPts[y];
             const CV_DECL_ALIGNED(16) float* newNrmRow = (const float*)newNrm[y];
@@ -322,41 +353,39 @@ struct GetAbInvoker : ParallelLoopBody
                     nyzx = v_reinterpret_as_f32(v_combine_low(yz00, x0y0));
                 }
 
-                v_float32x4 vutg[utBufferSize];
-                for(size_t i = 0; i < utBufferSize; i++)
-                    vutg[i] = v_load_aligned(upperTriangle + i*4);
-
-                int p = 0;
                 v_float32x4 v;
                 // vx * vd, vx * n
                 v = v_setall_f32(VxN.x);
-                v_store_aligned(upperTriangle + p*4, v_muladd(v, vd, vutg[p])); p++;
-                v_store_aligned(upperTriangle + p*4, v_muladd(v,  n, vutg[p])); p++;
+                vut[0] = v_muladd(v, vd, vut[0]);
+                vut[1] = v_muladd(v,  n, vut[1]);
                 // vy * vd, vy * n
                 v = v_setall_f32(VxN.y);
-                v_store_aligned(upperTriangle + p*4, v_muladd(v, vd, vutg[p])); p++;
-                v_store_aligned(upperTriangle + p*4, v_muladd(v,  n, vutg[p])); p++;
+                vut[2] = v_muladd(v, vd, vut[2]);
+                vut[3] = v_muladd(v,  n, vut[3]);
                 // vz * vd, vz * n
                 v = v_setall_f32(VxN.z);
-                v_store_aligned(upperTriangle + p*4, v_muladd(v, vd, vutg[p])); p++;
-                v_store_aligned(upperTriangle + p*4, v_muladd(v,  n, vutg[p])); p++;
+                vut[4] = v_muladd(v, vd, vut[4]);
+                vut[5] = v_muladd(v,  n, vut[5]);
                 // nx^2, ny^2, nz^2
-                v_store_aligned(upperTriangle + p*4, v_muladd(n, n, vutg[p])); p++;
+                vut[6] = v_muladd(n, n, vut[6]);
                 // nx*ny, ny*nz, nx*nz
-                v_store_aligned(upperTriangle + p*4, v_muladd(n, nyzx, vutg[p])); p++;
+                vut[7] = v_muladd(n, nyzx, vut[7]);
                 // nx*d, ny*d, nz*d
                 v = v_setall_f32(dotp);
-                v_store_aligned(upperTriangle + p*4, v_muladd(n, v, vutg[p])); p++;
+                vut[8] = v_muladd(n, v, vut[8]);
             }
         }
 
-        ABtype sumAB = ABtype::zeros();
+        float CV_DECL_ALIGNED(16) upperTriangle[utBufferSize*4];
+        for(int i = 0; i < utBufferSize; i++)
+            v_store_aligned(upperTriangle + i*4, vut[i]);
+
+        int pos = 0;
         for(int i = 0; i < 6; i++)
         {
             for(int j = i; j < 7; j++)
             {
-                size_t p = utPos[i*7+j];
-                sumAB(i, j) = upperTriangle[p];
+                sums[pos++] = upperTriangle[utPos[i*7+j]];
             }
         }
 
@@ -366,7 +395,7 @@ struct GetAbInvoker : ParallelLoopBody
         for(int i = 0; i < UTSIZE; i++)
             upperTriangle[i] = 0;
 
-        for(int y = range.start; y < range.end; y++)
+        for(int y = yStart; y < yEnd; y++)
         {
             const ptype* newPtsRow = newPts[y];
             const ptype* newNrmRow = newNrm[y];
@@ -464,23 +493,12 @@ struct GetAbInvoker : ParallelLoopBody
             }
         }
 
-        ABtype sumAB = ABtype::zeros();
-        int pos = 0;
-        for(int i = 0; i < 6; i++)
-        {
-            for(int j = i; j < 7; j++)
-            {
-                sumAB(i, j) = upperTriangle[pos++];
-            }
-        }
+        for(int i = 0; i < UTSIZE; i++)
+            sums[i] = upperTriangle[i];
 #endif
-
-        AutoLock al(mtx);
-        globalSumAb += sumAB;
     }
 
-    ABtype& globalSumAb;
-    Mutex& mtx;
+    Mat_<float>& tileSums;
     const Points& oldPts;
     const Normals& oldNrm;
     const Points& newPts;
@@ -501,28 +519,48 @@ void ICPImpl::getAb<Mat>(const Mat& oldPts, const Mat& oldNrm, const Mat& newPts
     CV_Assert(oldPts.size() == oldNrm.size());
     CV_Assert(newPts.size() == newNrm.size());
 
-    ABtype sumAB = ABtype::zeros();
-    Mutex mutex;
+    // there are no tiles to sum up
+    if(newPts.rows == 0)
+    {
+        A = Matx66f::zeros();
+        b = Vec6f::all(0);
+        return;
+    }
+
+    int nTiles = divUp(newPts.rows, (unsigned int)getAbTileRows);
+    Mat_<float> tileSums(nTiles, UTSIZE);
+
     const Points  op(oldPts), on(oldNrm);
     const Normals np(newPts), nn(newNrm);
-    GetAbInvoker invoker(sumAB, mutex, op, on, np, nn, pose,
+    GetAbInvoker invoker(tileSums, op, on, np, nn, pose,
                          intrinsics.scale(level).makeProjector(),
                          distanceThreshold*distanceThreshold, cos(angleThreshold));
-    Range range(0, newPts.rows);
+    Range range(0, nTiles);
     const int nstripes = -1;
     parallel_for_(range, invoker, nstripes);
 
-    // splitting AB matrix to A and b
-    for(int i = 0; i < 6; i++)
+    // pairwise tree reduce in fixed order keeps partial sums small enough for floats
+    // and makes the result the same for any number of threads
+    for(int step = 1; step < nTiles; step *= 2)
     {
-        // augment lower triangle of A by symmetry
-        for(int j = i; j < 6; j++)
+        for(int tile = 0; tile + step < nTiles; tile += 2*step)
         {
-            A(i, j) = A(j, i) = sumAB(i, j);
+            float* dst = tileSums[tile];
+            const float* src = tileSums[tile + step];
+#if USE_INTRINSICS
+            int j = 0;
+            for(; j <= UTSIZE - 4; j += 4)
+                v_store(dst + j, v_load(dst + j) + v_load(src + j));
+            for(; j < UTSIZE; j++)
+                dst[j] += src[j];
+#else
+            for(int j = 0; j < UTSIZE; j++)
+                dst[j] += src[j];
+#endif
         }
-
-        b(i) = sumAB(i, 6);
     }
+
+    unpackAb(tileSums[0], A, b);
 }
 
 ///////// GPU implementation /////////
@@ -621,27 +659,7 @@ void ICPImpl::getAb<UMat>(const UMat& oldPts, const UMat& oldNrm, const UMat& ne
     }
     groupedSumCpu.release();
 
-    ABtype sumAB = ABtype::zeros();
-    int pos = 0;
-    for(int i = 0; i < 6; i++)
-    {
-        for(int j = i; j < 7; j++)
-        {
-            sumAB(i, j) = upperTriangle[pos++];
-        }
-    }
-
-    // splitting AB matrix to A and b
-    for(int i = 0; i < 6; i++)
-    {
-        // augment lower triangle of A by symmetry
-        for(int j = i; j < 6; j++)
-        {
-            A(i, j) = A(j, i) = sumAB(i, j);
-        }
-
-        b(i) = sumAB(i, 6);
-    }
+    unpackAb(upperTriangle, A, b);
 }
 
 #endif
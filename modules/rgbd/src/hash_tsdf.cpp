@@ -5,12 +5,15 @@
 #include "hash_tsdf.hpp"
 
 #include <atomic>
+#include <cstdio>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <limits>
 #include <vector>
 
 #include "kinfu_frame.hpp"
+#include "marchingcubes.hpp"
 #include "opencv2/core/cvstd.hpp"
 #include "opencv2/core/utility.hpp"
 #include "opencv2/core/utils/trace.hpp"
@@ -33,19 +36,397 @@ HashTSDFVolume::HashTSDFVolume(float _voxelSize, cv::Matx44f _pose, float _rayca
     truncDist = std::max(_truncDist, 4.0f * voxelSize);
 }
 
+VolumeUnitIndexes::VolumeUnitIndexes(int _capacity) : mask(0), count(0)
+{
+    rehash(_capacity);
+}
+
+void VolumeUnitIndexes::rehash(int newCapacity)
+{
+    size_t capacity = roundDownPow2((size_t)std::max(newCapacity, 16));
+    if ((int)capacity < newCapacity)
+        capacity *= 2;
+
+    std::vector<Entry> oldEntries;
+    oldEntries.swap(entries);
+
+    Entry empty;
+    empty.idx  = cv::Vec3i();
+    empty.slot = -1;
+    entries.assign(capacity, empty);
+    mask = capacity - 1;
+
+    for (const Entry& e : oldEntries)
+    {
+        if (e.slot < 0)
+            continue;
+        size_t i = hash(e.idx) & mask;
+        while (entries[i].slot >= 0)
+            i = (i + 1) & mask;
+        entries[i] = e;
+    }
+}
+
+int VolumeUnitIndexes::insert(const cv::Vec3i& idx, bool& inserted)
+{
+    // keep load factor below 1/2 for short probe sequences
+    if (2 * (size_t)(count + 1) > entries.size())
+        rehash((int)entries.size() * 2);
+
+    size_t i = hash(idx) & mask;
+    for (;;)
+    {
+        Entry& e = entries[i];
+        if (e.slot < 0)
+        {
+            e.idx    = idx;
+            e.slot   = count++;
+            inserted = true;
+            return e.slot;
+        }
+        if (e.idx == idx)
+        {
+            inserted = false;
+            return e.slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+void VolumeUnitIndexes::erase(const cv::Vec3i& idx)
+{
+    size_t i = hash(idx) & mask;
+    for (;;)
+    {
+        if (entries[i].slot < 0)
+            return;
+        if (entries[i].idx == idx)
+            break;
+        i = (i + 1) & mask;
+    }
+    entries[i].slot = -1;
+    count--;
+
+    // backward shift deletion: move the following entries of the probe sequence
+    // into the hole unless they already are at or after their home position
+    size_t j = i;
+    for (;;)
+    {
+        j = (j + 1) & mask;
+        if (entries[j].slot < 0)
+            return;
+        size_t home = hash(entries[j].idx) & mask;
+        bool stays  = (i <= j) ? (i < home && home <= j) : (i < home || home <= j);
+        if (stays)
+            continue;
+        entries[i]      = entries[j];
+        entries[j].slot = -1;
+        i               = j;
+    }
+}
+
+void VolumeUnitIndexes::setSlot(const cv::Vec3i& idx, int slot)
+{
+    size_t i = hash(idx) & mask;
+    for (;;)
+    {
+        Entry& e = entries[i];
+        CV_Assert(e.slot >= 0);
+        if (e.idx == idx)
+        {
+            e.slot = slot;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+void VolumeUnitIndexes::clear()
+{
+    for (Entry& e : entries)
+        e.slot = -1;
+    count = 0;
+}
+
+VolumeUnitStore::VolumeUnitStore() : removeOnClose(false), blockSize(0), fileSize(0), nPagedOut(0)
+{
+}
+
+VolumeUnitStore::~VolumeUnitStore()
+{
+    close();
+}
+
+void VolumeUnitStore::open(const String& _path, size_t _blockSize)
+{
+    close();
+
+    removeOnClose = _path.empty();
+    path          = removeOnClose ? tempfile(".tsdf") : _path;
+    blockSize     = _blockSize;
+    fileSize      = 0;
+
+    file.open(path.c_str(),
+              std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        CV_Error(Error::StsError, "Can't open file for paged out volume units: " + path);
+}
+
+void VolumeUnitStore::close()
+{
+    if (file.is_open())
+    {
+        file.close();
+        if (removeOnClose)
+            std::remove(path.c_str());
+    }
+    blocks.clear();
+    nPagedOut = 0;
+    freeOffsets.clear();
+    fileSize = 0;
+}
+
+std::vector<cv::Vec3i> VolumeUnitStore::indices() const
+{
+    std::vector<cv::Vec3i> result;
+    result.reserve(nPagedOut);
+    for (const auto& keyvalue : blocks)
+        if (keyvalue.second.pagedOut)
+            result.push_back(keyvalue.first);
+    return result;
+}
+
+void VolumeUnitStore::write(const cv::Vec3i& idx, const void* data)
+{
+    AutoLock al(mutex);
+
+    int64 offset;
+    auto it                = blocks.find(idx);
+    const bool wasPagedOut = it != blocks.end() && it->second.pagedOut;
+    if (it != blocks.end())
+    {
+        offset = it->second.offset;
+    }
+    else if (!freeOffsets.empty())
+    {
+        offset = freeOffsets.back();
+        freeOffsets.pop_back();
+    }
+    else
+    {
+        offset = fileSize;
+        fileSize += (int64)blockSize;
+    }
+
+    file.seekp(offset);
+    file.write((const char*)data, blockSize);
+    if (!file)
+        CV_Error(Error::StsError, "Failed to write paged out volume unit to " + path);
+
+    Block& block = blocks[idx];
+    if (!wasPagedOut)
+        nPagedOut++;
+    block.offset   = offset;
+    block.pagedOut = true;
+}
+
+bool VolumeUnitStore::read(const cv::Vec3i& idx, void* data) const
+{
+    AutoLock al(mutex);
+
+    auto it = blocks.find(idx);
+    if (it == blocks.end() || !it->second.pagedOut)
+        return false;
+
+    file.seekg(it->second.offset);
+    file.read((char*)data, blockSize);
+    if (!file)
+        CV_Error(Error::StsError, "Failed to read paged out volume unit from " + path);
+    return true;
+}
+
+bool VolumeUnitStore::take(const cv::Vec3i& idx, void* data)
+{
+    if (!read(idx, data))
+        return false;
+
+    AutoLock al(mutex);
+    blocks[idx].pagedOut = false;
+    nPagedOut--;
+    return true;
+}
+
+bool VolumeUnitStore::restore(const cv::Vec3i& idx)
+{
+    AutoLock al(mutex);
+
+    auto it = blocks.find(idx);
+    if (it == blocks.end() || it->second.pagedOut)
+        return false;
+    it->second.pagedOut = true;
+    nPagedOut++;
+    return true;
+}
+
+void VolumeUnitStore::clear()
+{
+    AutoLock al(mutex);
+    for (const auto& keyvalue : blocks)
+        freeOffsets.push_back(keyvalue.second.offset);
+    blocks.clear();
+    nPagedOut = 0;
+}
+
 HashTSDFVolumeCPU::HashTSDFVolumeCPU(float _voxelSize, cv::Matx44f _pose, float _raycastStepFactor,
                                      float _truncDist, int _maxWeight, float _truncateThreshold,
                                      int _volumeUnitRes, bool _zFirstMemOrder)
     : HashTSDFVolume(_voxelSize, _pose, _raycastStepFactor, _truncDist, _maxWeight,
-                     _truncateThreshold, _volumeUnitRes, _zFirstMemOrder)
+                     _truncateThreshold, _volumeUnitRes, _zFirstMemOrder),
+      pagingRadius(0.f)
 {
+    // Same layout as TSDFVolumeCPU::volume of a volumeUnitResolution^3 cube
+    int xdim, ydim, zdim;
+    if (zFirstMemOrder)
+    {
+        xdim = volumeUnitResolution * volumeUnitResolution;
+        ydim = volumeUnitResolution;
+        zdim = 1;
+    }
+    else
+    {
+        xdim = 1;
+        ydim = volumeUnitResolution;
+        zdim = volumeUnitResolution * volumeUnitResolution;
+    }
+    volStrides = Vec4i(xdim, ydim, zdim);
+    neighbourCoords = Vec8i(
+        volStrides.dot(Vec4i(0, 0, 0)),
+        volStrides.dot(Vec4i(0, 0, 1)),
+        volStrides.dot(Vec4i(0, 1, 0)),
+        volStrides.dot(Vec4i(0, 1, 1)),
+        volStrides.dot(Vec4i(1, 0, 0)),
+        volStrides.dot(Vec4i(1, 0, 1)),
+        volStrides.dot(Vec4i(1, 1, 0)),
+        volStrides.dot(Vec4i(1, 1, 1))
+    );
 }
 
 // zero volume, leave rest params the same
 void HashTSDFVolumeCPU::reset()
 {
     CV_TRACE_FUNCTION();
+    volumeUnitIndexes.clear();
     volumeUnits.clear();
+    pagedOutUnits.clear();
+    // voxel pool memory is kept and zeroed on reuse
+
+    // meshes of volume units which had a surface should be cleared at the next update
+    dirtyUnits = meshedUnits;
+}
+
+void HashTSDFVolumeCPU::setPaging(const String& storagePath, float residentRadius)
+{
+    CV_TRACE_FUNCTION();
+
+    //! Bring everything back before the store is recreated
+    if (pagedOutUnits.isOpened())
+    {
+        const int firstNewSlot = volumeUnitIndexes.size();
+        for (const cv::Vec3i& idx : pagedOutUnits.indices())
+        {
+            bool inserted = false;
+            volumeUnitIndexes.insert(idx, inserted);
+            VolumeUnit volumeUnit;
+            volumeUnit.index      = idx;
+            volumeUnit.isActive   = false;
+            volumeUnit.isModified = true;
+            volumeUnits.push_back(volumeUnit);
+        }
+        allocateVolumeUnitsData(firstNewSlot);
+        pagedOutUnits.close();
+    }
+
+    pagingRadius = residentRadius;
+    if (pagingRadius > 0)
+    {
+        const size_t blockSize = (size_t)volumeUnitResolution * volumeUnitResolution *
+                                 volumeUnitResolution * sizeof(TsdfVoxel);
+        pagedOutUnits.open(storagePath, blockSize);
+    }
+}
+
+void HashTSDFVolumeCPU::allocateVolumeUnitsData(int firstNewSlot)
+{
+    CV_TRACE_FUNCTION();
+
+    const int nUnits     = volumeUnitIndexes.size();
+    const int unitVoxels = volumeUnitResolution * volumeUnitResolution * volumeUnitResolution;
+    if (volUnitsData.rows < nUnits)
+    {
+        // grow geometrically to keep the amortized cost of copying low
+        Mat newData(std::max(nUnits, 2 * volUnitsData.rows), unitVoxels, rawType<TsdfVoxel>());
+        if (firstNewSlot > 0)
+        {
+            Mat oldUnits = newData.rowRange(0, firstNewSlot);
+            volUnitsData.rowRange(0, firstNewSlot).copyTo(oldUnits);
+        }
+        volUnitsData = newData;
+    }
+    const size_t blockSize = (size_t)unitVoxels * sizeof(TsdfVoxel);
+    for (int slot = firstNewSlot; slot < nUnits; slot++)
+    {
+        //! Volume units return from the store as they were paged out
+        if (pagedOutUnits.isOpened() && pagedOutUnits.take(volumeUnits[slot].index,
+                                                           volUnitsData.ptr(slot)))
+        {
+            volumeUnits[slot].isModified = false;
+            continue;
+        }
+        // zero tsdf and weight, as TSDFVolumeCPU::reset() does
+        std::memset(volUnitsData.ptr(slot), 0, blockSize);
+        volumeUnits[slot].isModified = true;
+    }
+}
+
+void HashTSDFVolumeCPU::pageOutVolumeUnits(const cv::Matx44f& cameraPose)
+{
+    CV_TRACE_FUNCTION();
+
+    if (pagingRadius <= 0 || !pagedOutUnits.isOpened())
+        return;
+
+    //! Camera position in the volume coordinate frame
+    const Point3f camPos = (pose.inv() * Affine3f(cameraPose)).translation();
+    const Point3f halfUnit(0.5f * volumeUnitSize, 0.5f * volumeUnitSize, 0.5f * volumeUnitSize);
+    const float radius2    = pagingRadius * pagingRadius;
+    const size_t blockSize = (size_t)volUnitsData.cols * volUnitsData.elemSize();
+
+    int slot = 0;
+    while (slot < (int)volumeUnits.size())
+    {
+        const cv::Vec3i idx = volumeUnits[slot].index;
+        Point3f d           = volumeUnitIdxToVolume(idx) + halfUnit - camPos;
+        if (d.dot(d) <= radius2)
+        {
+            slot++;
+            continue;
+        }
+
+        //! The store still has the voxels of volume units which didn't change since page in
+        if (volumeUnits[slot].isModified || !pagedOutUnits.restore(idx))
+            pagedOutUnits.write(idx, volUnitsData.ptr(slot));
+        volumeUnitIndexes.erase(idx);
+
+        //! Keep slots dense: the last volume unit takes the freed slot
+        const int last = (int)volumeUnits.size() - 1;
+        if (slot != last)
+        {
+            std::memcpy(volUnitsData.ptr(slot), volUnitsData.ptr(last), blockSize);
+            volumeUnits[slot] = volumeUnits[last];
+            volumeUnitIndexes.setSlot(volumeUnits[slot].index, slot);
+        }
+        volumeUnits.pop_back();
+    }
 }
 
 struct AllocateVolumeUnitsInvoker : ParallelLoopBody
@@ -64,6 +445,7 @@ struct AllocateVolumeUnitsInvoker : ParallelLoopBody
 
     virtual void operator()(const Range& range) const override
     {
+        VolumeUnitIndexSet localAccessVolUnits;
         for (int y = range.start; y < range.end; y += depthStride)
         {
             const depthType* depthRow = depth[y];
@@ -81,7 +463,6 @@ struct AllocateVolumeUnitsInvoker : ParallelLoopBody
                     volPoint - cv::Point3f(volume.truncDist, volume.truncDist, volume.truncDist));
                 cv::Vec3i upper_bound = volume.volumeToVolumeUnitIdx(
                     volPoint + cv::Point3f(volume.truncDist, volume.truncDist, volume.truncDist));
-                VolumeUnitIndexSet localAccessVolUnits;
                 for (int i = lower_bound[0]; i <= upper_bound[0]; i++)
                     for (int j = lower_bound[1]; j <= upper_bound[1]; j++)
                         for (int k = lower_bound[2]; k <= lower_bound[2]; k++)
@@ -92,28 +473,24 @@ struct AllocateVolumeUnitsInvoker : ParallelLoopBody
                                 localAccessVolUnits.emplace(tsdf_idx);
                             }
                         }
-                AutoLock al(mutex);
-                for (const auto& tsdf_idx : localAccessVolUnits)
-                {
-                    //! If the insert into the global set passes
-                    if (!volume.volumeUnits.count(tsdf_idx))
-                    {
-                        VolumeUnit volumeUnit;
-                        cv::Point3i volumeDims(volume.volumeUnitResolution,
-                                               volume.volumeUnitResolution,
-                                               volume.volumeUnitResolution);
-
-                        cv::Matx44f subvolumePose =
-                            volume.pose.translate(volume.volumeUnitIdxToVolume(tsdf_idx)).matrix;
-                        volumeUnit.pVolume = cv::makePtr<TSDFVolumeCPU>(
-                            volume.voxelSize, subvolumePose, volume.raycastStepFactor,
-                            volume.truncDist, volume.maxWeight, volumeDims);
-                        //! This volume unit will definitely be required for current integration
-                        volumeUnit.index             = tsdf_idx;
-                        volumeUnit.isActive          = true;
-                        volume.volumeUnits[tsdf_idx] = volumeUnit;
-                    }
-                }
+            }
+        }
+
+        //! Lock once per stripe instead of once per pixel
+        AutoLock al(mutex);
+        for (const auto& tsdf_idx : localAccessVolUnits)
+        {
+            bool inserted = false;
+            volume.volumeUnitIndexes.insert(tsdf_idx, inserted);
+            //! If the insert into the global table passes
+            if (inserted)
+            {
+                VolumeUnit volumeUnit;
+                //! This volume unit will definitely be required for current integration
+                volumeUnit.index      = tsdf_idx;
+                volumeUnit.isActive   = true;
+                volumeUnit.isModified = true;
+                volume.volumeUnits.push_back(volumeUnit);
             }
         }
     }
@@ -137,16 +514,11 @@ void HashTSDFVolumeCPU::integrate(InputArray _depth, float depthFactor,
     Depth depth = _depth.getMat();
 
     //! Compute volumes to be allocated
+    const int firstNewSlot = volumeUnitIndexes.size();
     AllocateVolumeUnitsInvoker allocate_i(*this, depth, intrinsics, cameraPose, depthFactor);
     Range allocateRange(0, depth.rows);
     parallel_for_(allocateRange, allocate_i);
-
-    //! Get volumes that are in the current camera frame
-    std::vector<Vec3i> totalVolUnits;
-    for (const auto& keyvalue : volumeUnits)
-    {
-        totalVolUnits.push_back(keyvalue.first);
-    }
+    allocateVolumeUnitsData(firstNewSlot);
 
     //! Mark volumes in the camera frustum as active
     Range inFrustumRange(0, (int)volumeUnits.size());
@@ -156,47 +528,55 @@ void HashTSDFVolumeCPU::integrate(InputArray _depth, float depthFactor,
 
         for (int i = range.start; i < range.end; ++i)
         {
-            cv::Vec3i tsdf_idx         = totalVolUnits[i];
-            VolumeUnitMap::iterator it = volumeUnits.find(tsdf_idx);
-            if (it == volumeUnits.end())
-                return;
+            VolumeUnit& volumeUnit = volumeUnits[i];
 
-            Point3f volumeUnitPos     = volumeUnitIdxToVolume(it->first);
+            Point3f volumeUnitPos     = volumeUnitIdxToVolume(volumeUnit.index);
             Point3f volUnitInCamSpace = vol2cam * volumeUnitPos;
             if (volUnitInCamSpace.z < 0 || volUnitInCamSpace.z > truncateThreshold)
             {
-                it->second.isActive = false;
-                return;
+                volumeUnit.isActive = false;
+                continue;
             }
             Point2f cameraPoint = proj(volUnitInCamSpace);
             if (cameraPoint.x >= 0 && cameraPoint.y >= 0 && cameraPoint.x < depth.cols &&
                 cameraPoint.y < depth.rows)
             {
-                assert(it != volumeUnits.end());
-                it->second.isActive = true;
+                volumeUnit.isActive = true;
             }
         }
     });
 
     //! Integrate the correct volumeUnits
-    parallel_for_(Range(0, (int)totalVolUnits.size()), [&](const Range& range) {
+    const Point3i volUnitResolution(volumeUnitResolution, volumeUnitResolution,
+                                    volumeUnitResolution);
+    parallel_for_(Range(0, (int)volumeUnits.size()), [&](const Range& range) {
         for (int i = range.start; i < range.end; i++)
         {
-            cv::Vec3i tsdf_idx         = totalVolUnits[i];
-            VolumeUnitMap::iterator it = volumeUnits.find(tsdf_idx);
-            if (it == volumeUnits.end())
-                return;
-
-            VolumeUnit& volumeUnit = it->second;
+            VolumeUnit& volumeUnit = volumeUnits[i];
             if (volumeUnit.isActive)
             {
-                //! The volume unit should already be added into the Volume from the allocator
-                volumeUnit.pVolume->integrate(depth, depthFactor, cameraPose, intrinsics);
-                //! Ensure all active volumeUnits are set to inactive for next integration
-                volumeUnit.isActive = false;
+                //! The volume unit data should already be allocated in the pool
+                const Affine3f volumeUnitPose =
+                    pose.translate(volumeUnitIdxToVolume(volumeUnit.index));
+                integrateVolumeUnit(truncDist, voxelSize, maxWeight, volumeUnitPose,
+                                    volUnitResolution, volStrides, depth, depthFactor, cameraPose,
+                                    intrinsics, volUnitsData.ptr<TsdfVoxel>(i), false);
             }
         }
     });
+
+    for (VolumeUnit& volumeUnit : volumeUnits)
+    {
+        if (volumeUnit.isActive)
+        {
+            dirtyUnits.insert(volumeUnit.index);
+            volumeUnit.isModified = true;
+            //! Ensure all active volumeUnits are set to inactive for next integration
+            volumeUnit.isActive = false;
+        }
+    }
+
+    pageOutVolumeUnits(cameraPose);
 }
 
 cv::Vec3i HashTSDFVolumeCPU::volumeToVolumeUnitIdx(cv::Point3f p) const
@@ -228,16 +608,14 @@ inline TsdfVoxel HashTSDFVolumeCPU::at(const cv::Vec3i& volumeIdx) const
                                         cvFloor(volumeIdx[1] / volumeUnitResolution),
                                         cvFloor(volumeIdx[2] / volumeUnitResolution));
 
-    VolumeUnitMap::const_iterator it = volumeUnits.find(volumeUnitIdx);
-    if (it == volumeUnits.end())
+    int slot = volumeUnitIndexes.find(volumeUnitIdx);
+    if (slot < 0)
     {
         TsdfVoxel dummy;
         dummy.tsdf   = 1.f;
         dummy.weight = 0;
         return dummy;
     }
-    cv::Ptr<TSDFVolumeCPU> volumeUnit =
-        std::dynamic_pointer_cast<TSDFVolumeCPU>(it->second.pVolume);
 
     cv::Vec3i volUnitLocalIdx = volumeIdx - cv::Vec3i(volumeUnitIdx[0] * volumeUnitResolution,
                                                       volumeUnitIdx[1] * volumeUnitResolution,
@@ -245,53 +623,278 @@ inline TsdfVoxel HashTSDFVolumeCPU::at(const cv::Vec3i& volumeIdx) const
 
     volUnitLocalIdx =
         cv::Vec3i(abs(volUnitLocalIdx[0]), abs(volUnitLocalIdx[1]), abs(volUnitLocalIdx[2]));
-    return volumeUnit->at(volUnitLocalIdx);
+    return atVolumeUnit(slot, volUnitLocalIdx);
 }
 
-inline TsdfVoxel HashTSDFVolumeCPU::at(const cv::Point3f& point) const
+TsdfVoxel HashTSDFVolumeCPU::at(const cv::Point3f& point) const
 {
-    cv::Vec3i volumeUnitIdx          = volumeToVolumeUnitIdx(point);
-    VolumeUnitMap::const_iterator it = volumeUnits.find(volumeUnitIdx);
-    if (it == volumeUnits.end())
+    cv::Vec3i volumeUnitIdx = volumeToVolumeUnitIdx(point);
+    int slot                = volumeUnitIndexes.find(volumeUnitIdx);
+    if (slot < 0)
     {
         TsdfVoxel dummy;
         dummy.tsdf   = 1.f;
         dummy.weight = 0;
         return dummy;
     }
-    cv::Ptr<TSDFVolumeCPU> volumeUnit =
-        std::dynamic_pointer_cast<TSDFVolumeCPU>(it->second.pVolume);
 
     cv::Point3f volumeUnitPos = volumeUnitIdxToVolume(volumeUnitIdx);
     cv::Vec3i volUnitLocalIdx = volumeToVoxelCoord(point - volumeUnitPos);
     volUnitLocalIdx =
         cv::Vec3i(abs(volUnitLocalIdx[0]), abs(volUnitLocalIdx[1]), abs(volUnitLocalIdx[2]));
-    return volumeUnit->at(volUnitLocalIdx);
+    return atVolumeUnit(slot, volUnitLocalIdx);
+}
+
+//! Finds voxel blocks of resident volume units
+struct ResidentVolumeUnits
+{
+    ResidentVolumeUnits(const HashTSDFVolumeCPU& _volume) : volume(_volume) {}
+
+    inline const TsdfVoxel* operator()(const cv::Vec3i& volumeUnitIdx) const
+    {
+        int slot = volume.volumeUnitIndexes.find(volumeUnitIdx);
+        return slot < 0 ? nullptr : volume.volUnitsData.ptr<TsdfVoxel>(slot);
+    }
+
+    const HashTSDFVolumeCPU& volume;
+};
+
+//! Finds voxel blocks of resident volume units and reads the paged out ones from the store.
+//! Blocks which were read are cached, the cache is emptied when it grows over maxCachedUnits,
+//! so the returned pointer is valid until the next lookup only.
+//! It's not thread-safe, each thread should have its own instance.
+struct PagedOutVolumeUnits
+{
+    PagedOutVolumeUnits(const HashTSDFVolumeCPU& _volume, size_t _maxCachedUnits = 64)
+        : resident(_volume),
+          paging(_volume.pagedOutUnits.isOpened() && _volume.pagedOutUnits.size() > 0),
+          maxCachedUnits(_maxCachedUnits)
+    {
+    }
+
+    inline const TsdfVoxel* operator()(const cv::Vec3i& idx) const
+    {
+        const TsdfVoxel* volData = resident(idx);
+        if (volData || !paging)
+            return volData;
+
+        const HashTSDFVolumeCPU& volume = resident.volume;
+        if (!volume.pagedOutUnits.contains(idx))
+            return nullptr;
+
+        auto it = cache.find(idx);
+        if (it != cache.end())
+            return it->second.data();
+
+        if (cache.size() >= maxCachedUnits)
+            cache.clear();
+        std::vector<TsdfVoxel>& block = cache[idx];
+        block.resize((size_t)volume.volumeUnitResolution * volume.volumeUnitResolution *
+                     volume.volumeUnitResolution);
+        if (!volume.pagedOutUnits.read(idx, block.data()))
+        {
+            cache.erase(idx);
+            return nullptr;
+        }
+        return block.data();
+    }
+
+    ResidentVolumeUnits resident;
+    const bool paging;
+    const size_t maxCachedUnits;
+    mutable std::unordered_map<cv::Vec3i, std::vector<TsdfVoxel>, tsdf_hash> cache;
+};
+
+static inline int floorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a - 1) / b) - 1;
+}
+
+//! TSDF value at the voxel given by its index in the universal volume
+template<typename VolumeUnits>
+static inline TsdfType tsdfAt(const HashTSDFVolumeCPU& volume, const VolumeUnits& units,
+                              int x, int y, int z)
+{
+    const int res = volume.volumeUnitResolution;
+    cv::Vec3i volumeUnitIdx(floorDiv(x, res), floorDiv(y, res), floorDiv(z, res));
+    const TsdfVoxel* volData = units(volumeUnitIdx);
+    if (!volData)
+        return 1.f;
+    return volData[(x - volumeUnitIdx[0] * res) * volume.volStrides[0] +
+                   (y - volumeUnitIdx[1] * res) * volume.volStrides[1] +
+                   (z - volumeUnitIdx[2] * res) * volume.volStrides[2]].tsdf;
+}
+
+//! TSDF values at the 8 corners of the cell starting at (ix, iy, iz) in voxels,
+//! in the order of HashTSDFVolumeCPU::neighbourCoords
+template<typename VolumeUnits>
+static inline void cellCorners(const HashTSDFVolumeCPU& volume, const VolumeUnits& units,
+                               int ix, int iy, int iz, TsdfType vx[8])
+{
+    const int res = volume.volumeUnitResolution;
+    cv::Vec3i volumeUnitIdx(floorDiv(ix, res), floorDiv(iy, res), floorDiv(iz, res));
+    int lx = ix - volumeUnitIdx[0] * res;
+    int ly = iy - volumeUnitIdx[1] * res;
+    int lz = iz - volumeUnitIdx[2] * res;
+
+    // most cells lie inside of one volume unit, one lookup is enough for them
+    if (lx < res - 1 && ly < res - 1 && lz < res - 1)
+    {
+        const TsdfVoxel* volData = units(volumeUnitIdx);
+        if (!volData)
+        {
+            for (int i = 0; i < 8; i++)
+                vx[i] = 1.f;
+            return;
+        }
+        int coordBase = lx * volume.volStrides[0] + ly * volume.volStrides[1] +
+                        lz * volume.volStrides[2];
+        for (int i = 0; i < 8; i++)
+            vx[i] = volData[volume.neighbourCoords[i] + coordBase].tsdf;
+        return;
+    }
+
+    for (int i = 0; i < 8; i++)
+        vx[i] = tsdfAt(volume, units, ix + ((i >> 2) & 1), iy + ((i >> 1) & 1), iz + (i & 1));
+}
+
+#if USE_INTRINSICS
+//! p is in voxels
+template<typename VolumeUnits>
+static inline TsdfType interpolateVoxelWith(const HashTSDFVolumeCPU& volume,
+                                            const VolumeUnits& units, const v_float32x4& p)
+{
+    // tx, ty, tz = floor(p)
+    v_int32x4 ip  = v_floor(p);
+    v_float32x4 t = p - v_cvt_f32(ip);
+    float tx      = t.get0();
+    t             = v_reinterpret_as_f32(v_rotate_right<1>(v_reinterpret_as_u32(t)));
+    float ty      = t.get0();
+    t             = v_reinterpret_as_f32(v_rotate_right<1>(v_reinterpret_as_u32(t)));
+    float tz      = t.get0();
+
+    int ix = ip.get0();
+    ip     = v_rotate_right<1>(ip);
+    int iy = ip.get0();
+    ip     = v_rotate_right<1>(ip);
+    int iz = ip.get0();
+
+    TsdfType vx[8];
+    cellCorners(volume, units, ix, iy, iz, vx);
+
+    v_float32x4 v0246(vx[0], vx[2], vx[4], vx[6]), v1357(vx[1], vx[3], vx[5], vx[7]);
+    v_float32x4 vxx = v0246 + v_setall_f32(tz) * (v1357 - v0246);
+
+    v_float32x4 v00_10 = vxx;
+    v_float32x4 v01_11 = v_reinterpret_as_f32(v_rotate_right<1>(v_reinterpret_as_u32(vxx)));
+
+    v_float32x4 v0_1 = v00_10 + v_setall_f32(ty) * (v01_11 - v00_10);
+    float v0         = v0_1.get0();
+    v0_1             = v_reinterpret_as_f32(v_rotate_right<2>(v_reinterpret_as_u32(v0_1)));
+    float v1         = v0_1.get0();
+
+    return v0 + tx * (v1 - v0);
+}
+
+//! p is in voxels, gradientDeltaFactor is fixed at 1.0 of voxel size
+template<typename VolumeUnits>
+static inline v_float32x4 getNormalVoxelWith(const HashTSDFVolumeCPU& volume,
+                                             const VolumeUnits& units, const v_float32x4& p)
+{
+    v_int32x4 ip  = v_floor(p);
+    v_float32x4 t = p - v_cvt_f32(ip);
+    float tx      = t.get0();
+    t             = v_reinterpret_as_f32(v_rotate_right<1>(v_reinterpret_as_u32(t)));
+    float ty      = t.get0();
+    t             = v_reinterpret_as_f32(v_rotate_right<1>(v_reinterpret_as_u32(t)));
+    float tz      = t.get0();
+
+    int CV_DECL_ALIGNED(16) aip[4];
+    v_store_aligned(aip, ip);
+
+    const v_float32x4 vtz = v_setall_f32(tz), vty = v_setall_f32(ty);
+
+    float CV_DECL_ALIGNED(16) an[4];
+    an[0] = an[1] = an[2] = an[3] = 0.f;
+    for (int c = 0; c < 3; c++)
+    {
+        TsdfType vnext[8], vprev[8];
+        aip[c] += 1;
+        cellCorners(volume, units, aip[0], aip[1], aip[2], vnext);
+        aip[c] -= 2;
+        cellCorners(volume, units, aip[0], aip[1], aip[2], vprev);
+        aip[c] += 1;
+
+        v_float32x4 v0246 = v_float32x4(vnext[0], vnext[2], vnext[4], vnext[6]) -
+                            v_float32x4(vprev[0], vprev[2], vprev[4], vprev[6]);
+        v_float32x4 v1357 = v_float32x4(vnext[1], vnext[3], vnext[5], vnext[7]) -
+                            v_float32x4(vprev[1], vprev[3], vprev[5], vprev[7]);
+        v_float32x4 vxx = v0246 + vtz * (v1357 - v0246);
+
+        v_float32x4 v00_10 = vxx;
+        v_float32x4 v01_11 = v_reinterpret_as_f32(v_rotate_right<1>(v_reinterpret_as_u32(vxx)));
+
+        v_float32x4 v0_1 = v00_10 + vty * (v01_11 - v00_10);
+        float v0         = v0_1.get0();
+        v0_1             = v_reinterpret_as_f32(v_rotate_right<2>(v_reinterpret_as_u32(v0_1)));
+        float v1         = v0_1.get0();
+
+        an[c] = v0 + tx * (v1 - v0);
+    }
+
+    v_float32x4 n    = v_load_aligned(an);
+    v_float32x4 Norm = v_sqrt(v_setall_f32(v_reduce_sum(n * n)));
+
+    return Norm.get0() < 0.0001f ? nanv : n / Norm;
+}
+
+template<typename VolumeUnits>
+static inline Point3f getNormalVoxelWith(const HashTSDFVolumeCPU& volume,
+                                         const VolumeUnits& units, const Point3f& p)
+{
+    v_float32x4 result = getNormalVoxelWith(volume, units, v_float32x4(p.x, p.y, p.z, 0.f));
+    float CV_DECL_ALIGNED(16) ares[4];
+    v_store_aligned(ares, result);
+    return Point3f(ares[0], ares[1], ares[2]);
 }
 
 inline TsdfType HashTSDFVolumeCPU::interpolateVoxel(const cv::Point3f& point) const
 {
-    cv::Point3f neighbourCoords[] = {
-                                Point3f(0, 0, 0),
-                                Point3f(0, 0, 1),
-                                Point3f(0, 1, 0),
-                                Point3f(0, 1, 1),
-                                Point3f(1, 0, 0),
-                                Point3f(1, 0, 1),
-                                Point3f(1, 1, 0),
-                                Point3f(1, 1, 1) };
+    return interpolateVoxel(v_float32x4(point.x, point.y, point.z, 0.f));
+}
 
-    int ix = cvFloor(point.x);
-    int iy = cvFloor(point.y);
-    int iz = cvFloor(point.z);
+inline TsdfType HashTSDFVolumeCPU::interpolateVoxel(const v_float32x4& point) const
+{
+    return interpolateVoxelWith(*this, ResidentVolumeUnits(*this),
+                                point * v_setall_f32(voxelSizeInv));
+}
 
-    float tx = point.x - ix;
-    float ty = point.y - iy;
-    float tz = point.z - iz;
+Point3f HashTSDFVolumeCPU::getNormalVoxel(Point3f point) const
+{
+    return getNormalVoxelWith(*this, ResidentVolumeUnits(*this), point * voxelSizeInv);
+}
+
+inline v_float32x4 HashTSDFVolumeCPU::getNormalVoxel(const v_float32x4& point) const
+{
+    return getNormalVoxelWith(*this, ResidentVolumeUnits(*this),
+                              point * v_setall_f32(voxelSizeInv));
+}
+#else
+//! p is in voxels
+template<typename VolumeUnits>
+static inline TsdfType interpolateVoxelWith(const HashTSDFVolumeCPU& volume,
+                                            const VolumeUnits& units, const Point3f& p)
+{
+    int ix = cvFloor(p.x);
+    int iy = cvFloor(p.y);
+    int iz = cvFloor(p.z);
+
+    float tx = p.x - ix;
+    float ty = p.y - iy;
+    float tz = p.z - iz;
 
     TsdfType vx[8];
-    for (int i = 0; i < 8; i++)
-        vx[i] = at(neighbourCoords[i] * voxelSize + point).tsdf;
+    cellCorners(volume, units, ix, iy, iz, vx);
 
     TsdfType v00 = vx[0] + tz * (vx[1] - vx[0]);
     TsdfType v01 = vx[2] + tz * (vx[3] - vx[2]);
@@ -304,31 +907,58 @@ inline TsdfType HashTSDFVolumeCPU::interpolateVoxel(const cv::Point3f& point) co
     return v0 + tx * (v1 - v0);
 }
 
-inline Point3f HashTSDFVolumeCPU::getNormalVoxel(Point3f point) const
+//! p is in voxels, gradientDeltaFactor is fixed at 1.0 of voxel size
+template<typename VolumeUnits>
+static inline Point3f getNormalVoxelWith(const HashTSDFVolumeCPU& volume,
+                                         const VolumeUnits& units, const Point3f& p)
 {
-    Vec3f pointVec(point);
-    Vec3f normal = Vec3f(0, 0, 0);
+    int ip[3] = { cvFloor(p.x), cvFloor(p.y), cvFloor(p.z) };
 
-    Vec3f pointPrev = point;
-    Vec3f pointNext = point;
+    float tx = p.x - ip[0];
+    float ty = p.y - ip[1];
+    float tz = p.z - ip[2];
 
+    Vec3f an;
     for (int c = 0; c < 3; c++)
     {
-        pointPrev[c] -= voxelSize;
-        pointNext[c] += voxelSize;
+        TsdfType vnext[8], vprev[8];
+        ip[c] += 1;
+        cellCorners(volume, units, ip[0], ip[1], ip[2], vnext);
+        ip[c] -= 2;
+        cellCorners(volume, units, ip[0], ip[1], ip[2], vprev);
+        ip[c] += 1;
+
+        TsdfType vx[8];
+        for (int i = 0; i < 8; i++)
+            vx[i] = vnext[i] - vprev[i];
+
+        TsdfType v00 = vx[0] + tz * (vx[1] - vx[0]);
+        TsdfType v01 = vx[2] + tz * (vx[3] - vx[2]);
+        TsdfType v10 = vx[4] + tz * (vx[5] - vx[4]);
+        TsdfType v11 = vx[6] + tz * (vx[7] - vx[6]);
+
+        TsdfType v0 = v00 + ty * (v01 - v00);
+        TsdfType v1 = v10 + ty * (v11 - v10);
+
+        an[c] = v0 + tx * (v1 - v0);
+    }
 
-        //normal[c] = at(Point3f(pointNext)).tsdf - at(Point3f(pointPrev)).tsdf;
-        normal[c] = interpolateVoxel(Point3f(pointNext)) - interpolateVoxel(Point3f(pointPrev));
+    float nv = sqrt(an[0] * an[0] +
+                    an[1] * an[1] +
+                    an[2] * an[2]);
+    return nv < 0.0001f ? nan3 : an / nv;
+}
 
-        pointPrev[c] = pointVec[c];
-        pointNext[c] = pointVec[c];
-    }
-    //std::cout << normal << std::endl;
-    float nv = sqrt(normal[0] * normal[0] +
-                     normal[1] * normal[1] +
-                     normal[2] * normal[2]);
-    return nv < 0.0001f ? nan3 : normal/nv;
+inline TsdfType HashTSDFVolumeCPU::interpolateVoxel(const cv::Point3f& point) const
+{
+    return interpolateVoxelWith(*this, ResidentVolumeUnits(*this), point * voxelSizeInv);
+}
+
+Point3f HashTSDFVolumeCPU::getNormalVoxel(Point3f point) const
+{
+    return getNormalVoxelWith(*this, ResidentVolumeUnits(*this), point * voxelSizeInv);
 }
+#endif
 
 struct HashRaycastInvoker : ParallelLoopBody
 {
@@ -345,6 +975,150 @@ struct HashRaycastInvoker : ParallelLoopBody
     {
     }
 
+#if USE_INTRINSICS
+    virtual void operator()(const Range& range) const override
+    {
+        const v_float32x4 vfxy(reproj.fxinv, reproj.fyinv, 0, 0);
+        const v_float32x4 vcxy(reproj.cx, reproj.cy, 0, 0);
+
+        const float (&cm)[16] = cam2vol.matrix.val;
+        const v_float32x4 camRot0(cm[0], cm[4], cm[8], 0);
+        const v_float32x4 camRot1(cm[1], cm[5], cm[9], 0);
+        const v_float32x4 camRot2(cm[2], cm[6], cm[10], 0);
+        const v_float32x4 camTrans(cm[3], cm[7], cm[11], 0);
+
+        const float (&vm)[16] = vol2cam.matrix.val;
+        const v_float32x4 volRot0(vm[0], vm[4], vm[8], 0);
+        const v_float32x4 volRot1(vm[1], vm[5], vm[9], 0);
+        const v_float32x4 volRot2(vm[2], vm[6], vm[10], 0);
+        const v_float32x4 volTrans(vm[3], vm[7], vm[11], 0);
+
+        const float blockSize             = volume.volumeUnitSize;
+        const v_float32x4 vBlockSize      = v_setall_f32(blockSize);
+        const v_float32x4 vBlockSizeInv   = v_setall_f32(1.f / blockSize);
+        const v_float32x4 invVoxelSize    = v_setall_f32(volume.voxelSizeInv);
+        const v_int32x4 vStrides(volume.volStrides[0], volume.volStrides[1],
+                                 volume.volStrides[2], 0);
+        const v_int32x4 upLimits = v_setall_s32(volume.volumeUnitResolution);
+
+        //! Rays go through paged out volume units as well
+        PagedOutVolumeUnits units(volume);
+
+        for (int y = range.start; y < range.end; y++)
+        {
+            ptype* ptsRow = points[y];
+            ptype* nrmRow = normals[y];
+
+            for (int x = 0; x < points.cols; x++)
+            {
+                //! Initialize default value
+                v_float32x4 point = nanv, normal = nanv;
+
+                //! Ray origin and direction in the volume coordinate frame
+                v_float32x4 orig = camTrans;
+
+                // 1. reproject (x, y) on projecting plane where z = 1.f
+                v_float32x4 planed = (v_float32x4((float)x, (float)y, 0.f, 0.f) - vcxy) * vfxy;
+                planed             = v_combine_low(planed, v_float32x4(1.f, 0.f, 0.f, 0.f));
+
+                // 2. rotate to volume space
+                planed = v_matmuladd(planed, camRot0, camRot1, camRot2, v_setzero_f32());
+
+                // 3. normalize
+                v_float32x4 invNorm = v_invsqrt(v_setall_f32(v_reduce_sum(planed * planed)));
+                v_float32x4 rayDirV = planed * invNorm;
+
+                float tmin  = 0;
+                float tmax  = volume.truncateThreshold;
+                float tcurr = tmin;
+
+                int CV_DECL_ALIGNED(16) prevVolumeUnitIdx[4] = {
+                    std::numeric_limits<int>::min(), std::numeric_limits<int>::min(),
+                    std::numeric_limits<int>::min(), 0 };
+
+                float tprev                = tcurr;
+                TsdfType prevTsdf          = volume.truncDist;
+                const TsdfVoxel* prevUnit  = nullptr;
+                while (tcurr < tmax)
+                {
+                    v_float32x4 currRayPos = orig + rayDirV * v_setall_f32(tcurr);
+
+                    v_int32x4 vVolumeUnitIdx = v_floor(currRayPos * vBlockSizeInv);
+                    int CV_DECL_ALIGNED(16) currVolumeUnitIdx[4];
+                    v_store_aligned(currVolumeUnitIdx, vVolumeUnitIdx);
+
+                    //! Consecutive steps mostly stay in the same volume unit
+                    const TsdfVoxel* currUnit = prevUnit;
+                    if (currVolumeUnitIdx[0] != prevVolumeUnitIdx[0] ||
+                        currVolumeUnitIdx[1] != prevVolumeUnitIdx[1] ||
+                        currVolumeUnitIdx[2] != prevVolumeUnitIdx[2])
+                    {
+                        currUnit = units(cv::Vec3i(currVolumeUnitIdx[0], currVolumeUnitIdx[1],
+                                                   currVolumeUnitIdx[2]));
+                    }
+
+                    TsdfType currTsdf = prevTsdf;
+                    int currWeight    = 0;
+                    float stepSize    = 0.5f * blockSize;
+
+                    //! Does the subvolume exist in hashtable
+                    if (currUnit)
+                    {
+                        v_float32x4 currVolUnitPos = v_cvt_f32(vVolumeUnitIdx) * vBlockSize;
+                        v_int32x4 volUnitLocalIdx =
+                            v_floor((currRayPos - currVolUnitPos) * invVoxelSize);
+
+                        //! Same bounds check as in atVolumeUnit()
+                        v_int32x4 outOfBounds = (volUnitLocalIdx < v_setzero_s32()) |
+                                                (volUnitLocalIdx >= upLimits);
+                        outOfBounds = outOfBounds & v_int32x4(-1, -1, -1, 0);
+                        if (!v_check_any(outOfBounds))
+                        {
+                            //! Nearest voxel, as in the scalar version
+                            const TsdfVoxel& currVoxel =
+                                currUnit[v_reduce_sum(volUnitLocalIdx * vStrides)];
+                            currTsdf   = currVoxel.tsdf;
+                            currWeight = currVoxel.weight;
+                        }
+                        else
+                        {
+                            currTsdf = 1.f;
+                        }
+                        stepSize = tstep;
+                    }
+                    //! Surface crossing
+                    if (prevTsdf > 0.f && currTsdf <= 0.f && currWeight > 0)
+                    {
+                        float tInterp =
+                            (tcurr * prevTsdf - tprev * currTsdf) / (prevTsdf - currTsdf);
+                        if (!cvIsNaN(tInterp) && !cvIsInf(tInterp))
+                        {
+                            v_float32x4 pv = orig + rayDirV * v_setall_f32(tInterp);
+                            v_float32x4 nv = getNormalVoxelWith(volume, units, pv * invVoxelSize);
+
+                            if (!isNaN(nv))
+                            {
+                                //! convert pv and nv to camera space
+                                normal = v_matmuladd(nv, volRot0, volRot1, volRot2, v_setzero_f32());
+                                point  = v_matmuladd(pv, volRot0, volRot1, volRot2, volTrans);
+                            }
+                        }
+                        break;
+                    }
+                    prevVolumeUnitIdx[0] = currVolumeUnitIdx[0];
+                    prevVolumeUnitIdx[1] = currVolumeUnitIdx[1];
+                    prevVolumeUnitIdx[2] = currVolumeUnitIdx[2];
+                    prevUnit             = currUnit;
+                    prevTsdf             = currTsdf;
+                    tprev                = tcurr;
+                    tcurr += stepSize;
+                }
+                v_store((float*)(&ptsRow[x]), point);
+                v_store((float*)(&nrmRow[x]), normal);
+            }
+        }
+    }
+#else
     virtual void operator()(const Range& range) const override
     {
         const Point3f cam2volTrans = cam2vol.translation();
@@ -353,6 +1127,9 @@ struct HashRaycastInvoker : ParallelLoopBody
 
         const float blockSize = volume.volumeUnitSize;
 
+        //! Rays go through paged out volume units as well
+        PagedOutVolumeUnits units(volume);
+
         for (int y = range.start; y < range.end; y++)
         {
             ptype* ptsRow = points[y];
@@ -376,15 +1153,18 @@ struct HashRaycastInvoker : ParallelLoopBody
                     cv::Vec3i(std::numeric_limits<int>::min(), std::numeric_limits<int>::min(),
                               std::numeric_limits<int>::min());
 
-                float tprev       = tcurr;
-                TsdfType prevTsdf = volume.truncDist;
-                cv::Ptr<TSDFVolumeCPU> currVolumeUnit;
+                float tprev               = tcurr;
+                TsdfType prevTsdf         = volume.truncDist;
+                const TsdfVoxel* prevUnit = nullptr;
                 while (tcurr < tmax)
                 {
                     Point3f currRayPos          = orig + tcurr * rayDirV;
                     cv::Vec3i currVolumeUnitIdx = volume.volumeToVolumeUnitIdx(currRayPos);
 
-                    VolumeUnitMap::const_iterator it = volume.volumeUnits.find(currVolumeUnitIdx);
+                    //! Consecutive steps mostly stay in the same volume unit
+                    const TsdfVoxel* currUnit = (currVolumeUnitIdx == prevVolumeUnitIdx)
+                                                    ? prevUnit
+                                                    : units(currVolumeUnitIdx);
 
                     TsdfType currTsdf = prevTsdf;
                     int currWeight    = 0;
@@ -392,16 +1172,14 @@ struct HashRaycastInvoker : ParallelLoopBody
                     cv::Vec3i volUnitLocalIdx;
 
                     //! Does the subvolume exist in hashtable
-                    if (it != volume.volumeUnits.end())
+                    if (currUnit)
                     {
-                        currVolumeUnit =
-                            std::dynamic_pointer_cast<TSDFVolumeCPU>(it->second.pVolume);
                         cv::Point3f currVolUnitPos =
                             volume.volumeUnitIdxToVolume(currVolumeUnitIdx);
                         volUnitLocalIdx = volume.volumeToVoxelCoord(currRayPos - currVolUnitPos);
 
                         //! TODO: Figure out voxel interpolation
-                        TsdfVoxel currVoxel = currVolumeUnit->at(volUnitLocalIdx);
+                        TsdfVoxel currVoxel = volume.atVolumeUnitData(currUnit, volUnitLocalIdx);
                         currTsdf            = currVoxel.tsdf;
                         currWeight          = currVoxel.weight;
                         stepSize            = tstep;
@@ -414,7 +1192,8 @@ struct HashRaycastInvoker : ParallelLoopBody
                         if (!cvIsNaN(tInterp) && !cvIsInf(tInterp))
                         {
                             Point3f pv = orig + tInterp * rayDirV;
-                            Point3f nv = volume.getNormalVoxel(pv);
+                            Point3f nv =
+                                getNormalVoxelWith(volume, units, pv * volume.voxelSizeInv);
 
                             if (!isNaN(nv))
                             {
@@ -425,6 +1204,7 @@ struct HashRaycastInvoker : ParallelLoopBody
                         break;
                     }
                     prevVolumeUnitIdx = currVolumeUnitIdx;
+                    prevUnit          = currUnit;
                     prevTsdf          = currTsdf;
                     tprev             = tcurr;
                     tcurr += stepSize;
@@ -434,6 +1214,7 @@ struct HashRaycastInvoker : ParallelLoopBody
             }
         }
     }
+#endif
 
     Points& points;
     Normals& normals;
@@ -463,105 +1244,161 @@ void HashTSDFVolumeCPU::raycast(const cv::Matx44f& cameraPose, const cv::kinfu::
     parallel_for_(Range(0, points.rows), ri, nstripes);
 }
 
+//! Points are fetched in two passes: the first one counts points of each volume unit,
+//! the second one writes them to the output at the offsets of volume units
 struct HashFetchPointsNormalsInvoker : ParallelLoopBody
 {
     HashFetchPointsNormalsInvoker(const HashTSDFVolumeCPU& _volume,
-                              const std::vector<Vec3i>& _totalVolUnits,
-                              std::vector<std::vector<ptype>>& _pVecs,
-                              std::vector<std::vector<ptype>>& _nVecs, bool _needNormals)
+                                  const std::vector<cv::Vec3i>& _pagedOutUnits,
+                                  std::vector<int>& _offsets, ptype* _points, ptype* _normals)
         : ParallelLoopBody(),
           volume(_volume),
-          totalVolUnits(_totalVolUnits),
-          pVecs(_pVecs),
-          nVecs(_nVecs),
-          needNormals(_needNormals)
+          pagedOutUnits(_pagedOutUnits),
+          offsets(_offsets),
+          points(_points),
+          normals(_normals)
     {
     }
 
-    virtual void operator()(const Range& range) const override
+    //! Counts points of the volume unit if there's no output
+    template<typename VolumeUnits>
+    inline int fetchVolumeUnit(const cv::Vec3i& tsdf_idx, const TsdfVoxel* volData,
+                               const VolumeUnits& units, ptype* unitPoints,
+                               ptype* unitNormals) const
     {
-        std::vector<ptype> points, normals;
-        for (int i = range.start; i < range.end; i++)
-        {
-            cv::Vec3i tsdf_idx = totalVolUnits[i];
+        int count = 0;
+        Point3f base_point = volume.volumeUnitIdxToVolume(tsdf_idx);
+        for (int x = 0; x < volume.volumeUnitResolution; x++)
+            for (int y = 0; y < volume.volumeUnitResolution; y++)
+                for (int z = 0; z < volume.volumeUnitResolution; z++)
+                {
+                    cv::Vec3i voxelIdx(x, y, z);
+                    TsdfVoxel voxel = volume.atVolumeUnitData(volData, voxelIdx);
 
-            VolumeUnitMap::const_iterator it = volume.volumeUnits.find(tsdf_idx);
-            Point3f base_point               = volume.volumeUnitIdxToVolume(tsdf_idx);
-            if (it != volume.volumeUnits.end())
-            {
-                cv::Ptr<TSDFVolumeCPU> volumeUnit =
-                    std::dynamic_pointer_cast<TSDFVolumeCPU>(it->second.pVolume);
-                std::vector<ptype> localPoints;
-                std::vector<ptype> localNormals;
-                for (int x = 0; x < volume.volumeUnitResolution; x++)
-                    for (int y = 0; y < volume.volumeUnitResolution; y++)
-                        for (int z = 0; z < volume.volumeUnitResolution; z++)
+                    if (voxel.tsdf != 1.f && voxel.weight != 0)
+                    {
+                        if (unitPoints)
                         {
-                            cv::Vec3i voxelIdx(x, y, z);
-                            TsdfVoxel voxel = volumeUnit->at(voxelIdx);
-
-                            if (voxel.tsdf != 1.f && voxel.weight != 0)
+                            Point3f point = base_point + volume.voxelCoordToVolume(voxelIdx);
+                            unitPoints[count] = toPtype(point);
+                            if (unitNormals)
                             {
-                                Point3f point = base_point + volume.voxelCoordToVolume(voxelIdx);
-                                localPoints.push_back(toPtype(point));
-                                if (needNormals)
-                                {
-                                    Point3f normal = volume.getNormalVoxel(point);
-                                    localNormals.push_back(toPtype(normal));
-                                }
+                                Point3f normal = getNormalVoxelWith(
+                                    volume, units, point * volume.voxelSizeInv);
+                                unitNormals[count] = toPtype(normal);
                             }
                         }
+                        count++;
+                    }
+                }
+        return count;
+    }
 
-                AutoLock al(mutex);
-                pVecs.push_back(localPoints);
-                nVecs.push_back(localNormals);
+    virtual void operator()(const Range& range) const override
+    {
+        const int nResident = (int)volume.volumeUnits.size();
+        std::vector<TsdfVoxel> pagedOutData;
+        //! Normals near paged out volume units need their voxels too
+        PagedOutVolumeUnits units(volume);
+        for (int i = range.start; i < range.end; i++)
+        {
+            ptype* unitPoints  = points ? points + offsets[i] : nullptr;
+            ptype* unitNormals = normals ? normals + offsets[i] : nullptr;
+            int count          = 0;
+            if (i < nResident)
+            {
+                count = fetchVolumeUnit(volume.volumeUnits[i].index,
+                                        volume.volUnitsData.ptr<TsdfVoxel>(i), units,
+                                        unitPoints, unitNormals);
             }
+            else
+            {
+                //! Paged out units are read one by one and are not brought back,
+                //! the block is kept out of the lookup cache which is emptied from time to time
+                const cv::Vec3i& tsdf_idx = pagedOutUnits[i - nResident];
+                pagedOutData.resize((size_t)volume.volumeUnitResolution *
+                                    volume.volumeUnitResolution * volume.volumeUnitResolution);
+                if (volume.pagedOutUnits.read(tsdf_idx, pagedOutData.data()))
+                    count = fetchVolumeUnit(tsdf_idx, pagedOutData.data(), units, unitPoints,
+                                            unitNormals);
+            }
+
+            if (!points)
+                offsets[i + 1] = count;
         }
     }
 
     const HashTSDFVolumeCPU& volume;
-    std::vector<cv::Vec3i> totalVolUnits;
-    std::vector<std::vector<ptype>>& pVecs;
-    std::vector<std::vector<ptype>>& nVecs;
-    const TsdfVoxel* volDataStart;
-    bool needNormals;
-    mutable Mutex mutex;
+    const std::vector<cv::Vec3i>& pagedOutUnits;
+    std::vector<int>& offsets;
+    ptype* points;
+    ptype* normals;
 };
 
+//! Returns offsets of volume units in the output, the last one is the number of points
+static std::vector<int> countPoints(const HashTSDFVolumeCPU& volume,
+                                    const std::vector<cv::Vec3i>& pagedOutIndices)
+{
+    const int nUnits = (int)(volume.volumeUnits.size() + pagedOutIndices.size());
+    std::vector<int> offsets(nUnits + 1, 0);
+    HashFetchPointsNormalsInvoker ci(volume, pagedOutIndices, offsets, nullptr, nullptr);
+    parallel_for_(Range(0, nUnits), ci);
+    for (size_t i = 1; i < offsets.size(); i++)
+        offsets[i] += offsets[i - 1];
+    return offsets;
+}
+
 void HashTSDFVolumeCPU::fetchPointsNormals(OutputArray _points, OutputArray _normals) const
 {
     CV_TRACE_FUNCTION();
 
     if (_points.needed())
     {
-        std::vector<std::vector<ptype>> pVecs, nVecs;
+        std::vector<cv::Vec3i> pagedOutIndices;
+        if (pagedOutUnits.isOpened())
+            pagedOutIndices = pagedOutUnits.indices();
+
+        std::vector<int> offsets = countPoints(*this, pagedOutIndices);
+        const int nPoints        = offsets.back();
 
-        std::vector<Vec3i> totalVolUnits;
-        for (const auto& keyvalue : volumeUnits)
+        _points.create(nPoints, 1, POINT_TYPE);
+        Mat points = _points.getMat(), normals;
+        if (_normals.needed())
         {
-            totalVolUnits.push_back(keyvalue.first);
+            _normals.create(nPoints, 1, POINT_TYPE);
+            normals = _normals.getMat();
         }
-        HashFetchPointsNormalsInvoker fi(*this, totalVolUnits, pVecs, nVecs, _normals.needed());
-        Range range(0, (int)totalVolUnits.size());
-        const int nstripes = -1;
-        parallel_for_(range, fi, nstripes);
-        std::vector<ptype> points, normals;
-        for (size_t i = 0; i < pVecs.size(); i++)
+
+        if (nPoints > 0)
         {
-            points.insert(points.end(), pVecs[i].begin(), pVecs[i].end());
-            normals.insert(normals.end(), nVecs[i].begin(), nVecs[i].end());
+            HashFetchPointsNormalsInvoker fi(*this, pagedOutIndices, offsets,
+                                             points.ptr<ptype>(),
+                                             normals.empty() ? nullptr : normals.ptr<ptype>());
+            parallel_for_(Range(0, (int)offsets.size() - 1), fi);
         }
+    }
+}
 
-        _points.create((int)points.size(), 1, POINT_TYPE);
-        if (!points.empty())
-            Mat((int)points.size(), 1, POINT_TYPE, &points[0]).copyTo(_points.getMat());
+void HashTSDFVolumeCPU::fetchPointsNormalsToBuffers(Mat& points, Mat& normals, bool needNormals) const
+{
+    CV_TRACE_FUNCTION();
 
-        if (_normals.needed())
-        {
-            _normals.create((int)normals.size(), 1, POINT_TYPE);
-            if (!normals.empty())
-                Mat((int)normals.size(), 1, POINT_TYPE, &normals[0]).copyTo(_normals.getMat());
-        }
+    std::vector<cv::Vec3i> pagedOutIndices;
+    if (pagedOutUnits.isOpened())
+        pagedOutIndices = pagedOutUnits.indices();
+
+    std::vector<int> offsets = countPoints(*this, pagedOutIndices);
+    const int nPoints        = offsets.back();
+
+    resizePointsBuffer(points, nPoints);
+    if (needNormals)
+        resizePointsBuffer(normals, nPoints);
+
+    if (nPoints > 0)
+    {
+        HashFetchPointsNormalsInvoker fi(*this, pagedOutIndices, offsets, points.ptr<ptype>(),
+                                         needNormals ? normals.ptr<ptype>() : nullptr);
+        parallel_for_(Range(0, (int)offsets.size() - 1), fi);
     }
 }
 
@@ -577,22 +1414,163 @@ void HashTSDFVolumeCPU::fetchNormals(cv::InputArray _points, cv::OutputArray _no
         _normals.createSameSize(_points, _points.type());
         Normals normals = _normals.getMat();
 
-        const HashTSDFVolumeCPU& _volume = *this;
-        auto HashPushNormals = [&](const ptype& point, const int* position)
+        const Affine3f invPose(pose.inv());
+        parallel_for_(Range(0, points.rows), [&](const Range& range) {
+            //! Points may lie in paged out volume units or next to them
+            PagedOutVolumeUnits units(*this);
+            for (int y = range.start; y < range.end; y++)
+            {
+                for (int x = 0; x < points.cols; x++)
+                {
+                    Point3f p = fromPtype(points(y, x));
+                    Point3f n = nan3;
+                    if (!isNaN(p))
+                    {
+                        Point3f voxelPoint = invPose * p;
+                        n = pose.rotation() *
+                            getNormalVoxelWith(*this, units, voxelPoint * voxelSizeInv);
+                    }
+                    normals(y, x) = toPtype(n);
+                }
+            }
+        });
+    }
+}
+
+struct HashMeshUnitsInvoker : ParallelLoopBody
+{
+    HashMeshUnitsInvoker(const HashTSDFVolumeCPU& _volume, const std::vector<cv::Vec3i>& _units,
+                         std::vector<std::vector<ptype>>& _meshes)
+        : ParallelLoopBody(), volume(_volume), units(_units), meshes(_meshes)
+    {
+        for (int i = 0; i < 8; i++)
+            cornerCoords[i] =
+                volume.volStrides.dot(Vec4i(mcCorners[i][0], mcCorners[i][1], mcCorners[i][2]));
+    }
+
+    //! Voxel block of the volume unit, paged out units are read to the given buffer
+    inline const TsdfVoxel* unitData(const cv::Vec3i& idx, std::vector<TsdfVoxel>& buf) const
+    {
+        int slot = volume.volumeUnitIndexes.find(idx);
+        if (slot >= 0)
+            return volume.volUnitsData.ptr<TsdfVoxel>(slot);
+        if (volume.pagedOutUnits.isOpened())
+        {
+            buf.resize((size_t)volume.volumeUnitResolution * volume.volumeUnitResolution *
+                       volume.volumeUnitResolution);
+            if (volume.pagedOutUnits.read(idx, buf.data()))
+                return buf.data();
+        }
+        return nullptr;
+    }
+
+    virtual void operator()(const Range& range) const override
+    {
+        const int res = volume.volumeUnitResolution;
+        std::vector<TsdfVoxel> buffers[8];
+        std::vector<Point3f> triangles;
+        for (int i = range.start; i < range.end; i++)
         {
-            const HashTSDFVolumeCPU& volume(_volume);
-            Affine3f invPose(volume.pose.inv());
-            Point3f p = fromPtype(point);
-            Point3f n = nan3;
-            if (!isNaN(p))
+            const cv::Vec3i& idx = units[i];
+            triangles.clear();
+
+            //! The unit itself and its upper neighbours which hold corners of border cells,
+            //! indexed by (dx*4 + dy*2 + dz)
+            const TsdfVoxel* blocks[8];
+            for (int n = 0; n < 8; n++)
+                blocks[n] = unitData(idx + cv::Vec3i(n >> 2, (n >> 1) & 1, n & 1), buffers[n]);
+
+            if (blocks[0])
             {
-                Point3f voxelPoint = invPose * p;
-                n = volume.pose.rotation() * volume.getNormalVoxel(voxelPoint);
+                for (int x = 0; x < res; x++)
+                    for (int y = 0; y < res; y++)
+                        for (int z = 0; z < res; z++)
+                        {
+                            const TsdfVoxel* voxel = blocks[0] + x * volume.volStrides[0] +
+                                                     y * volume.volStrides[1] +
+                                                     z * volume.volStrides[2];
+                            if (voxel->weight == 0)
+                                continue;
+
+                            const bool inner = x < res - 1 && y < res - 1 && z < res - 1;
+                            int cubeIndex       = 0;
+                            float tsdfValues[8] = { 0 };
+                            for (int c = 0; c < 8; c++)
+                            {
+                                TsdfVoxel corner;
+                                if (inner)
+                                {
+                                    corner = voxel[cornerCoords[c]];
+                                }
+                                else
+                                {
+                                    cv::Vec3i v(x + mcCorners[c][0], y + mcCorners[c][1],
+                                                z + mcCorners[c][2]);
+                                    cv::Vec3i d(v[0] >= res, v[1] >= res, v[2] >= res);
+                                    const TsdfVoxel* block = blocks[d[0] * 4 + d[1] * 2 + d[2]];
+                                    if (!block)
+                                        continue;
+                                    corner = volume.atVolumeUnitData(block, v - d * res);
+                                }
+                                if (corner.weight == 0)
+                                    continue;
+                                tsdfValues[c] = corner.tsdf;
+                                if (corner.tsdf <= 0)
+                                    cubeIndex |= (1 << c);
+                            }
+                            marchCube(Point3f((float)x, (float)y, (float)z), tsdfValues,
+                                      cubeIndex, triangles);
+                        }
             }
-            normals(position[0], position[1]) = toPtype(n);
-        };
-        points.forEach(HashPushNormals);
+
+            const Point3f unitPos = volume.volumeUnitIdxToVolume(idx);
+            std::vector<ptype>& mesh = meshes[i];
+            mesh.reserve(triangles.size());
+            for (const Point3f& t : triangles)
+                mesh.push_back(toPtype(volume.pose * (unitPos + t * volume.voxelSize)));
+        }
     }
+
+    const HashTSDFVolumeCPU& volume;
+    const std::vector<cv::Vec3i>& units;
+    std::vector<std::vector<ptype>>& meshes;
+    int cornerCoords[8];
+};
+
+void HashTSDFVolumeCPU::fetchMeshUpdates(OutputArray _blockIndices,
+                                         OutputArrayOfArrays _blockMeshes)
+{
+    CV_TRACE_FUNCTION();
+
+    //! Cells of a volume unit have corners in its upper neighbours,
+    //! so lower neighbours of changed units are polygonized as well
+    VolumeUnitIndexSet changed;
+    for (const cv::Vec3i& idx : dirtyUnits)
+    {
+        for (int n = 0; n < 8; n++)
+        {
+            cv::Vec3i neighbour = idx - cv::Vec3i(n >> 2, (n >> 1) & 1, n & 1);
+            if (n == 0 || volumeUnitIndexes.find(neighbour) >= 0 ||
+                pagedOutUnits.contains(neighbour) || meshedUnits.count(neighbour))
+                changed.insert(neighbour);
+        }
+    }
+    dirtyUnits.clear();
+
+    std::vector<cv::Vec3i> units(changed.begin(), changed.end());
+    std::vector<std::vector<ptype>> meshes(units.size());
+    HashMeshUnitsInvoker mi(*this, units, meshes);
+    parallel_for_(Range(0, (int)units.size()), mi);
+
+    for (size_t i = 0; i < units.size(); i++)
+    {
+        if (meshes[i].empty())
+            meshedUnits.erase(units[i]);
+        else
+            meshedUnits.insert(units[i]);
+    }
+
+    writeMeshUpdates(units, meshes, _blockIndices, _blockMeshes);
 }
 
 cv::Ptr<HashTSDFVolume> makeHashTSDFVolume(float _voxelSize, cv::Matx44f _pose,
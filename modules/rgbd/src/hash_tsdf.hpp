@@ -6,8 +6,10 @@
 #define __OPENCV_HASH_TSDF_H__
 
 #include <opencv2/rgbd/volume.hpp>
+#include <fstream>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "tsdf.hpp"
 
@@ -26,6 +28,11 @@ class HashTSDFVolume : public Volume
 
     virtual ~HashTSDFVolume() = default;
 
+    //! Page volume units farther than residentRadius (in meters) from the camera out to the file
+    //! at storagePath and bring them back when they are accessed again.
+    //! Temporary file is used if storagePath is empty, residentRadius <= 0 disables paging.
+    virtual void setPaging(const String& storagePath, float residentRadius) = 0;
+
    public:
     int maxWeight;
     float truncDist;
@@ -37,12 +44,10 @@ class HashTSDFVolume : public Volume
 
 struct VolumeUnit
 {
-    VolumeUnit() : pVolume(nullptr){};
-    ~VolumeUnit() = default;
-
-    cv::Ptr<TSDFVolume> pVolume;
     cv::Vec3i index;
     bool isActive;
+    //! Voxels were integrated since the volume unit was paged in
+    bool isModified;
 };
 
 //! Spatial hashing
@@ -61,7 +66,114 @@ struct tsdf_hash
 };
 
 typedef std::unordered_set<cv::Vec3i, tsdf_hash> VolumeUnitIndexSet;
-typedef std::unordered_map<cv::Vec3i, VolumeUnit, tsdf_hash> VolumeUnitMap;
+
+//! Open addressing (linear probing) hash table which maps volume unit indices
+//! to slots of the contiguous voxel pool, slots are given out in insertion order
+class VolumeUnitIndexes
+{
+   public:
+    VolumeUnitIndexes(int _capacity = 1024);
+
+    //! Returns the slot of the volume unit or -1 if it is not allocated
+    inline int find(const cv::Vec3i& idx) const
+    {
+        size_t i = hash(idx) & mask;
+        for (;;)
+        {
+            const Entry& e = entries[i];
+            if (e.slot < 0)
+                return -1;
+            if (e.idx == idx)
+                return e.slot;
+            i = (i + 1) & mask;
+        }
+    }
+
+    //! Returns the slot of the volume unit, allocates the next free slot if it's not found
+    int insert(const cv::Vec3i& idx, bool& inserted);
+    //! Removes the volume unit, the caller is responsible for keeping slots dense
+    void erase(const cv::Vec3i& idx);
+    //! Moves the volume unit to another slot
+    void setSlot(const cv::Vec3i& idx, int slot);
+
+    int size() const { return count; }
+    void clear();
+
+   private:
+    struct Entry
+    {
+        cv::Vec3i idx;
+        int slot;
+    };
+
+    static inline size_t hash(const cv::Vec3i& idx)
+    {
+        // Teschner et al., "Optimized Spatial Hashing for Collision Detection of Deformable Objects"
+        return (size_t)(((uint32_t)idx[0] * 73856093u) ^ ((uint32_t)idx[1] * 19349669u) ^
+                        ((uint32_t)idx[2] * 83492791u));
+    }
+
+    void rehash(int newCapacity);
+
+    std::vector<Entry> entries;
+    size_t mask;
+    int count;
+};
+
+//! Keeps volume units paged out of memory as fixed-size voxel blocks in one binary file.
+//! Blocks of volume units which were paged back in stay in the file until they are paged out
+//! again, so that unchanged volume units are not written twice.
+//! Lookups are not locked, the store must not be changed while it's read from other threads.
+class VolumeUnitStore
+{
+   public:
+    VolumeUnitStore();
+    ~VolumeUnitStore();
+
+    //! Creates an empty store, temporary file is used if path is empty
+    void open(const String& path, size_t blockSize);
+    bool isOpened() const { return file.is_open(); }
+    void close();
+
+    //! Whether the volume unit is paged out
+    bool contains(const cv::Vec3i& idx) const
+    {
+        auto it = blocks.find(idx);
+        return it != blocks.end() && it->second.pagedOut;
+    }
+    //! Number of paged out volume units
+    size_t size() const { return nPagedOut; }
+    std::vector<cv::Vec3i> indices() const;
+
+    //! Pages the volume unit out, replaces its stored voxel block if it exists
+    void write(const cv::Vec3i& idx, const void* data);
+    //! Reads voxel block of the paged out volume unit, returns false if it's not paged out
+    bool read(const cv::Vec3i& idx, void* data) const;
+    //! Reads voxel block of the paged out volume unit and pages it in,
+    //! the block is kept as a copy for restore()
+    bool take(const cv::Vec3i& idx, void* data);
+    //! Pages out the volume unit given by take() using the kept block,
+    //! returns false if there's no such block and the volume unit should be written
+    bool restore(const cv::Vec3i& idx);
+    void clear();
+
+   private:
+    struct Block
+    {
+        int64 offset;
+        bool pagedOut;
+    };
+
+    String path;
+    bool removeOnClose;
+    size_t blockSize;
+    int64 fileSize;
+    mutable std::fstream file;
+    std::unordered_map<cv::Vec3i, Block, tsdf_hash> blocks;
+    size_t nPagedOut;
+    std::vector<int64> freeOffsets;
+    mutable Mutex mutex;
+};
 
 class HashTSDFVolumeCPU : public HashTSDFVolume
 {
@@ -79,9 +191,16 @@ class HashTSDFVolumeCPU : public HashTSDFVolume
 
     virtual void fetchNormals(cv::InputArray points, cv::OutputArray _normals) const override;
     virtual void fetchPointsNormals(cv::OutputArray points, cv::OutputArray normals) const override;
+    virtual void fetchPointsNormalsToBuffers(Mat& points, Mat& normals, bool needNormals) const override;
 
     virtual void reset() override;
 
+    //! Volume units are the blocks of the mesh
+    virtual void fetchMeshUpdates(cv::OutputArray blockIndices,
+                                  cv::OutputArrayOfArrays blockMeshes) override;
+
+    virtual void setPaging(const String& storagePath, float residentRadius) override;
+
     //! Return the voxel given the voxel index in the universal volume (1 unit = 1 voxel_length)
     virtual TsdfVoxel at(const cv::Vec3i& volumeIdx) const;
 
@@ -89,9 +208,16 @@ class HashTSDFVolumeCPU : public HashTSDFVolume
     //! 1m)
     virtual TsdfVoxel at(const cv::Point3f& point) const;
 
+    //! Trilinear interpolation of TSDF and its gradient, point is in volume coordinate system,
+    //! voxels of neighbouring volume units are taken into account
     inline TsdfType interpolateVoxel(const cv::Point3f& point) const;
     Point3f getNormalVoxel(cv::Point3f p) const;
 
+#if USE_INTRINSICS
+    inline TsdfType interpolateVoxel(const v_float32x4& point) const;
+    v_float32x4 getNormalVoxel(const v_float32x4& point) const;
+#endif
+
     //! Utility functions for coordinate transformations
     cv::Vec3i volumeToVolumeUnitIdx(cv::Point3f point) const;
     cv::Point3f volumeUnitIdxToVolume(cv::Vec3i volumeUnitIdx) const;
@@ -99,9 +225,57 @@ class HashTSDFVolumeCPU : public HashTSDFVolume
     cv::Point3f voxelCoordToVolume(cv::Vec3i voxelIdx) const;
     cv::Vec3i volumeToVoxelCoord(cv::Point3f point) const;
 
+    //! Returns the voxel of the volume unit stored at given slot, volUnitLocalIdx is in voxels
+    inline TsdfVoxel atVolumeUnit(int slot, const cv::Vec3i& volUnitLocalIdx) const
+    {
+        return atVolumeUnitData(volUnitsData.ptr<TsdfVoxel>(slot), volUnitLocalIdx);
+    }
+
+    //! Same as atVolumeUnit() for a voxel block which is not in the pool
+    inline TsdfVoxel atVolumeUnitData(const TsdfVoxel* volData,
+                                      const cv::Vec3i& volUnitLocalIdx) const
+    {
+        if ((volUnitLocalIdx[0] >= volumeUnitResolution || volUnitLocalIdx[0] < 0) ||
+            (volUnitLocalIdx[1] >= volumeUnitResolution || volUnitLocalIdx[1] < 0) ||
+            (volUnitLocalIdx[2] >= volumeUnitResolution || volUnitLocalIdx[2] < 0))
+        {
+            TsdfVoxel dummy;
+            dummy.tsdf   = 1.0f;
+            dummy.weight = 0;
+            return dummy;
+        }
+        return volData[volUnitLocalIdx[0] * volStrides[0] + volUnitLocalIdx[1] * volStrides[1] +
+                       volUnitLocalIdx[2] * volStrides[2]];
+    }
+
+    //! Makes sure the voxel pool has rows for all slots given out by volumeUnitIndexes,
+    //! rows starting from firstNewSlot are read from the paged out store or zeroed
+    void allocateVolumeUnitsData(int firstNewSlot);
+
+    //! Moves volume units farther than pagingRadius from the camera to the paged out store,
+    //! only the ones integrated since they were paged in are written
+    void pageOutVolumeUnits(const cv::Matx44f& cameraPose);
+
    public:
-    //! Hashtable of individual smaller volume units
-    VolumeUnitMap volumeUnits;
+    //! Hashtable of individual smaller volume units: maps volume unit index to its slot
+    VolumeUnitIndexes volumeUnitIndexes;
+    //! Volume units info indexed by slot
+    std::vector<VolumeUnit> volumeUnits;
+    //! Voxels of all volume units, one row per slot,
+    //! each row is laid out as TSDFVolumeCPU::volume with volStrides
+    Mat volUnitsData;
+    Vec4i volStrides;
+    //! Offsets of the 8 voxels of a cell inside a volume unit, as in TSDFVolume
+    Vec8i neighbourCoords;
+
+    //! Volume units paged out of memory
+    VolumeUnitStore pagedOutUnits;
+    float pagingRadius;
+
+    //! Volume units integrated since the last mesh update
+    VolumeUnitIndexSet dirtyUnits;
+    //! Volume units which had a non-empty mesh at the last mesh update
+    VolumeUnitIndexSet meshedUnits;
 };
 cv::Ptr<HashTSDFVolume> makeHashTSDFVolume(float _voxelSize, cv::Matx44f _pose,
                                            float _raycastStepFactor, float _truncDist,
@@ -10,6 +10,16 @@
 #include "hash_tsdf.hpp"
 #include "kinfu_frame.hpp"
 
+#include <functional>
+#include <type_traits>
+
+#ifndef OPENCV_DISABLE_THREAD_SUPPORT
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#endif
+
 namespace cv {
 namespace kinfu {
 
@@ -76,6 +86,17 @@ Ptr<Params> Params::defaultParams()
     // depth truncation is not used by default but can be useful in some scenes
     p.truncateThreshold = 0.f; //meters
 
+    // all HashTSDF volume units are kept in memory by default
+    p.volumeUnitPagingRadius = 0.f; //meters
+    p.volumeUnitPagingPath = String();
+
+    // used by MULTIRES_HASHTSDF volume only
+    p.volumeLevels = 3;
+    p.volumeLevelDistance = 1.f; //meters
+
+    // all frame processing steps run one after another by default
+    p.pipelined = false;
+
     return makePtr<Params>(p);
 }
 
@@ -107,6 +128,130 @@ Ptr<Params> Params::hashTSDFParams(bool isCoarse)
     return p;
 }
 
+Ptr<Params> Params::multiResHashTSDFParams(bool isCoarse)
+{
+    Ptr<Params> p = hashTSDFParams(isCoarse);
+    p->volumeType = VolumeType::MULTIRES_HASHTSDF;
+    return p;
+}
+
+#ifndef OPENCV_DISABLE_THREAD_SUPPORT
+//! Runs jobs one by one on its own thread in the order they were submitted.
+//! submit() blocks while the queue is full, so the producer can't run ahead too far.
+//! Exceptions thrown by a job are rethrown in the next submit() or wait() call.
+class PipelineWorker
+{
+public:
+    explicit PipelineWorker(size_t _capacity = 1);
+    ~PipelineWorker();
+
+    void submit(const std::function<void()>& job);
+    //! Blocks until all submitted jobs are done
+    void wait();
+
+private:
+    void run();
+    void rethrowError();
+
+    const size_t capacity;
+    std::deque< std::function<void()> > jobs;
+    bool busy;
+    bool stopping;
+    std::exception_ptr error;
+
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::thread thread;
+};
+
+PipelineWorker::PipelineWorker(size_t _capacity) :
+    capacity(std::max(_capacity, (size_t)1)),
+    jobs(), busy(false), stopping(false), error()
+{
+    thread = std::thread(&PipelineWorker::run, this);
+}
+
+PipelineWorker::~PipelineWorker()
+{
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cond.notify_all();
+    thread.join();
+}
+
+void PipelineWorker::submit(const std::function<void()>& job)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [this]() { return jobs.size() < capacity; });
+    rethrowError();
+    jobs.push_back(job);
+    cond.notify_all();
+}
+
+void PipelineWorker::wait()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cond.wait(lock, [this]() { return jobs.empty() && !busy; });
+    rethrowError();
+}
+
+void PipelineWorker::rethrowError()
+{
+    if(error)
+    {
+        std::exception_ptr e = error;
+        error = std::exception_ptr();
+        std::rethrow_exception(e);
+    }
+}
+
+void PipelineWorker::run()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while(true)
+    {
+        cond.wait(lock, [this]() { return stopping || !jobs.empty(); });
+        if(jobs.empty())
+            break;
+
+        std::function<void()> job = jobs.front();
+        jobs.pop_front();
+        busy = true;
+        // a slot in the queue is free now
+        cond.notify_all();
+
+        lock.unlock();
+        try
+        {
+            job();
+        }
+        catch(...)
+        {
+            lock.lock();
+            error = std::current_exception();
+            lock.unlock();
+        }
+        lock.lock();
+
+        busy = false;
+        cond.notify_all();
+    }
+}
+#else
+//! Builds without thread support run the jobs right away
+class PipelineWorker
+{
+public:
+    explicit PipelineWorker(size_t /*_capacity*/ = 1) { }
+
+    void submit(const std::function<void()>& job) { job(); }
+    void wait() { }
+};
+#endif
+
+
 // MatType should be Mat or UMat
 template< typename MatType>
 class KinFuImpl : public KinFu
@@ -123,6 +268,7 @@ public:
     virtual void getCloud(OutputArray points, OutputArray normals) const CV_OVERRIDE;
     void getPoints(OutputArray points) const CV_OVERRIDE;
     void getNormals(InputArray points, OutputArray normals) const CV_OVERRIDE;
+    void getMeshUpdates(OutputArray blockIndices, OutputArrayOfArrays blockMeshes) CV_OVERRIDE;
 
     void reset() CV_OVERRIDE;
 
@@ -133,6 +279,11 @@ public:
     bool updateT(const MatType& depth);
 
 private:
+    //! Runs the job on the worker thread in pipelined mode, immediately otherwise
+    void runModelJob(const std::function<void()>& job);
+    //! Waits until the model is updated by all the frames passed
+    void syncModel() const;
+
     Params params;
 
     cv::Ptr<ICP> icp;
@@ -142,6 +293,9 @@ private:
     Matx44f pose;
     std::vector<MatType> pyrPoints;
     std::vector<MatType> pyrNormals;
+
+    //! Integrates and raycasts frames in pipelined mode, empty otherwise
+    cv::Ptr<PipelineWorker> worker;
 };
 
 
@@ -151,14 +305,42 @@ KinFuImpl<MatType>::KinFuImpl(const Params &_params) :
     icp(makeICP(params.intr, params.icpIterations, params.icpAngleThresh, params.icpDistThresh)),
     pyrPoints(), pyrNormals()
 {
-    volume = makeVolume(params.volumeType, params.voxelSize, params.volumePose.matrix, params.raycast_step_factor,
-                        params.tsdf_trunc_dist, params.tsdf_max_weight, params.truncateThreshold, params.volumeDims);
+    volume = makeVolume(makePtr<Params>(params));
+    if(params.volumeUnitPagingRadius > 0)
+    {
+        if(params.volumeType != VolumeType::HASHTSDF)
+            CV_Error(Error::StsNotImplemented, "Volume unit paging is supported by HASHTSDF volume only");
+        volume.dynamicCast<HashTSDFVolume>()->setPaging(params.volumeUnitPagingPath,
+                                                        params.volumeUnitPagingRadius);
+    }
+    // OpenCL implementation stays sequential
+    if(params.pipelined && std::is_same<MatType, Mat>::value)
+    {
+        worker = makePtr<PipelineWorker>();
+    }
     reset();
 }
 
+template< typename MatType >
+void KinFuImpl<MatType>::runModelJob(const std::function<void()>& job)
+{
+    if(worker)
+        worker->submit(job);
+    else
+        job();
+}
+
+template< typename MatType >
+void KinFuImpl<MatType>::syncModel() const
+{
+    if(worker)
+        worker->wait();
+}
+
 template< typename MatType >
 void KinFuImpl<MatType >::reset()
 {
+    syncModel();
     frameCounter = 0;
     pose = Affine3f::Identity().matrix;
     volume->reset();
@@ -166,7 +348,10 @@ void KinFuImpl<MatType >::reset()
 
 template< typename MatType >
 KinFuImpl<MatType>::~KinFuImpl()
-{ }
+{
+    // the worker may be still busy with the last frame
+    worker.release();
+}
 
 template< typename MatType >
 const Params& KinFuImpl<MatType>::getParams() const
@@ -225,10 +410,13 @@ bool KinFuImpl<MatType>::updateT(const MatType& _depth)
     MatType depth;
     if(_depth.type() != DEPTH_TYPE)
         _depth.convertTo(depth, DEPTH_TYPE);
+    else if(worker)
+        // the caller may overwrite its buffer while the frame is being integrated
+        depth = _depth.clone();
     else
         depth = _depth;
 
-
+    // in pipelined mode the previous frame is being integrated meanwhile
     std::vector<MatType> newPoints, newNormals;
     makeFrameFromDepth(depth, newPoints, newNormals, params.intr,
                        params.pyramidLevels,
@@ -239,13 +427,22 @@ bool KinFuImpl<MatType>::updateT(const MatType& _depth)
                        params.truncateThreshold);
     if(frameCounter == 0)
     {
-        // use depth instead of distance
-        volume->integrate(depth, params.depthFactor, pose, params.intr);
+        syncModel();
         pyrPoints  = newPoints;
         pyrNormals = newNormals;
+
+        const Matx44f framePose = pose;
+        runModelJob([this, depth, framePose]()
+        {
+            // use depth instead of distance
+            volume->integrate(depth, params.depthFactor, framePose, params.intr);
+        });
     }
     else
     {
+        // ICP needs the model raycasted from the previous frame
+        syncModel();
+
         Affine3f affine;
         bool success = icp->estimateTransform(affine, pyrPoints, pyrNormals, newPoints, newNormals);
         if(!success)
@@ -256,16 +453,22 @@ bool KinFuImpl<MatType>::updateT(const MatType& _depth)
         float rnorm = (float)cv::norm(affine.rvec());
         float tnorm = (float)cv::norm(affine.translation());
         // We do not integrate volume if camera does not move
-        if((rnorm + tnorm)/2 >= params.tsdf_min_camera_movement)
+        bool integrate = (rnorm + tnorm)/2 >= params.tsdf_min_camera_movement;
+
+        const Matx44f framePose = pose;
+        runModelJob([this, depth, framePose, integrate]()
         {
-            // use depth instead of distance
-            volume->integrate(depth, params.depthFactor, pose, params.intr);
-        }
-        MatType& points  = pyrPoints [0];
-        MatType& normals = pyrNormals[0];
-        volume->raycast(pose, params.intr, params.frameSize, points, normals);
-        buildPyramidPointsNormals(points, normals, pyrPoints, pyrNormals,
-                                  params.pyramidLevels);
+            if(integrate)
+            {
+                // use depth instead of distance
+                volume->integrate(depth, params.depthFactor, framePose, params.intr);
+            }
+            MatType& points  = pyrPoints [0];
+            MatType& normals = pyrNormals[0];
+            volume->raycast(framePose, params.intr, params.frameSize, points, normals);
+            buildPyramidPointsNormals(points, normals, pyrPoints, pyrNormals,
+                                      params.pyramidLevels);
+        });
     }
 
     frameCounter++;
@@ -278,6 +481,8 @@ void KinFuImpl<MatType>::render(OutputArray image, const Matx44f& _cameraPose) c
 {
     CV_TRACE_FUNCTION();
 
+    syncModel();
+
     Affine3f cameraPose(_cameraPose);
     Affine3f _pose(pose);
 
@@ -299,6 +504,7 @@ void KinFuImpl<MatType>::render(OutputArray image, const Matx44f& _cameraPose) c
 template< typename MatType >
 void KinFuImpl<MatType>::getCloud(OutputArray p, OutputArray n) const
 {
+    syncModel();
     volume->fetchPointsNormals(p, n);
 }
 
@@ -306,6 +512,7 @@ void KinFuImpl<MatType>::getCloud(OutputArray p, OutputArray n) const
 template< typename MatType >
 void KinFuImpl<MatType>::getPoints(OutputArray points) const
 {
+    syncModel();
     volume->fetchPointsNormals(points, noArray());
 }
 
@@ -313,9 +520,18 @@ void KinFuImpl<MatType>::getPoints(OutputArray points) const
 template< typename MatType >
 void KinFuImpl<MatType>::getNormals(InputArray points, OutputArray normals) const
 {
+    syncModel();
     volume->fetchNormals(points, normals);
 }
 
+
+template< typename MatType >
+void KinFuImpl<MatType>::getMeshUpdates(OutputArray blockIndices, OutputArrayOfArrays blockMeshes)
+{
+    syncModel();
+    volume->fetchMeshUpdates(blockIndices, blockMeshes);
+}
+
 // importing class
 
 #ifdef OPENCV_ENABLE_NONFREE
@@ -917,51 +917,14 @@ static void orUnaligned8u(const uchar * src, const int src_stride,
                    uchar * dst, const int dst_stride,
                    const int width, const int height)
 {
-#if CV_SSE2
-  volatile bool haveSSE2 = checkHardwareSupport(CPU_SSE2);
-#if CV_SSE3
-  volatile bool haveSSE3 = checkHardwareSupport(CPU_SSE3);
-#endif
-  bool src_aligned = reinterpret_cast<unsigned long long>(src) % 16 == 0;
-#endif
-
   for (int r = 0; r < height; ++r)
   {
     int c = 0;
 
-#if CV_SSE2
-    // Use aligned loads if possible
-    if (haveSSE2 && src_aligned)
-    {
-      for ( ; c < width - 15; c += 16)
-      {
-        const __m128i* src_ptr = reinterpret_cast<const __m128i*>(src + c);
-        __m128i* dst_ptr = reinterpret_cast<__m128i*>(dst + c);
-        *dst_ptr = _mm_or_si128(*dst_ptr, *src_ptr);
-      }
-    }
-#if CV_SSE3
-    // Use LDDQU for fast unaligned load
-    else if (haveSSE3)
-    {
-      for ( ; c < width - 15; c += 16)
-      {
-        __m128i val = _mm_lddqu_si128(reinterpret_cast<const __m128i*>(src + c));
-        __m128i* dst_ptr = reinterpret_cast<__m128i*>(dst + c);
-        *dst_ptr = _mm_or_si128(*dst_ptr, val);
-      }
-    }
-#endif
-    // Fall back to MOVDQU
-    else if (haveSSE2)
-    {
-      for ( ; c < width - 15; c += 16)
-      {
-        __m128i val = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c));
-        __m128i* dst_ptr = reinterpret_cast<__m128i*>(dst + c);
-        *dst_ptr = _mm_or_si128(*dst_ptr, val);
-      }
-    }
+#if CV_SIMD
+    // Unaligned loads are as fast as aligned ones on current hardware
+    for ( ; c <= width - v_uint8::nlanes; c += v_uint8::nlanes)
+      v_store(dst + c, vx_load(dst + c) | vx_load(src + c));
 #endif
     for ( ; c < width; ++c)
       dst[c] |= src[c];
@@ -1165,8 +1128,8 @@ static void similarity(const std::vector<Mat>& linear_memories, const Template&
 {
   // 63 features or less is a special case because the max similarity per-feature is 4.
   // 255/4 = 63, so up to that many we can add up similarities in 8 bits without worrying
-  // about overflow. Therefore here we use _mm_add_epi8 as the workhorse, whereas a more
-  // general function would use _mm_add_epi16.
+  // about overflow. Therefore here we use 8-bit addition as the workhorse, whereas a more
+  // general function would use 16-bit one.
   CV_Assert(templ.features.size() <= 63);
   /// @todo Handle more than 255/MAX_RESPONSE features!!
 
@@ -1193,13 +1156,6 @@ static void similarity(const std::vector<Mat>& linear_memories, const Template&
   dst = Mat::zeros(H, W, CV_8U);
   uchar* dst_ptr = dst.ptr<uchar>();
 
-#if CV_SSE2
-  volatile bool haveSSE2 = checkHardwareSupport(CV_CPU_SSE2);
-#if CV_SSE3
-  volatile bool haveSSE3 = checkHardwareSupport(CV_CPU_SSE3);
-#endif
-#endif
-
   // Compute the similarity measure for this template by accumulating the contribution of
   // each feature
   for (int i = 0; i < (int)templ.features.size(); ++i)
@@ -1215,31 +1171,10 @@ static void similarity(const std::vector<Mat>& linear_memories, const Template&
 
     // Now we do an aligned/unaligned add of dst_ptr and lm_ptr with template_positions elements
     int j = 0;
-    // Process responses 16 at a time if vectorization possible
-#if CV_SSE2
-#if CV_SSE3
-    if (haveSSE3)
-    {
-      // LDDQU may be more efficient than MOVDQU for unaligned load of next 16 responses
-      for ( ; j < template_positions - 15; j += 16)
-      {
-        __m128i responses = _mm_lddqu_si128(reinterpret_cast<const __m128i*>(lm_ptr + j));
-        __m128i* dst_ptr_sse = reinterpret_cast<__m128i*>(dst_ptr + j);
-        *dst_ptr_sse = _mm_add_epi8(*dst_ptr_sse, responses);
-      }
-    }
-    else
-#endif
-    if (haveSSE2)
-    {
-      // Fall back to MOVDQU
-      for ( ; j < template_positions - 15; j += 16)
-      {
-        __m128i responses = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lm_ptr + j));
-        __m128i* dst_ptr_sse = reinterpret_cast<__m128i*>(dst_ptr + j);
-        *dst_ptr_sse = _mm_add_epi8(*dst_ptr_sse, responses);
-      }
-    }
+    // Process responses by the widest register available
+#if CV_SIMD
+    for ( ; j <= template_positions - v_uint8::nlanes; j += v_uint8::nlanes)
+      v_store(dst_ptr + j, v_add_wrap(vx_load(dst_ptr + j), vx_load(lm_ptr + j)));
 #endif
     for ( ; j < template_positions; ++j)
       dst_ptr[j] = uchar(dst_ptr[j] + lm_ptr[j]);
@@ -1273,13 +1208,6 @@ static void similarityLocal(const std::vector<Mat>& linear_memories, const Templ
   int offset_x = (center.x / T - 8) * T;
   int offset_y = (center.y / T - 8) * T;
 
-#if CV_SSE2
-  volatile bool haveSSE2 = checkHardwareSupport(CV_CPU_SSE2);
-#if CV_SSE3
-  volatile bool haveSSE3 = checkHardwareSupport(CV_CPU_SSE3);
-#endif
-  __m128i* dst_ptr_sse = dst.ptr<__m128i>();
-#endif
 
   for (int i = 0; i < (int)templ.features.size(); ++i)
   {
@@ -1293,57 +1221,38 @@ static void similarityLocal(const std::vector<Mat>& linear_memories, const Templ
     const uchar* lm_ptr = accessLinearMemory(linear_memories, f, T, W);
 
     // Process whole row at a time if vectorization possible
-#if CV_SSE2
-#if CV_SSE3
-    if (haveSSE3)
-    {
-      // LDDQU may be more efficient than MOVDQU for unaligned load of 16 responses from current row
-      for (int row = 0; row < 16; ++row)
-      {
-        __m128i aligned = _mm_lddqu_si128(reinterpret_cast<const __m128i*>(lm_ptr));
-        dst_ptr_sse[row] = _mm_add_epi8(dst_ptr_sse[row], aligned);
-        lm_ptr += W; // Step to next row
-      }
-    }
-    else
-#endif
-    if (haveSSE2)
+    uchar* dst_ptr = dst.ptr<uchar>();
+    for (int row = 0; row < 16; ++row)
     {
-      // Fall back to MOVDQU
-      for (int row = 0; row < 16; ++row)
-      {
-        __m128i aligned = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lm_ptr));
-        dst_ptr_sse[row] = _mm_add_epi8(dst_ptr_sse[row], aligned);
-        lm_ptr += W; // Step to next row
-      }
-    }
-    else
+#if CV_SIMD128
+      v_store(dst_ptr, v_add_wrap(v_load(dst_ptr), v_load(lm_ptr)));
+#else
+      for (int col = 0; col < 16; ++col)
+        dst_ptr[col] = uchar(dst_ptr[col] + lm_ptr[col]);
 #endif
-    {
-      uchar* dst_ptr = dst.ptr<uchar>();
-      for (int row = 0; row < 16; ++row)
-      {
-        for (int col = 0; col < 16; ++col)
-          dst_ptr[col] = uchar(dst_ptr[col] + lm_ptr[col]);
-        dst_ptr += 16;
-        lm_ptr += W;
-      }
+      dst_ptr += 16;
+      lm_ptr += W; // Step to next row
     }
   }
 }
 
 static void addUnaligned8u16u(const uchar * src1, const uchar * src2, ushort * res, int length)
 {
-  const uchar * end = src1 + length;
+  int i = 0;
 
-  while (src1 != end)
+#if CV_SIMD
+  for ( ; i <= length - v_uint8::nlanes; i += v_uint8::nlanes)
   {
-    *res = *src1 + *src2;
-
-    ++src1;
-    ++src2;
-    ++res;
+    v_uint16 a0, a1, b0, b1;
+    v_expand(vx_load(src1 + i), a0, a1);
+    v_expand(vx_load(src2 + i), b0, b1);
+    v_store(res + i, a0 + b0);
+    v_store(res + i + v_uint16::nlanes, a1 + b1);
   }
+#endif
+
+  for ( ; i < length; ++i)
+    res[i] = ushort(src1[i] + src2[i]);
 }
 
 /**
@@ -1390,7 +1299,41 @@ void Detector::match(const std::vector<Mat>& sources, float threshold, std::vect
                      const std::vector<String>& class_ids, OutputArrayOfArrays quantized_images,
                      const std::vector<Mat>& masks) const
 {
-  matches.clear();
+  std::vector<LinearMemoryPyramid> lm_pyramids(1);
+  std::vector< std::vector<Size> > sizes(1);
+  computeLinearMemories(sources, masks, lm_pyramids[0], sizes[0], quantized_images);
+
+  std::vector< std::vector<Match> > image_matches;
+  matchImages(lm_pyramids, sizes, threshold, image_matches, class_ids);
+  matches.swap(image_matches[0]);
+}
+
+void Detector::matchBatch(const std::vector< std::vector<Mat> >& sources, float threshold,
+                          std::vector< std::vector<Match> >& matches,
+                          const std::vector<String>& class_ids,
+                          const std::vector< std::vector<Mat> >& masks) const
+{
+  CV_Assert(masks.empty() || masks.size() == sources.size());
+
+  int num_images = static_cast<int>(sources.size());
+  std::vector<LinearMemoryPyramid> lm_pyramids(num_images);
+  std::vector< std::vector<Size> > sizes(num_images);
+
+  // Images are independent, so their linear memories are computed in parallel
+  parallel_for_(Range(0, num_images), [&](const Range& range)
+  {
+    for (int i = range.start; i < range.end; ++i)
+      computeLinearMemories(sources[i], masks.empty() ? std::vector<Mat>() : masks[i],
+                            lm_pyramids[i], sizes[i]);
+  });
+
+  matchImages(lm_pyramids, sizes, threshold, matches, class_ids);
+}
+
+void Detector::computeLinearMemories(const std::vector<Mat>& sources, const std::vector<Mat>& masks,
+                                     LinearMemoryPyramid& lm_pyramid, std::vector<Size>& sizes,
+                                     OutputArrayOfArrays quantized_images) const
+{
   if (quantized_images.needed())
     quantized_images.create(1, static_cast<int>(pyramid_levels * modalities.size()), CV_8U);
 
@@ -1408,11 +1351,10 @@ void Detector::match(const std::vector<Mat>& sources, float threshold, std::vect
     quantizers.push_back(modalities[i]->process(source, mask));
   }
   // pyramid level -> modality -> quantization
-  LinearMemoryPyramid lm_pyramid(pyramid_levels,
-                                 std::vector<LinearMemories>(modalities.size(), LinearMemories(8)));
+  lm_pyramid.assign(pyramid_levels, std::vector<LinearMemories>(modalities.size(), LinearMemories(8)));
 
   // For each pyramid level, precompute linear memories for each modality
-  std::vector<Size> sizes;
+  sizes.clear();
   for (int l = 0; l < pyramid_levels; ++l)
   {
     int T = T_at_level[l];
@@ -1442,13 +1384,21 @@ void Detector::match(const std::vector<Mat>& sources, float threshold, std::vect
 
     sizes.push_back(quantized.size());
   }
+}
 
+void Detector::matchImages(const std::vector<LinearMemoryPyramid>& lm_pyramids,
+                           const std::vector< std::vector<Size> >& sizes,
+                           float threshold, std::vector< std::vector<Match> >& matches,
+                           const std::vector<String>& class_ids) const
+{
+  // Templates to match in the order the sequential search would visit them
+  std::vector< std::pair<TemplatesMap::const_iterator, int> > templates;
+  std::vector<TemplatesMap::const_iterator> classes;
   if (class_ids.empty())
   {
     // Match all templates
-    TemplatesMap::const_iterator it = class_templates.begin(), itend = class_templates.end();
-    for ( ; it != itend; ++it)
-      matchClass(lm_pyramid, sizes, threshold, matches, it->first, it->second);
+    for (TemplatesMap::const_iterator it = class_templates.begin(); it != class_templates.end(); ++it)
+      classes.push_back(it);
   }
   else
   {
@@ -1457,14 +1407,49 @@ void Detector::match(const std::vector<Mat>& sources, float threshold, std::vect
     {
       TemplatesMap::const_iterator it = class_templates.find(class_ids[i]);
       if (it != class_templates.end())
-        matchClass(lm_pyramid, sizes, threshold, matches, it->first, it->second);
+        classes.push_back(it);
     }
   }
+  for (size_t i = 0; i < classes.size(); ++i)
+  {
+    for (int template_id = 0; template_id < (int)classes[i]->second.size(); ++template_id)
+      templates.push_back(std::make_pair(classes[i], template_id));
+  }
+
+  // One task per template and image, each task writes its own matches. Templates differ
+  // a lot in the number of candidates to refine, so every task is a separate stripe
+  // to let idle threads pick up the remaining ones.
+  int num_images = static_cast<int>(lm_pyramids.size());
+  int num_templates = static_cast<int>(templates.size());
+  int num_tasks = num_images * num_templates;
+  std::vector< std::vector<Match> > task_matches(num_tasks);
+  parallel_for_(Range(0, num_tasks), [&](const Range& range)
+  {
+    for (int task = range.start; task < range.end; ++task)
+    {
+      int image = task / num_templates;
+      const TemplatesMap::const_iterator& it = templates[task % num_templates].first;
+      int template_id = templates[task % num_templates].second;
+      matchTemplate(lm_pyramids[image], sizes[image], threshold, task_matches[task],
+                    it->first, template_id, it->second[template_id]);
+    }
+  }, num_tasks);
+
+  matches.assign(num_images, std::vector<Match>());
+  for (int image = 0; image < num_images; ++image)
+  {
+    std::vector<Match>& image_matches = matches[image];
+    for (int t = 0; t < num_templates; ++t)
+    {
+      const std::vector<Match>& m = task_matches[image * num_templates + t];
+      image_matches.insert(image_matches.end(), m.begin(), m.end());
+    }
 
-  // Sort matches by similarity, and prune any duplicates introduced by pyramid refinement
-  std::sort(matches.begin(), matches.end());
-  std::vector<Match>::iterator new_end = std::unique(matches.begin(), matches.end());
-  matches.erase(new_end, matches.end());
+    // Sort matches by similarity, and prune any duplicates introduced by pyramid refinement
+    std::sort(image_matches.begin(), image_matches.end());
+    std::vector<Match>::iterator new_end = std::unique(image_matches.begin(), image_matches.end());
+    image_matches.erase(new_end, image_matches.end());
+  }
 }
 
 // Used to filter out weak matches
@@ -1483,124 +1468,129 @@ void Detector::matchClass(const LinearMemoryPyramid& lm_pyramid,
 {
   // For each template...
   for (size_t template_id = 0; template_id < template_pyramids.size(); ++template_id)
+    matchTemplate(lm_pyramid, sizes, threshold, matches, class_id,
+                  static_cast<int>(template_id), template_pyramids[template_id]);
+}
+
+void Detector::matchTemplate(const LinearMemoryPyramid& lm_pyramid,
+                             const std::vector<Size>& sizes,
+                             float threshold, std::vector<Match>& matches,
+                             const String& class_id, int template_id,
+                             const TemplatePyramid& tp) const
+{
+  // First match over the whole image at the lowest pyramid level
+  const std::vector<LinearMemories>& lowest_lm = lm_pyramid.back();
+
+  // Compute similarity maps for each modality at lowest pyramid level
+  std::vector<Mat> similarities(modalities.size());
+  int lowest_start = static_cast<int>(tp.size() - modalities.size());
+  int lowest_T = T_at_level.back();
+  int num_features = 0;
+  for (int i = 0; i < (int)modalities.size(); ++i)
   {
-    const TemplatePyramid& tp = template_pyramids[template_id];
-
-    // First match over the whole image at the lowest pyramid level
-    /// @todo Factor this out into separate function
-    const std::vector<LinearMemories>& lowest_lm = lm_pyramid.back();
-
-    // Compute similarity maps for each modality at lowest pyramid level
-    std::vector<Mat> similarities(modalities.size());
-    int lowest_start = static_cast<int>(tp.size() - modalities.size());
-    int lowest_T = T_at_level.back();
-    int num_features = 0;
-    for (int i = 0; i < (int)modalities.size(); ++i)
-    {
-      const Template& templ = tp[lowest_start + i];
-      num_features += static_cast<int>(templ.features.size());
-      similarity(lowest_lm[i], templ, similarities[i], sizes.back(), lowest_T);
-    }
+    const Template& templ = tp[lowest_start + i];
+    num_features += static_cast<int>(templ.features.size());
+    similarity(lowest_lm[i], templ, similarities[i], sizes.back(), lowest_T);
+  }
 
-    // Combine into overall similarity
-    /// @todo Support weighting the modalities
-    Mat total_similarity;
-    addSimilarities(similarities, total_similarity);
+  // Combine into overall similarity
+  /// @todo Support weighting the modalities
+  Mat total_similarity;
+  addSimilarities(similarities, total_similarity);
 
-    // Convert user-friendly percentage to raw similarity threshold. The percentage
-    // threshold scales from half the max response (what you would expect from applying
-    // the template to a completely random image) to the max response.
-    // NOTE: This assumes max per-feature response is 4, so we scale between [2*nf, 4*nf].
-    int raw_threshold = static_cast<int>(2*num_features + (threshold / 100.f) * (2*num_features) + 0.5f);
+  // Convert user-friendly percentage to raw similarity threshold. The percentage
+  // threshold scales from half the max response (what you would expect from applying
+  // the template to a completely random image) to the max response.
+  // NOTE: This assumes max per-feature response is 4, so we scale between [2*nf, 4*nf].
+  int raw_threshold = static_cast<int>(2*num_features + (threshold / 100.f) * (2*num_features) + 0.5f);
 
-    // Find initial matches
-    std::vector<Match> candidates;
-    for (int r = 0; r < total_similarity.rows; ++r)
+  // Find initial matches
+  std::vector<Match> candidates;
+  for (int r = 0; r < total_similarity.rows; ++r)
+  {
+    ushort* row = total_similarity.ptr<ushort>(r);
+    for (int c = 0; c < total_similarity.cols; ++c)
     {
-      ushort* row = total_similarity.ptr<ushort>(r);
-      for (int c = 0; c < total_similarity.cols; ++c)
+      int raw_score = row[c];
+      if (raw_score > raw_threshold)
       {
-        int raw_score = row[c];
-        if (raw_score > raw_threshold)
-        {
-          int offset = lowest_T / 2 + (lowest_T % 2 - 1);
-          int x = c * lowest_T + offset;
-          int y = r * lowest_T + offset;
-          float score =(raw_score * 100.f) / (4 * num_features) + 0.5f;
-          candidates.push_back(Match(x, y, score, class_id, static_cast<int>(template_id)));
-        }
+        int offset = lowest_T / 2 + (lowest_T % 2 - 1);
+        int x = c * lowest_T + offset;
+        int y = r * lowest_T + offset;
+        float score =(raw_score * 100.f) / (4 * num_features) + 0.5f;
+        candidates.push_back(Match(x, y, score, class_id, template_id));
       }
     }
+  }
 
-    // Locally refine each match by marching up the pyramid
-    for (int l = pyramid_levels - 2; l >= 0; --l)
+  // Locally refine each match by marching up the pyramid
+  for (int l = pyramid_levels - 2; l >= 0; --l)
+  {
+    const std::vector<LinearMemories>& lms = lm_pyramid[l];
+    int T = T_at_level[l];
+    int start = static_cast<int>(l * modalities.size());
+    Size size = sizes[l];
+    int border = 8 * T;
+    int offset = T / 2 + (T % 2 - 1);
+    int max_x = size.width - tp[start].width - border;
+    int max_y = size.height - tp[start].height - border;
+
+    std::vector<Mat> similarities2(modalities.size());
+    Mat total_similarity2;
+    for (int m = 0; m < (int)candidates.size(); ++m)
     {
-      const std::vector<LinearMemories>& lms = lm_pyramid[l];
-      int T = T_at_level[l];
-      int start = static_cast<int>(l * modalities.size());
-      Size size = sizes[l];
-      int border = 8 * T;
-      int offset = T / 2 + (T % 2 - 1);
-      int max_x = size.width - tp[start].width - border;
-      int max_y = size.height - tp[start].height - border;
-
-      std::vector<Mat> similarities2(modalities.size());
-      Mat total_similarity2;
-      for (int m = 0; m < (int)candidates.size(); ++m)
-      {
-        Match& match2 = candidates[m];
-        int x = match2.x * 2 + 1; /// @todo Support other pyramid distance
-        int y = match2.y * 2 + 1;
+      Match& match2 = candidates[m];
+      int x = match2.x * 2 + 1; /// @todo Support other pyramid distance
+      int y = match2.y * 2 + 1;
 
-        // Require 8 (reduced) row/cols to the up/left
-        x = std::max(x, border);
-        y = std::max(y, border);
+      // Require 8 (reduced) row/cols to the up/left
+      x = std::max(x, border);
+      y = std::max(y, border);
 
-        // Require 8 (reduced) row/cols to the down/left, plus the template size
-        x = std::min(x, max_x);
-        y = std::min(y, max_y);
+      // Require 8 (reduced) row/cols to the down/left, plus the template size
+      x = std::min(x, max_x);
+      y = std::min(y, max_y);
 
-        // Compute local similarity maps for each modality
-        int numFeatures = 0;
-        for (int i = 0; i < (int)modalities.size(); ++i)
-        {
-          const Template& templ = tp[start + i];
-          numFeatures += static_cast<int>(templ.features.size());
-          similarityLocal(lms[i], templ, similarities2[i], size, T, Point(x, y));
-        }
-        addSimilarities(similarities2, total_similarity2);
+      // Compute local similarity maps for each modality
+      int numFeatures = 0;
+      for (int i = 0; i < (int)modalities.size(); ++i)
+      {
+        const Template& templ = tp[start + i];
+        numFeatures += static_cast<int>(templ.features.size());
+        similarityLocal(lms[i], templ, similarities2[i], size, T, Point(x, y));
+      }
+      addSimilarities(similarities2, total_similarity2);
 
-        // Find best local adjustment
-        int best_score = 0;
-        int best_r = -1, best_c = -1;
-        for (int r = 0; r < total_similarity2.rows; ++r)
+      // Find best local adjustment
+      int best_score = 0;
+      int best_r = -1, best_c = -1;
+      for (int r = 0; r < total_similarity2.rows; ++r)
+      {
+        ushort* row = total_similarity2.ptr<ushort>(r);
+        for (int c = 0; c < total_similarity2.cols; ++c)
         {
-          ushort* row = total_similarity2.ptr<ushort>(r);
-          for (int c = 0; c < total_similarity2.cols; ++c)
+          int score = row[c];
+          if (score > best_score)
           {
-            int score = row[c];
-            if (score > best_score)
-            {
-              best_score = score;
-              best_r = r;
-              best_c = c;
-            }
+            best_score = score;
+            best_r = r;
+            best_c = c;
           }
         }
-        // Update current match
-        match2.x = (x / T - 8 + best_c) * T + offset;
-        match2.y = (y / T - 8 + best_r) * T + offset;
-        match2.similarity = (best_score * 100.f) / (4 * numFeatures);
       }
-
-      // Filter out any matches that drop below the similarity threshold
-      std::vector<Match>::iterator new_end = std::remove_if(candidates.begin(), candidates.end(),
-                                                            MatchPredicate(threshold));
-      candidates.erase(new_end, candidates.end());
+      // Update current match
+      match2.x = (x / T - 8 + best_c) * T + offset;
+      match2.y = (y / T - 8 + best_r) * T + offset;
+      match2.similarity = (best_score * 100.f) / (4 * numFeatures);
     }
 
-    matches.insert(matches.end(), candidates.begin(), candidates.end());
+    // Filter out any matches that drop below the similarity threshold
+    std::vector<Match>::iterator new_end = std::remove_if(candidates.begin(), candidates.end(),
+                                                          MatchPredicate(threshold));
+    candidates.erase(new_end, candidates.end());
   }
+
+  matches.insert(matches.end(), candidates.begin(), candidates.end());
 }
 
 int Detector::addTemplate(const std::vector<Mat>& sources, const String& class_id,
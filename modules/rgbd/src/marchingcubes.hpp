@@ -1,6 +1,11 @@
 #ifndef __OPENCV_DYNAFU_MARCHINGCUBES_H__
 #define __OPENCV_DYNAFU_MARCHINGCUBES_H__
 
+#include <cmath>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
 /*
 These tables are originally generated by Cory Gene Bloyd
 (http://paulbourke.net/geometry/polygonise) and are released
@@ -16,7 +21,7 @@ namespace dynafu {
 // For any cube the are 2^8=256 possible sets of vertex states
 // This table lists the edges intersected by the surface for all 256 possible vertex states
 // There are 12 edges.  For each entry in the table, if edge #n is intersected, then bit #n is set to 1
-int edgeTable[256] =
+static const int edgeTable[256] =
     {
         0x000, 0x109, 0x203, 0x30a, 0x406, 0x50f, 0x605, 0x70c, 0x80c, 0x905, 0xa0f, 0xb06, 0xc0a, 0xd03, 0xe09, 0xf00,
         0x190, 0x099, 0x393, 0x29a, 0x596, 0x49f, 0x795, 0x69c, 0x99c, 0x895, 0xb9f, 0xa96, 0xd9a, 0xc93, 0xf99, 0xe90,
@@ -40,7 +45,7 @@ int edgeTable[256] =
 //  0-5 edge triples with the list terminated by the invalid value -1.
 //  For example: a2iTriangleConnectionTable[3] list the 2 triangles formed when corner[0]
 //  and corner[1] are inside of the surface, but the rest of the cube is not.
-int triTable[256][16] =
+static const int triTable[256][16] =
     {
         {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
         {0, 8, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
@@ -300,5 +305,53 @@ int triTable[256][16] =
         {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}};
 
 } // namespace dynafu
+
+namespace kinfu {
+
+//! Corners of a cube in the order used by the tables above
+static const int mcCorners[8][3] = {
+    {0, 0, 0}, {0, 0, 1}, {0, 1, 1}, {0, 1, 0},
+    {1, 0, 0}, {1, 0, 1}, {1, 1, 1}, {1, 1, 0}};
+
+//! Corners connected by each of the 12 cube edges
+static const int mcEdgeCorners[12][2] = {
+    {0, 1}, {1, 2}, {2, 3}, {3, 0},
+    {4, 5}, {5, 6}, {6, 7}, {7, 4},
+    {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+//! Triangulates one cube given TSDF values at its corners (in mcCorners order)
+//! and the bit mask of corners inside of the surface.
+//! Vertices are appended to triangles in voxel coordinates, 3 per triangle.
+inline void marchCube(const Point3f& basePt, const float tsdfValues[8], int cubeIndex,
+                      std::vector<Point3f>& triangles)
+{
+    const int edges = dynafu::edgeTable[cubeIndex];
+    if (edges == 0)
+        return;
+
+    Point3f vertices[12];
+    for (int e = 0; e < 12; e++)
+    {
+        if (!(edges & (1 << e)))
+            continue;
+        const int* c0 = mcCorners[mcEdgeCorners[e][0]];
+        const int* c1 = mcCorners[mcEdgeCorners[e][1]];
+        float v0 = tsdfValues[mcEdgeCorners[e][0]];
+        float v1 = tsdfValues[mcEdgeCorners[e][1]];
+
+        float dV = 0.5f;
+        if (std::abs(v0 - v1) > 0.0001f)
+            dV = v0 / (v0 - v1);
+
+        Point3f p0((float)c0[0], (float)c0[1], (float)c0[2]);
+        Point3f p1((float)c1[0], (float)c1[1], (float)c1[2]);
+        vertices[e] = basePt + p0 + dV * (p1 - p0);
+    }
+
+    for (int i = 0; dynafu::triTable[cubeIndex][i] != -1; i++)
+        triangles.push_back(vertices[dynafu::triTable[cubeIndex][i]]);
+}
+
+} // namespace kinfu
 } // namespace cv
 #endif
@@ -0,0 +1,342 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+#include "precomp.hpp"
+#include "multires_hash_tsdf.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "kinfu_frame.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/core/utils/trace.hpp"
+#include "utils.hpp"
+
+namespace cv
+{
+namespace kinfu
+{
+MultiResHashTSDFVolumeCPU::MultiResHashTSDFVolumeCPU(float _voxelSize, cv::Matx44f _pose,
+                                                     float _raycastStepFactor, float _truncDist,
+                                                     int _maxWeight, float _truncateThreshold,
+                                                     int _levels, float _levelDistance,
+                                                     int _volumeUnitRes)
+    : Volume(_voxelSize, _pose, _raycastStepFactor),
+      truncateThreshold(_truncateThreshold),
+      levelDistance(_levelDistance)
+{
+    CV_Assert(_levels > 0 && _levels < 16);
+    CV_Assert(_levelDistance > 0);
+
+    for (int l = 0; l < _levels; l++)
+    {
+        const float scale = (float)(1 << l);
+        levels.push_back(makePtr<HashTSDFVolumeCPU>(voxelSize * scale, _pose, _raycastStepFactor,
+                                                    _truncDist * scale, _maxWeight,
+                                                    _truncateThreshold, _volumeUnitRes));
+    }
+}
+
+void MultiResHashTSDFVolumeCPU::reset()
+{
+    CV_TRACE_FUNCTION();
+    for (const Ptr<HashTSDFVolumeCPU>& level : levels)
+        level->reset();
+}
+
+float MultiResHashTSDFVolumeCPU::levelNearDistance(int level) const
+{
+    return level == 0 ? 0.f : levelDistance * (float)(1 << (level - 1));
+}
+
+float MultiResHashTSDFVolumeCPU::levelFarDistance(int level) const
+{
+    return level == (int)levels.size() - 1 ? std::numeric_limits<float>::infinity()
+                                           : levelDistance * (float)(1 << level);
+}
+
+int MultiResHashTSDFVolumeCPU::levelAtDepth(float depth) const
+{
+    int level = 0;
+    while (level < (int)levels.size() - 1 && depth >= levelFarDistance(level))
+        level++;
+    return level;
+}
+
+int MultiResHashTSDFVolumeCPU::finestObservedLevel(const cv::Point3f& point) const
+{
+    for (int l = 0; l < (int)levels.size(); l++)
+    {
+        if (levels[l]->at(point).weight > 0)
+            return l;
+    }
+    return -1;
+}
+
+void MultiResHashTSDFVolumeCPU::integrate(InputArray _depth, float depthFactor,
+                                          const cv::Matx44f& cameraPose, const Intr& intrinsics)
+{
+    CV_TRACE_FUNCTION();
+
+    CV_Assert(_depth.type() == DEPTH_TYPE);
+    Depth depth = _depth.getMat();
+    levelDepth.create(depth.size());
+
+    for (int l = 0; l < (int)levels.size(); l++)
+    {
+        HashTSDFVolumeCPU& level = *levels[l];
+
+        //! Neighbouring levels overlap by truncation distance to avoid gaps between them
+        const float nearDepth = (levelNearDistance(l) - level.truncDist) * depthFactor;
+        const float farDepth  = (levelFarDistance(l) + level.truncDist) * depthFactor;
+
+        parallel_for_(Range(0, depth.rows), [&](const Range& range) {
+            for (int y = range.start; y < range.end; y++)
+            {
+                const depthType* depthRow = depth[y];
+                depthType* levelRow       = levelDepth[y];
+                for (int x = 0; x < depth.cols; x++)
+                {
+                    depthType d = depthRow[x];
+                    levelRow[x] = (d >= nearDepth && d < farDepth) ? d : 0;
+                }
+            }
+        });
+
+        level.integrate(levelDepth, depthFactor, cameraPose, intrinsics);
+    }
+}
+
+struct MultiResRaycastInvoker : ParallelLoopBody
+{
+    MultiResRaycastInvoker(Points& _points, Normals& _normals, const Matx44f& cameraPose,
+                           const Intr& intrinsics, const MultiResHashTSDFVolumeCPU& _volume)
+        : ParallelLoopBody(),
+          points(_points),
+          normals(_normals),
+          volume(_volume),
+          cam2vol(volume.pose.inv() * Affine3f(cameraPose)),
+          vol2cam(Affine3f(cameraPose.inv()) * volume.pose),
+          reproj(intrinsics.makeReprojector())
+    {
+    }
+
+    virtual void operator()(const Range& range) const override
+    {
+        const Point3f cam2volTrans = cam2vol.translation();
+        const Matx33f cam2volRot   = cam2vol.rotation();
+        const Matx33f vol2camRot   = vol2cam.rotation();
+        const int nLevels          = (int)volume.levels.size();
+
+        for (int y = range.start; y < range.end; y++)
+        {
+            ptype* ptsRow = points[y];
+            ptype* nrmRow = normals[y];
+
+            for (int x = 0; x < points.cols; x++)
+            {
+                //! Initialize default value
+                Point3f point = nan3, normal = nan3;
+
+                //! Ray origin and direction in the volume coordinate frame,
+                //! depth of a ray point is t*depthPerT
+                Point3f orig          = cam2volTrans;
+                Point3f rayDir        = reproj(Point3f(float(x), float(y), 1.f));
+                float rayNorm         = (float)norm(rayDir);
+                Point3f rayDirV       = cam2volRot * (rayDir / rayNorm);
+                const float depthPerT = 1.f / rayNorm;
+
+                float tmax        = volume.truncateThreshold;
+                float tcurr       = 0;
+                float tprev       = tcurr;
+                TsdfType prevTsdf = 1.f;
+                while (tcurr < tmax)
+                {
+                    Point3f currRayPos = orig + tcurr * rayDirV;
+
+                    //! The finest level which has observed the point is used,
+                    //! the step is chosen by the finest level which has a volume unit there
+                    int currLevel = -1, unitLevel = -1;
+                    TsdfVoxel currVoxel = { 1.f, 0 };
+                    for (int l = 0; l < nLevels && currLevel < 0; l++)
+                    {
+                        const HashTSDFVolumeCPU& level = *volume.levels[l];
+                        cv::Vec3i volumeUnitIdx = level.volumeToVolumeUnitIdx(currRayPos);
+                        int slot = level.volumeUnitIndexes.find(volumeUnitIdx);
+                        if (slot < 0)
+                            continue;
+                        if (unitLevel < 0)
+                            unitLevel = l;
+
+                        cv::Vec3i volUnitLocalIdx = level.volumeToVoxelCoord(
+                            currRayPos - level.volumeUnitIdxToVolume(volumeUnitIdx));
+                        currVoxel = level.atVolumeUnit(slot, volUnitLocalIdx);
+                        if (currVoxel.weight > 0)
+                            currLevel = l;
+                    }
+
+                    TsdfType currTsdf = prevTsdf;
+                    float stepSize;
+                    if (unitLevel >= 0)
+                    {
+                        const HashTSDFVolumeCPU& level = *volume.levels[unitLevel];
+                        stepSize = level.truncDist * level.raycastStepFactor;
+                    }
+                    else
+                    {
+                        //! Skip empty space by the volume units of the level at that distance
+                        stepSize = 0.5f * volume.levels[volume.levelAtDepth(tcurr * depthPerT)]
+                                              ->volumeUnitSize;
+                    }
+                    if (currLevel >= 0)
+                        currTsdf = currVoxel.tsdf;
+
+                    //! Surface crossing
+                    if (prevTsdf > 0.f && currTsdf <= 0.f && currLevel >= 0)
+                    {
+                        float tInterp =
+                            (tcurr * prevTsdf - tprev * currTsdf) / (prevTsdf - currTsdf);
+                        if (!cvIsNaN(tInterp) && !cvIsInf(tInterp))
+                        {
+                            Point3f pv = orig + tInterp * rayDirV;
+                            Point3f nv = volume.levels[currLevel]->getNormalVoxel(pv);
+
+                            if (!isNaN(nv))
+                            {
+                                normal = vol2camRot * nv;
+                                point  = vol2cam * pv;
+                            }
+                        }
+                        break;
+                    }
+                    prevTsdf = currTsdf;
+                    tprev    = tcurr;
+                    tcurr += stepSize;
+                }
+                ptsRow[x] = toPtype(point);
+                nrmRow[x] = toPtype(normal);
+            }
+        }
+    }
+
+    Points& points;
+    Normals& normals;
+    const MultiResHashTSDFVolumeCPU& volume;
+    const Affine3f cam2vol;
+    const Affine3f vol2cam;
+    const Intr::Reprojector reproj;
+};
+
+void MultiResHashTSDFVolumeCPU::raycast(const cv::Matx44f& cameraPose,
+                                        const cv::kinfu::Intr& intrinsics, cv::Size frameSize,
+                                        cv::OutputArray _points, cv::OutputArray _normals) const
+{
+    CV_TRACE_FUNCTION();
+    CV_Assert(frameSize.area() > 0);
+
+    _points.create(frameSize, POINT_TYPE);
+    _normals.create(frameSize, POINT_TYPE);
+
+    Points points   = _points.getMat();
+    Normals normals = _normals.getMat();
+
+    MultiResRaycastInvoker ri(points, normals, cameraPose, intrinsics, *this);
+
+    const int nstripes = -1;
+    parallel_for_(Range(0, points.rows), ri, nstripes);
+}
+
+void MultiResHashTSDFVolumeCPU::fetchPointsNormals(OutputArray _points, OutputArray _normals) const
+{
+    CV_TRACE_FUNCTION();
+
+    if (_points.needed())
+    {
+        const bool needNormals = _normals.needed();
+        std::vector<Mat> levelPoints(levels.size()), levelNormals(levels.size());
+        std::vector<std::vector<uchar>> keep(levels.size());
+        int nPoints = 0;
+        for (int l = 0; l < (int)levels.size(); l++)
+        {
+            if (needNormals)
+                levels[l]->fetchPointsNormals(levelPoints[l], levelNormals[l]);
+            else
+                levels[l]->fetchPointsNormals(levelPoints[l], noArray());
+
+            //! Surface seen by a finer level is taken from there
+            const Mat& pts = levelPoints[l];
+            keep[l].resize(pts.rows);
+            parallel_for_(Range(0, pts.rows), [&](const Range& range) {
+                for (int i = range.start; i < range.end; i++)
+                    keep[l][i] = finestObservedLevel(fromPtype(pts.at<ptype>(i))) == l;
+            });
+            nPoints += (int)std::count(keep[l].begin(), keep[l].end(), 1);
+        }
+
+        _points.create(nPoints, 1, POINT_TYPE);
+        Mat points = _points.getMat(), normals;
+        if (needNormals)
+        {
+            _normals.create(nPoints, 1, POINT_TYPE);
+            normals = _normals.getMat();
+        }
+
+        int n = 0;
+        for (int l = 0; l < (int)levels.size(); l++)
+        {
+            for (int i = 0; i < levelPoints[l].rows; i++)
+            {
+                if (!keep[l][i])
+                    continue;
+                points.at<ptype>(n) = levelPoints[l].at<ptype>(i);
+                if (needNormals)
+                    normals.at<ptype>(n) = levelNormals[l].at<ptype>(i);
+                n++;
+            }
+        }
+    }
+}
+
+void MultiResHashTSDFVolumeCPU::fetchNormals(cv::InputArray _points,
+                                             cv::OutputArray _normals) const
+{
+    CV_TRACE_FUNCTION();
+
+    if (_normals.needed())
+    {
+        Points points = _points.getMat();
+        CV_Assert(points.type() == POINT_TYPE);
+
+        _normals.createSameSize(_points, _points.type());
+        Normals normals = _normals.getMat();
+
+        const Affine3f invPose(pose.inv());
+        points.forEach([&](const ptype& pp, const int* position) {
+            Point3f p = fromPtype(pp);
+            Point3f n = nan3;
+            if (!isNaN(p))
+            {
+                Point3f voxelPoint = invPose * p;
+                int level          = finestObservedLevel(voxelPoint);
+                if (level >= 0)
+                    n = pose.rotation() * levels[level]->getNormalVoxel(voxelPoint);
+            }
+            normals(position[0], position[1]) = toPtype(n);
+        });
+    }
+}
+
+cv::Ptr<MultiResHashTSDFVolumeCPU> makeMultiResHashTSDFVolume(float _voxelSize, cv::Matx44f _pose,
+                                                              float _raycastStepFactor, float _truncDist,
+                                                              int _maxWeight, float _truncateThreshold,
+                                                              int _levels, float _levelDistance,
+                                                              int _volumeUnitResolution)
+{
+    return cv::makePtr<MultiResHashTSDFVolumeCPU>(_voxelSize, _pose, _raycastStepFactor, _truncDist,
+                                                  _maxWeight, _truncateThreshold, _levels,
+                                                  _levelDistance, _volumeUnitResolution);
+}
+
+}  // namespace kinfu
+}  // namespace cv
@@ -0,0 +1,66 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef __OPENCV_MULTIRES_HASH_TSDF_H__
+#define __OPENCV_MULTIRES_HASH_TSDF_H__
+
+#include <opencv2/rgbd/volume.hpp>
+#include <vector>
+
+#include "hash_tsdf.hpp"
+
+namespace cv
+{
+namespace kinfu
+{
+//! Set of HashTSDF volumes (levels) which voxel size depends on the distance from the camera.
+//! Level 0 is integrated with depth closer than levelDistance, level l > 0 with depth
+//! from levelDistance * 2^(l-1) to levelDistance * 2^l, the last level has no far limit.
+//! Voxel size, truncation distance and volume unit size are doubled from level to level.
+class MultiResHashTSDFVolumeCPU : public Volume
+{
+   public:
+    // voxel size of the finest level, sizes in meters
+    MultiResHashTSDFVolumeCPU(float _voxelSize, cv::Matx44f _pose, float _raycastStepFactor,
+                              float _truncDist, int _maxWeight, float _truncateThreshold,
+                              int _levels, float _levelDistance, int _volumeUnitRes = 16);
+
+    virtual void integrate(InputArray _depth, float depthFactor, const cv::Matx44f& cameraPose,
+                           const cv::kinfu::Intr& intrinsics) override;
+    virtual void raycast(const cv::Matx44f& cameraPose, const cv::kinfu::Intr& intrinsics,
+                         cv::Size frameSize, cv::OutputArray points,
+                         cv::OutputArray normals) const override;
+
+    virtual void fetchNormals(cv::InputArray points, cv::OutputArray _normals) const override;
+    virtual void fetchPointsNormals(cv::OutputArray points, cv::OutputArray normals) const override;
+
+    virtual void reset() override;
+
+    //! Distance range along the camera axis the level is integrated from (without truncation margin)
+    float levelNearDistance(int level) const;
+    float levelFarDistance(int level) const;
+    //! Level which covers given distance along the camera axis
+    int levelAtDepth(float depth) const;
+
+    //! Finest level having an observed voxel at the point in volume coordinate system,
+    //! -1 if there is no such level
+    int finestObservedLevel(const cv::Point3f& point) const;
+
+   public:
+    float truncateThreshold;
+    float levelDistance;
+    std::vector<Ptr<HashTSDFVolumeCPU>> levels;
+
+    //! Depth of the level being integrated, kept between frames
+    Depth levelDepth;
+};
+
+cv::Ptr<MultiResHashTSDFVolumeCPU> makeMultiResHashTSDFVolume(float _voxelSize, cv::Matx44f _pose,
+                                                              float _raycastStepFactor, float _truncDist,
+                                                              int _maxWeight, float truncateThreshold,
+                                                              int levels = 3, float levelDistance = 1.f,
+                                                              int volumeUnitResolution = 16);
+}  // namespace kinfu
+}  // namespace cv
+#endif
@@ -160,6 +160,8 @@ bool ICPImpl::estimateWarpNodes(WarpField& currentWarp, const Affine3f &pose,
             for(int c = 0; c < currentWarp.k; c++)
             {
                 const int child = children[c];
+                // a coarser level may have less than k nodes
+                if(child < 0) continue;
                 Vec3f childPos = nextLevelNodes[child]->pos;
                 Vec3f childTranslation = nextLevelNodes[child]->transform.translation();
 
@@ -205,6 +207,7 @@ bool ICPImpl::estimateWarpNodes(WarpField& currentWarp, const Affine3f &pose,
             for(int edge = 0; edge < currentWarp.k; edge++)
             {
                 const int child = children[edge];
+                if(child < 0) continue;
                 const Ptr<WarpNode> childNode = nextLevelNodes[child];
                 Vec3f childTranslation = childNode->transform.translation();
 
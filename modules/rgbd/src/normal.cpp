@@ -132,8 +132,149 @@ namespace rgbd
     }
   }
 
+  /** Sums n rows of a strided array: dst[i] = src[i] + src[i + step] + ... + src[i + (n-1)*step]
+   */
+  template<typename T>
+  static void
+  sumStrided(const T* src, int step, int n, T* dst, int len)
+  {
+    for (int i = 0; i < len; ++i)
+    {
+      T s = src[i];
+      for (int k = 1; k < n; ++k)
+        s += src[i + k * step];
+      dst[i] = s;
+    }
+  }
+
+  static void
+  sumStrided(const float* src, int step, int n, float* dst, int len)
+  {
+    int i = 0;
+#if CV_SIMD
+    for (; i <= len - v_float32::nlanes; i += v_float32::nlanes)
+    {
+      v_float32 s = vx_load(src + i);
+      for (int k = 1; k < n; ++k)
+        s += vx_load(src + i + k * step);
+      v_store(dst + i, s);
+    }
+#endif
+    for (; i < len; ++i)
+    {
+      float s = src[i];
+      for (int k = 1; k < n; ++k)
+        s += src[i + k * step];
+      dst[i] = s;
+    }
+  }
+
+  /** B = V / r for one row of FALS, zero where it is not finite. V and B are planar: x, y, z coordinates
+   * of the row one after another
+   */
+  template<typename T>
+  static void
+  falsComputeB(const T* r, const T* V, T* B, int cols, int x = 0)
+  {
+    for (; x < cols; ++x)
+    {
+      T val[3];
+      bool finite = true;
+      for (int c = 0; c < 3; ++c)
+      {
+        val[c] = V[c * cols + x] / r[x];
+        finite = finite && !cvIsInf(val[c]) && !cvIsNaN(val[c]);
+      }
+      for (int c = 0; c < 3; ++c)
+        B[c * cols + x] = finite ? val[c] : T(0);
+    }
+  }
+
+  static void
+  falsComputeB(const float* r, const float* V, float* B, int cols)
+  {
+    int x = 0;
+#if CV_SIMD
+    const v_float32 inf = vx_setall_f32(std::numeric_limits<float>::infinity()), z = vx_setzero_f32();
+    for (; x <= cols - v_float32::nlanes; x += v_float32::nlanes)
+    {
+      v_float32 rv = vx_load(r + x);
+      v_float32 b0 = vx_load(V + x) / rv;
+      v_float32 b1 = vx_load(V + cols + x) / rv;
+      v_float32 b2 = vx_load(V + 2 * cols + x) / rv;
+      // NaNs fail the comparison too
+      v_float32 finite = (v_abs(b0) < inf) & (v_abs(b1) < inf) & (v_abs(b2) < inf);
+      v_store(B + x, v_select(finite, b0, z));
+      v_store(B + cols + x, v_select(finite, b1, z));
+      v_store(B + 2 * cols + x, v_select(finite, b2, z));
+    }
+#endif
+    falsComputeB<float>(r, V, B, cols, x);
+  }
+
+  /** Normals of one row of FALS from the inverse of M and the box filtered B, both planar
+   */
+  template<typename T>
+  static void
+  falsComputeNormals(const T* r, const T* M_inv, const T* B, Vec<T, 3>* normals, int cols, int x = 0)
+  {
+    for (; x < cols; ++x)
+    {
+      if (cvIsNaN(r[x]))
+      {
+        normals[x] = Vec<T, 3>::all(r[x]);
+        continue;
+      }
+      const T* Mr = M_inv + x;
+      const T Br[3] = { B[x], B[cols + x], B[2 * cols + x] };
+      Vec<T, 3> MBr(Mr[0] * Br[0] + Mr[cols] * Br[1] + Mr[2 * cols] * Br[2],
+                    Mr[3 * cols] * Br[0] + Mr[4 * cols] * Br[1] + Mr[5 * cols] * Br[2],
+                    Mr[6 * cols] * Br[0] + Mr[7 * cols] * Br[1] + Mr[8 * cols] * Br[2]);
+      signNormal(MBr, normals[x]);
+    }
+  }
+
+  static void
+  falsComputeNormals(const float* r, const float* M_inv, const float* B, Vec3f* normals, int cols)
+  {
+    int x = 0;
+#if CV_SIMD
+    const v_float32 one = vx_setall_f32(1.f), z = vx_setzero_f32();
+    for (; x <= cols - v_float32::nlanes; x += v_float32::nlanes)
+    {
+      v_float32 m[9];
+      for (int k = 0; k < 9; ++k)
+        m[k] = vx_load(M_inv + k * cols + x);
+      v_float32 b0 = vx_load(B + x), b1 = vx_load(B + cols + x), b2 = vx_load(B + 2 * cols + x);
+
+      v_float32 n0 = m[0] * b0 + m[1] * b1 + m[2] * b2;
+      v_float32 n1 = m[3] * b0 + m[4] * b1 + m[5] * b2;
+      v_float32 n2 = m[6] * b0 + m[7] * b1 + m[8] * b2;
+
+      // point the normals towards the camera
+      v_float32 norm = v_sqrt(n0 * n0 + n1 * n1 + n2 * n2);
+      v_float32 sign = v_select(n2 > z, z - one, one);
+      n0 = sign * (n0 / norm);
+      n1 = sign * (n1 / norm);
+      n2 = sign * (n2 / norm);
+
+      v_float32 rv = vx_load(r + x);
+      v_float32 nan = rv != rv;
+      v_store_interleave(normals[x].val, v_select(nan, rv, n0), v_select(nan, rv, n1), v_select(nan, rv, n2));
+    }
+#endif
+    falsComputeNormals<float>(r, M_inv, B, normals, cols, x);
+  }
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+  struct NormalsTables
+  {
+    int rows, cols, depth, window_size, method;
+    Mat K;
+    std::vector<Mat> tables;
+  };
+
   class RgbdNormalsImpl
   {
   public:
@@ -167,13 +308,67 @@ namespace rgbd
       return (rows == rows_) && (cols == cols_) && (window_size == window_size_) && (depth == depth_) && (K_test)
              && (method == method_);
     }
+
+    /** Takes the tables cached by the implementation for the previous parameters of the same object
+     */
+    void
+    takeCachedTables(RgbdNormalsImpl &other)
+    {
+      tables_cache_.swap(other.tables_cache_);
+    }
   protected:
+    /** The tables computed by cache() are kept by the RgbdNormals object for its last parameter sets,
+     * so switching between two resolutions doesn't compute them again. They are freed with the object.
+     * @return true if the tables were found
+     */
+    bool
+    getCachedTables(std::vector<Mat> &tables);
+    void
+    setCachedTables(const std::vector<Mat> &tables);
+
     int rows_, cols_, depth_;
     Mat K_, K_ori_;
     int window_size_;
     RgbdNormals::RGBD_NORMALS_METHOD method_;
+    // the most recently used first
+    std::list<NormalsTables> tables_cache_;
   };
 
+  // the current parameter set and the previous one
+  static const size_t maxCachedNormalsTables = 2;
+
+  bool
+  RgbdNormalsImpl::getCachedTables(std::vector<Mat> &tables)
+  {
+    for (std::list<NormalsTables>::iterator it = tables_cache_.begin(); it != tables_cache_.end(); ++it)
+    {
+      if (validate(it->rows, it->cols, it->depth, it->K, it->window_size, it->method))
+      {
+        tables = it->tables;
+        tables_cache_.splice(tables_cache_.begin(), tables_cache_, it);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void
+  RgbdNormalsImpl::setCachedTables(const std::vector<Mat> &tables)
+  {
+    NormalsTables entry;
+    entry.rows = rows_;
+    entry.cols = cols_;
+    entry.depth = depth_;
+    entry.window_size = window_size_;
+    entry.method = method_;
+    entry.K = K_ori_.clone();
+    entry.tables = tables;
+
+    tables_cache_.push_front(entry);
+    if (tables_cache_.size() > maxCachedNormalsTables)
+      tables_cache_.pop_back();
+  }
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
   /** Given a set of 3d points in a depth image, compute the normals at each point
@@ -203,6 +398,14 @@ namespace rgbd
     virtual void
     cache() CV_OVERRIDE
     {
+      std::vector<Mat> tables;
+      if (getCachedTables(tables))
+      {
+        V_ = tables[0];
+        M_inv_ = tables[1];
+        return;
+      }
+
       // Compute theta and phi according to equation 3
       Mat cos_theta, sin_theta, cos_phi, sin_phi;
       computeThetaPhi<T>(rows_, cols_, K_, cos_theta, sin_theta, cos_phi, sin_phi);
@@ -212,12 +415,13 @@ namespace rgbd
       channels[0] = sin_theta.mul(cos_phi);
       channels[1] = sin_phi;
       channels[2] = cos_theta.mul(cos_phi);
-      merge(channels, V_);
+      Mat_<Vec3T> V;
+      merge(channels, V);
 
       // Compute M
       Mat_<Vec9T> M(rows_, cols_);
       Mat33T VVt;
-      const Vec3T * vec = V_[0];
+      const Vec3T * vec = V[0];
       Vec9T * M_ptr = M[0], *M_ptr_end = M_ptr + rows_ * cols_;
       for (; M_ptr != M_ptr_end; ++vec, ++M_ptr)
       {
@@ -227,16 +431,33 @@ namespace rgbd
 
       boxFilter(M, M, M.depth(), Size(window_size_, window_size_), Point(-1, -1), false);
 
-      // Compute M's inverse
-      Mat33T M_inv;
-      M_inv_.create(rows_, cols_);
-      Vec9T * M_inv_ptr = M_inv_[0];
-      for (M_ptr = &M(0); M_ptr != M_ptr_end; ++M_inv_ptr, ++M_ptr)
+      // Compute M's inverse, V and M's inverse are stored planar by element in each row
+      Mat_<T> V_planar(rows_, 3 * cols_), M_inv_planar(rows_, 9 * cols_);
+      parallel_for_(Range(0, rows_), [&](const Range& range)
       {
-        // We have a semi-definite matrix
-        invert(Mat33T(M_ptr->val), M_inv, DECOMP_CHOLESKY);
-        *M_inv_ptr = Vec9T(M_inv.val);
-      }
+        Mat33T M_inv;
+        for (int y = range.start; y < range.end; ++y)
+        {
+          T * V_row = V_planar[y], *M_inv_row = M_inv_planar[y];
+          for (int x = 0; x < cols_; ++x)
+          {
+            for (int c = 0; c < 3; ++c)
+              V_row[c * cols_ + x] = V(y, x)[c];
+
+            // We have a semi-definite matrix
+            invert(Mat33T(M(y, x).val), M_inv, DECOMP_CHOLESKY);
+            for (int c = 0; c < 9; ++c)
+              M_inv_row[c * cols_ + x] = M_inv.val[c];
+          }
+        }
+      });
+
+      V_ = V_planar;
+      M_inv_ = M_inv_planar;
+
+      tables.push_back(V_);
+      tables.push_back(M_inv_);
+      setCachedTables(tables);
     }
 
     /** Compute the normals
@@ -246,52 +467,52 @@ namespace rgbd
     virtual void
     compute(const Mat&, const Mat &r, Mat & normals) const
     {
-      // Compute B
-      Mat_<Vec3T> B(rows_, cols_);
+      // B is computed, box filtered and multiplied by M's inverse tile by tile, so it stays in cache.
+      // Border rows and columns are reflected as boxFilter() does
+      const int tileRows = 16;
+      const int half = window_size_ / 2;
+      const int rowLen = 3 * cols_, paddedCols = cols_ + 2 * half;
 
-      const T* row_r = r.ptr < T > (0), *row_r_end = row_r + rows_ * cols_;
-      const Vec3T *row_V = V_[0];
-      Vec3T *row_B = B[0];
-      for (; row_r != row_r_end; ++row_r, ++row_B, ++row_V)
+      parallel_for_(Range(0, divUp(rows_, tileRows)), [&](const Range& range)
       {
-          Vec3T val = (*row_V) / (*row_r);
-          if(cvIsInf(val[0]) || cvIsNaN(val[0]) ||
-             cvIsInf(val[1]) || cvIsNaN(val[1]) ||
-             cvIsInf(val[2]) || cvIsNaN(val[2]))
-              *row_B = Vec3T();
-          else
-              *row_B = val;
-      }
-
-      // Apply a box filter to B
-      boxFilter(B, B, B.depth(), Size(window_size_, window_size_), Point(-1, -1), false);
+        // B of the tile rows with the window margins, the column sums of a row with the margins
+        // on both sides and the box filtered row, all of them planar by coordinate
+        AutoBuffer<T> tileBuf((tileRows + 2 * half) * rowLen), colSumBuf(3 * paddedCols), boxBuf(rowLen);
+        T* tile = tileBuf.data(), *colSum = colSumBuf.data(), *box = boxBuf.data();
 
-      // compute the Minv*B products
-      row_r = r.ptr < T > (0);
-      const Vec3T * B_vec = B[0];
-      const Mat33T * M_inv = reinterpret_cast<const Mat33T *>(M_inv_.ptr(0));
-      Vec3T *normal = normals.ptr<Vec3T>(0);
-      for (; row_r != row_r_end; ++row_r, ++B_vec, ++normal, ++M_inv)
-        if (cvIsNaN(*row_r))
+        for (int t = range.start; t < range.end; ++t)
         {
-          (*normal)[0] = *row_r;
-          (*normal)[1] = *row_r;
-          (*normal)[2] = *row_r;
-        }
-        else
-        {
-            Mat33T Mr = *M_inv;
-            Vec3T Br = *B_vec;
-            Vec3T MBr(Mr(0, 0) * Br[0] + Mr(0, 1)*Br[1] + Mr(0, 2)*Br[2],
-                      Mr(1, 0) * Br[0] + Mr(1, 1)*Br[1] + Mr(1, 2)*Br[2],
-                      Mr(2, 0) * Br[0] + Mr(2, 1)*Br[1] + Mr(2, 2)*Br[2]);
-           signNormal(MBr, *normal);
+          const int y0 = t * tileRows, y1 = std::min(y0 + tileRows, rows_);
+          for (int ty = 0; ty < y1 - y0 + 2 * half; ++ty)
+          {
+            const int y = borderInterpolate(y0 - half + ty, rows_, BORDER_REFLECT_101);
+            falsComputeB(r.ptr<T>(y), V_[y], tile + ty * rowLen, cols_);
+          }
+
+          for (int y = y0; y < y1; ++y)
+          {
+            for (int c = 0; c < 3; ++c)
+            {
+              T* colSumC = colSum + c * paddedCols;
+              sumStrided(tile + (y - y0) * rowLen + c * cols_, rowLen, window_size_, colSumC + half, cols_);
+              for (int x = 1; x <= half; ++x)
+              {
+                colSumC[half - x] = colSumC[half + borderInterpolate(-x, cols_, BORDER_REFLECT_101)];
+                colSumC[half + cols_ - 1 + x] = colSumC[half + borderInterpolate(cols_ - 1 + x, cols_, BORDER_REFLECT_101)];
+              }
+              sumStrided(colSumC, 1, window_size_, box + c * cols_, cols_);
+            }
+
+            falsComputeNormals(r.ptr<T>(y), M_inv_[y], box, normals.ptr<Vec3T>(y), cols_);
+          }
         }
+      });
     }
 
   private:
-    Mat_<Vec3T> V_;
-    Mat_<Vec9T> M_inv_;
+    /** V and M's inverse, planar by element in each row */
+    Mat_<T> V_;
+    Mat_<T> M_inv_;
   };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -313,6 +534,120 @@ multiply_by_K_inv(const Matx<T, 3, 3> & K_inv, U a, U b, U c, Vec<T, 3> &res)
   res[2] = (T)c;
 }
 
+#if CV_SIMD
+  static inline v_float32
+  loadDepthAsFloat(const float* ptr)
+  {
+    return vx_load(ptr);
+  }
+
+  static inline v_float32
+  loadDepthAsFloat(const unsigned short* ptr)
+  {
+    return v_cvt_f32(v_reinterpret_as_s32(vx_load_expand(ptr)));
+  }
+
+  /** LINEMOD normals of the pixels x .. xEnd-1 of the row y, several pixels at once.
+   * Unsigned short depth, the sums of equation (8) and dx, dy are exact in float, so both depth
+   * types take the same float path. d * det goes up to about 1.5e9 though, it and the following
+   * products are rounded where the scalar code for unsigned short depth computes them in integers,
+   * so the normals differ from the scalar ones by a few float ulps
+   * @return the first pixel left for the scalar code
+   */
+  template<typename DepthDepth>
+  static int
+  linemodNormalsRowSIMD(const DepthDepth* p_line, const long* offsets, const long* offsets_x, const long* offsets_y,
+                    int num_offsets, float difference_threshold, const Matx33f& K_inv, int y, int x, int xEnd,
+                    Vec3f* normal)
+  {
+    const int nlanes = v_float32::nlanes;
+    float lanes[nlanes];
+    for (int i = 0; i < nlanes; ++i)
+      lanes[i] = (float)i;
+    const v_float32 lane_x = vx_load(lanes);
+    const v_float32 threshold = vx_setall_f32(difference_threshold);
+    const v_float32 one = vx_setall_f32(1.f), z = vx_setzero_f32();
+    const v_float32 yv = vx_setall_f32((float)y);
+    const v_float32 k00 = vx_setall_f32(K_inv(0, 0)), k01 = vx_setall_f32(K_inv(0, 1)), k02 = vx_setall_f32(K_inv(0, 2));
+    const v_float32 k11 = vx_setall_f32(K_inv(1, 1)), k12 = vx_setall_f32(K_inv(1, 2));
+
+    for (; x <= xEnd - nlanes; x += nlanes, p_line += nlanes, normal += nlanes)
+    {
+      v_float32 d = loadDepthAsFloat(p_line);
+
+      v_float32 A0 = z, A1 = z, A3 = z, b0 = z, b1 = z;
+      for (int i = 0; i < num_offsets; ++i)
+      {
+        v_float32 delta = loadDepthAsFloat(p_line + offsets[i]) - d;
+        // NaN deltas are not skipped, as in the scalar code
+        v_float32 skip = v_abs(delta) > threshold;
+        v_float32 ox = vx_setall_f32((float)offsets_x[i]), oy = vx_setall_f32((float)offsets_y[i]);
+
+        A0 += v_select(skip, z, ox * ox);
+        A1 += v_select(skip, z, ox * oy);
+        A3 += v_select(skip, z, oy * oy);
+        b0 += v_select(skip, z, ox * delta);
+        b1 += v_select(skip, z, oy * delta);
+      }
+
+      // see the scalar code for the explanation
+      v_float32 det = A0 * A3 - A1 * A1;
+      v_float32 dx = A3 * b0 - A1 * b1;
+      v_float32 dy = A0 * b1 - A1 * b0;
+
+      v_float32 xv = vx_setall_f32((float)x) + lane_x;
+      v_float32 d_det = d * det;
+
+      // X1_minus_X and X2_minus_X, their last coordinates are dx and dy
+      v_float32 u1 = d_det + (xv + one) * dx, v1 = yv * dx;
+      v_float32 X1_0 = k00 * u1 + k01 * v1 + k02 * dx;
+      v_float32 X1_1 = k11 * v1 + k12 * dx;
+
+      v_float32 u2 = xv * dy, v2 = d_det + (yv + one) * dy;
+      v_float32 X2_0 = k00 * u2 + k01 * v2 + k02 * dy;
+      v_float32 X2_1 = k11 * v2 + k12 * dy;
+
+      v_float32 n0 = X1_1 * dy - dx * X2_1;
+      v_float32 n1 = dx * X2_0 - X1_0 * dy;
+      v_float32 n2 = X1_0 * X2_1 - X1_1 * X2_0;
+
+      v_float32 norm = v_sqrt(n0 * n0 + n1 * n1 + n2 * n2);
+      v_float32 sign = v_select(n2 > z, z - one, one);
+      v_store_interleave(normal->val, sign * (n0 / norm), sign * (n1 / norm), sign * (n2 / norm));
+    }
+
+    return x;
+  }
+#endif
+
+  template<typename T, typename DepthDepth>
+  static inline int
+  linemodNormalsRow(const DepthDepth*, const long*, const long*, const long*, int, float, const Matx<T, 3, 3>&,
+                    int, int x, int, Vec<T, 3>*)
+  {
+    return x;
+  }
+
+#if CV_SIMD
+  static inline int
+  linemodNormalsRow(const float* p_line, const long* offsets, const long* offsets_x, const long* offsets_y,
+                    int num_offsets, float difference_threshold, const Matx33f& K_inv, int y, int x, int xEnd,
+                    Vec3f* normal)
+  {
+    return linemodNormalsRowSIMD(p_line, offsets, offsets_x, offsets_y, num_offsets, difference_threshold,
+                                 K_inv, y, x, xEnd, normal);
+  }
+
+  static inline int
+  linemodNormalsRow(const unsigned short* p_line, const long* offsets, const long* offsets_x, const long* offsets_y,
+                    int num_offsets, float difference_threshold, const Matx33f& K_inv, int y, int x, int xEnd,
+                    Vec3f* normal)
+  {
+    return linemodNormalsRowSIMD(p_line, offsets, offsets_x, offsets_y, num_offsets, difference_threshold,
+                                 K_inv, y, x, xEnd, normal);
+  }
+#endif
+
   /** Given a depth image, compute the normals as detailed in the LINEMOD paper
    * ``Gradient Response Maps for Real-Time Detection of Texture-Less Objects``
    * by S. Hinterstoisser, C. Cagniart, S. Ilic, P. Sturm, N. Navab, P. Fua, and V. Lepetit
@@ -406,59 +741,66 @@ multiply_by_K_inv(const Matx<T, 3, 3> & K_inv, U a, U b, U c, Vec<T, 3> &res)
       K_inv(1, 1) = 1 / K(1, 1);
       K_inv(1, 2) = -K(1, 2) / K(1, 1);
 
-      Vec3T X1_minus_X, X2_minus_X;
-
       ContainerDepth difference_threshold = 50;
       normals.setTo(std::numeric_limits<DepthDepth>::quiet_NaN());
-      for (int y = r; y < rows_ - r - 1; ++y)
+      parallel_for_(Range(r, rows_ - r - 1), [&](const Range& range)
       {
-        const DepthDepth * p_line = reinterpret_cast<const DepthDepth*>(depth.ptr(y, r));
-        Vec3T *normal = normals.ptr<Vec3T>(y, r);
-
-        for (int x = r; x < cols_ - r - 1; ++x)
+        for (int y = range.start; y < range.end; ++y)
         {
-          DepthDepth d = p_line[0];
-
-          // accum
-          long A[4];
-          A[0] = A[1] = A[2] = A[3] = 0;
-          ContainerDepth b[2];
-          b[0] = b[1] = 0;
-          for (unsigned int i = 0; i < square_size * square_size; ++i) {
-            // We need to cast to ContainerDepth in case we have unsigned DepthDepth
-            ContainerDepth delta = ContainerDepth(p_line[offsets[i]]) - ContainerDepth(d);
-            if (std::abs(delta) > difference_threshold)
-               continue;
-
-             A[0] += offsets_x_x[i];
-             A[1] += offsets_x_y[i];
-             A[3] += offsets_y_y[i];
-             b[0] += offsets_x[i] * delta;
-             b[1] += offsets_y[i] * delta;
-          }
+          const DepthDepth * p_line = reinterpret_cast<const DepthDepth*>(depth.ptr(y, r));
+          Vec3T *normal = normals.ptr<Vec3T>(y, r);
+          Vec3T X1_minus_X, X2_minus_X;
+
+          int x = linemodNormalsRow(p_line, offsets, offsets_x, offsets_y, square_size * square_size,
+                                    (float)difference_threshold, K_inv, y, r, cols_ - r - 1, normal);
+          p_line += x - r;
+          normal += x - r;
 
-          // solve for the optimal gradient D of equation (8)
-          long det = A[0] * A[3] - A[1] * A[1];
-          // We should divide the following two by det, but instead, we multiply
-          // X1_minus_X and X2_minus_X by det (which does not matter as we normalize the normals)
-          // Therefore, no division is done: this is only for speedup
-          ContainerDepth dx = (A[3] * b[0] - A[1] * b[1]);
-          ContainerDepth dy = (-A[1] * b[0] + A[0] * b[1]);
-
-          // Compute the dot product
-          //Vec3T X = K_inv * Vec3T(x, y, 1) * depth(y, x);
-          //Vec3T X1 = K_inv * Vec3T(x + 1, y, 1) * (depth(y, x) + dx);
-          //Vec3T X2 = K_inv * Vec3T(x, y + 1, 1) * (depth(y, x) + dy);
-          //Vec3T nor = (X1 - X).cross(X2 - X);
-          multiply_by_K_inv(K_inv, d * det + (x + 1) * dx, y * dx, dx, X1_minus_X);
-          multiply_by_K_inv(K_inv, x * dy, d * det + (y + 1) * dy, dy, X2_minus_X);
-          Vec3T nor = X1_minus_X.cross(X2_minus_X);
-          signNormal(nor, *normal);
-
-          ++p_line;
-          ++normal;
+          for (; x < cols_ - r - 1; ++x)
+          {
+            DepthDepth d = p_line[0];
+
+            // accum
+            long A[4];
+            A[0] = A[1] = A[2] = A[3] = 0;
+            ContainerDepth b[2];
+            b[0] = b[1] = 0;
+            for (unsigned int i = 0; i < square_size * square_size; ++i) {
+              // We need to cast to ContainerDepth in case we have unsigned DepthDepth
+              ContainerDepth delta = ContainerDepth(p_line[offsets[i]]) - ContainerDepth(d);
+              if (std::abs(delta) > difference_threshold)
+                 continue;
+
+               A[0] += offsets_x_x[i];
+               A[1] += offsets_x_y[i];
+               A[3] += offsets_y_y[i];
+               b[0] += offsets_x[i] * delta;
+               b[1] += offsets_y[i] * delta;
+            }
+
+            // solve for the optimal gradient D of equation (8)
+            long det = A[0] * A[3] - A[1] * A[1];
+            // We should divide the following two by det, but instead, we multiply
+            // X1_minus_X and X2_minus_X by det (which does not matter as we normalize the normals)
+            // Therefore, no division is done: this is only for speedup
+            ContainerDepth dx = (A[3] * b[0] - A[1] * b[1]);
+            ContainerDepth dy = (-A[1] * b[0] + A[0] * b[1]);
+
+            // Compute the dot product
+            //Vec3T X = K_inv * Vec3T(x, y, 1) * depth(y, x);
+            //Vec3T X1 = K_inv * Vec3T(x + 1, y, 1) * (depth(y, x) + dx);
+            //Vec3T X2 = K_inv * Vec3T(x, y + 1, 1) * (depth(y, x) + dy);
+            //Vec3T nor = (X1 - X).cross(X2 - X);
+            multiply_by_K_inv(K_inv, d * det + (x + 1) * dx, y * dx, dx, X1_minus_X);
+            multiply_by_K_inv(K_inv, x * dy, d * det + (y + 1) * dy, dy, X2_minus_X);
+            Vec3T nor = X1_minus_X.cross(X2_minus_X);
+            signNormal(nor, *normal);
+
+            ++p_line;
+            ++normal;
+          }
         }
-      }
+      });
 
       return normals;
     }
@@ -492,6 +834,21 @@ multiply_by_K_inv(const Matx<T, 3, 3> & K_inv, U a, U b, U c, Vec<T, 3> &res)
     virtual void
     cache() CV_OVERRIDE
     {
+      std::vector<Mat> tables;
+      if (getCachedTables(tables))
+      {
+        R_hat_ = tables[0];
+        xy_ = tables[1];
+        fxy_ = tables[2];
+        invxy_ = tables[3];
+        invfxy_ = tables[4];
+        kx_dx_ = tables[5];
+        ky_dx_ = tables[6];
+        kx_dy_ = tables[7];
+        ky_dy_ = tables[8];
+        return;
+      }
+
       Mat_<T> cos_theta, sin_theta, cos_phi, sin_phi;
       computeThetaPhi<T>(rows_, cols_, K_, cos_theta, sin_theta, cos_phi, sin_phi);
 
@@ -560,6 +917,9 @@ multiply_by_K_inv(const Matx<T, 3, 3> & K_inv, U a, U b, U c, Vec<T, 3> &res)
       // the step is not 1. Only need to do it on one dimension as it computes derivatives in only one direction
       kx_dx_ /= theta_step_;
       ky_dy_ /= phi_step_;
+
+      Mat shared[] = { R_hat_, xy_, fxy_, invxy_, invfxy_, kx_dx_, ky_dx_, kx_dy_, ky_dy_ };
+      setCachedTables(std::vector<Mat>(shared, shared + 9));
     }
 
     /** Compute the normals
@@ -739,8 +1099,6 @@ multiply_by_K_inv(const Matx<T, 3, 3> & K_inv, U a, U b, U c, Vec<T, 3> &res)
         break;
       }
     }
-
-    reinterpret_cast<RgbdNormalsImpl *>(rgbd_normals_impl_)->cache();
   }
 
   /** Initializes some data that is cached for later computation
@@ -750,11 +1108,20 @@ multiply_by_K_inv(const Matx<T, 3, 3> & K_inv, U a, U b, U c, Vec<T, 3> &res)
   RgbdNormals::initialize() const
   {
     if (rgbd_normals_impl_ == 0)
+    {
       initialize_normals_impl(rows_, cols_, depth_, K_, window_size_, method_);
+      reinterpret_cast<RgbdNormalsImpl *>(rgbd_normals_impl_)->cache();
+    }
     else if (!reinterpret_cast<RgbdNormalsImpl *>(rgbd_normals_impl_)->validate(rows_, cols_, depth_, K_, window_size_,
                                                                                 method_)) {
-      delete_normals_impl(rgbd_normals_impl_, method_, depth_);
+      // the parameters may have changed the type of the implementation,
+      // the old one goes through the virtual destructor
+      RgbdNormalsImpl *old_impl = reinterpret_cast<RgbdNormalsImpl *>(rgbd_normals_impl_);
       initialize_normals_impl(rows_, cols_, depth_, K_, window_size_, method_);
+      RgbdNormalsImpl *impl = reinterpret_cast<RgbdNormalsImpl *>(rgbd_normals_impl_);
+      impl->takeCachedTables(*old_impl);
+      delete old_impl;
+      impl->cache();
     }
   }
 
@@ -541,223 +541,305 @@ void computeCorresps(const Mat& K, const Mat& K_inv, const Mat& Rt,
     }
 }
 
-static inline
-void calcRgbdEquationCoeffs(double* C, double dIdx, double dIdy, const Point3f& p3d, double fx, double fy)
+// Correspondences reduced to one partial sum of the normal equations
+static const int lsmChunkSize = 256;
+// Upper triangle of 6x6 AtA kept row by row, each row followed by its AtB element
+static const int lsmSumSize = 27;
+
+/** Accumulates the normal equations of Jacobian rows C = [p x v, v], restricted to the columns
+ * [offset, offset + dim), with the right-hand sides wb. The partial sums are kept in floats,
+ * which is enough for lsmChunkSize correspondences.
+ */
+static void accumulateLsmChunk(const float* px, const float* py, const float* pz,
+                               const float* vx, const float* vy, const float* vz, const float* wb,
+                               int count, int offset, int dim, float* sums)
 {
-    double invz  = 1. / p3d.z,
-           v0 = dIdx * fx * invz,
-           v1 = dIdy * fy * invz,
-           v2 = -(v0 * p3d.x + v1 * p3d.y) * invz;
+    const int sumSize = dim*(dim + 3)/2;
+    int k = 0;
+#if CV_SIMD
+    v_float32 acc[lsmSumSize];
+    for(int i = 0; i < sumSize; i++)
+        acc[i] = vx_setzero_f32();
+
+    for(; k <= count - v_float32::nlanes; k += v_float32::nlanes)
+    {
+        v_float32 x = vx_load(px + k), y = vx_load(py + k), z = vx_load(pz + k);
+        v_float32 a = vx_load(vx + k), b = vx_load(vy + k), c = vx_load(vz + k);
+        v_float32 r = vx_load(wb + k);
+
+        v_float32 C[6];
+        C[0] = y*c - z*b;
+        C[1] = z*a - x*c;
+        C[2] = x*b - y*a;
+        C[3] = a;
+        C[4] = b;
+        C[5] = c;
+        const v_float32* A = C + offset;
+
+        int pos = 0;
+        for(int i = 0; i < dim; i++)
+        {
+            for(int j = i; j < dim; j++, pos++)
+                acc[pos] = v_muladd(A[i], A[j], acc[pos]);
+            acc[pos] = v_muladd(A[i], r, acc[pos]);
+            pos++;
+        }
+    }
 
-    C[0] = -p3d.z * v1 + p3d.y * v2;
-    C[1] =  p3d.z * v0 - p3d.x * v2;
-    C[2] = -p3d.y * v0 + p3d.x * v1;
-    C[3] = v0;
-    C[4] = v1;
-    C[5] = v2;
-}
+    for(int i = 0; i < sumSize; i++)
+        sums[i] = v_reduce_sum(acc[i]);
+    vx_cleanup();
+#else
+    for(int i = 0; i < sumSize; i++)
+        sums[i] = 0.f;
+#endif
 
-static inline
-void calcRgbdEquationCoeffsRotation(double* C, double dIdx, double dIdy, const Point3f& p3d, double fx, double fy)
-{
-    double invz  = 1. / p3d.z,
-           v0 = dIdx * fx * invz,
-           v1 = dIdy * fy * invz,
-           v2 = -(v0 * p3d.x + v1 * p3d.y) * invz;
-    C[0] = -p3d.z * v1 + p3d.y * v2;
-    C[1] =  p3d.z * v0 - p3d.x * v2;
-    C[2] = -p3d.y * v0 + p3d.x * v1;
+    for(; k < count; k++)
+    {
+        float C[6];
+        C[0] = py[k]*vz[k] - pz[k]*vy[k];
+        C[1] = pz[k]*vx[k] - px[k]*vz[k];
+        C[2] = px[k]*vy[k] - py[k]*vx[k];
+        C[3] = vx[k];
+        C[4] = vy[k];
+        C[5] = vz[k];
+        const float* A = C + offset;
+
+        int pos = 0;
+        for(int i = 0; i < dim; i++)
+        {
+            for(int j = i; j < dim; j++, pos++)
+                sums[pos] += A[i]*A[j];
+            sums[pos] += A[i]*wb[k];
+            pos++;
+        }
+    }
 }
 
-static inline
-void calcRgbdEquationCoeffsTranslation(double* C, double dIdx, double dIdy, const Point3f& p3d, double fx, double fy)
+/** Sums the chunks in their order, so that the result doesn't depend on the number of threads
+ */
+static void reduceLsmChunks(const Mat_<float>& chunkSums, int dim, Mat& AtA, Mat& AtB)
 {
-    double invz  = 1. / p3d.z,
-           v0 = dIdx * fx * invz,
-           v1 = dIdy * fy * invz,
-           v2 = -(v0 * p3d.x + v1 * p3d.y) * invz;
-    C[0] = v0;
-    C[1] = v1;
-    C[2] = v2;
-}
-
-typedef
-void (*CalcRgbdEquationCoeffsPtr)(double*, double, double, const Point3f&, double, double);
+    const int sumSize = dim*(dim + 3)/2;
+    double total[lsmSumSize] = { 0 };
+    for(int chunk = 0; chunk < chunkSums.rows; chunk++)
+    {
+        const float* sums = chunkSums[chunk];
+        for(int i = 0; i < sumSize; i++)
+            total[i] += sums[i];
+    }
 
-static inline
-void calcICPEquationCoeffs(double* C, const Point3f& p0, const Vec3f& n1)
-{
-    C[0] = -p0.z * n1[1] + p0.y * n1[2];
-    C[1] =  p0.z * n1[0] - p0.x * n1[2];
-    C[2] = -p0.y * n1[0] + p0.x * n1[1];
-    C[3] = n1[0];
-    C[4] = n1[1];
-    C[5] = n1[2];
+    AtA = Mat(dim, dim, CV_64FC1);
+    AtB = Mat(dim, 1, CV_64FC1);
+    int pos = 0;
+    for(int i = 0; i < dim; i++)
+    {
+        // augment lower triangle of AtA by symmetry
+        for(int j = i; j < dim; j++)
+            AtA.at<double>(i, j) = AtA.at<double>(j, i) = total[pos++];
+        AtB.at<double>(i) = total[pos++];
+    }
 }
 
 static inline
-void calcICPEquationCoeffsRotation(double* C, const Point3f& p0, const Vec3f& n1)
+Point3f transformPoint(const Point3f& p, const double* Rt_ptr)
 {
-    C[0] = -p0.z * n1[1] + p0.y * n1[2];
-    C[1] =  p0.z * n1[0] - p0.x * n1[2];
-    C[2] = -p0.y * n1[0] + p0.x * n1[1];
+    return Point3f((float)(p.x * Rt_ptr[0] + p.y * Rt_ptr[1] + p.z * Rt_ptr[2] + Rt_ptr[3]),
+                   (float)(p.x * Rt_ptr[4] + p.y * Rt_ptr[5] + p.z * Rt_ptr[6] + Rt_ptr[7]),
+                   (float)(p.x * Rt_ptr[8] + p.y * Rt_ptr[9] + p.z * Rt_ptr[10] + Rt_ptr[11]));
 }
 
+/** Residual weight of the robust reweighting used by both kinds of odometry
+ */
 static inline
-void calcICPEquationCoeffsTranslation(double* C, const Point3f& /*p0*/, const Vec3f& n1)
+float lsmWeight(double sigma, float diff)
 {
-    C[0] = n1[0];
-    C[1] = n1[1];
-    C[2] = n1[2];
+    double w = sigma + std::abs(diff);
+    return (float)(w > DBL_EPSILON ? 1./w : 1.);
 }
 
-typedef
-void (*CalcICPEquationCoeffsPtr)(double*, const Point3f&, const Vec3f&);
+// Both kinds of odometry fill the points (transformed source cloud) and the residuals first,
+// then reweight the residuals and accumulate the normal equations by chunks in parallel.
+// The Jacobian row of a correspondence is [p x v, v], where v is the weighted normal for ICP and
+// the weighted image gradient scaled by the projection derivative for RGBD.
+// transformOffset and transformDim select the columns used by the transformation type.
 
 static
 void calcRgbdLsmMatrices(const Mat& image0, const Mat& cloud0, const Mat& Rt,
                const Mat& image1, const Mat& dI_dx1, const Mat& dI_dy1,
                const Mat& corresps, double fx, double fy, double sobelScaleIn,
-               Mat& AtA, Mat& AtB, CalcRgbdEquationCoeffsPtr func, int transformDim)
+               Mat& AtA, Mat& AtB, int transformOffset, int transformDim)
 {
-    AtA = Mat(transformDim, transformDim, CV_64FC1, Scalar(0));
-    AtB = Mat(transformDim, 1, CV_64FC1, Scalar(0));
-    double* AtB_ptr = AtB.ptr<double>();
-
     const int correspsCount = corresps.rows;
+    const int nChunks = divUp(correspsCount, lsmChunkSize);
 
     CV_Assert(Rt.type() == CV_64FC1);
     const double * Rt_ptr = Rt.ptr<const double>();
 
-    AutoBuffer<float> diffs(correspsCount);
-    float* diffs_ptr = diffs.data();
+    AutoBuffer<float> buf(4 * correspsCount);
+    float* diffs_ptr = buf.data();
+    float* px = diffs_ptr + correspsCount;
+    float* py = px + correspsCount;
+    float* pz = py + correspsCount;
 
     const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
 
-    double sigma = 0;
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
+    std::vector<double> chunkSigma(nChunks, 0.);
+    parallel_for_(Range(0, nChunks), [&](const Range& range)
     {
-         const Vec4i& c = corresps_ptr[correspIndex];
-         int u0 = c[0], v0 = c[1];
-         int u1 = c[2], v1 = c[3];
+        for(int chunk = range.start; chunk < range.end; chunk++)
+        {
+            const int start = chunk * lsmChunkSize, end = std::min(start + lsmChunkSize, correspsCount);
+            double sigma = 0;
+            for(int correspIndex = start; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u0 = c[0], v0 = c[1];
+                int u1 = c[2], v1 = c[3];
+
+                float diff = static_cast<float>(static_cast<int>(image0.at<uchar>(v0,u0)) -
+                                                static_cast<int>(image1.at<uchar>(v1,u1)));
+                diffs_ptr[correspIndex] = diff;
+                sigma += diff * diff;
+
+                Point3f tp0 = transformPoint(cloud0.at<Point3f>(v0,u0), Rt_ptr);
+                px[correspIndex] = tp0.x;
+                py[correspIndex] = tp0.y;
+                pz[correspIndex] = tp0.z;
+            }
+            chunkSigma[chunk] = sigma;
+        }
+    });
 
-         diffs_ptr[correspIndex] = static_cast<float>(static_cast<int>(image0.at<uchar>(v0,u0)) -
-                                                      static_cast<int>(image1.at<uchar>(v1,u1)));
-         sigma += diffs_ptr[correspIndex] * diffs_ptr[correspIndex];
-    }
+    double sigma = 0;
+    for(int chunk = 0; chunk < nChunks; chunk++)
+        sigma += chunkSigma[chunk];
     sigma = std::sqrt(sigma/correspsCount);
 
-    std::vector<double> A_buf(transformDim);
-    double* A_ptr = &A_buf[0];
-
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
+    Mat_<float> chunkSums(nChunks, lsmSumSize);
+    parallel_for_(Range(0, nChunks), [&](const Range& range)
     {
-         const Vec4i& c = corresps_ptr[correspIndex];
-         int u0 = c[0], v0 = c[1];
-         int u1 = c[2], v1 = c[3];
-
-         double w = sigma + std::abs(diffs_ptr[correspIndex]);
-         w = w > DBL_EPSILON ? 1./w : 1.;
-
-         double w_sobelScale = w * sobelScaleIn;
-
-         const Point3f& p0 = cloud0.at<Point3f>(v0,u0);
-         Point3f tp0;
-         tp0.x = (float)(p0.x * Rt_ptr[0] + p0.y * Rt_ptr[1] + p0.z * Rt_ptr[2] + Rt_ptr[3]);
-         tp0.y = (float)(p0.x * Rt_ptr[4] + p0.y * Rt_ptr[5] + p0.z * Rt_ptr[6] + Rt_ptr[7]);
-         tp0.z = (float)(p0.x * Rt_ptr[8] + p0.y * Rt_ptr[9] + p0.z * Rt_ptr[10] + Rt_ptr[11]);
+        AutoBuffer<float> vbuf(4 * lsmChunkSize);
+        float* vx = vbuf.data();
+        float* vy = vx + lsmChunkSize;
+        float* vz = vy + lsmChunkSize;
+        float* wb = vz + lsmChunkSize;
 
-         func(A_ptr,
-              w_sobelScale * dI_dx1.at<short int>(v1,u1),
-              w_sobelScale * dI_dy1.at<short int>(v1,u1),
-              tp0, fx, fy);
-
-        for(int y = 0; y < transformDim; y++)
+        for(int chunk = range.start; chunk < range.end; chunk++)
         {
-            double* AtA_ptr = AtA.ptr<double>(y);
-            for(int x = y; x < transformDim; x++)
-                AtA_ptr[x] += A_ptr[y] * A_ptr[x];
+            const int start = chunk * lsmChunkSize, end = std::min(start + lsmChunkSize, correspsCount);
+            for(int correspIndex = start; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u1 = c[2], v1 = c[3];
+                int k = correspIndex - start;
+
+                float w = lsmWeight(sigma, diffs_ptr[correspIndex]);
+                double w_sobelScale = w * sobelScaleIn;
+
+                double invz = 1. / pz[correspIndex],
+                       g0 = w_sobelScale * dI_dx1.at<short int>(v1,u1) * fx * invz,
+                       g1 = w_sobelScale * dI_dy1.at<short int>(v1,u1) * fy * invz,
+                       g2 = -(g0 * px[correspIndex] + g1 * py[correspIndex]) * invz;
+                vx[k] = (float)g0;
+                vy[k] = (float)g1;
+                vz[k] = (float)g2;
+                wb[k] = w * diffs_ptr[correspIndex];
+            }
 
-            AtB_ptr[y] += A_ptr[y] * w * diffs_ptr[correspIndex];
+            accumulateLsmChunk(px + start, py + start, pz + start, vx, vy, vz, wb,
+                               end - start, transformOffset, transformDim, chunkSums[chunk]);
         }
-    }
+    });
 
-    for(int y = 0; y < transformDim; y++)
-        for(int x = y+1; x < transformDim; x++)
-            AtA.at<double>(x,y) = AtA.at<double>(y,x);
+    reduceLsmChunks(chunkSums, transformDim, AtA, AtB);
 }
 
 static
 void calcICPLsmMatrices(const Mat& cloud0, const Mat& Rt,
                         const Mat& cloud1, const Mat& normals1,
                         const Mat& corresps,
-                        Mat& AtA, Mat& AtB, CalcICPEquationCoeffsPtr func, int transformDim)
+                        Mat& AtA, Mat& AtB, int transformOffset, int transformDim)
 {
-    AtA = Mat(transformDim, transformDim, CV_64FC1, Scalar(0));
-    AtB = Mat(transformDim, 1, CV_64FC1, Scalar(0));
-    double* AtB_ptr = AtB.ptr<double>();
-
     const int correspsCount = corresps.rows;
+    const int nChunks = divUp(correspsCount, lsmChunkSize);
 
     CV_Assert(Rt.type() == CV_64FC1);
     const double * Rt_ptr = Rt.ptr<const double>();
 
-    AutoBuffer<float> diffs(correspsCount);
-    float * diffs_ptr = diffs.data();
-
-    AutoBuffer<Point3f> transformedPoints0(correspsCount);
-    Point3f * tps0_ptr = transformedPoints0.data();
+    AutoBuffer<float> buf(4 * correspsCount);
+    float* diffs_ptr = buf.data();
+    float* px = diffs_ptr + correspsCount;
+    float* py = px + correspsCount;
+    float* pz = py + correspsCount;
 
     const Vec4i* corresps_ptr = corresps.ptr<Vec4i>();
 
-    double sigma = 0;
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
+    std::vector<double> chunkSigma(nChunks, 0.);
+    parallel_for_(Range(0, nChunks), [&](const Range& range)
     {
-        const Vec4i& c = corresps_ptr[correspIndex];
-        int u0 = c[0], v0 = c[1];
-        int u1 = c[2], v1 = c[3];
-
-        const Point3f& p0 = cloud0.at<Point3f>(v0,u0);
-        Point3f tp0;
-        tp0.x = (float)(p0.x * Rt_ptr[0] + p0.y * Rt_ptr[1] + p0.z * Rt_ptr[2] + Rt_ptr[3]);
-        tp0.y = (float)(p0.x * Rt_ptr[4] + p0.y * Rt_ptr[5] + p0.z * Rt_ptr[6] + Rt_ptr[7]);
-        tp0.z = (float)(p0.x * Rt_ptr[8] + p0.y * Rt_ptr[9] + p0.z * Rt_ptr[10] + Rt_ptr[11]);
-
-        Vec3f n1 = normals1.at<Vec3f>(v1, u1);
-        Point3f v = cloud1.at<Point3f>(v1,u1) - tp0;
-
-        tps0_ptr[correspIndex] = tp0;
-        diffs_ptr[correspIndex] = n1[0] * v.x + n1[1] * v.y + n1[2] * v.z;
-        sigma += diffs_ptr[correspIndex] * diffs_ptr[correspIndex];
-    }
+        for(int chunk = range.start; chunk < range.end; chunk++)
+        {
+            const int start = chunk * lsmChunkSize, end = std::min(start + lsmChunkSize, correspsCount);
+            double sigma = 0;
+            for(int correspIndex = start; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u0 = c[0], v0 = c[1];
+                int u1 = c[2], v1 = c[3];
 
-    sigma = std::sqrt(sigma/correspsCount);
+                Point3f tp0 = transformPoint(cloud0.at<Point3f>(v0,u0), Rt_ptr);
 
-    std::vector<double> A_buf(transformDim);
-    double* A_ptr = &A_buf[0];
-    for(int correspIndex = 0; correspIndex < corresps.rows; correspIndex++)
-    {
-        const Vec4i& c = corresps_ptr[correspIndex];
-        int u1 = c[2], v1 = c[3];
+                Vec3f n1 = normals1.at<Vec3f>(v1, u1);
+                Point3f v = cloud1.at<Point3f>(v1,u1) - tp0;
+
+                px[correspIndex] = tp0.x;
+                py[correspIndex] = tp0.y;
+                pz[correspIndex] = tp0.z;
+                diffs_ptr[correspIndex] = n1[0] * v.x + n1[1] * v.y + n1[2] * v.z;
+                sigma += diffs_ptr[correspIndex] * diffs_ptr[correspIndex];
+            }
+            chunkSigma[chunk] = sigma;
+        }
+    });
 
-        double w = sigma + std::abs(diffs_ptr[correspIndex]);
-        w = w > DBL_EPSILON ? 1./w : 1.;
+    double sigma = 0;
+    for(int chunk = 0; chunk < nChunks; chunk++)
+        sigma += chunkSigma[chunk];
+    sigma = std::sqrt(sigma/correspsCount);
 
-        func(A_ptr, tps0_ptr[correspIndex], normals1.at<Vec3f>(v1, u1) * w);
+    Mat_<float> chunkSums(nChunks, lsmSumSize);
+    parallel_for_(Range(0, nChunks), [&](const Range& range)
+    {
+        AutoBuffer<float> vbuf(4 * lsmChunkSize);
+        float* vx = vbuf.data();
+        float* vy = vx + lsmChunkSize;
+        float* vz = vy + lsmChunkSize;
+        float* wb = vz + lsmChunkSize;
 
-        for(int y = 0; y < transformDim; y++)
+        for(int chunk = range.start; chunk < range.end; chunk++)
         {
-            double* AtA_ptr = AtA.ptr<double>(y);
-            for(int x = y; x < transformDim; x++)
-                AtA_ptr[x] += A_ptr[y] * A_ptr[x];
+            const int start = chunk * lsmChunkSize, end = std::min(start + lsmChunkSize, correspsCount);
+            for(int correspIndex = start; correspIndex < end; correspIndex++)
+            {
+                const Vec4i& c = corresps_ptr[correspIndex];
+                int u1 = c[2], v1 = c[3];
+                int k = correspIndex - start;
+
+                float w = lsmWeight(sigma, diffs_ptr[correspIndex]);
+                Vec3f n1 = normals1.at<Vec3f>(v1, u1) * w;
+                vx[k] = n1[0];
+                vy[k] = n1[1];
+                vz[k] = n1[2];
+                wb[k] = w * diffs_ptr[correspIndex];
+            }
 
-            AtB_ptr[y] += A_ptr[y] * w * diffs_ptr[correspIndex];
+            accumulateLsmChunk(px + start, py + start, pz + start, vx, vy, vz, wb,
+                               end - start, transformOffset, transformDim, chunkSums[chunk]);
         }
-    }
+    });
 
-    for(int y = 0; y < transformDim; y++)
-        for(int x = y+1; x < transformDim; x++)
-            AtA.at<double>(x,y) = AtA.at<double>(y,x);
+    reduceLsmChunks(chunkSums, transformDim, AtA, AtB);
 }
 
 static
@@ -795,25 +877,19 @@ bool RGBDICPOdometryImpl(OutputArray _Rt, const Mat& initRt,
                          double maxTranslation, double maxRotation,
                          int method, int transfromType)
 {
-    int transformDim = -1;
-    CalcRgbdEquationCoeffsPtr rgbdEquationFuncPtr = 0;
-    CalcICPEquationCoeffsPtr icpEquationFuncPtr = 0;
+    // the columns of the full [rotation, translation] Jacobian used by the transformation type
+    int transformDim = -1, transformOffset = 0;
     switch(transfromType)
     {
     case Odometry::RIGID_BODY_MOTION:
         transformDim = 6;
-        rgbdEquationFuncPtr = calcRgbdEquationCoeffs;
-        icpEquationFuncPtr = calcICPEquationCoeffs;
         break;
     case Odometry::ROTATION:
         transformDim = 3;
-        rgbdEquationFuncPtr = calcRgbdEquationCoeffsRotation;
-        icpEquationFuncPtr = calcICPEquationCoeffsRotation;
         break;
     case Odometry::TRANSLATION:
         transformDim = 3;
-        rgbdEquationFuncPtr = calcRgbdEquationCoeffsTranslation;
-        icpEquationFuncPtr = calcICPEquationCoeffsTranslation;
+        transformOffset = 3;
         break;
     default:
         CV_Error(Error::StsBadArg, "Incorrect transformation type");
@@ -867,7 +943,7 @@ bool RGBDICPOdometryImpl(OutputArray _Rt, const Mat& initRt,
                 calcRgbdLsmMatrices(srcFrame->pyramidImage[level], srcFrame->pyramidCloud[level], resultRt,
                                     dstFrame->pyramidImage[level], dstFrame->pyramid_dI_dx[level], dstFrame->pyramid_dI_dy[level],
                                     corresps_rgbd, fx, fy, sobelScale,
-                                    AtA_rgbd, AtB_rgbd, rgbdEquationFuncPtr, transformDim);
+                                    AtA_rgbd, AtB_rgbd, transformOffset, transformDim);
 
                 AtA += AtA_rgbd;
                 AtB += AtB_rgbd;
@@ -876,7 +952,7 @@ bool RGBDICPOdometryImpl(OutputArray _Rt, const Mat& initRt,
             {
                 calcICPLsmMatrices(srcFrame->pyramidCloud[level], resultRt,
                                    dstFrame->pyramidCloud[level], dstFrame->pyramidNormals[level],
-                                   corresps_icp, AtA_icp, AtB_icp, icpEquationFuncPtr, transformDim);
+                                   corresps_icp, AtA_icp, AtB_icp, transformOffset, transformDim);
                 AtA += AtA_icp;
                 AtB += AtB_icp;
             }
@@ -15,6 +15,7 @@
  */
 
 #include "precomp.hpp"
+#include <atomic>
 
 namespace cv
 {
@@ -98,6 +99,16 @@ public:
     ++K_;
   }
 
+  /** Add the sums of several points at once
+   */
+  void
+  UpdateStatistics(const Vec3f & m_sum, const Matx33f & Q, int K)
+  {
+    m_sum_ += m_sum;
+    Q_ += Q;
+    K_ += K;
+  }
+
   inline size_t
   empty() const
   {
@@ -211,63 +222,70 @@ public:
     if (points3d.cols % block_size != 0)
       ++mini_cols;
 
-    // Compute all the interesting quantities
+    // Compute all the interesting quantities, the tiles are independent
     m_.create(mini_rows, mini_cols);
     n_.create(mini_rows, mini_cols);
     Q_.create(points3d.rows, points3d.cols);
     mse_.create(mini_rows, mini_cols);
-    for (int y = 0; y < mini_rows; ++y)
-      for (int x = 0; x < mini_cols; ++x)
-      {
-        // Update the tiles
-        Matx33f Q = Matx33f::zeros();
-        Vec3f m = Vec3f(0, 0, 0);
-        int K = 0;
-        for (int j = y * block_size; j < std::min((y + 1) * block_size, points3d.rows); ++j)
+    K_.create(mini_rows, mini_cols);
+    Q_sum_.create(mini_rows, mini_cols);
+    parallel_for_(Range(0, mini_rows), [&](const Range& range)
+    {
+      for (int y = range.start; y < range.end; ++y)
+        for (int x = 0; x < mini_cols; ++x)
         {
-          const Vec3f * vec = points3d.ptr < Vec3f > (j, x * block_size), *vec_end;
-          float * pointpointt = reinterpret_cast<float*>(Q_.ptr < Vec<float, 9> > (j, x * block_size));
-          if (x == mini_cols - 1)
-            vec_end = points3d.ptr < Vec3f > (j, points3d.cols - 1) + 1;
-          else
-            vec_end = vec + block_size;
-          for (; vec != vec_end; ++vec, pointpointt += 9)
+          // Update the tiles
+          Matx33f Q = Matx33f::zeros();
+          Vec3f m = Vec3f(0, 0, 0);
+          int K = 0;
+          for (int j = y * block_size; j < std::min((y + 1) * block_size, points3d.rows); ++j)
           {
-            if (cvIsNaN(vec->val[0]))
-              continue;
-            // Fill point*point.t()
-            *pointpointt = vec->val[0] * vec->val[0];
-            *(pointpointt + 1) = vec->val[0] * vec->val[1];
-            *(pointpointt + 2) = vec->val[0] * vec->val[2];
-            *(pointpointt + 3) = *(pointpointt + 1);
-            *(pointpointt + 4) = vec->val[1] * vec->val[1];
-            *(pointpointt + 5) = vec->val[1] * vec->val[2];
-            *(pointpointt + 6) = *(pointpointt + 2);
-            *(pointpointt + 7) = *(pointpointt + 5);
-            *(pointpointt + 8) = vec->val[2] * vec->val[2];
-
-            Q += *reinterpret_cast<Matx33f*>(pointpointt);
-            m += (*vec);
-            ++K;
+            const Vec3f * vec = points3d.ptr < Vec3f > (j, x * block_size), *vec_end;
+            float * pointpointt = reinterpret_cast<float*>(Q_.ptr < Vec<float, 9> > (j, x * block_size));
+            if (x == mini_cols - 1)
+              vec_end = points3d.ptr < Vec3f > (j, points3d.cols - 1) + 1;
+            else
+              vec_end = vec + block_size;
+            for (; vec != vec_end; ++vec, pointpointt += 9)
+            {
+              if (cvIsNaN(vec->val[0]))
+                continue;
+              // Fill point*point.t()
+              *pointpointt = vec->val[0] * vec->val[0];
+              *(pointpointt + 1) = vec->val[0] * vec->val[1];
+              *(pointpointt + 2) = vec->val[0] * vec->val[2];
+              *(pointpointt + 3) = *(pointpointt + 1);
+              *(pointpointt + 4) = vec->val[1] * vec->val[1];
+              *(pointpointt + 5) = vec->val[1] * vec->val[2];
+              *(pointpointt + 6) = *(pointpointt + 2);
+              *(pointpointt + 7) = *(pointpointt + 5);
+              *(pointpointt + 8) = vec->val[2] * vec->val[2];
+
+              Q += *reinterpret_cast<Matx33f*>(pointpointt);
+              m += (*vec);
+              ++K;
+            }
+          }
+          K_(y, x) = K;
+          Q_sum_(y, x) = Vec<float, 9>(Q.val);
+          if (K == 0)
+          {
+            mse_(y, x) = std::numeric_limits<float>::max();
+            continue;
           }
-        }
-        if (K == 0)
-        {
-          mse_(y, x) = std::numeric_limits<float>::max();
-          continue;
-        }
 
-        m /= K;
-        m_(y, x) = m;
+          m /= K;
+          m_(y, x) = m;
 
-        // Compute C
-        Matx33f C = Q - K * m * m.t();
+          // Compute C
+          Matx33f C = Q - K * m * m.t();
 
-        // Compute n
-        SVD svd(C);
-        n_(y, x) = Vec3f(svd.vt.at<float>(2, 0), svd.vt.at<float>(2, 1), svd.vt.at<float>(2, 2));
-        mse_(y, x) = svd.w.at<float>(2) / K;
-      }
+          // Compute n
+          SVD svd(C);
+          n_(y, x) = Vec3f(svd.vt.at<float>(2, 0), svd.vt.at<float>(2, 1), svd.vt.at<float>(2, 2));
+          mse_(y, x) = svd.w.at<float>(2) / K;
+        }
+    });
   }
 
   /** The size of the block */
@@ -276,228 +294,140 @@ public:
   Mat_<Vec3f> n_;
   Mat_<Vec<float, 9> > Q_;
   Mat_<float> mse_;
+  /** The number of points and the sum of point*point.t() of the tiles */
+  Mat_<int> K_;
+  Mat_<Vec<float, 9> > Q_sum_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-class TileQueue
+/** Union-find over the tiles, unions can be done concurrently
+ */
+class TileUnionFind
 {
 public:
-  struct PlaneTile
-  {
-    PlaneTile(int x, int y, float mse)
-        :
-          x_(x),
-          y_(y),
-          mse_(mse)
-    {
-    }
-
-    bool
-    operator<(const PlaneTile &tile2) const
-    {
-      return mse_ < tile2.mse_;
-    }
-
-    int x_;
-    int y_;
-    float mse_;
-  };
-
-  TileQueue(const PlaneGrid &plane_grid)
+  explicit
+  TileUnionFind(int n)
+      :
+        parent_(n)
   {
-    done_tiles_ = Mat_<unsigned char>::zeros(plane_grid.mse_.rows, plane_grid.mse_.cols);
-    tiles_.clear();
-    for (int y = 0; y < plane_grid.mse_.rows; ++y)
-      for (int x = 0; x < plane_grid.mse_.cols; ++x)
-        if (plane_grid.mse_(y, x) != std::numeric_limits<float>::max())
-          // Update the tiles
-          tiles_.push_back(PlaneTile(x, y, plane_grid.mse_(y, x)));
-    // Sort tiles by MSE
-    tiles_.sort();
+    for (int i = 0; i < n; ++i)
+      parent_[i].store(i);
   }
 
-  bool
-  empty()
+  int
+  find(int i)
   {
-    while (!tiles_.empty())
+    for (;;)
     {
-      const PlaneTile & tile = tiles_.front();
-      if (done_tiles_(tile.y_, tile.x_))
-        tiles_.pop_front();
-      else
-        break;
+      int p = parent_[i].load();
+      if (p == i)
+        return i;
+      // Path halving, it does not matter if another thread has changed the parent meanwhile
+      int gp = parent_[p].load();
+      parent_[i].compare_exchange_weak(p, gp);
+      i = gp;
     }
-    return tiles_.empty();
-  }
-
-  const PlaneTile &
-  front() const
-  {
-    return tiles_.front();
   }
 
   void
-  remove(int y, int x)
+  unite(int a, int b)
   {
-    done_tiles_(y, x) = 1;
+    for (;;)
+    {
+      a = find(a);
+      b = find(b);
+      if (a == b)
+        return;
+      // The smaller index becomes the root, so the roots do not depend on the order of the unions
+      if (a > b)
+        std::swap(a, b);
+      int expected = b;
+      if (parent_[b].compare_exchange_strong(expected, a))
+        return;
+    }
   }
+
 private:
-  /** The list of tiles ordered from most planar to least */
-  std::list<PlaneTile> tiles_;
-  /** contains 1 when the tiles has been studied, 0 otherwise */
-  Mat_<unsigned char> done_tiles_;
+  std::vector<std::atomic<int> > parent_;
 };
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-class InlierFinder
+/** The sums of the points of a tile that belong to a plane */
+struct PlaneTileStatistics
 {
-public:
-  InlierFinder(float err, const Mat_<Vec3f> & points3d, const Mat_<Vec3f> & normals,
-               unsigned char plane_index, int block_size)
+  PlaneTileStatistics(int plane)
       :
-        err_(err),
-        points3d_(points3d),
-        normals_(normals),
-        plane_index_(plane_index),
-        block_size_(block_size)
+        plane_(plane),
+        m_sum_(Vec3f(0, 0, 0)),
+        Q_(Matx33f::zeros()),
+        K_(0)
   {
   }
 
-  void
-  Find(const PlaneGrid &plane_grid, Ptr<PlaneBase> & plane, TileQueue & tile_queue,
-       std::set<TileQueue::PlaneTile> & neighboring_tiles, Mat_<unsigned char> & overall_mask,
-       Mat_<unsigned char> & plane_mask)
-  {
-    // Do not use reference as we pop the from later on
-    TileQueue::PlaneTile tile = *(neighboring_tiles.begin());
-
-    // Figure the part of the image to look at
-    Range range_x, range_y;
-    int x = tile.x_ * block_size_, y = tile.y_ * block_size_;
-
-    if (tile.x_ == plane_mask.cols - 1)
-      range_x = Range(x, overall_mask.cols);
-    else
-      range_x = Range(x, x + block_size_);
-
-    if (tile.y_ == plane_mask.rows - 1)
-      range_y = Range(y, overall_mask.rows);
-    else
-      range_y = Range(y, y + block_size_);
-
-    int n_valid_points = 0;
-    for (int yy = range_y.start; yy != range_y.end; ++yy)
-    {
-      uchar* data = overall_mask.ptr(yy, range_x.start), *data_end = data + range_x.size();
-      const Vec3f* point = points3d_.ptr < Vec3f > (yy, range_x.start);
-      const Matx33f* Q_local = reinterpret_cast<const Matx33f *>(plane_grid.Q_.ptr < Vec<float, 9>
-          > (yy, range_x.start));
-
-      // Depending on whether you have a normal, check it
-      if (!normals_.empty())
-      {
-        const Vec3f* normal = normals_.ptr < Vec3f > (yy, range_x.start);
-        for (; data != data_end; ++data, ++point, ++normal, ++Q_local)
-        {
-          // Don't do anything if the point already belongs to another plane
-          if (cvIsNaN(point->val[0]) || ((*data) != 255))
-            continue;
-
-          // If the point is close enough to the plane
-          if (plane->distance(*point) < err_)
-          {
-            // make sure the normals are similar to the plane
-            if (std::abs(plane->n().dot(*normal)) > 0.3)
-            {
-              // The point now belongs to the plane
-              plane->UpdateStatistics(*point, *Q_local);
-              *data = plane_index_;
-              ++n_valid_points;
-            }
-          }
-        }
-      }
-      else
-      {
-        for (; data != data_end; ++data, ++point, ++Q_local)
-        {
-          // Don't do anything if the point already belongs to another plane
-          if (cvIsNaN(point->val[0]) || ((*data) != 255))
-            continue;
-
-          // If the point is close enough to the plane
-          if (plane->distance(*point) < err_)
-          {
-            // The point now belongs to the plane
-            plane->UpdateStatistics(*point, *Q_local);
-            *data = plane_index_;
-            ++n_valid_points;
-          }
-        }
-      }
-    }
+  int plane_;
+  Vec3f m_sum_;
+  Matx33f Q_;
+  int K_;
+};
 
-    plane->UpdateParameters();
+static Ptr<PlaneBase>
+createPlane(const Vec3f & m, const Vec3f &n, int index, double sensor_error_a, double sensor_error_b,
+            double sensor_error_c)
+{
+  if ((sensor_error_a == 0) && (sensor_error_b == 0) && (sensor_error_c == 0))
+    return Ptr<PlaneBase>(new Plane(m, n, index));
+  return Ptr<PlaneBase>(new PlaneABC(m, n, index, (float)sensor_error_a, (float)sensor_error_b,
+                                     (float)sensor_error_c));
+}
 
-    // Mark the front as being done and pop it
-    if (n_valid_points > (range_x.size() * range_y.size()) / 2)
-      tile_queue.remove(tile.y_, tile.x_);
-    plane_mask(tile.y_, tile.x_) = 1;
-    neighboring_tiles.erase(neighboring_tiles.begin());
+/** The part of the image covered by a tile, the last row and column of tiles take the remaining pixels */
+static Rect
+tileRect(const Size & size, int block_size, int mini_rows, int mini_cols, int tile_x, int tile_y)
+{
+  int x = tile_x * block_size, y = tile_y * block_size;
+  return Rect(x, y, (tile_x == mini_cols - 1 ? size.width : x + block_size) - x,
+              (tile_y == mini_rows - 1 ? size.height : y + block_size) - y);
+}
 
-    // Add potential neighbors of the tile
-    std::vector<std::pair<int, int> > pairs;
-    if (tile.x_ > 0)
-      for (unsigned char * val = overall_mask.ptr<unsigned char>(range_y.start, range_x.start), *val_end = val
-          + range_y.size() * overall_mask.step; val != val_end; val += overall_mask.step)
-        if (*val == plane_index_)
-        {
-          pairs.push_back(std::pair<int, int>(tile.x_ - 1, tile.y_));
-          break;
-        }
-    if (tile.x_ < plane_mask.cols - 1)
-      for (unsigned char * val = overall_mask.ptr<unsigned char>(range_y.start, range_x.end - 1), *val_end = val
-          + range_y.size() * overall_mask.step; val != val_end; val += overall_mask.step)
-        if (*val == plane_index_)
-        {
-          pairs.push_back(std::pair<int, int>(tile.x_ + 1, tile.y_));
-          break;
-        }
-    if (tile.y_ > 0)
-      for (unsigned char * val = overall_mask.ptr<unsigned char>(range_y.start, range_x.start), *val_end = val
-          + range_x.size(); val != val_end; ++val)
-        if (*val == plane_index_)
-        {
-          pairs.push_back(std::pair<int, int>(tile.x_, tile.y_ - 1));
-          break;
-        }
-    if (tile.y_ < plane_mask.rows - 1)
-      for (unsigned char * val = overall_mask.ptr<unsigned char>(range_y.end - 1, range_x.start), *val_end = val
-          + range_x.size(); val != val_end; ++val)
-        if (*val == plane_index_)
-        {
-          pairs.push_back(std::pair<int, int>(tile.x_, tile.y_ + 1));
-          break;
-        }
+/** Whether a point can belong to a plane: it is close enough and its normal, if any, is similar */
+static inline bool
+isInlier(const PlaneBase & plane, const Vec3f & point, const Vec3f * normal, float err)
+{
+  return (plane.distance(point) < err) && (!normal || std::abs(plane.n().dot(*normal)) > 0.3);
+}
 
-    for (unsigned char i = 0; i < pairs.size(); ++i)
-      if (!plane_mask(pairs[i].second, pairs[i].first))
-        neighboring_tiles.insert(
-            TileQueue::PlaneTile(pairs[i].first, pairs[i].second, plane_grid.mse_(pairs[i].second, pairs[i].first)));
+/** The number of points of a tile which can belong to a plane */
+static int
+tileInliers(const Mat_<Vec3f> & points3d, const Mat_<Vec3f> & normals, const PlaneBase & plane, const Rect & rect,
+            float err)
+{
+  int n_inliers = 0;
+  for (int yy = rect.y; yy < rect.y + rect.height; ++yy)
+  {
+    const Vec3f* point = points3d.ptr < Vec3f > (yy, rect.x);
+    const Vec3f* normal = normals.empty() ? 0 : normals.ptr < Vec3f > (yy, rect.x);
+    for (int xx = 0; xx < rect.width; ++xx)
+      if (!cvIsNaN(point[xx][0]) && isInlier(plane, point[xx], normal ? normal + xx : 0, err))
+        ++n_inliers;
   }
+  return n_inliers;
+}
 
-private:
-  float err_;
-  const Mat_<Vec3f> & points3d_;
-  const Mat_<Vec3f> & normals_;
-  unsigned char plane_index_;
-  /** THe block size as defined in the main algorithm */
-  int block_size_;
+/** Two neighboring tiles are merged if the plane of one of them takes more than half of the other one,
+ * which is when the growing plane used to mark a tile as done so that it could not start another plane
+ */
+static bool
+tilesCoplanar(const Mat_<Vec3f> & points3d, const Mat_<Vec3f> & normals,
+              const std::vector<Ptr<PlaneBase> > & tile_planes, const std::vector<Rect> & tile_rects,
+              int tile1, int tile2, float err)
+{
+  const Ptr<PlaneBase> & plane1 = tile_planes[tile1], &plane2 = tile_planes[tile2];
+  if (plane1.empty() || plane2.empty())
+    return false;
 
-  const InlierFinder & operator = (const InlierFinder &);
-};
+  return (tileInliers(points3d, normals, *plane1, tile_rects[tile2], err) > tile_rects[tile2].area() / 2)
+         || (tileInliers(points3d, normals, *plane2, tile_rects[tile1], err) > tile_rects[tile1].area() / 2);
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -552,75 +482,228 @@ private:
     Mat_<unsigned char> mask_out_uc = (Mat_<unsigned char>&) mask_out_mat;
     mask_out_uc.setTo(255);
     PlaneGrid plane_grid(points3d, block_size_);
-    TileQueue plane_queue(plane_grid);
-    size_t index_plane = 0;
-
-    std::vector<Vec4f> plane_coefficients;
+    const int mini_rows = plane_grid.mse_.rows, mini_cols = plane_grid.mse_.cols, n_tiles = mini_rows * mini_cols;
+    const float err = (float)threshold_;
     float mse_min = (float)(threshold_ * threshold_);
 
-    while (!plane_queue.empty())
-    {
-      // Get the first tile if it's good enough
-      const TileQueue::PlaneTile front_tile = plane_queue.front();
-      if (front_tile.mse_ > mse_min)
-        break;
-
-      InlierFinder inlier_finder((float)threshold_, points3d, normals, (unsigned char)index_plane, block_size_);
-
-      // Construct the plane for the first tile
-      int x = front_tile.x_, y = front_tile.y_;
-      const Vec3f & n = plane_grid.n_(y, x);
-      Ptr<PlaneBase> plane;
-      if ((sensor_error_a_ == 0) && (sensor_error_b_ == 0) && (sensor_error_c_ == 0))
-        plane = Ptr<PlaneBase>(new Plane(plane_grid.m_(y, x), n, (int)index_plane));
-      else
-        plane = Ptr<PlaneBase>(new PlaneABC(plane_grid.m_(y, x), n, (int)index_plane,
-			(float)sensor_error_a_, (float)sensor_error_b_, (float)sensor_error_c_));
+    std::vector<Rect> tile_rects(n_tiles);
+    for (int y = 0; y < mini_rows; ++y)
+      for (int x = 0; x < mini_cols; ++x)
+        tile_rects[y * mini_cols + x] = tileRect(points3d.size(), block_size_, mini_rows, mini_cols, x, y);
 
-      Mat_<unsigned char> plane_mask = Mat_<unsigned char>::zeros(divUp(points3d.rows, block_size_),
-                                                                  divUp(points3d.cols, block_size_));
-      std::set<TileQueue::PlaneTile> neighboring_tiles;
-      neighboring_tiles.insert(front_tile);
-      plane_queue.remove(front_tile.y_, front_tile.x_);
+    // The tiles planar enough to start a plane
+    std::vector<Ptr<PlaneBase> > tile_planes(n_tiles);
+    for (int y = 0; y < mini_rows; ++y)
+      for (int x = 0; x < mini_cols; ++x)
+        if (plane_grid.mse_(y, x) <= mse_min)
+          tile_planes[y * mini_cols + x] = createPlane(plane_grid.m_(y, x), plane_grid.n_(y, x), -1, sensor_error_a_,
+                                                       sensor_error_b_, sensor_error_c_);
 
-      // Process all the neighboring tiles
-      while (!neighboring_tiles.empty())
-        inlier_finder.Find(plane_grid, plane, plane_queue, neighboring_tiles, mask_out_uc, plane_mask);
+    // Merge the neighboring tiles of the same plane
+    TileUnionFind tiles(n_tiles);
+    parallel_for_(Range(0, mini_rows), [&](const Range& range)
+    {
+      for (int y = range.start; y < range.end; ++y)
+        for (int x = 0; x < mini_cols; ++x)
+        {
+          int tile = y * mini_cols + x;
+          if (x < mini_cols - 1 && tilesCoplanar(points3d, normals, tile_planes, tile_rects, tile, tile + 1, err))
+            tiles.unite(tile, tile + 1);
+          if (y < mini_rows - 1
+              && tilesCoplanar(points3d, normals, tile_planes, tile_rects, tile, tile + mini_cols, err))
+            tiles.unite(tile, tile + mini_cols);
+        }
+    });
 
-      // Don't record the plane if it's empty
-      if (plane->empty())
+    // Order the groups of tiles from the most planar one, as the planes used to be grown
+    std::vector<float> root_mse(n_tiles, std::numeric_limits<float>::max());
+    std::vector<int> tile_root(n_tiles, -1);
+    for (int tile = 0; tile < n_tiles; ++tile)
+    {
+      if (tile_planes[tile].empty())
+        continue;
+      tile_root[tile] = tiles.find(tile);
+      root_mse[tile_root[tile]] = std::min(root_mse[tile_root[tile]], plane_grid.mse_(tile / mini_cols, tile % mini_cols));
+    }
+    std::vector<std::pair<float, int> > roots;
+    for (int tile = 0; tile < n_tiles; ++tile)
+      if (tile_root[tile] == tile)
+        roots.push_back(std::make_pair(root_mse[tile], tile));
+    std::sort(roots.begin(), roots.end());
+    // The mask can't index more planes
+    if (roots.size() > 255)
+      roots.resize(255);
+
+    // Fit a plane to each group of tiles
+    std::vector<int> root_plane(n_tiles, -1), tile_plane(n_tiles, -1);
+    std::vector<Ptr<PlaneBase> > planes;
+    for (size_t i = 0; i < roots.size(); ++i)
+    {
+      int root = roots[i].second;
+      root_plane[root] = (int)i;
+      planes.push_back(createPlane(plane_grid.m_(root / mini_cols, root % mini_cols),
+                                   plane_grid.n_(root / mini_cols, root % mini_cols), (int)i, sensor_error_a_,
+                                   sensor_error_b_, sensor_error_c_));
+    }
+    for (int tile = 0; tile < n_tiles; ++tile)
+    {
+      if (tile_root[tile] < 0 || root_plane[tile_root[tile]] < 0)
         continue;
-      // Don't record the plane if it's smaller than asked
-      if (plane->K() < min_size_) {
-        // Reset the plane index in the mask
-        for (y = 0; y < plane_mask.rows; ++y)
-          for (x = 0; x < plane_mask.cols; ++x) {
-            if (!plane_mask(y, x))
+      tile_plane[tile] = root_plane[tile_root[tile]];
+      int y = tile / mini_cols, x = tile % mini_cols, K = plane_grid.K_(y, x);
+      planes[tile_plane[tile]]->UpdateStatistics(plane_grid.m_(y, x) * (float)K,
+                                                 Matx33f(plane_grid.Q_sum_(y, x).val), K);
+    }
+    for (size_t i = 0; i < planes.size(); ++i)
+      planes[i]->UpdateParameters();
+
+    // Each point goes to the first plane it can belong to, in the order of the planes, as a point taken by a
+    // plane could not be taken by the next ones. The points of a tile are assigned again when new planes reach it
+    std::vector<std::vector<int> > tile_candidates(n_tiles);
+    std::vector<std::vector<PlaneTileStatistics> > tile_statistics(n_tiles);
+    auto assignTilePoints = [&](int tile)
+    {
+      const Rect & rect = tile_rects[tile];
+      const std::vector<int> & candidates = tile_candidates[tile];
+      std::vector<PlaneTileStatistics> statistics;
+      for (size_t i = 0; i < candidates.size(); ++i)
+        statistics.push_back(PlaneTileStatistics(candidates[i]));
+      for (int yy = rect.y; yy < rect.y + rect.height; ++yy)
+      {
+        uchar* data = mask_out_uc.ptr(yy, rect.x), *data_end = data + rect.width;
+        const Vec3f* point = points3d.ptr < Vec3f > (yy, rect.x);
+        const Vec3f* normal = normals.empty() ? 0 : normals.ptr < Vec3f > (yy, rect.x);
+        const Matx33f* Q_local = reinterpret_cast<const Matx33f *>(plane_grid.Q_.ptr < Vec<float, 9>
+            > (yy, rect.x));
+        for (; data != data_end; ++data, ++point, ++Q_local)
+        {
+          const Vec3f* point_normal = normal;
+          if (normal)
+            ++normal;
+          *data = 255;
+          if (cvIsNaN(point->val[0]))
+            continue;
+
+          for (size_t i = 0; i < candidates.size(); ++i)
+          {
+            if (!isInlier(*planes[candidates[i]], *point, point_normal, err))
               continue;
-            // Go over the tile
-            for (int yy = y * block_size_;
-                yy < std::min((y + 1) * block_size_, mask_out_uc.rows); ++yy) {
-              uchar* data = mask_out_uc.ptr(yy, x * block_size_);
-              uchar* data_end = data
-                  + std::min(block_size_,
-                      mask_out_uc.cols - x * block_size_);
-              for (; data != data_end; ++data) {
-                if (*data == index_plane)
-                  *data = 255;
-              }
-            }
+            // The point now belongs to the plane
+            PlaneTileStatistics & plane_statistics = statistics[i];
+            plane_statistics.m_sum_ += *point;
+            plane_statistics.Q_ += *Q_local;
+            ++plane_statistics.K_;
+            *data = (uchar)plane_statistics.plane_;
+            break;
           }
-        continue;
+        }
+      }
+      tile_statistics[tile].swap(statistics);
+    };
+
+    // Fit the planes to the points they got so far, in the order of the tiles so the result is always the same
+    auto fitPlanes = [&](std::vector<Ptr<PlaneBase> > & fitted_planes)
+    {
+      fitted_planes.resize(planes.size());
+      for (size_t i = 0; i < planes.size(); ++i)
+      {
+        int root = roots[i].second;
+        fitted_planes[i] = createPlane(plane_grid.m_(root / mini_cols, root % mini_cols), planes[i]->n(), (int)i,
+                                       sensor_error_a_, sensor_error_b_, sensor_error_c_);
+      }
+      for (int tile = 0; tile < n_tiles; ++tile)
+        for (size_t i = 0; i < tile_statistics[tile].size(); ++i)
+        {
+          const PlaneTileStatistics & statistics = tile_statistics[tile][i];
+          fitted_planes[statistics.plane_]->UpdateStatistics(statistics.m_sum_, statistics.Q_, statistics.K_);
+        }
+    };
+
+    // Grow the planes like the sequential region growing did: a plane is tried on the neighbors of the tiles
+    // where it got points on the common border, until no plane reaches a new tile. As the sequential growing
+    // refitted a plane with each block it took, the planes are refitted after each round of growth
+    std::vector<Ptr<PlaneBase> > fitted_planes;
+    std::vector<int> grown_tiles, next_tiles;
+    std::vector<uchar> is_next(n_tiles, 0);
+    for (int tile = 0; tile < n_tiles; ++tile)
+      if (tile_plane[tile] >= 0)
+      {
+        tile_candidates[tile].push_back(tile_plane[tile]);
+        grown_tiles.push_back(tile);
+      }
+    auto spreadBorder = [&](int neighbor, Point start, Point step, int length)
+    {
+      std::vector<int> & candidates = tile_candidates[neighbor];
+      for (int k = 0; k < length; ++k)
+      {
+        int plane = mask_out_uc(start + k * step);
+        if (plane == 255)
+          continue;
+        std::vector<int>::iterator it = std::lower_bound(candidates.begin(), candidates.end(), plane);
+        if (it != candidates.end() && *it == plane)
+          continue;
+        candidates.insert(it, plane);
+        if (!is_next[neighbor])
+        {
+          is_next[neighbor] = 1;
+          next_tiles.push_back(neighbor);
+        }
       }
+    };
+    while (!grown_tiles.empty())
+    {
+      parallel_for_(Range(0, (int)grown_tiles.size()), [&](const Range& range)
+      {
+        for (int i = range.start; i < range.end; ++i)
+          assignTilePoints(grown_tiles[i]);
+      });
+
+      fitPlanes(fitted_planes);
+      for (size_t i = 0; i < planes.size(); ++i)
+        if (!fitted_planes[i]->empty())
+        {
+          fitted_planes[i]->UpdateParameters();
+          planes[i] = fitted_planes[i];
+        }
 
-      ++index_plane;
-      if (index_plane >= 255)
-        break;
+      next_tiles.clear();
+      for (size_t i = 0; i < grown_tiles.size(); ++i)
+      {
+        int tile = grown_tiles[i], tile_y = tile / mini_cols, tile_x = tile % mini_cols;
+        const Rect & rect = tile_rects[tile];
+        if (tile_x > 0)
+          spreadBorder(tile - 1, rect.tl(), Point(0, 1), rect.height);
+        if (tile_x < mini_cols - 1)
+          spreadBorder(tile + 1, Point(rect.x + rect.width - 1, rect.y), Point(0, 1), rect.height);
+        if (tile_y > 0)
+          spreadBorder(tile - mini_cols, rect.tl(), Point(1, 0), rect.width);
+        if (tile_y < mini_rows - 1)
+          spreadBorder(tile + mini_cols, Point(rect.x, rect.y + rect.height - 1), Point(1, 0), rect.width);
+      }
+      for (size_t i = 0; i < next_tiles.size(); ++i)
+        is_next[next_tiles[i]] = 0;
+      grown_tiles.swap(next_tiles);
+    }
+
+    // The planes fitted after the last round of growth have all their points. Don't record the planes which are
+    // smaller than asked, the others are renumbered
+    std::vector<Vec4f> plane_coefficients;
+    Mat_<uchar> plane_indices(1, 256, (uchar)255);
+    for (size_t i = 0; i < fitted_planes.size(); ++i)
+    {
+      const Ptr<PlaneBase> & plane = fitted_planes[i];
+      if (plane->empty() || plane->K() < min_size_)
+        continue;
+
+      plane->UpdateParameters();
+      plane_indices(0, (int)i) = (uchar)plane_coefficients.size();
       Vec4f coeffs(plane->n()[0], plane->n()[1], plane->n()[2], plane->d());
       if (coeffs(2) > 0)
         coeffs = -coeffs;
       plane_coefficients.push_back(coeffs);
-    };
+    }
+    if (plane_coefficients.size() != fitted_planes.size())
+      LUT(mask_out_uc, plane_indices, mask_out_uc);
 
     // Fill the plane coefficients
     if (plane_coefficients.empty())
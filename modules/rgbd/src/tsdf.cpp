@@ -6,12 +6,17 @@
 
 #include "precomp.hpp"
 #include "tsdf.hpp"
+#include "marchingcubes.hpp"
 #include "opencl_kernels_rgbd.hpp"
 
 namespace cv {
 
 namespace kinfu {
 
+// Mesh blocks are cubes of (1 << meshBlockShift) voxels per side
+static const int meshBlockShift = 3;
+static const int meshBlockSize  = 1 << meshBlockShift;
+
 TSDFVolume::TSDFVolume(float _voxelSize, Matx44f _pose, float _raycastStepFactor, float _truncDist,
                        int _maxWeight, Point3i _resolution, bool zFirstMemOrder)
     : Volume(_voxelSize, _pose, _raycastStepFactor),
@@ -63,6 +68,13 @@ TSDFVolumeCPU::TSDFVolumeCPU(float _voxelSize, cv::Matx44f _pose, float _raycast
 {
     volume = Mat(1, volResolution.x * volResolution.y * volResolution.z, rawType<TsdfVoxel>());
 
+    meshBlocksResolution = Point3i((volResolution.x + meshBlockSize - 1) / meshBlockSize,
+                                   (volResolution.y + meshBlockSize - 1) / meshBlockSize,
+                                   (volResolution.z + meshBlockSize - 1) / meshBlockSize);
+    int nBlocks = meshBlocksResolution.x * meshBlocksResolution.y * meshBlocksResolution.z;
+    dirtyMeshBlocks = Mat::zeros(1, nBlocks, CV_8U);
+    meshedBlocks    = Mat::zeros(1, nBlocks, CV_8U);
+
     reset();
 }
 
@@ -76,6 +88,9 @@ void TSDFVolumeCPU::reset()
         TsdfVoxel& v = reinterpret_cast<TsdfVoxel&>(vv);
         v.tsdf = 0.0f; v.weight = 0;
     });
+
+    // meshes of blocks which had a surface should be cleared at the next update
+    dirtyMeshBlocks |= meshedBlocks;
 }
 
 TsdfVoxel TSDFVolumeCPU::at(const cv::Vec3i& volumeIdx) const
@@ -177,18 +192,26 @@ static inline depthType bilinearDepth(const Depth& m, cv::Point2f pt)
 
 struct IntegrateInvoker : ParallelLoopBody
 {
-    IntegrateInvoker(TSDFVolumeCPU& _volume, const Depth& _depth, const Intr& intrinsics, const cv::Matx44f& cameraPose,
-                     float depthFactor) :
+    IntegrateInvoker(float _truncDist, float _voxelSize, WeightType _maxWeight,
+                     const cv::Affine3f& volumePose, Point3i _volResolution, Vec4i _volDims,
+                     const Depth& _depth, const Intr& intrinsics, const cv::Matx44f& cameraPose,
+                     float depthFactor, TsdfVoxel* _volDataStart,
+                     uchar* _dirtyBlocks = nullptr, Point3i _dirtyBlocksRes = Point3i()) :
         ParallelLoopBody(),
-        volume(_volume),
+        truncDist(_truncDist),
+        voxelSize(_voxelSize),
+        maxWeight(_maxWeight),
+        volResolution(_volResolution),
+        volDims(_volDims),
         depth(_depth),
         proj(intrinsics.makeProjector()),
-        vol2cam(Affine3f(cameraPose.inv()) * _volume.pose),
-        truncDistInv(1.f/_volume.truncDist),
-        dfac(1.f/depthFactor)
-    {
-        volDataStart = volume.volume.ptr<TsdfVoxel>();
-    }
+        vol2cam(Affine3f(cameraPose.inv()) * volumePose),
+        truncDistInv(1.f/_truncDist),
+        dfac(1.f/depthFactor),
+        volDataStart(_volDataStart),
+        dirtyBlocks(_dirtyBlocks),
+        dirtyBlocksRes(_dirtyBlocksRes)
+    { }
 
 #if USE_INTRINSICS
     virtual void operator() (const Range& range) const override
@@ -196,7 +219,7 @@ struct IntegrateInvoker : ParallelLoopBody
         // zStep == vol2cam*(Point3f(x, y, 1)*voxelSize) - basePt;
         Point3f zStepPt = Point3f(vol2cam.matrix(0, 2),
                                   vol2cam.matrix(1, 2),
-                                  vol2cam.matrix(2, 2))*volume.voxelSize;
+                                  vol2cam.matrix(2, 2))*voxelSize;
 
         v_float32x4 zStep(zStepPt.x, zStepPt.y, zStepPt.z, 0);
         v_float32x4 vfxy(proj.fx, proj.fy, 0.f, 0.f), vcxy(proj.cx, proj.cy, 0.f, 0.f);
@@ -204,12 +227,14 @@ struct IntegrateInvoker : ParallelLoopBody
 
         for(int x = range.start; x < range.end; x++)
         {
-            TsdfVoxel* volDataX = volDataStart + x*volume.volDims[0];
-            for(int y = 0; y < volume.volResolution.y; y++)
+            TsdfVoxel* volDataX = volDataStart + x*volDims[0];
+            for(int y = 0; y < volResolution.y; y++)
             {
-                TsdfVoxel* volDataY = volDataX + y*volume.volDims[1];
+                TsdfVoxel* volDataY = volDataX + y*volDims[1];
+                uchar* dirtyBlocksY = dirtyBlocks ? dirtyBlocks +
+                    ((x >> meshBlockShift)*dirtyBlocksRes.y + (y >> meshBlockShift))*dirtyBlocksRes.z : nullptr;
                 // optimization of camSpace transformation (vector addition instead of matmul at each z)
-                Point3f basePt = vol2cam*(Point3f((float)x, (float)y, 0)*volume.voxelSize);
+                Point3f basePt = vol2cam*(Point3f((float)x, (float)y, 0)*voxelSize);
                 v_float32x4 camSpacePt(basePt.x, basePt.y, basePt.z, 0);
 
                 int startZ, endZ;
@@ -219,7 +244,7 @@ struct IntegrateInvoker : ParallelLoopBody
                     if(zStepPt.z > 0)
                     {
                         startZ = baseZ;
-                        endZ   = volume.volResolution.z;
+                        endZ   = volResolution.z;
                     }
                     else
                     {
@@ -232,7 +257,7 @@ struct IntegrateInvoker : ParallelLoopBody
                     if (basePt.z > 0)
                     {
                         startZ = 0;
-                        endZ   = volume.volResolution.z;
+                        endZ   = volResolution.z;
                     }
                     else
                     {
@@ -241,7 +266,7 @@ struct IntegrateInvoker : ParallelLoopBody
                     }
                 }
                 startZ = max(0, startZ);
-                endZ   = min(volume.volResolution.z, endZ);
+                endZ   = min(volResolution.z, endZ);
                 for(int z = startZ; z < endZ; z++)
                 {
                     // optimization of the following:
@@ -312,17 +337,20 @@ struct IntegrateInvoker : ParallelLoopBody
                     TsdfType sdf = pixNorm*(v*dfac - zCamSpace);
                     // possible alternative is:
                     // kftype sdf = norm(camSpacePt)*(v*dfac/camSpacePt.z - 1);
-                    if(sdf >= -volume.truncDist)
+                    if(sdf >= -truncDist)
                     {
                         TsdfType tsdf = fmin(1.f, sdf * truncDistInv);
 
-                        TsdfVoxel& voxel = volDataY[z*volume.volDims[2]];
+                        TsdfVoxel& voxel = volDataY[z*volDims[2]];
                         WeightType& weight      = voxel.weight;
                         TsdfType& value  = voxel.tsdf;
 
                         // update TSDF
                         value  = (value*weight+tsdf) / (weight + 1);
-                        weight = min(weight + 1, volume.maxWeight);
+                        weight = min(weight + 1, maxWeight);
+
+                        if(dirtyBlocksY)
+                            dirtyBlocksY[z >> meshBlockShift] = 1;
                     }
                 }
             }
@@ -333,18 +361,20 @@ struct IntegrateInvoker : ParallelLoopBody
     {
         for(int x = range.start; x < range.end; x++)
         {
-            TsdfVoxel* volDataX = volDataStart + x*volume.volDims[0];
-            for(int y = 0; y < volume.volResolution.y; y++)
+            TsdfVoxel* volDataX = volDataStart + x*volDims[0];
+            for(int y = 0; y < volResolution.y; y++)
             {
-                TsdfVoxel* volDataY = volDataX+y*volume.volDims[1];
+                TsdfVoxel* volDataY = volDataX+y*volDims[1];
+                uchar* dirtyBlocksY = dirtyBlocks ? dirtyBlocks +
+                    ((x >> meshBlockShift)*dirtyBlocksRes.y + (y >> meshBlockShift))*dirtyBlocksRes.z : nullptr;
                 // optimization of camSpace transformation (vector addition instead of matmul at each z)
-                Point3f basePt = vol2cam*(Point3f(x, y, 0)*volume.voxelSize);
+                Point3f basePt = vol2cam*(Point3f(x, y, 0)*voxelSize);
                 Point3f camSpacePt = basePt;
                 // zStep == vol2cam*(Point3f(x, y, 1)*voxelSize) - basePt;
                 // zStep == vol2cam*[Point3f(x, y, 1) - Point3f(x, y, 0)]*voxelSize
                 Point3f zStep = Point3f(vol2cam.matrix(0, 2),
                                         vol2cam.matrix(1, 2),
-                                        vol2cam.matrix(2, 2))*volume.voxelSize;
+                                        vol2cam.matrix(2, 2))*voxelSize;
                 int startZ, endZ;
                 if(abs(zStep.z) > 1e-5)
                 {
@@ -352,7 +382,7 @@ struct IntegrateInvoker : ParallelLoopBody
                     if(zStep.z > 0)
                     {
                         startZ = baseZ;
-                        endZ   = volume.volResolution.z;
+                        endZ   = volResolution.z;
                     }
                     else
                     {
@@ -365,7 +395,7 @@ struct IntegrateInvoker : ParallelLoopBody
                     if(basePt.z > 0)
                     {
                         startZ = 0;
-                        endZ   = volume.volResolution.z;
+                        endZ   = volResolution.z;
                     }
                     else
                     {
@@ -374,11 +404,11 @@ struct IntegrateInvoker : ParallelLoopBody
                     }
                 }
                 startZ = max(0, startZ);
-                endZ   = min(volume.volResolution.z, endZ);
+                endZ   = min(volResolution.z, endZ);
                 for(int z = startZ; z < endZ; z++)
                 {
                     // optimization of the following:
-                    //Point3f volPt = Point3f(x, y, z)*volume.voxelSize;
+                    //Point3f volPt = Point3f(x, y, z)*voxelSize;
                     //Point3f camSpacePt = vol2cam * volPt;
                     camSpacePt += zStep;
                     if(camSpacePt.z <= 0)
@@ -398,17 +428,20 @@ struct IntegrateInvoker : ParallelLoopBody
 
                     // possible alternative is:
                     // kftype sdf = norm(camSpacePt)*(v*dfac/camSpacePt.z - 1);
-                    if(sdf >= -volume.truncDist)
+                    if(sdf >= -truncDist)
                     {
                         TsdfType tsdf = fmin(1.f, sdf * truncDistInv);
 
-                        TsdfVoxel& voxel = volDataY[z*volume.volDims[2]];
+                        TsdfVoxel& voxel = volDataY[z*volDims[2]];
                         WeightType& weight      = voxel.weight;
                         TsdfType& value  = voxel.tsdf;
 
                         // update TSDF
                         value  = (value*weight+tsdf) / (weight + 1);
-                        weight = min(weight + 1, volume.maxWeight);
+                        weight = min(weight + 1, maxWeight);
+
+                        if(dirtyBlocksY)
+                            dirtyBlocksY[z >> meshBlockShift] = 1;
                     }
                 }
             }
@@ -416,13 +449,20 @@ struct IntegrateInvoker : ParallelLoopBody
     }
 #endif
 
-    TSDFVolumeCPU& volume;
+    const float truncDist;
+    const float voxelSize;
+    const WeightType maxWeight;
+    const Point3i volResolution;
+    const Vec4i volDims;
     const Depth& depth;
     const Intr::Projector proj;
     const cv::Affine3f vol2cam;
     const float truncDistInv;
     const float dfac;
     TsdfVoxel* volDataStart;
+    // mesh blocks with updated voxels are marked here if not null
+    uchar* dirtyBlocks;
+    const Point3i dirtyBlocksRes;
 };
 
 // use depth instead of distance (optimization)
@@ -434,9 +474,28 @@ void TSDFVolumeCPU::integrate(InputArray _depth, float depthFactor, const cv::Ma
     CV_Assert(_depth.type() == DEPTH_TYPE);
     CV_Assert(!_depth.empty());
     Depth depth = _depth.getMat();
-    IntegrateInvoker ii(*this, depth, intrinsics, cameraPose, depthFactor);
+    IntegrateInvoker ii(truncDist, voxelSize, maxWeight, pose, volResolution, volDims, depth,
+                        intrinsics, cameraPose, depthFactor, volume.ptr<TsdfVoxel>(),
+                        dirtyMeshBlocks.ptr(), meshBlocksResolution);
+    // stripes are aligned to mesh blocks so that each dirty flag is written by one thread only
+    parallel_for_(Range(0, meshBlocksResolution.x), [&](const Range& range)
+    {
+        ii(Range(range.start*meshBlockSize, min(range.end*meshBlockSize, volResolution.x)));
+    });
+}
+
+void integrateVolumeUnit(float truncDist, float voxelSize, WeightType maxWeight,
+                         const cv::Affine3f& volumePose, Point3i volResolution, Vec4i volDims,
+                         const Depth& depth, float depthFactor, const cv::Matx44f& cameraPose,
+                         const Intr& intrinsics, TsdfVoxel* volData, bool parallel)
+{
+    IntegrateInvoker ii(truncDist, voxelSize, maxWeight, volumePose, volResolution, volDims,
+                        depth, intrinsics, cameraPose, depthFactor, volData);
     Range range(0, volResolution.x);
-    parallel_for_(range, ii);
+    if(parallel)
+        parallel_for_(range, ii);
+    else
+        ii(range);
 }
 
 #if USE_INTRINSICS
@@ -942,23 +1001,25 @@ void TSDFVolumeCPU::raycast(const cv::Matx44f& cameraPose, const Intr& intrinsic
 }
 
 
+// Points are fetched in two passes: the first one counts points of each x slice,
+// the second one writes them to the output at the offsets of slices
 struct FetchPointsNormalsInvoker : ParallelLoopBody
 {
     FetchPointsNormalsInvoker(const TSDFVolumeCPU& _volume,
-                              std::vector<std::vector<ptype>>& _pVecs,
-                              std::vector<std::vector<ptype>>& _nVecs,
-                              bool _needNormals) :
+                              std::vector<int>& _offsets,
+                              ptype* _points,
+                              ptype* _normals) :
         ParallelLoopBody(),
         vol(_volume),
-        pVecs(_pVecs),
-        nVecs(_nVecs),
-        needNormals(_needNormals)
+        offsets(_offsets),
+        points(_points),
+        normals(_normals)
     {
         volDataStart = vol.volume.ptr<TsdfVoxel>();
     }
 
-    inline void coord(std::vector<ptype>& points, std::vector<ptype>& normals,
-                      int x, int y, int z, Point3f V, float v0, int axis) const
+    // returns true and a surface point if there's a zero crossing between this voxel and the next one along axis
+    inline bool coord(int x, int y, int z, Point3f V, float v0, int axis, Point3f& p) const
     {
         // 0 for x, 1 for y, 2 for z
         bool limits = false;
@@ -999,25 +1060,25 @@ struct FetchPointsNormalsInvoker : ParallelLoopBody
                     float dinv  = 1.f/(abs(v0)+abs(vd));
                     float inter = (Vc*abs(vd) + Vn*abs(v0))*dinv;
 
-                    Point3f p(shift.x ? inter : V.x,
-                              shift.y ? inter : V.y,
-                              shift.z ? inter : V.z);
-                    {
-                        points.push_back(toPtype(vol.pose * p));
-                        if(needNormals)
-                            normals.push_back(toPtype(vol.pose.rotation() *
-                                                      vol.getNormalVoxel(p*vol.voxelSizeInv)));
-                    }
+                    p = Point3f(shift.x ? inter : V.x,
+                                shift.y ? inter : V.y,
+                                shift.z ? inter : V.z);
+                    return true;
                 }
             }
         }
+        return false;
     }
 
     virtual void operator() (const Range& range) const override
     {
-        std::vector<ptype> points, normals;
         for(int x = range.start; x < range.end; x++)
         {
+            // counting pass if there's no output
+            int count = 0;
+            ptype* pointsX  = points ? points + offsets[x] : nullptr;
+            ptype* normalsX = normals ? normals + offsets[x] : nullptr;
+
             const TsdfVoxel* volDataX = volDataStart + x*vol.volDims[0];
             for(int y = 0; y < vol.volResolution.y; y++)
             {
@@ -1030,59 +1091,92 @@ struct FetchPointsNormalsInvoker : ParallelLoopBody
                     {
                         Point3f V(Point3f((float)x + 0.5f, (float)y + 0.5f, (float)z + 0.5f)*vol.voxelSize);
 
-                        coord(points, normals, x, y, z, V, v0, 0);
-                        coord(points, normals, x, y, z, V, v0, 1);
-                        coord(points, normals, x, y, z, V, v0, 2);
-
+                        for(int axis = 0; axis < 3; axis++)
+                        {
+                            Point3f p;
+                            if(!coord(x, y, z, V, v0, axis, p))
+                                continue;
+                            if(pointsX)
+                            {
+                                pointsX[count] = toPtype(vol.pose * p);
+                                if(normalsX)
+                                    normalsX[count] = toPtype(vol.pose.rotation() *
+                                                              vol.getNormalVoxel(p*vol.voxelSizeInv));
+                            }
+                            count++;
+                        }
                     } // if voxel is not empty
                 }
             }
-        }
 
-        AutoLock al(mutex);
-        pVecs.push_back(points);
-        nVecs.push_back(normals);
+            if(!points)
+                offsets[x + 1] = count;
+        }
     }
 
     const TSDFVolumeCPU& vol;
-    std::vector<std::vector<ptype>>& pVecs;
-    std::vector<std::vector<ptype>>& nVecs;
+    std::vector<int>& offsets;
+    ptype* points;
+    ptype* normals;
     const TsdfVoxel* volDataStart;
-    bool needNormals;
-    mutable Mutex mutex;
 };
 
+// returns offsets of x slices in the output, the last one is the number of points
+static std::vector<int> countPoints(const TSDFVolumeCPU& volume)
+{
+    std::vector<int> offsets(volume.volResolution.x + 1, 0);
+    FetchPointsNormalsInvoker ci(volume, offsets, nullptr, nullptr);
+    parallel_for_(Range(0, volume.volResolution.x), ci);
+    for(size_t i = 1; i < offsets.size(); i++)
+        offsets[i] += offsets[i - 1];
+    return offsets;
+}
+
 void TSDFVolumeCPU::fetchPointsNormals(OutputArray _points, OutputArray _normals) const
 {
     CV_TRACE_FUNCTION();
 
     if(_points.needed())
     {
-        std::vector<std::vector<ptype>> pVecs, nVecs;
-        FetchPointsNormalsInvoker fi(*this, pVecs, nVecs, _normals.needed());
-        Range range(0, volResolution.x);
-        const int nstripes = -1;
-        parallel_for_(range, fi, nstripes);
-        std::vector<ptype> points, normals;
-        for(size_t i = 0; i < pVecs.size(); i++)
+        std::vector<int> offsets = countPoints(*this);
+        int nPoints = offsets.back();
+
+        _points.create(nPoints, 1, POINT_TYPE);
+        Mat points = _points.getMat(), normals;
+        if(_normals.needed())
         {
-            points.insert(points.end(), pVecs[i].begin(), pVecs[i].end());
-            normals.insert(normals.end(), nVecs[i].begin(), nVecs[i].end());
+            _normals.create(nPoints, 1, POINT_TYPE);
+            normals = _normals.getMat();
         }
 
-        _points.create((int)points.size(), 1, POINT_TYPE);
-        if(!points.empty())
-            Mat((int)points.size(), 1, POINT_TYPE, &points[0]).copyTo(_points.getMat());
-
-        if(_normals.needed())
+        if(nPoints > 0)
         {
-            _normals.create((int)normals.size(), 1, POINT_TYPE);
-            if(!normals.empty())
-                Mat((int)normals.size(), 1, POINT_TYPE, &normals[0]).copyTo(_normals.getMat());
+            FetchPointsNormalsInvoker fi(*this, offsets, points.ptr<ptype>(),
+                                         normals.empty() ? nullptr : normals.ptr<ptype>());
+            parallel_for_(Range(0, volResolution.x), fi);
         }
     }
 }
 
+void TSDFVolumeCPU::fetchPointsNormalsToBuffers(Mat& points, Mat& normals, bool needNormals) const
+{
+    CV_TRACE_FUNCTION();
+
+    std::vector<int> offsets = countPoints(*this);
+    int nPoints = offsets.back();
+
+    resizePointsBuffer(points, nPoints);
+    if(needNormals)
+        resizePointsBuffer(normals, nPoints);
+
+    if(nPoints > 0)
+    {
+        FetchPointsNormalsInvoker fi(*this, offsets, points.ptr<ptype>(),
+                                     needNormals ? normals.ptr<ptype>() : nullptr);
+        parallel_for_(Range(0, volResolution.x), fi);
+    }
+}
+
 void TSDFVolumeCPU::fetchNormals(InputArray _points, OutputArray _normals) const
 {
     CV_TRACE_FUNCTION();
@@ -1114,6 +1208,150 @@ void TSDFVolumeCPU::fetchNormals(InputArray _points, OutputArray _normals) const
     }
 }
 
+struct MeshBlocksInvoker : ParallelLoopBody
+{
+    MeshBlocksInvoker(const TSDFVolumeCPU& _volume, const std::vector<Vec3i>& _blocks,
+                      std::vector<std::vector<ptype>>& _meshes) :
+        ParallelLoopBody(),
+        volume(_volume),
+        blocks(_blocks),
+        meshes(_meshes),
+        volDataStart(_volume.volume.ptr<TsdfVoxel>())
+    {
+        for(int i = 0; i < 8; i++)
+            cornerCoords[i] = volume.volDims.dot(Vec4i(mcCorners[i][0], mcCorners[i][1], mcCorners[i][2]));
+    }
+
+    virtual void operator() (const Range& range) const override
+    {
+        std::vector<Point3f> triangles;
+        for(int i = range.start; i < range.end; i++)
+        {
+            const Vec3i& b = blocks[i];
+            // cells on the upper border of the volume have no upper corners
+            Point3i start = Point3i(b[0], b[1], b[2])*meshBlockSize;
+            Point3i end(min(start.x + meshBlockSize, volume.volResolution.x - 1),
+                        min(start.y + meshBlockSize, volume.volResolution.y - 1),
+                        min(start.z + meshBlockSize, volume.volResolution.z - 1));
+
+            triangles.clear();
+            for(int x = start.x; x < end.x; x++)
+            {
+                const TsdfVoxel* volDataX = volDataStart + x*volume.volDims[0];
+                for(int y = start.y; y < end.y; y++)
+                {
+                    const TsdfVoxel* volDataY = volDataX + y*volume.volDims[1];
+                    for(int z = start.z; z < end.z; z++)
+                    {
+                        const TsdfVoxel* voxel = volDataY + z*volume.volDims[2];
+                        if(voxel->weight == 0)
+                            continue;
+
+                        int cubeIndex = 0;
+                        float tsdfValues[8] = {0};
+                        for(int c = 0; c < 8; c++)
+                        {
+                            const TsdfVoxel& corner = voxel[cornerCoords[c]];
+                            if(corner.weight == 0)
+                                continue;
+                            tsdfValues[c] = corner.tsdf;
+                            if(corner.tsdf <= 0)
+                                cubeIndex |= (1 << c);
+                        }
+                        marchCube(Point3f((float)x, (float)y, (float)z), tsdfValues, cubeIndex, triangles);
+                    }
+                }
+            }
+
+            std::vector<ptype>& mesh = meshes[i];
+            mesh.reserve(triangles.size());
+            for(const Point3f& t : triangles)
+                mesh.push_back(toPtype(volume.pose * (t*volume.voxelSize)));
+        }
+    }
+
+    const TSDFVolumeCPU& volume;
+    const std::vector<Vec3i>& blocks;
+    std::vector<std::vector<ptype>>& meshes;
+    const TsdfVoxel* volDataStart;
+    int cornerCoords[8];
+};
+
+void TSDFVolumeCPU::fetchMeshUpdates(OutputArray _blockIndices, OutputArrayOfArrays _blockMeshes)
+{
+    CV_TRACE_FUNCTION();
+
+    const Point3i& res = meshBlocksResolution;
+    const uchar* dirty = dirtyMeshBlocks.ptr();
+    uchar* meshed = meshedBlocks.ptr();
+
+    // cells of a block have corners in its upper neighbours,
+    // so a block is polygonized again if any of them has changed
+    std::vector<Vec3i> blocks;
+    for(int x = 0; x < res.x; x++)
+    {
+        for(int y = 0; y < res.y; y++)
+        {
+            for(int z = 0; z < res.z; z++)
+            {
+                bool changed = false;
+                for(int c = 0; c < 8 && !changed; c++)
+                {
+                    int nx = x + mcCorners[c][0], ny = y + mcCorners[c][1], nz = z + mcCorners[c][2];
+                    if(nx < res.x && ny < res.y && nz < res.z)
+                        changed = dirty[(nx*res.y + ny)*res.z + nz] != 0;
+                }
+                if(changed)
+                    blocks.push_back(Vec3i(x, y, z));
+            }
+        }
+    }
+
+    std::vector<std::vector<ptype>> meshes(blocks.size());
+    MeshBlocksInvoker mi(*this, blocks, meshes);
+    parallel_for_(Range(0, (int)blocks.size()), mi);
+
+    for(size_t i = 0; i < blocks.size(); i++)
+        meshed[(blocks[i][0]*res.y + blocks[i][1])*res.z + blocks[i][2]] = !meshes[i].empty();
+    dirtyMeshBlocks.setTo(0);
+
+    writeMeshUpdates(blocks, meshes, _blockIndices, _blockMeshes);
+}
+
+void resizePointsBuffer(Mat& buf, int n)
+{
+    // Mat::resize() keeps memory if there's enough capacity
+    if(buf.dims == 2 && buf.type() == POINT_TYPE && buf.cols == 1 && !buf.isSubmatrix() && buf.data)
+        buf.resize(n);
+    else
+        buf.create(n, 1, POINT_TYPE);
+}
+
+void writeMeshUpdates(const std::vector<Vec3i>& blocks, const std::vector<std::vector<ptype>>& meshes,
+                      OutputArray _blockIndices, OutputArrayOfArrays _blockMeshes)
+{
+    CV_Assert(blocks.size() == meshes.size());
+
+    if(_blockIndices.needed())
+    {
+        _blockIndices.create((int)blocks.size(), 1, CV_32SC3);
+        if(!blocks.empty())
+            Mat((int)blocks.size(), 1, CV_32SC3, (void*)&blocks[0]).copyTo(_blockIndices.getMat());
+    }
+
+    if(_blockMeshes.needed())
+    {
+        _blockMeshes.create((int)meshes.size(), 1, POINT_TYPE);
+        for(int i = 0; i < (int)meshes.size(); i++)
+        {
+            const std::vector<ptype>& mesh = meshes[i];
+            _blockMeshes.create((int)mesh.size(), 1, POINT_TYPE, i);
+            if(!mesh.empty())
+                Mat((int)mesh.size(), 1, POINT_TYPE, (void*)&mesh[0]).copyTo(_blockMeshes.getMat(i));
+        }
+    }
+}
+
 ///////// GPU implementation /////////
 
 #ifdef HAVE_OPENCL
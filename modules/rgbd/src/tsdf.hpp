@@ -62,8 +62,11 @@ class TSDFVolumeCPU : public TSDFVolume
 
     virtual void fetchNormals(cv::InputArray points, cv::OutputArray _normals) const override;
     virtual void fetchPointsNormals(cv::OutputArray points, cv::OutputArray normals) const override;
+    virtual void fetchPointsNormalsToBuffers(Mat& points, Mat& normals, bool needNormals) const override;
 
     virtual void reset() override;
+    virtual void fetchMeshUpdates(cv::OutputArray blockIndices,
+                                  cv::OutputArrayOfArrays blockMeshes) override;
     virtual TsdfVoxel at(const cv::Vec3i& volumeIdx) const;
 
     TsdfType interpolateVoxel(cv::Point3f p) const;
@@ -78,8 +81,29 @@ class TSDFVolumeCPU : public TSDFVolume
     // for the array layout info
     // Consist of Voxel elements
     Mat volume;
+
+    //! Number of blocks along each axis the volume is split into for incremental meshing
+    Point3i meshBlocksResolution;
+    //! One byte per block, non-zero for blocks with voxels updated since the last mesh update
+    Mat dirtyMeshBlocks;
+    //! One byte per block, non-zero for blocks which had a non-empty mesh at the last update
+    Mat meshedBlocks;
 };
 
+//! Integrates depth into a voxel array of given resolution and strides (see TSDFVolumeCPU::volume),
+//! can be used by volumes which keep voxel data outside of TSDFVolumeCPU objects
+void integrateVolumeUnit(float truncDist, float voxelSize, WeightType maxWeight,
+                         const cv::Affine3f& volumePose, Point3i volResolution, Vec4i volDims,
+                         const Depth& depth, float depthFactor, const cv::Matx44f& cameraPose,
+                         const cv::kinfu::Intr& intrinsics, TsdfVoxel* volData, bool parallel);
+
+//! Resizes a column of points, memory is reallocated only if its capacity is not enough
+void resizePointsBuffer(Mat& buf, int n);
+
+//! Writes changed blocks and their meshes to the outputs of Volume::fetchMeshUpdates()
+void writeMeshUpdates(const std::vector<Vec3i>& blocks, const std::vector<std::vector<ptype>>& meshes,
+                      OutputArray blockIndices, OutputArrayOfArrays blockMeshes);
+
 #ifdef HAVE_OPENCL
 class TSDFVolumeGPU : public TSDFVolume
 {
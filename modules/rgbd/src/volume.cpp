@@ -7,11 +7,37 @@
 
 #include "tsdf.hpp"
 #include "hash_tsdf.hpp"
+#include "multires_hash_tsdf.hpp"
 
 namespace cv
 {
 namespace kinfu
 {
+void Volume::fetchPointsNormalsToBuffers(Mat& points, Mat& normals, bool needNormals) const
+{
+    Mat p, n;
+    if (needNormals)
+        fetchPointsNormals(p, n);
+    else
+        fetchPointsNormals(p, noArray());
+
+    // copyTo() releases the destination if the source is empty
+    resizePointsBuffer(points, p.rows);
+    if (!p.empty())
+        p.copyTo(points);
+    if (needNormals)
+    {
+        resizePointsBuffer(normals, n.rows);
+        if (!n.empty())
+            n.copyTo(normals);
+    }
+}
+
+void Volume::fetchMeshUpdates(OutputArray /* blockIndices */, OutputArrayOfArrays /* blockMeshes */)
+{
+    CV_Error(Error::StsNotImplemented, "Incremental mesh extraction is not supported by this volume");
+}
+
 cv::Ptr<Volume> makeVolume(VolumeType _volumeType, float _voxelSize, cv::Matx44f _pose,
                            float _raycastStepFactor, float _truncDist, int _maxWeight,
                            float _truncateThreshold, Vec3i _resolution)
@@ -27,9 +53,28 @@ cv::Ptr<Volume> makeVolume(VolumeType _volumeType, float _voxelSize, cv::Matx44f
         return makeHashTSDFVolume(_voxelSize, _pose, _raycastStepFactor, _truncDist, _maxWeight,
                                   _truncateThreshold);
     }
+    else if (_volumeType == VolumeType::MULTIRES_HASHTSDF)
+    {
+        return makeMultiResHashTSDFVolume(_voxelSize, _pose, _raycastStepFactor, _truncDist,
+                                          _maxWeight, _truncateThreshold);
+    }
     else
         return nullptr;
 }
 
+cv::Ptr<Volume> makeVolume(const Ptr<Params>& _params)
+{
+    CV_Assert(_params);
+    const Params& p = *_params;
+    if (p.volumeType == VolumeType::MULTIRES_HASHTSDF)
+    {
+        return makeMultiResHashTSDFVolume(p.voxelSize, p.volumePose.matrix, p.raycast_step_factor,
+                                          p.tsdf_trunc_dist, p.tsdf_max_weight, p.truncateThreshold,
+                                          p.volumeLevels, p.volumeLevelDistance);
+    }
+    return makeVolume(p.volumeType, p.voxelSize, p.volumePose.matrix, p.raycast_step_factor,
+                      p.tsdf_trunc_dist, p.tsdf_max_weight, p.truncateThreshold, p.volumeDims);
+}
+
 }  // namespace kinfu
 }  // namespace cv
@@ -4,6 +4,145 @@
 namespace cv {
 namespace dynafu {
 
+PointGrid::PointGrid(float _cellSize) :
+cellSize(_cellSize), cellSizeInv(1.f/_cellSize),
+points(), cells(),
+minCell(Vec3i::all(std::numeric_limits<int>::max())),
+maxCell(Vec3i::all(std::numeric_limits<int>::min()))
+{
+    CV_Assert(_cellSize > 0);
+}
+
+void PointGrid::clear()
+{
+    points.clear();
+    cells.clear();
+    minCell = Vec3i::all(std::numeric_limits<int>::max());
+    maxCell = Vec3i::all(std::numeric_limits<int>::min());
+}
+
+Vec3i PointGrid::cellOf(Point3f p) const
+{
+    return Vec3i(cvFloor(p.x*cellSizeInv), cvFloor(p.y*cellSizeInv), cvFloor(p.z*cellSizeInv));
+}
+
+int PointGrid::add(Point3f p)
+{
+    int idx = (int)points.size();
+    points.push_back(p);
+
+    // invalid points keep their index but can't be found
+    if(cvIsNaN(p.x) || cvIsNaN(p.y) || cvIsNaN(p.z))
+        return idx;
+
+    Vec3i c = cellOf(p);
+    cells[c].push_back(idx);
+    for(int i = 0; i < 3; i++)
+    {
+        minCell[i] = std::min(minCell[i], c[i]);
+        maxCell[i] = std::max(maxCell[i], c[i]);
+    }
+    return idx;
+}
+
+int PointGrid::knnSearch(Point3f q, int k, int* indices, float* sqDists) const
+{
+    // the bounds of the occupied cells are not set until a finite point is added
+    int found = 0;
+    if(cells.empty() || k <= 0)
+        return found;
+
+    Vec3i qc = cellOf(q);
+    // number of shells covering all the occupied cells
+    int maxShell = 0;
+    for(int i = 0; i < 3; i++)
+        maxShell = std::max(maxShell, std::max(qc[i] - minCell[i], maxCell[i] - qc[i]));
+
+    // cells are visited by growing shells around the query cell, each shell being
+    // the cells at Chebyshev distance r; points out of shells 0..r are further than r*cellSize
+    for(int r = 0; r <= maxShell; r++)
+    {
+        int zLo = std::max(qc[2] - r, minCell[2]), zHi = std::min(qc[2] + r, maxCell[2]);
+        for(int x = std::max(qc[0] - r, minCell[0]); x <= std::min(qc[0] + r, maxCell[0]); x++)
+        {
+            for(int y = std::max(qc[1] - r, minCell[1]); y <= std::min(qc[1] + r, maxCell[1]); y++)
+            {
+                bool onSide = (std::abs(x - qc[0]) == r) || (std::abs(y - qc[1]) == r);
+                // inside the shell only the two z faces belong to it
+                int zStep = onSide ? 1 : 2*r;
+                for(int z = onSide ? zLo : qc[2] - r; z <= zHi; z += zStep)
+                {
+                    if(z < zLo)
+                        continue;
+                    auto it = cells.find(Vec3i(x, y, z));
+                    if(it == cells.end())
+                        continue;
+
+                    for(int idx: it->second)
+                    {
+                        Point3f d = points[idx] - q;
+                        float dist = d.dot(d);
+                        if(found == k && dist >= sqDists[k-1])
+                            continue;
+
+                        // insertion into the sorted list of the nearest ones
+                        int pos = found < k ? found++ : k-1;
+                        for(; pos > 0 && sqDists[pos-1] > dist; pos--)
+                        {
+                            sqDists[pos] = sqDists[pos-1];
+                            indices[pos] = indices[pos-1];
+                        }
+                        sqDists[pos] = dist;
+                        indices[pos] = idx;
+                    }
+                }
+            }
+        }
+
+        float reach = r*cellSize;
+        if(found == k && sqDists[k-1] <= reach*reach)
+            break;
+    }
+
+    return found;
+}
+
+void PointGrid::radiusSearch(Point3f q, float sqRadius, std::vector<int>& indices) const
+{
+    indices.clear();
+    if(cells.empty())
+        return;
+
+    float radius = std::sqrt(sqRadius);
+    Vec3i lo = cellOf(q - Point3f(radius, radius, radius));
+    Vec3i hi = cellOf(q + Point3f(radius, radius, radius));
+    for(int i = 0; i < 3; i++)
+    {
+        lo[i] = std::max(lo[i], minCell[i]);
+        hi[i] = std::min(hi[i], maxCell[i]);
+    }
+
+    for(int x = lo[0]; x <= hi[0]; x++)
+    {
+        for(int y = lo[1]; y <= hi[1]; y++)
+        {
+            for(int z = lo[2]; z <= hi[2]; z++)
+            {
+                auto it = cells.find(Vec3i(x, y, z));
+                if(it == cells.end())
+                    continue;
+
+                for(int idx: it->second)
+                {
+                    Point3f d = points[idx] - q;
+                    if(d.dot(d) <= sqRadius)
+                        indices.push_back(idx);
+                }
+            }
+        }
+    }
+}
+
 WarpField::WarpField(int _maxNeighbours, int K, int levels, float baseResolution, float resolutionGrowth):
 k(K), n_levels(levels),
 nodes(), maxNeighbours(_maxNeighbours), // good amount for dense kinfu pointclouds
@@ -11,7 +150,7 @@ baseRes(baseResolution),
 resGrowthRate(resolutionGrowth),
 regGraphNodes(n_levels-1),
 heirarchy(n_levels-1),
-nodeIndex(nullptr)
+nodeIndex(std::sqrt(baseResolution))
 {
     CV_Assert(k <= DYNAFU_MAX_NEIGHBOURS);
 }
@@ -38,7 +177,7 @@ bool PtCmp(cv::Point3f a, cv::Point3f b)
             ((a.x >= b.x) && (a.y >= b.y) && (a.z < b.z));
 }
 
-Ptr<flann::GenericIndex<flann::L2_Simple<float> > > WarpField::getNodeIndex() const
+const PointGrid& WarpField::getNodeIndex() const
 {
     return nodeIndex;
 }
@@ -67,8 +206,13 @@ void WarpField::updateNodesFromPoints(InputArray inputPoints)
         points_matrix = inputPoints.getMat().reshape(1).colRange(0, 3).clone();
     }
 
-    cvflann::LinearIndexParams params;
-    flann::GenericIndex<flann::L2_Simple <float> > searchIndex(points_matrix, params);
+    // radius of the searches is sqrt(baseRes), so they look at 27 cells at most
+    PointGrid searchIndex(std::sqrt(baseRes));
+    for(int i = 0; i < points_matrix.rows; i++)
+    {
+        const float* p = points_matrix.ptr<float>(i);
+        searchIndex.add(Point3f(p[0], p[1], p[2]));
+    }
 
     AutoBuffer<bool> validIndex;
     removeSupported(searchIndex, validIndex);
@@ -76,38 +220,38 @@ void WarpField::updateNodesFromPoints(InputArray inputPoints)
     NodeVectorType newNodes;
     if((int)nodes.size() > k)
     {
-        newNodes = subsampleIndex(points_matrix, searchIndex, validIndex, baseRes, nodeIndex);
+        newNodes = subsampleIndex(searchIndex, validIndex, baseRes, &nodeIndex);
     }
     else
     {
-        newNodes = subsampleIndex(points_matrix, searchIndex, validIndex, baseRes);
+        newNodes = subsampleIndex(searchIndex, validIndex, baseRes);
     }
 
     initTransforms(newNodes);
     nodes.insert(nodes.end(), newNodes.begin(), newNodes.end());
-    nodesPos = getNodesPos(nodes);
-    //re-build index
-    nodeIndex = new flann::GenericIndex<flann::L2_Simple<float> >(nodesPos,
-                                                                  cvflann::LinearIndexParams());
+    // the index grows with the nodes instead of being re-built
+    for(const auto& n: newNodes)
+    {
+        nodeIndex.add(n->pos);
+    }
 
     constructRegGraph();
 }
 
 
-void WarpField::removeSupported(flann::GenericIndex<flann::L2_Simple<float> >& ind,
-                                  AutoBuffer<bool>& validInd)
+void WarpField::removeSupported(const PointGrid& ind, AutoBuffer<bool>& validInd)
 {
     validInd.allocate(ind.size());
-    std::fill_n(validInd.data(), ind.size(), true);
-
-    for(WarpNode* n: nodes)
+    for(int i = 0; i < ind.size(); i++)
     {
-        std::vector<float> query = {n->pos.x, n->pos.y, n->pos.z};
-
-        std::vector<int> indices_vec(maxNeighbours);
-        std::vector<float> dists_vec(maxNeighbours);
+        Point3f p = ind.point(i);
+        validInd[i] = !(cvIsNaN(p.x) || cvIsNaN(p.y) || cvIsNaN(p.z));
+    }
 
-        ind.radiusSearch(query, indices_vec, dists_vec, n->radius, cvflann::SearchParams());
+    std::vector<int> indices_vec;
+    for(const auto& n: nodes)
+    {
+        ind.radiusSearch(n->pos, n->radius, indices_vec);
 
         for(auto i: indices_vec)
         {
@@ -117,15 +261,14 @@ void WarpField::removeSupported(flann::GenericIndex<flann::L2_Simple<float> >& i
     }
 }
 
-NodeVectorType WarpField::subsampleIndex(Mat& pmat,
-                                         flann::GenericIndex<flann::L2_Simple<float> >& ind,
-                                         AutoBuffer<bool>& validIndex, float res,
-                                         Ptr<flann::GenericIndex<flann::L2_Simple<float> > > knnIndex)
+NodeVectorType WarpField::subsampleIndex(const PointGrid& ind, AutoBuffer<bool>& validIndex, float res,
+                                         const PointGrid* knnIndex)
 {
     CV_TRACE_FUNCTION();
 
     NodeVectorType temp_nodes;
 
+    std::vector<int> indices_vec;
     for(int i = 0; i < (int)validIndex.size(); i++)
     {
         if(!validIndex[i])
@@ -133,10 +276,7 @@ NodeVectorType WarpField::subsampleIndex(Mat& pmat,
             continue;
         }
 
-        std::vector<int> indices_vec(maxNeighbours);
-        std::vector<float> dist_vec(maxNeighbours);
-
-        ind.radiusSearch(pmat.row(i), indices_vec, dist_vec, res, cvflann::SearchParams());
+        ind.radiusSearch(ind.point(i), res, indices_vec);
 
 
         Ptr<WarpNode> wn = new WarpNode;
@@ -146,9 +286,7 @@ NodeVectorType WarpField::subsampleIndex(Mat& pmat,
         {
             if(validIndex[index])
             {
-                centre += Point3f(pmat.at<float>(index, 0),
-                                  pmat.at<float>(index, 1),
-                                  pmat.at<float>(index, 2));
+                centre += ind.point(index);
                 len++;
             }
         }
@@ -161,15 +299,13 @@ NodeVectorType WarpField::subsampleIndex(Mat& pmat,
             validIndex[index] = false;
         }
 
-        std::vector<int> knn_indices(k+1, 0);
-        std::vector<float> knn_dists(k+1, 0);
-
-        std::vector<float> query = {wn->pos.x, wn->pos.y, wn->pos.z};
-
         if(knnIndex != nullptr)
         {
-            knnIndex->knnSearch(query, knn_indices, knn_dists, (k+1), cvflann::SearchParams());
-            wn->radius = *std::max_element(knn_dists.begin(), knn_dists.end());
+            int knn_indices[DYNAFU_MAX_NEIGHBOURS+1];
+            float knn_dists[DYNAFU_MAX_NEIGHBOURS+1];
+            int found = knnIndex->knnSearch(wn->pos, k+1, knn_indices, knn_dists);
+            // the distances are sorted, the last one is the largest
+            wn->radius = found > 0 ? knn_dists[found-1] : res;
         }
         else
         {
@@ -186,43 +322,57 @@ NodeVectorType WarpField::subsampleIndex(Mat& pmat,
 
 void WarpField::initTransforms(NodeVectorType nv)
 {
-    if(nodesPos.size().height == 0)
+    if(nodes.empty() || nv.empty())
     {
         return;
     }
 
-    for(auto nodePtr: nv)
-    {
-        std::vector<int> knnIndices(k);
-        std::vector<float> knnDists(k);
+    const int nNew = (int)nv.size();
+    std::vector<int> knnIndices(nNew*k, -1);
+    std::vector<float> weights(nNew*k, 0.f);
+    std::vector<Vec3f> translations(nNew);
 
-        std::vector<float> query = {nodePtr->pos.x, nodePtr->pos.y, nodePtr->pos.z};
+    parallel_for_(Range(0, nNew), [&](const Range& range)
+    {
+        for(int i = range.start; i < range.end; i++)
+        {
+            const WarpNode& node = *nv[i];
+            int* idx = &knnIndices[i*k];
+            float* w = &weights[i*k];
 
-        nodeIndex->knnSearch(query ,knnIndices, knnDists, k, cvflann::SearchParams());
+            float knnDists[DYNAFU_MAX_NEIGHBOURS];
+            int found = nodeIndex.knnSearch(node.pos, k, idx, knnDists);
 
-        std::vector<float> weights(knnIndices.size());
-        std::vector<Affine3f> transforms(knnIndices.size());
+            // linearly interpolate translations
+            Vec3f translation(0, 0, 0);
+            float totalWeight = 0;
+            for(int j = 0; j < found; j++)
+            {
+                const WarpNode& neigh = *nodes[idx[j]];
+                w[j] = neigh.weight(node.pos);
+                translation += w[j]*neigh.transform.translation();
+                totalWeight += w[j];
+            }
 
-        size_t i = 0;
-        for(int idx: knnIndices)
-        {
-            weights[i] = nodes[idx]->weight(nodePtr->pos);
-            transforms[i++] = nodes[idx]->transform;
+            if(totalWeight < 1e-5) translation = Vec3f(0, 0, 0);
+            else translation /= totalWeight;
+            translations[i] = translation;
         }
+    });
 
-        Affine3f pose = DQB(weights, transforms);
-        // linearly interpolate translations
-        Vec3f translation(0,0,0);
-        float totalWeight = 0;
-        for(i = 0; i < transforms.size(); i++)
-        {
-            translation += weights[i]*transforms[i].translation();
-            totalWeight += weights[i];
-        }
+    std::vector<DualQuaternion> quats(nodes.size());
+    for(size_t i = 0; i < nodes.size(); i++)
+    {
+        quats[i] = DualQuaternion(nodes[i]->transform);
+    }
 
-        if(totalWeight < 1e-5) translation = Vec3f(0, 0, 0);
-        else translation /= totalWeight;
-        nodePtr->transform = Affine3f(pose.rotation(), translation);
+    // rotations are blended for all the new nodes at once
+    std::vector<Affine3f> poses;
+    DQB(quats, knnIndices, weights, k, poses);
+
+    for(int i = 0; i < nNew; i++)
+    {
+        nv[i]->transform = Affine3f(poses[i].rotation(), translations[i]);
     }
 }
 
@@ -239,49 +389,38 @@ void WarpField::constructRegGraph()
 
     float effResolution = baseRes*resGrowthRate;
     NodeVectorType curNodes = nodes;
-    Mat curNodeMatrix = getNodesPos(curNodes);
-
-    Ptr<flann::GenericIndex<flann::L2_Simple<float> > > curNodeIndex(
-        new flann::GenericIndex<flann::L2_Simple<float> >(curNodeMatrix,
-                                                          cvflann::LinearIndexParams()));
+    PointGrid curNodeIndex = nodeIndex;
 
     for(int l = 0; l < (n_levels-1); l++)
     {
         AutoBuffer<bool> nodeValidity;
-        nodeValidity.allocate(curNodeIndex->size());
+        nodeValidity.allocate(curNodeIndex.size());
 
-        std::fill_n(nodeValidity.data(), curNodeIndex->size(), true);
-        NodeVectorType coarseNodes = subsampleIndex(curNodeMatrix, *curNodeIndex, nodeValidity,
-                                                    effResolution);
+        std::fill_n(nodeValidity.data(), curNodeIndex.size(), true);
+        NodeVectorType coarseNodes = subsampleIndex(curNodeIndex, nodeValidity, effResolution);
 
         initTransforms(coarseNodes);
 
-        Mat coarseNodeMatrix = getNodesPos(coarseNodes);
-
-        Ptr<flann::GenericIndex<flann::L2_Simple<float> > > coarseNodeIndex(
-            new flann::GenericIndex<flann::L2_Simple<float> >(coarseNodeMatrix,
-                                                              cvflann::LinearIndexParams()));
+        PointGrid coarseNodeIndex(std::sqrt(effResolution));
+        for(const auto& n: coarseNodes)
+        {
+            coarseNodeIndex.add(n->pos);
+        }
 
         heirarchy[l] = std::vector<nodeNeighboursType>(curNodes.size());
-        for(int i = 0; i < (int)curNodes.size(); i++)
+        parallel_for_(Range(0, (int)curNodes.size()), [&](const Range& range)
         {
-            std::vector<int> children_indices(k);
-            std::vector<float> children_dists(k);
-
-            std::vector<float> query = {curNodeMatrix.at<float>(i, 0),
-                                        curNodeMatrix.at<float>(i, 1),
-                                        curNodeMatrix.at<float>(i, 2)};
-
-            coarseNodeIndex->knnSearch(query, children_indices, children_dists, k,
-                                       cvflann::SearchParams());
-            heirarchy[l][i].fill(-1);
-            std::copy(children_indices.begin(), children_indices.end(), heirarchy[l][i].begin());
-        }
+            float children_dists[DYNAFU_MAX_NEIGHBOURS];
+            for(int i = range.start; i < range.end; i++)
+            {
+                heirarchy[l][i].fill(-1);
+                coarseNodeIndex.knnSearch(curNodeIndex.point(i), k, heirarchy[l][i].data(), children_dists);
+            }
+        });
 
         regGraphNodes.push_back(coarseNodes);
         curNodes = coarseNodes;
-        curNodeMatrix = coarseNodeMatrix;
-        curNodeIndex = coarseNodeIndex;
+        curNodeIndex = std::move(coarseNodeIndex);
         effResolution *= resGrowthRate;
     }
 
@@ -301,14 +440,15 @@ Point3f WarpField::applyWarp(Point3f p, const nodeNeighboursType neighbours, int
 
     for(int i = 0; i < n; i++)
     {
-        Ptr<WarpNode> neigh = nodes[neighbours[i]];
-        float w = neigh->weight(p);
+        // no Ptr copies here, their reference counters are shared between threads
+        const WarpNode& neigh = *nodes[neighbours[i]];
+        float w = neigh.weight(p);
         if(w < 0.01)
         {
             continue;
         }
 
-        Matx33f R = neigh->transform.rotation();
+        Matx33f R = neigh.transform.rotation();
         Point3f newPt(0, 0, 0);
 
         if(normal)
@@ -317,8 +457,8 @@ Point3f WarpField::applyWarp(Point3f p, const nodeNeighboursType neighbours, int
         }
         else
         {
-            newPt = R * (p - neigh->pos) + neigh->pos;
-            Vec3f T = neigh->transform.translation();
+            newPt = R * (p - neigh.pos) + neigh.pos;
+            Vec3f T = neigh.transform.translation();
             newPt.x += T[0];
             newPt.y += T[1];
             newPt.z += T[2];
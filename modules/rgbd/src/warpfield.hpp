@@ -1,8 +1,8 @@
 #ifndef __OPENCV_RGBD_WARPFIELD_HPP__
 #define __OPENCV_RGBD_WARPFIELD_HPP__
 
+#include <unordered_map>
 #include "opencv2/core.hpp"
-#include "opencv2/flann.hpp"
 #include "dqb.hpp"
 
 #define DYNAFU_MAX_NEIGHBOURS 10
@@ -18,7 +18,7 @@ struct WarpNode
     float radius;
     Affine3f transform;
 
-    float weight(Point3f x)
+    float weight(Point3f x) const
     {
         Point3f diff = pos - x;
         float L2 = diff.x*diff.x + diff.y*diff.y + diff.z*diff.z;
@@ -28,6 +28,59 @@ struct WarpNode
 
 typedef std::vector<Ptr<WarpNode> > NodeVectorType;
 
+struct GridCellHash
+{
+    size_t operator()(const Vec3i& c) const noexcept
+    {
+        size_t seed = 0;
+        constexpr uint32_t GOLDEN_RATIO = 0x9e3779b9;
+        for(int i = 0; i < 3; i++)
+        {
+            seed ^= std::hash<int>()(c[i]) + GOLDEN_RATIO + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+};
+
+/** Regular grid of 3d points for radius and k-nearest neighbour searches.
+ * Points are only added, each one goes to its cell right away,
+ * so the index grows together with the warp field and is never rebuilt.
+ * Distances are squared like in flann::L2_Simple.
+ */
+class CV_EXPORTS PointGrid
+{
+public:
+    PointGrid(float cellSize = .10f);
+
+    void clear();
+    int add(Point3f p);
+
+    int size() const
+    {
+        return (int)points.size();
+    }
+
+    Point3f point(int i) const
+    {
+        return points[i];
+    }
+
+    //! Finds up to k nearest points sorted by distance, returns their number
+    int knnSearch(Point3f q, int k, int* indices, float* sqDists) const;
+
+    //! Finds all the points closer than sqrt(sqRadius)
+    void radiusSearch(Point3f q, float sqRadius, std::vector<int>& indices) const;
+
+private:
+    Vec3i cellOf(Point3f p) const;
+
+    float cellSize, cellSizeInv;
+    std::vector<Point3f> points;
+    std::unordered_map<Vec3i, std::vector<int>, GridCellHash> cells;
+    // bounds of the occupied cells, the searches don't go beyond
+    Vec3i minCell, maxCell;
+};
+
 class WarpField
 {
 public:
@@ -49,23 +102,22 @@ public:
 
     void setAllRT(Affine3f warpRT);
 
-    Ptr<flann::GenericIndex<flann::L2_Simple<float> > > getNodeIndex() const;
+    const PointGrid& getNodeIndex() const;
 
-    inline void findNeighbours(Point3f queryPt, std::vector<int>& indices, std::vector<float>& dists)
+    //! Finds up to k nearest nodes and their squared distances, returns their number
+    inline int findNeighbours(Point3f queryPt, nodeNeighboursType& indices, float* dists) const
     {
-        std::vector<float> query = {queryPt.x, queryPt.y, queryPt.z};
-        nodeIndex->knnSearch(query, indices, dists, k, cvflann::SearchParams());
+        return nodeIndex.knnSearch(queryPt, k, indices.data(), dists);
     }
 
     int k; //k-nearest neighbours will be used
     int n_levels; // number of levels in the heirarchy
 
 private:
-    void removeSupported(flann::GenericIndex<flann::L2_Simple<float> >& ind, AutoBuffer<bool>& supInd);
+    void removeSupported(const PointGrid& ind, AutoBuffer<bool>& supInd);
 
-    NodeVectorType subsampleIndex(Mat& pmat, flann::GenericIndex<flann::L2_Simple<float> >& ind,
-                                  AutoBuffer<bool>& supInd, float res,
-                                  Ptr<flann::GenericIndex<flann::L2_Simple<float> > > knnIndex = nullptr);
+    NodeVectorType subsampleIndex(const PointGrid& ind, AutoBuffer<bool>& supInd, float res,
+                                  const PointGrid* knnIndex = nullptr);
     void constructRegGraph();
 
     void initTransforms(NodeVectorType nv);
@@ -79,9 +131,8 @@ private:
     std::vector<NodeVectorType> regGraphNodes; // heirarchy levels 1 to L
     heirarchyType heirarchy;
 
-    Ptr<flann::GenericIndex<flann::L2_Simple<float> > > nodeIndex;
-
-    Mat nodesPos;
+    // nodes of level 0, updated as they are added
+    PointGrid nodeIndex;
 
 };
 
@@ -0,0 +1,111 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+// This code is also subject to the license terms in the LICENSE_WillowGarage.md file found in this module's directory
+
+#include "test_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+static const Matx33f depthK(525.f, 0.f, 319.5f, 0.f, 525.f, 239.5f, 0.f, 0.f, 1.f);
+
+/** Compares images which have NaN at the same places */
+static double normInfNaN(const Mat& a, const Mat& b)
+{
+    Mat nanA = (a != a), nanB = (b != b);
+    if(cvtest::norm(nanA, nanB, NORM_INF) > 0)
+        return std::numeric_limits<double>::infinity();
+    Mat a0 = a.clone(), b0 = b.clone();
+    patchNaNs(a0, 0);
+    patchNaNs(b0, 0);
+    return cvtest::norm(a0, b0, NORM_INF);
+}
+
+/** Wavy surface in millimeters with a few holes */
+static Mat_<unsigned short> wavyDepth()
+{
+    Mat_<unsigned short> depth(480, 640);
+    for(int y = 0; y < depth.rows; y++)
+    {
+        for(int x = 0; x < depth.cols; x++)
+        {
+            float dx = (x - 319.5f)/525.f, dy = (y - 239.5f)/525.f;
+            depth(y, x) = (unsigned short)cvRound(1500.f + 100.f*std::sin(dx*8.f)*std::cos(dy*6.f) + 200.f*dx);
+        }
+    }
+    rectangle(depth, Rect(100, 100, 40, 30), Scalar::all(0), FILLED);
+    return depth;
+}
+
+TEST(Rgbd_DepthPreprocessor, matches_separate_passes)
+{
+    Mat_<unsigned short> depth = wavyDepth();
+
+    Ptr<DepthPreprocessor> preprocessor = DepthPreprocessor::create(depthK, 1000.f, false);
+
+    Matx33f colorK(520.f, 0.f, 330.f, 0.f, 520.f, 245.f, 0.f, 0.f, 1.f);
+    Matx44f Rt = Matx44f::eye();
+    Rt(0, 3) = 0.025f;
+    preprocessor->setRegistration(colorK, Mat(), Rt, Size(640, 480), true);
+
+    Mat cleanDepth, points, registered;
+    (*preprocessor)(depth, cleanDepth, points, registered);
+
+    Mat expectedDepth;
+    rescaleDepth(depth, CV_32F, expectedDepth);
+    EXPECT_LE(normInfNaN(cleanDepth, expectedDepth), 1e-6);
+
+    Mat expectedPoints;
+    depthTo3d(depth, depthK, expectedPoints);
+    ASSERT_EQ(expectedPoints.type(), points.type());
+    EXPECT_LE(normInfNaN(points.reshape(1), expectedPoints.reshape(1)), 1e-5);
+
+    Mat_<unsigned short> expectedRegistered;
+    registerDepth(depthK, colorK, Mat(), Rt, depth, Size(640, 480), expectedRegistered, true);
+    ASSERT_EQ(expectedRegistered.size(), registered.size());
+
+    // Pixels rounded to the other side of .5 by the chained transform are allowed
+    int nDiff = 0;
+    for(int y = 0; y < registered.rows; y++)
+    {
+        for(int x = 0; x < registered.cols; x++)
+        {
+            float z = registered.at<float>(y, x);
+            unsigned short e = expectedRegistered(y, x);
+            if(cvIsNaN(z) ? e != 0 : std::abs(z*1000.f - e) > 1.f)
+                nDiff++;
+        }
+    }
+    EXPECT_LE(nDiff, registered.rows*registered.cols/1000);
+}
+
+TEST(Rgbd_DepthPreprocessor, clean)
+{
+    Mat_<float> depth;
+    wavyDepth().convertTo(depth, CV_32F, 1./1000.);
+    depth.setTo(std::numeric_limits<float>::quiet_NaN(), depth == 0);
+
+    Mat cleanDepth, points;
+    DepthPreprocessor preprocessor(depthK, 1.f, true);
+    preprocessor(depth, cleanDepth, points);
+
+    // The NIL cleaner gives the same result far from the image borders and the holes
+    Ptr<DepthCleaner> cleaner = DepthCleaner::create(CV_32F);
+    Mat expected;
+    (*cleaner)(depth, expected);
+
+    Rect inner(1, 1, depth.cols - 2, depth.rows - 2);
+    Mat validMask = (depth == depth);
+    erode(validMask, validMask, Mat());
+    Mat diff = abs(cleanDepth - expected);
+    diff.setTo(0, ~validMask);
+    EXPECT_LE(cvtest::norm(diff(inner), NORM_INF), 1e-5);
+
+    // The points are made of the cleaned depth
+    std::vector<Mat> channels;
+    split(points, channels);
+    EXPECT_EQ(0, normInfNaN(channels[2], cleanDepth));
+}
+
+}} // namespace
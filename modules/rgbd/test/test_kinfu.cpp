@@ -6,6 +6,8 @@
 
 #include "test_precomp.hpp"
 
+#include <fstream>
+
 // Inspired by Inigo Quilez' raymarching guide:
 // http://iquilezles.org/www/articles/distfunctions/distfunctions.htm
 
@@ -276,7 +278,7 @@ Ptr<Scene> Scene::create(int nScene, Size sz, Matx33f _intr, float _depthFactor)
 
 static const bool display = false;
 
-void flyTest(bool hiDense, bool inequal, bool hashTsdf = false)
+void flyTest(bool hiDense, bool inequal, bool hashTsdf = false, bool pipelined = false)
 {
     Ptr<kinfu::Params> params;
     if(hiDense)
@@ -287,6 +289,8 @@ void flyTest(bool hiDense, bool inequal, bool hashTsdf = false)
     if(hashTsdf)
         params = kinfu::Params::hashTSDFParams(!hiDense);
 
+    params->pipelined = pipelined;
+
     if(inequal)
     {
         params->volumeDims[0] += 32;
@@ -372,6 +376,122 @@ TEST(KinectFusion, DISABLED_OCL)
 }
 #endif
 
+//! Runs KinFu sequentially and pipelined on the same frames,
+//! the frames are processed the same way, so the results should match
+void pipelinedTest()
+{
+    Ptr<kinfu::Params> params = kinfu::Params::coarseParams();
+    Ptr<kinfu::Params> pipelinedParams = makePtr<kinfu::Params>(*params);
+    pipelinedParams->pipelined = true;
+
+    Ptr<Scene> scene = Scene::create(false, params->frameSize, params->intr, params->depthFactor);
+    std::vector<Affine3f> poses = scene->getPoses();
+
+    Ptr<kinfu::KinFu> sequential = kinfu::KinFu::create(params);
+    Ptr<kinfu::KinFu> pipelined = kinfu::KinFu::create(pipelinedParams);
+    Affine3f startPose;
+    for(size_t i = 0; i < poses.size(); i++)
+    {
+        Mat depth = scene->depth(poses[i]);
+        ASSERT_EQ(sequential->update(depth), pipelined->update(depth)) << "frame " << i;
+        Affine3f pose = sequential->getPose(), pipelinedPose = pipelined->getPose();
+        ASSERT_LT(cv::norm(pose.rvec() - pipelinedPose.rvec()), 1e-5) << "frame " << i;
+        ASSERT_LT(cv::norm(pose.translation() - pipelinedPose.translation()), 1e-5) << "frame " << i;
+        if(i == 0)
+            startPose = pose;
+    }
+
+    for(const Affine3f& pose : { startPose, sequential->getPose() })
+    {
+        Mat image, pipelinedImage;
+        sequential->render(image, pose.matrix);
+        pipelined->render(pipelinedImage, pose.matrix);
+        Mat diff;
+        absdiff(image, pipelinedImage, diff);
+        EXPECT_LT(countNonZero(diff.reshape(1) > 8), (int)diff.total()/100);
+    }
+}
+
+#ifdef OPENCV_ENABLE_NONFREE
+TEST( KinectFusion, pipelined )
+#else
+TEST(KinectFusion, DISABLED_pipelined)
+#endif
+{
+    //! pipelined mode is used by CPU implementation only
+    bool useOcl = cv::ocl::useOpenCL();
+    cv::ocl::setUseOpenCL(false);
+    flyTest(false, false, false, true);
+    pipelinedTest();
+    cv::ocl::setUseOpenCL(useOcl);
+}
+
+//! Runs KinFu with volume units paged out beyond a radius around the camera
+//! and without paging on the same frames, the results should match
+void pagingTest()
+{
+    Ptr<kinfu::Params> params = kinfu::Params::hashTSDFParams(true);
+    Ptr<kinfu::Params> pagedParams = makePtr<kinfu::Params>(*params);
+    // far parts of the scene are paged out and come back as the camera goes round
+    pagedParams->volumeUnitPagingRadius = 2.5f;
+    pagedParams->volumeUnitPagingPath = cv::tempfile(".bin");
+
+    Ptr<Scene> scene = Scene::create(false, params->frameSize, params->intr, params->depthFactor);
+    std::vector<Affine3f> poses = scene->getPoses();
+    Affine3f startPose;
+    {
+        Ptr<kinfu::KinFu> resident = kinfu::KinFu::create(params);
+        Ptr<kinfu::KinFu> paged = kinfu::KinFu::create(pagedParams);
+        for(size_t i = 0; i < poses.size(); i++)
+        {
+            Mat depth = scene->depth(poses[i]);
+            ASSERT_EQ(resident->update(depth), paged->update(depth)) << "frame " << i;
+            Affine3f pose = resident->getPose(), pagedPose = paged->getPose();
+            ASSERT_LT(cv::norm(pose.rvec() - pagedPose.rvec()), 1e-4) << "frame " << i;
+            ASSERT_LT(cv::norm(pose.translation() - pagedPose.translation()), 1e-4) << "frame " << i;
+            if(i == 0)
+                startPose = pose;
+        }
+
+        // rays from the first pose go through the volume units paged out since then
+        for(const Affine3f& pose : { startPose, resident->getPose() })
+        {
+            Mat image, pagedImage;
+            resident->render(image, pose.matrix);
+            paged->render(pagedImage, pose.matrix);
+            Mat diff;
+            absdiff(image, pagedImage, diff);
+            EXPECT_LT(countNonZero(diff.reshape(1) > 8), (int)diff.total()/100);
+        }
+
+        Mat points, normals, pagedPoints, pagedNormals;
+        resident->getCloud(points, normals);
+        paged->getCloud(pagedPoints, pagedNormals);
+        ASSERT_GT(points.rows, 0);
+        EXPECT_LE(std::abs(points.rows - pagedPoints.rows), points.rows/100);
+    }
+
+    // volume units were actually paged out
+    std::ifstream storage(pagedParams->volumeUnitPagingPath, std::ios::binary | std::ios::ate);
+    ASSERT_TRUE(storage.is_open());
+    EXPECT_GT((int64)storage.tellg(), 0);
+    storage.close();
+    std::remove(pagedParams->volumeUnitPagingPath.c_str());
+}
+
+#ifdef OPENCV_ENABLE_NONFREE
+TEST( KinectFusion, hashTsdfPaging )
+#else
+TEST(KinectFusion, DISABLED_hashTsdfPaging)
+#endif
+{
+    //! volume unit paging is implemented by CPU HashTSDF volume
+    bool useOcl = cv::ocl::useOpenCL();
+    cv::ocl::setUseOpenCL(false);
+    pagingTest();
+    cv::ocl::setUseOpenCL(useOcl);
+}
+
 TEST( KinectFusion, DISABLED_hashTsdf )
 {
     flyTest(false, false, true);
@@ -0,0 +1,109 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+// This code is also subject to the license terms in the LICENSE_WillowGarage.md file found in this module's directory
+
+#include "test_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+/** Several colored shapes on a gray background, shifted by the offset */
+static Mat drawShapes(Point offset)
+{
+    Mat image(480, 640, CV_8UC3, Scalar::all(96));
+    rectangle(image, Rect(Point(200, 150) + offset, Size(90, 60)), Scalar(255, 0, 0), FILLED);
+    circle(image, Point(330, 200) + offset, 40, Scalar(0, 255, 255), FILLED);
+    rectangle(image, Rect(Point(240, 230) + offset, Size(50, 70)), Scalar(0, 0, 255), FILLED);
+    circle(image, Point(340, 280) + offset, 25, Scalar(255, 255, 255), FILLED);
+    return image;
+}
+
+static void expectSameMatches(const std::vector<linemod::Match>& m1, const std::vector<linemod::Match>& m2)
+{
+    ASSERT_EQ(m1.size(), m2.size());
+    for(size_t i = 0; i < m1.size(); i++)
+    {
+        EXPECT_EQ(m1[i].x, m2[i].x);
+        EXPECT_EQ(m1[i].y, m2[i].y);
+        EXPECT_EQ(m1[i].similarity, m2[i].similarity);
+        EXPECT_EQ(m1[i].class_id, m2[i].class_id);
+        EXPECT_EQ(m1[i].template_id, m2[i].template_id);
+    }
+}
+
+/** Matches image by image, template by template, the way match() did before matchBatch() */
+class SequentialDetector : public linemod::Detector
+{
+public:
+    SequentialDetector(const std::vector< Ptr<linemod::Modality> >& _modalities, const std::vector<int>& T_pyramid)
+        : linemod::Detector(_modalities, T_pyramid) {}
+
+    void matchSequential(const std::vector<Mat>& sources, float threshold, std::vector<linemod::Match>& matches) const
+    {
+        LinearMemoryPyramid lm_pyramid;
+        std::vector<Size> sizes;
+        computeLinearMemories(sources, std::vector<Mat>(), lm_pyramid, sizes);
+
+        matches.clear();
+        for(TemplatesMap::const_iterator it = class_templates.begin(); it != class_templates.end(); ++it)
+        {
+            for(size_t template_id = 0; template_id < it->second.size(); template_id++)
+                matchTemplate(lm_pyramid, sizes, threshold, matches, it->first,
+                              static_cast<int>(template_id), it->second[template_id]);
+        }
+        std::sort(matches.begin(), matches.end());
+        matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    }
+};
+
+TEST(Rgbd_Linemod, matchBatch)
+{
+    std::vector< Ptr<linemod::Modality> > modalities(1, makePtr<linemod::ColorGradient>());
+    std::vector<int> T_pyramid;
+    T_pyramid.push_back(5);
+    T_pyramid.push_back(8);
+    SequentialDetector detector(modalities, T_pyramid);
+
+    Mat templImage = drawShapes(Point(0, 0));
+    Mat mask = Mat::zeros(templImage.size(), CV_8U);
+    rectangle(mask, Rect(190, 140, 200, 180), Scalar::all(255), FILLED);
+    Rect bb;
+    ASSERT_EQ(0, detector.addTemplate(std::vector<Mat>(1, templImage), "shapes", mask, &bb));
+    ASSERT_EQ(1, detector.addTemplate(std::vector<Mat>(1, templImage(Rect(0, 0, 640, 400)).clone()),
+                                      "shapes", mask(Rect(0, 0, 640, 400))));
+
+    std::vector<Point> offsets;
+    offsets.push_back(Point(0, 0));
+    offsets.push_back(Point(40, 24));
+    offsets.push_back(Point(-64, 32));
+    std::vector< std::vector<Mat> > sources;
+    for(size_t i = 0; i < offsets.size(); i++)
+        sources.push_back(std::vector<Mat>(1, drawShapes(offsets[i])));
+
+    const float threshold = 80.f;
+    std::vector< std::vector<linemod::Match> > batchMatches;
+    detector.matchBatch(sources, threshold, batchMatches);
+    ASSERT_EQ(batchMatches.size(), sources.size());
+
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        // The best match is the first template at the place the shapes were moved to
+        ASSERT_FALSE(batchMatches[i].empty());
+        const linemod::Match& best = batchMatches[i][0];
+        EXPECT_EQ("shapes", best.class_id);
+        EXPECT_GE(best.similarity, 90.f);
+        EXPECT_LE(std::abs(best.x - (bb.x + offsets[i].x)), 2) << "image " << i;
+        EXPECT_LE(std::abs(best.y - (bb.y + offsets[i].y)), 2) << "image " << i;
+
+        std::vector<linemod::Match> sequentialMatches;
+        detector.matchSequential(sources[i], threshold, sequentialMatches);
+        expectSameMatches(sequentialMatches, batchMatches[i]);
+
+        std::vector<linemod::Match> matches;
+        detector.match(sources[i], threshold, matches);
+        expectSameMatches(sequentialMatches, matches);
+    }
+}
+
+}} // namespace
@@ -435,12 +435,184 @@ TEST(Rgbd_Normals, compute)
   test.safe_run();
 }
 
+TEST(Rgbd_Normals, linemod_16u_matches_scalar)
+{
+    // a tilted plane in millimeters with noise, a box in front of it and a hole,
+    // the width is odd so that the scalar code handles the ends of the rows
+    const int rows = 120, cols = 163;
+    Mat_<unsigned short> depth(rows, cols);
+    RNG rng(0);
+    for (int y = 0; y < rows; y++)
+        for (int x = 0; x < cols; x++)
+            depth(y, x) = saturate_cast<unsigned short>(1500 + 2.5 * x + 1.5 * y + rng.uniform(-3, 4));
+    depth(Rect(40, 30, 50, 40)) -= 300;
+    depth(Rect(110, 80, 20, 20)) = 0;
+
+    Matx33f camera_matrix(525.f, 0.f, 81.f,
+                          0.f, 525.f, 60.f,
+                          0.f, 0.f, 1.f);
+    RgbdNormals normals_computer(rows, cols, CV_32F, camera_matrix, 5, RgbdNormals::RGBD_NORMALS_METHOD_LINEMOD);
+
+    // the 16U depth takes the vectorized path where it is available, the 64F one is computed by the scalar code
+    // exactly as the 16U one was
+    Mat_<Vec3f> normals, normals_scalar;
+    Mat depth64;
+    depth.convertTo(depth64, CV_64F);
+    normals_computer(depth, normals);
+    normals_computer(depth64, normals_scalar);
+
+    int n_valid = 0;
+    for (int y = 0; y < rows; y++)
+        for (int x = 0; x < cols; x++)
+        {
+            const Vec3f &n = normals(y, x), &n_scalar = normals_scalar(y, x);
+            ASSERT_EQ(cvIsNaN(n_scalar[0]), cvIsNaN(n[0])) << "at " << Point(x, y);
+            if (cvIsNaN(n_scalar[0]))
+                continue;
+            n_valid++;
+            ASSERT_LE(cvtest::norm(n, n_scalar, NORM_INF), 1e-4) << "at " << Point(x, y);
+        }
+    EXPECT_GT(n_valid, (rows - 11) * (cols - 11) / 2);
+}
+
+TEST(Rgbd_Normals, switch_parameters)
+{
+    // points of a tilted plane
+    const Size sizes[] = { Size(160, 120), Size(80, 60) };
+    Mat_<Vec3f> points[2];
+    for (int k = 0; k < 2; k++)
+    {
+        points[k].create(sizes[k]);
+        for (int y = 0; y < sizes[k].height; y++)
+            for (int x = 0; x < sizes[k].width; x++)
+            {
+                float z = 1.f + 0.002f * x + 0.003f * y;
+                points[k](y, x) = Vec3f((x - sizes[k].width / 2.f) * z / 100.f, (y - sizes[k].height / 2.f) * z / 100.f, z);
+            }
+    }
+    Matx33f camera_matrix(100.f, 0.f, 80.f,
+                          0.f, 100.f, 60.f,
+                          0.f, 0.f, 1.f);
+
+    // one object goes back and forth between resolutions and methods,
+    // the normals match the ones of the objects made for each of them
+    RgbdNormals normals_computer(sizes[0].height, sizes[0].width, CV_32F, camera_matrix, 5,
+                                 RgbdNormals::RGBD_NORMALS_METHOD_FALS);
+    const int methods[] = { RgbdNormals::RGBD_NORMALS_METHOD_FALS, RgbdNormals::RGBD_NORMALS_METHOD_FALS,
+                            RgbdNormals::RGBD_NORMALS_METHOD_FALS, RgbdNormals::RGBD_NORMALS_METHOD_LINEMOD,
+                            RgbdNormals::RGBD_NORMALS_METHOD_FALS };
+    for (int i = 0; i < 5; i++)
+    {
+        const int k = i % 2;
+        normals_computer.setRows(sizes[k].height);
+        normals_computer.setCols(sizes[k].width);
+        normals_computer.setMethod(methods[i]);
+        Mat normals, expected;
+        normals_computer(points[k], normals);
+
+        RgbdNormals fresh(sizes[k].height, sizes[k].width, CV_32F, camera_matrix, 5, methods[i]);
+        fresh(points[k], expected);
+
+        patchNaNs(normals);
+        patchNaNs(expected);
+        EXPECT_EQ(0, cvtest::norm(normals, expected, NORM_INF)) << "step " << i;
+    }
+}
+
 TEST(Rgbd_Plane, compute)
 {
   CV_RgbdPlaneTest test;
   test.safe_run();
 }
 
+TEST(Rgbd_Plane, multi_plane_scene)
+{
+    std::vector<Plane> gt_planes;
+    Mat points3d, gt_normals;
+    Mat_<unsigned char> gt_plane_mask;
+    gen_points_3d(gt_planes, gt_plane_mask, points3d, gt_normals, 3);
+
+    RgbdPlane plane_computer;
+    for (int i_test = 0; i_test < 2; ++i_test)
+    {
+        Mat plane_mask;
+        std::vector<Vec4f> plane_coefficients;
+        if (i_test == 0)
+            plane_computer(points3d, gt_normals, plane_mask, plane_coefficients);
+        else
+            plane_computer(points3d, plane_mask, plane_coefficients);
+
+        // Every plane is found once, with the points of its part of the image
+        ASSERT_EQ(gt_planes.size(), plane_coefficients.size()) << "normals " << (i_test == 0);
+        for (size_t j = 0; j < gt_planes.size(); ++j)
+        {
+            Mat gt_mask = gt_plane_mask == (int)j;
+            int n_gt = countNonZero(gt_mask), n_max = 0, i_max = 0;
+            for (int i = 0; i < (int)plane_coefficients.size(); ++i)
+            {
+                Mat dst;
+                bitwise_and(gt_mask, plane_mask == i, dst);
+                int n = countNonZero(dst);
+                if (n > n_max)
+                {
+                    n_max = n;
+                    i_max = i;
+                }
+            }
+            EXPECT_GE(n_max, 0.95 * n_gt) << "plane " << j;
+
+            const Plane& gt = gt_planes[j];
+            Vec4d expected(gt.n[0], gt.n[1], gt.n[2], -gt.p_dot_n);
+            if (expected[2] > 0)
+                expected = -expected;
+            for (int k = 0; k < 4; ++k)
+                EXPECT_NEAR(expected[k], plane_coefficients[i_max][k], k < 3 ? 1e-3 : 1e-2) << "plane " << j;
+        }
+    }
+}
+
+TEST(Rgbd_Plane, noisy_large_plane)
+{
+    // a tilted plane seen by a 640x480 camera, with noise along the rays
+    const float f = 525.f, cx = 319.5f, cy = 239.5f;
+    const Vec3f n = normalize(Vec3f(0.2f, -0.3f, 1.f)), p0(0.f, 0.f, 2.f);
+    const int block_size = 40;
+    Mat_<Vec3f> points3d(480, 640);
+    Mat_<uchar> spikes(points3d.size(), (uchar)0);
+    RNG rng(0);
+    for (int y = 0; y < points3d.rows; ++y)
+        for (int x = 0; x < points3d.cols; ++x)
+        {
+            Vec3f ray((x - cx) / f, (y - cy) / f, 1.f);
+            float t = n.dot(p0) / n.dot(ray) + (float)rng.gaussian(0.002);
+            // one point far off the plane in each tile but the top left ones, so that the plane can't be
+            // found by merging tiles and has to grow from there
+            if (y % block_size == block_size / 2 && x % block_size == block_size / 2
+                && (y >= 2 * block_size || x >= 2 * block_size))
+            {
+                t += 1.f;
+                spikes(y, x) = 255;
+            }
+            points3d(y, x) = ray * t;
+        }
+
+    RgbdPlane plane_computer(RgbdPlane::RGBD_PLANE_METHOD_DEFAULT, block_size, block_size * block_size, 0.01);
+    Mat plane_mask;
+    std::vector<Vec4f> plane_coefficients;
+    plane_computer(points3d, plane_mask, plane_coefficients);
+
+    ASSERT_EQ(1u, plane_coefficients.size());
+    Mat on_plane = (plane_mask == 0) & (spikes == 0);
+    EXPECT_GE(countNonZero(on_plane), 0.99 * (points3d.total() - countNonZero(spikes)));
+    EXPECT_EQ(0, countNonZero((plane_mask == 0) & spikes));
+
+    Vec4f expected(n[0], n[1], n[2], -n.dot(p0));
+    if (expected[2] > 0)
+        expected = -expected;
+    for (int k = 0; k < 4; ++k)
+        EXPECT_NEAR(expected[k], plane_coefficients[0][k], 1e-3);
+}
+
 TEST(Rgbd_Plane, regression_2309_valgrind_check)
 {
     Mat points(640, 480, CV_32FC3, Scalar::all(0));
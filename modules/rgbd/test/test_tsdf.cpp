@@ -3,6 +3,9 @@
 // of this distribution and at http://opencv.org/license.html
 
 #include "test_precomp.hpp"
+#include <map>
+#include <set>
+#include <tuple>
 
 namespace opencv_test { namespace {
 
@@ -277,6 +280,15 @@ void renderPointsNormals(InputArray _points, InputArray _normals, OutputArray im
 static const bool display = false;
 static const bool parallelCheck = false;
 
+Ptr<kinfu::Params> volumeParams(kinfu::VolumeType volumeType)
+{
+    if (volumeType == kinfu::VolumeType::HASHTSDF)
+        return kinfu::Params::hashTSDFParams(true);
+    if (volumeType == kinfu::VolumeType::MULTIRES_HASHTSDF)
+        return kinfu::Params::multiResHashTSDFParams(true);
+    return kinfu::Params::coarseParams();
+}
+
 void normalsCheck(Mat normals)
 {
     Vec4f vector;
@@ -293,13 +305,9 @@ void normalsCheck(Mat normals)
     }
 }
 
-void normal_test(bool isHashTSDF, bool isRaycast, bool isFetchPointsNormals, bool isFetchNormals)
+void normal_test(kinfu::VolumeType volumeType, bool isRaycast, bool isFetchPointsNormals, bool isFetchNormals)
 {
-    Ptr<kinfu::Params> _params;
-    if (isHashTSDF)
-        _params = kinfu::Params::hashTSDFParams(true);
-    else
-        _params = kinfu::Params::coarseParams();
+    Ptr<kinfu::Params> _params = volumeParams(volumeType);
 
     Ptr<Scene> scene = Scene::create(_params->frameSize, _params->intr, _params->depthFactor);
     std::vector<Affine3f> poses = scene->getPoses();
@@ -413,13 +421,9 @@ int counterOfValid(Mat points)
     return count;
 }
 
-void valid_points_test(bool isHashTSDF)
+void valid_points_test(kinfu::VolumeType volumeType)
 {
-    Ptr<kinfu::Params> _params;
-    if (isHashTSDF)
-        _params = kinfu::Params::hashTSDFParams(true);
-    else
-        _params = kinfu::Params::coarseParams();
+    Ptr<kinfu::Params> _params = volumeParams(volumeType);
 
     Ptr<Scene> scene = Scene::create(_params->frameSize, _params->intr, _params->depthFactor);
     std::vector<Affine3f> poses = scene->getPoses();
@@ -470,44 +474,271 @@ void valid_points_test(bool isHashTSDF)
     ASSERT_LT(0.5 - percentValidity, 0.3);
 }
 
+void reused_buffers_test(kinfu::VolumeType volumeType)
+{
+    Ptr<kinfu::Params> _params = volumeParams(volumeType);
+
+    Ptr<Scene> scene = Scene::create(_params->frameSize, _params->intr, _params->depthFactor);
+    std::vector<Affine3f> poses = scene->getPoses();
+
+    // output order of OpenCL volumes may differ between calls
+    bool useOpenCL = cv::ocl::useOpenCL();
+    cv::ocl::setUseOpenCL(false);
+    Ptr<kinfu::Volume> volume = kinfu::makeVolume(_params->volumeType, _params->voxelSize, _params->volumePose.matrix,
+        _params->raycast_step_factor, _params->tsdf_trunc_dist, _params->tsdf_max_weight,
+        _params->truncateThreshold, _params->volumeDims);
+    cv::ocl::setUseOpenCL(useOpenCL);
+
+    // larger than needed, should be reused
+    Mat points(1000000, 1, CV_32FC4), normals(1000000, 1, CV_32FC4);
+    const uchar* pointsData = points.data;
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        Mat depth = scene->depth(poses[i]);
+        volume->integrate(depth, _params->depthFactor, poses[i].matrix, _params->intr);
+
+        Mat refPoints, refNormals;
+        volume->fetchPointsNormals(refPoints, refNormals);
+        volume->fetchPointsNormalsToBuffers(points, normals, true);
+
+        ASSERT_GT(refPoints.rows, 0);
+        ASSERT_LT(refPoints.rows, 1000000);
+        ASSERT_EQ(points.data, pointsData);
+
+        patchNaNs(refNormals);
+        patchNaNs(normals);
+        EXPECT_EQ(0, cvtest::norm(refPoints, points, NORM_INF));
+        EXPECT_EQ(0, cvtest::norm(refNormals, normals, NORM_INF));
+    }
+}
+
+typedef std::map<std::tuple<int, int, int>, Mat> BlockMeshes;
+
+// Replaces the meshes of the updated blocks, drops the blocks with no surface
+void patchBlockMeshes(BlockMeshes& meshes, const Mat& blockIndices, const std::vector<Mat>& blockMeshes)
+{
+    ASSERT_EQ(blockIndices.total(), blockMeshes.size());
+    for (size_t i = 0; i < blockMeshes.size(); i++)
+    {
+        const Vec3i b = blockIndices.at<Vec3i>((int)i);
+        const std::tuple<int, int, int> key(b[0], b[1], b[2]);
+        if (blockMeshes[i].empty())
+            meshes.erase(key);
+        else
+            meshes[key] = blockMeshes[i];
+    }
+}
+
+void mesh_updates_test(kinfu::VolumeType volumeType)
+{
+    Ptr<kinfu::Params> _params = volumeParams(volumeType);
+
+    Ptr<Scene> scene = Scene::create(_params->frameSize, _params->intr, _params->depthFactor);
+    std::vector<Affine3f> poses = scene->getPoses();
+    Mat depth = scene->depth(poses[0]);
+
+    // incremental meshing is implemented for CPU volumes only
+    bool useOpenCL = cv::ocl::useOpenCL();
+    cv::ocl::setUseOpenCL(false);
+    Ptr<kinfu::Volume> volume = kinfu::makeVolume(_params->volumeType, _params->voxelSize, _params->volumePose.matrix,
+        _params->raycast_step_factor, _params->tsdf_trunc_dist, _params->tsdf_max_weight,
+        _params->truncateThreshold, _params->volumeDims);
+    Ptr<kinfu::Volume> freshVolume = kinfu::makeVolume(_params->volumeType, _params->voxelSize, _params->volumePose.matrix,
+        _params->raycast_step_factor, _params->tsdf_trunc_dist, _params->tsdf_max_weight,
+        _params->truncateThreshold, _params->volumeDims);
+    cv::ocl::setUseOpenCL(useOpenCL);
+
+    Mat blockIndices;
+    std::vector<Mat> blockMeshes;
+
+    volume->fetchMeshUpdates(blockIndices, blockMeshes);
+    ASSERT_EQ(blockIndices.total(), 0u);
+    ASSERT_TRUE(blockMeshes.empty());
+
+    volume->integrate(depth, _params->depthFactor, poses[0].matrix, _params->intr);
+    volume->fetchMeshUpdates(blockIndices, blockMeshes);
+    ASSERT_GT(blockIndices.total(), 0u);
+    ASSERT_EQ(blockIndices.type(), CV_32SC3);
+    ASSERT_EQ(blockIndices.total(), blockMeshes.size());
+
+    size_t nonEmpty = 0;
+    for (const Mat& mesh : blockMeshes)
+    {
+        if (mesh.empty())
+            continue;
+        nonEmpty++;
+        ASSERT_EQ(mesh.type(), CV_32FC4);
+        ASSERT_EQ(mesh.total() % 3, 0u);
+    }
+    ASSERT_GT(nonEmpty, 0u);
+
+    BlockMeshes patched;
+    patchBlockMeshes(patched, blockIndices, blockMeshes);
+
+    // nothing has changed
+    volume->fetchMeshUpdates(blockIndices, blockMeshes);
+    ASSERT_EQ(blockIndices.total(), 0u);
+
+    // the meshes patched with the updates after further frames are
+    // the ones of a fresh volume which has integrated all the frames
+    const size_t numFrames = 3;
+    for (size_t i = 1; i < numFrames; i++)
+    {
+        volume->integrate(scene->depth(poses[i]), _params->depthFactor, poses[i].matrix, _params->intr);
+        volume->fetchMeshUpdates(blockIndices, blockMeshes);
+        ASSERT_GT(blockIndices.total(), 0u);
+        patchBlockMeshes(patched, blockIndices, blockMeshes);
+    }
+
+    for (size_t i = 0; i < numFrames; i++)
+        freshVolume->integrate(scene->depth(poses[i]), _params->depthFactor, poses[i].matrix, _params->intr);
+    BlockMeshes full;
+    freshVolume->fetchMeshUpdates(blockIndices, blockMeshes);
+    patchBlockMeshes(full, blockIndices, blockMeshes);
+
+    ASSERT_EQ(full.size(), patched.size());
+    for (BlockMeshes::const_iterator it = full.begin(), pit = patched.begin(); it != full.end(); ++it, ++pit)
+    {
+        ASSERT_TRUE(it->first == pit->first);
+        ASSERT_EQ(it->second.total(), pit->second.total());
+        EXPECT_EQ(0, cvtest::norm(it->second, pit->second, NORM_INF));
+    }
+
+    // all meshed blocks are cleared
+    volume->reset();
+    volume->fetchMeshUpdates(blockIndices, blockMeshes);
+    ASSERT_GE(blockMeshes.size(), patched.size());
+    for (const Mat& mesh : blockMeshes)
+        ASSERT_TRUE(mesh.empty());
+}
+
 TEST(TSDF, raycast_normals)
 {
-    normal_test(false, true, false, false);
+    normal_test(kinfu::VolumeType::TSDF, true, false, false);
 }
 
 TEST(HashTSDF, raycast_normals)
 {
-    normal_test(true, true, false, false);
+    normal_test(kinfu::VolumeType::HASHTSDF, true, false, false);
 }
 
 TEST(TSDF, fetch_points_normals)
 {
-    normal_test(false, false, true, false);
+    normal_test(kinfu::VolumeType::TSDF, false, true, false);
 }
 
 TEST(HashTSDF, fetch_points_normals)
 {
-    normal_test(true, false, true, false);
+    normal_test(kinfu::VolumeType::HASHTSDF, false, true, false);
 }
 
 TEST(TSDF, fetch_normals)
 {
-    normal_test(false, false, false, true);
+    normal_test(kinfu::VolumeType::TSDF, false, false, true);
 }
 
 TEST(HashTSDF, fetch_normals)
 {
-    normal_test(true, false, false, true);
+    normal_test(kinfu::VolumeType::HASHTSDF, false, false, true);
 }
 
 TEST(TSDF, valid_points)
 {
-    valid_points_test(false);
+    valid_points_test(kinfu::VolumeType::TSDF);
 }
 
 TEST(HashTSDF, valid_points)
 {
-    valid_points_test(true);
+    valid_points_test(kinfu::VolumeType::HASHTSDF);
+}
+
+TEST(MultiResHashTSDF, raycast_normals)
+{
+    normal_test(kinfu::VolumeType::MULTIRES_HASHTSDF, true, false, false);
+}
+
+TEST(MultiResHashTSDF, fetch_points_normals)
+{
+    normal_test(kinfu::VolumeType::MULTIRES_HASHTSDF, false, true, false);
+}
+
+TEST(MultiResHashTSDF, fetch_normals)
+{
+    normal_test(kinfu::VolumeType::MULTIRES_HASHTSDF, false, false, true);
+}
+
+TEST(MultiResHashTSDF, valid_points)
+{
+    valid_points_test(kinfu::VolumeType::MULTIRES_HASHTSDF);
+}
+
+TEST(MultiResHashTSDF, finest_observed_level)
+{
+    Ptr<kinfu::Params> _params = kinfu::Params::multiResHashTSDFParams(true);
+    ASSERT_EQ(3, _params->volumeLevels);
+    ASSERT_EQ(1.f, _params->volumeLevelDistance);
+    Ptr<kinfu::Volume> volume = kinfu::makeVolume(_params);
+
+    // fronto-parallel strips seen by level 0 only, by levels 0 and 1, by level 2 only
+    const float stripDepth[] = { 0.5f, 1.f, 3.f };
+    Mat depth(_params->frameSize, CV_32F);
+    for (int x = 0; x < depth.cols; x++)
+        depth.col(x).setTo(stripDepth[x * 3 / depth.cols] * _params->depthFactor);
+    volume->integrate(depth, _params->depthFactor, Matx44f::eye(), _params->intr);
+
+    Points points;
+    volume->fetchPointsNormals(points, noArray());
+    ASSERT_GT(points.total(), 0u);
+
+    // the points are voxels of the level they come from, in voxels of level 0
+    // they are multiples of 2^level
+    const float voxelSize = _params->voxelSize;
+    const float truncDist = _params->tsdf_trunc_dist;
+    const float volumeDepth = _params->volumePose.translation()[2];
+    std::set< std::tuple<int, int, int> > voxels;
+    int level0Near = 0, level0Mid = 0;
+    for (size_t i = 0; i < points.total(); i++)
+    {
+        const ptype& p = points(int(i));
+        const Vec3i v(cvRound(p[0] / voxelSize), cvRound(p[1] / voxelSize), cvRound(p[2] / voxelSize));
+        const bool level0 = (v[0] % 2) || (v[1] % 2) || (v[2] % 2);
+        const bool level2 = !(v[0] % 4) && !(v[1] % 4) && !(v[2] % 4);
+
+        // a voxel observed by several levels is taken from the finest one only
+        ASSERT_TRUE(voxels.insert(std::make_tuple(v[0], v[1], v[2])).second) << p;
+
+        const float z = p[2] + volumeDepth;
+        if (z < 0.75f)
+            level0Near += level0;
+        else if (z < 1.5f)
+            level0Mid += level0 && std::abs(z - 1.f) < truncDist / 2;
+        else
+            ASSERT_TRUE(level2) << p;
+    }
+    EXPECT_GT(level0Near, 0);
+    // the finest level wins where the levels overlap
+    EXPECT_GT(level0Mid, 0);
+}
+
+TEST(TSDF, fetch_points_normals_reuse)
+{
+    reused_buffers_test(kinfu::VolumeType::TSDF);
+}
+
+TEST(HashTSDF, fetch_points_normals_reuse)
+{
+    reused_buffers_test(kinfu::VolumeType::HASHTSDF);
+}
+
+TEST(TSDF, mesh_updates)
+{
+    mesh_updates_test(kinfu::VolumeType::TSDF);
+}
+
+TEST(HashTSDF, mesh_updates)
+{
+    mesh_updates_test(kinfu::VolumeType::HASHTSDF);
 }
 
 }}  // namespace
@@ -0,0 +1,94 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+// This code is also subject to the license terms in the LICENSE_KinectFusion.md file found in this module's directory
+
+#include "test_precomp.hpp"
+#include "../src/warpfield.hpp"
+
+namespace opencv_test { namespace {
+
+using cv::dynafu::PointGrid;
+
+static Point3f randomPoint(RNG& rng, float lo, float hi)
+{
+    return Point3f(rng.uniform(lo, hi), rng.uniform(lo, hi), rng.uniform(lo, hi));
+}
+
+/** Squared distances from q to the finite points, sorted, with the indices of the points */
+static std::vector<std::pair<float, int> > bruteForceDistances(const std::vector<Point3f>& points, Point3f q)
+{
+    std::vector<std::pair<float, int> > dists;
+    for(size_t i = 0; i < points.size(); i++)
+    {
+        if(cvIsNaN(points[i].x))
+            continue;
+        Point3f d = points[i] - q;
+        dists.push_back(std::make_pair(d.dot(d), (int)i));
+    }
+    std::sort(dists.begin(), dists.end());
+    return dists;
+}
+
+TEST(DynaFu_PointGrid, search_matches_brute_force)
+{
+    RNG rng(0);
+    const float cellSize = 0.1f;
+    PointGrid grid(cellSize);
+    std::vector<Point3f> points;
+    for(int i = 0; i < 500; i++)
+    {
+        // invalid points keep their index but can't be found
+        Point3f p = i % 50 == 7 ? Point3f(NAN, NAN, NAN) : randomPoint(rng, -0.5f, 0.5f);
+        ASSERT_EQ((int)points.size(), grid.add(p));
+        points.push_back(p);
+    }
+
+    const int k = 8;
+    for(int iter = 0; iter < 300; iter++)
+    {
+        // a third of the queries are far outside of the occupied cells
+        Point3f q = iter % 3 == 0 ? randomPoint(rng, -3.f, 3.f) : randomPoint(rng, -0.6f, 0.6f);
+        std::vector<std::pair<float, int> > expected = bruteForceDistances(points, q);
+
+        int indices[k];
+        float sqDists[k];
+        int found = grid.knnSearch(q, k, indices, sqDists);
+        ASSERT_EQ(std::min(k, (int)expected.size()), found);
+        for(int i = 0; i < found; i++)
+        {
+            // ties can swap the indices, the distances are the same
+            EXPECT_EQ(expected[i].first, sqDists[i]) << "query " << q << ", neighbour " << i;
+            Point3f d = points[indices[i]] - q;
+            EXPECT_EQ(sqDists[i], d.dot(d));
+        }
+
+        float sqRadius = rng.uniform(0.f, 0.09f);
+        std::vector<int> inRadius, expectedInRadius;
+        grid.radiusSearch(q, sqRadius, inRadius);
+        for(size_t i = 0; i < expected.size() && expected[i].first <= sqRadius; i++)
+            expectedInRadius.push_back(expected[i].second);
+        std::sort(inRadius.begin(), inRadius.end());
+        std::sort(expectedInRadius.begin(), expectedInRadius.end());
+        EXPECT_EQ(expectedInRadius, inRadius) << "query " << q;
+    }
+}
+
+TEST(DynaFu_PointGrid, no_finite_points)
+{
+    PointGrid grid(0.1f);
+    int indices[4];
+    float sqDists[4];
+    std::vector<int> inRadius;
+    EXPECT_EQ(0, grid.knnSearch(Point3f(0, 0, 0), 4, indices, sqDists));
+    grid.radiusSearch(Point3f(0, 0, 0), 1.f, inRadius);
+    EXPECT_TRUE(inRadius.empty());
+
+    grid.add(Point3f(NAN, 0, 0));
+    EXPECT_EQ(0, grid.knnSearch(Point3f(1e6f, -1e6f, 0), 4, indices, sqDists));
+    grid.radiusSearch(Point3f(0, 0, 0), 1.f, inRadius);
+    EXPECT_TRUE(inRadius.empty());
+}
+
+}} // namespace
@@ -59,6 +59,53 @@ namespace ppf_match_3d
 //! @addtogroup surface_matching
 //! @{
 
+/**
+* @brief Nearest neighbour index of a scene for ICP::registerModelToScene().
+*
+* Building the index once lets many models and pose hypotheses be registered to the same scene
+* without rebuilding the search structures on every call. ICP looks up the scene sampled with
+* the steps of its pyramid levels, the structure of each step is built on its first use and kept
+* for the later calls. Moving a few scene points with updatePoints() adjusts the structures
+* in place instead of rebuilding them.
+*
+* The index can be shared by concurrent registrations, but it must not be updated meanwhile.
+*/
+class CV_EXPORTS ICPSceneIndex
+{
+public:
+
+  ICPSceneIndex();
+
+  /**
+     *  \brief Builds the index of a scene
+     *  @param [in] scene The input point cloud for the scene with the normals (Nx6). Currently,
+     *  CV_32F is the only supported data type. The index keeps a copy of it.
+     */
+  explicit ICPSceneIndex(const Mat& scene);
+
+  /**
+     *  \brief Builds the index of a scene, the structures built for the previous scene are dropped
+     *  @param [in] scene The input point cloud for the scene with the normals (Nx6).
+     */
+  void build(const Mat& scene);
+
+  /**
+     *  \brief Replaces some points of the scene
+     *  @param [in] rows Rows of the scene to replace
+     *  @param [in] points New points with the normals, one row per element of rows
+     */
+  void updatePoints(const std::vector<int>& rows, const Mat& points);
+
+  //! The indexed scene
+  Mat getScene() const;
+
+  class Impl;
+
+private:
+  friend class ICP;
+  Ptr<Impl> impl;
+};
+
 /**
 * @brief This class implements a very efficient and robust variant of the iterative closest point (ICP) algorithm.
 * The task is to register a 3D model (or point cloud) against a set of noisy target data. The variants are put together
@@ -151,6 +198,29 @@ public:
      */
   CV_WRAP int registerModelToScene(const Mat& srcPC, const Mat& dstPC, CV_IN_OUT std::vector<Pose3DPtr>& poses);
 
+  /**
+     *  \brief Perform registration against an indexed scene
+     *
+     *  @param [in] srcPC The input point cloud for the model. Expected to have the normals (Nx6). Currently,
+     *  CV_32F is the only supported data type.
+     *  @param [in] scene Index of the scene, it can be shared by many calls
+     *  @param [out] residual The output registration error.
+     *  @param [out] pose Transformation between srcPC and the scene.
+     *  \return On successful termination, the function returns 0.
+     */
+  int registerModelToScene(const Mat& srcPC, const ICPSceneIndex& scene, double& residual, Matx44d& pose);
+
+  /**
+     *  \brief Perform registration with multiple initial poses against an indexed scene
+     *
+     *  @param [in] srcPC The input point cloud for the model. Expected to have the normals (Nx6). Currently,
+     *  CV_32F is the only supported data type.
+     *  @param [in] scene Index of the scene, it can be shared by many calls
+     *  @param [in,out] poses Input poses to start with but also list output of poses.
+     *  \return On successful termination, the function returns 0.
+     */
+  int registerModelToScene(const Mat& srcPC, const ICPSceneIndex& scene, std::vector<Pose3DPtr>& poses);
+
 private:
   float m_tolerance;
   int m_maxIterations;
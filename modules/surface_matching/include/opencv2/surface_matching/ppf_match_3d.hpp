@@ -140,6 +140,26 @@ public:
     */
   CV_WRAP void match(const Mat& scene, CV_OUT std::vector<Pose3DPtr> &results, const double relativeSceneSampleStep=1.0/5.0, const double relativeSceneDistance=0.03);
 
+  /**
+    *  \brief Writes the trained model into a binary file
+    *
+    *  @param [in] filename Name of the file
+    *
+    *  \details The file keeps the sampled model, its point pair features and the hash table
+    *  ready to use. It is read by loadModel() on machines with the same byte order.
+    */
+  CV_WRAP void saveModel(const String& filename) const;
+
+  /**
+    *  \brief Loads a model written by saveModel()
+    *
+    *  @param [in] filename Name of the file
+    *
+    *  \details The file is memory-mapped where the platform allows it, nothing is rebuilt,
+    *  so the detector is ready for calling "match" right away. Search parameters are kept.
+    */
+  CV_WRAP void loadModel(const String& filename);
+
   void read(const FileNode& fn);
   void write(FileStorage& fs) const;
 
@@ -149,6 +169,8 @@ protected:
   double sampling_step_relative, angle_step_relative, distance_step_relative;
   Mat sampled_pc, ppf;
   int num_ref_points;
+  // Hash table of the model PPFs. It's kept in CSR form by the implementation,
+  // the nodes are no longer allocated and hash_nodes stays NULL
   hashtable_int* hash_table;
   THash* hash_nodes;
 
@@ -171,6 +193,106 @@ private:
   bool trained;
 };
 
+/**
+  * @brief Class, matching several 3D models in a scene at once.
+  *
+  * The point pair features of all the models go into one hash table, each entry
+  * knows the model it comes from. The scene is sampled and its point pairs are computed
+  * and looked up only once, they vote for all the models at the same time. Then the poses
+  * of each model are clustered in parallel.
+  *
+  * Typical Use:
+  * @code
+  * ppf_match_3d::PPF3DMultiDetector detector(0.05, 0.05);
+  * detector.addModel(pc1);
+  * detector.addModel(pc2);
+  * // results[m] are the poses of the model m
+  * vector< vector<Pose3DPtr> > results;
+  * detector.match(pcTest, results, 1.0/5.0, 0.05);
+  * @endcode
+  *
+  * \details Distances of the point pairs of each model are quantized with its own step,
+  * relativeSamplingStep times its diameter, as PPF3DDetector does. The models with the same
+  * step share the hash keys, a scene pair is hashed once per distinct step. So the models
+  * of the same size are matched at the cost of one, models of different sizes cost a lookup
+  * of the scene pairs per size.
+  */
+class CV_EXPORTS PPF3DMultiDetector
+{
+public:
+
+  /**
+    * Constructor with arguments, see PPF3DDetector::PPF3DDetector()
+    */
+  PPF3DMultiDetector(const double relativeSamplingStep=0.05, const double relativeDistanceStep=0.05, const double numAngles=30);
+
+  virtual ~PPF3DMultiDetector();
+
+  /**
+    *  Set the parameters for the search, see PPF3DDetector::setSearchParams()
+    */
+  void setSearchParams(const double positionThreshold=-1, const double rotationThreshold=-1, const bool useWeightedClustering=false);
+
+  /**
+    *  \brief Adds a model to be trained.
+    *
+    *  @param [in] Model The input point cloud with normals (Nx6)
+    *  @return Index of the model in the results of "match"
+    *
+    *  \details The model is sampled relative to its own diameter right away. The hash table
+    *  is built by trainModels() or by the next call to "match".
+    */
+  int addModel(const Mat& Model);
+
+  //! Number of the added models
+  int numModels() const;
+
+  /**
+    *  \brief Builds the joint hash table of all the added models.
+    */
+  void trainModels();
+
+  /**
+    *  \brief Matches all the models across a provided scene.
+    *
+    *  @param [in] scene Point cloud for the scene
+    *  @param [out] results Lists of output poses, one list per model in the order of addModel() calls
+    *  @param [in] relativeSceneSampleStep See PPF3DDetector::match()
+    *  @param [in] relativeSceneDistance See PPF3DDetector::match()
+    */
+  void match(const Mat& scene, std::vector< std::vector<Pose3DPtr> >& results, const double relativeSceneSampleStep=1.0/5.0, const double relativeSceneDistance=0.03);
+
+protected:
+
+  double angle_step;
+  double sampling_step_relative, angle_step_relative, distance_step_relative;
+
+  // Sampled models as added and their diameters
+  std::vector<Mat> models;
+  std::vector<float> model_diameters;
+
+  // Distance steps of the groups of models with the same diameter, model m is in
+  // the group model_groups[m]
+  std::vector<double> distance_steps;
+  std::vector<int> model_groups;
+
+  // Sampled points and PPFs of all the models one after another, the ones of model m are
+  // the rows model_starts[m] .. model_starts[m+1]-1 and ppf_starts[m] .. ppf_starts[m+1]-1
+  Mat sampled_pc, ppf;
+  std::vector<int> model_starts, ppf_starts;
+
+  // Hash table of the PPFs of all the models in CSR form: bucket b holds rows
+  // hash_buckets[b] .. hash_buckets[b+1]-1 of hash_entries, each row is (key, i, ppfInd)
+  // where key is hashed with the distance step of the model of i, i is the row
+  // in sampled_pc and ppfInd is the row in ppf
+  Mat hash_buckets, hash_entries;
+
+  double position_threshold, rotation_threshold;
+  bool use_weighted_avg;
+
+  bool trained;
+};
+
 //! @}
 
 } // namespace ppf_match_3d
@@ -51,10 +51,10 @@
 /* I'm yet to work on a platform where 'uchar' is not 8 bits */
 #define MH_UINT8  uchar
 
-void PMurHash32_Process(MH_UINT32 *ph1, MH_UINT32 *pcarry, const void *key, int len);
-MH_UINT32 PMurHash32_Result(MH_UINT32 h1, MH_UINT32 carry, MH_UINT32 total_length);
-MH_UINT32 PMurHash32(MH_UINT32 seed, const void *key, int len);
-void hashMurmurx86 ( const void * key, const int len, const uint seed, void * out );
+FORCE_INLINE void PMurHash32_Process(MH_UINT32 *ph1, MH_UINT32 *pcarry, const void *key, int len);
+FORCE_INLINE MH_UINT32 PMurHash32_Result(MH_UINT32 h1, MH_UINT32 carry, MH_UINT32 total_length);
+FORCE_INLINE MH_UINT32 PMurHash32(MH_UINT32 seed, const void *key, int len);
+FORCE_INLINE void hashMurmurx86 ( const void * key, const int len, const uint seed, void * out );
 
 /* I used ugly type names in the header to avoid potential conflicts with
 * application or system typedefs & defines. Since I'm not including any more
@@ -141,7 +141,7 @@ void hashMurmurx86 ( const void * key, const int len, const uint seed, void * ou
 
 /* Main hashing function. Initialise carry to 0 and h1 to 0 or an initial seed
 * if wanted. Both ph1 and pcarry are required arguments. */
-void PMurHash32_Process(uint32_t *ph1, uint32_t *pcarry, const void *key, int len)
+FORCE_INLINE void PMurHash32_Process(uint32_t *ph1, uint32_t *pcarry, const void *key, int len)
 {
     uint32_t h1 = *ph1;
     uint32_t c = *pcarry;
@@ -235,7 +235,7 @@ void PMurHash32_Process(uint32_t *ph1, uint32_t *pcarry, const void *key, int le
 /*---------------------------------------------------------------------------*/
 
 /* Finalize a hash. To match the original Murmur3A the total_length must be provided */
-uint32_t PMurHash32_Result(uint32_t h, uint32_t carry, uint32_t total_length)
+FORCE_INLINE uint32_t PMurHash32_Result(uint32_t h, uint32_t carry, uint32_t total_length)
 {
     uint32_t k1;
     int n = carry & 3;
@@ -262,14 +262,14 @@ uint32_t PMurHash32_Result(uint32_t h, uint32_t carry, uint32_t total_length)
 /*---------------------------------------------------------------------------*/
 
 /* Murmur3A compatible all-at-once */
-uint32_t PMurHash32(uint32_t seed, const void *key, int len)
+FORCE_INLINE uint32_t PMurHash32(uint32_t seed, const void *key, int len)
 {
     uint32_t h1=seed, carry=0;
     PMurHash32_Process(&h1, &carry, key, len);
     return PMurHash32_Result(h1, carry, len);
 }
 
-void hashMurmurx86 ( const void * key, const int len, const uint seed, void * out )
+FORCE_INLINE void hashMurmurx86 ( const void * key, const int len, const uint seed, void * out )
 {
     *(uint*)out = PMurHash32 (seed, key, len);
 }
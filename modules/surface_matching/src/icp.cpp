@@ -107,6 +107,22 @@ static double computeDistToOrigin(Mat srcPC)
   return dist;
 }
 
+// compute the average distance to the given point
+static double computeDistToPoint(Mat srcPC, const Vec3d& center)
+{
+  int height = srcPC.rows;
+  double dist = 0;
+
+  for (int i=0; i<height; i++)
+  {
+    const float *row = srcPC.ptr<float>(i);
+    const Vec3d d(row[0]-center[0], row[1]-center[1], row[2]-center[2]);
+    dist += sqrt(d.dot(d));
+  }
+
+  return dist;
+}
+
 // From numerical receipes: Finds the median of an array
 static float medianF(float arr[], int n)
 {
@@ -242,33 +258,286 @@ static hashtable_int* getHashtable(int* data, size_t length, int numMaxElement)
   return hashtable;
 }
 
+// Kd-tree over the scene rows 0, step, 2*step, ... as taken by samplePCUniform().
+// Each node keeps the bounding box of its points, so moving a point only refits
+// the boxes on the way from its leaf to the root and the search stays exact.
+class SceneKDTree
+{
+public:
+  SceneKDTree(const Mat& scene, int sampleStep);
+
+  // number of the sampled points
+  int size() const { return (int)points.size(); }
+
+  // index of the nearest sampled point and the squared distance to it
+  void nearest(const Vec3f& q, int& index, float& sqDist) const;
+
+  // moves the point of the scene row if it is sampled
+  void updatePoint(int sceneRow, const Vec3f& p);
+
+private:
+  struct Node
+  {
+    Vec3f minPt, maxPt;
+    int parent, left, right;
+    // the points of the node are order[start] .. order[end-1]
+    int start, end;
+  };
+
+  static const int leafSize = 8;
+
+  int build(int start, int end, int parent);
+  void fitLeaf(Node& node) const;
+  float boxSqDist(const Node& node, const Vec3f& q) const;
+  void search(int ni, const Vec3f& q, int& index, float& sqDist) const;
+
+  int step;
+  std::vector<Vec3f> points;
+  std::vector<int> order;
+  std::vector<int> leafOf;
+  std::vector<Node> nodes;
+};
+
+SceneKDTree::SceneKDTree(const Mat& scene, int sampleStep) : step(sampleStep)
+{
+  const int numPoints = scene.rows / step;
+  points.resize(numPoints);
+  order.resize(numPoints);
+  leafOf.resize(numPoints);
+  for (int i = 0; i < numPoints; i++)
+  {
+    points[i] = Vec3f(scene.ptr<float>(i*step));
+    order[i] = i;
+  }
+
+  if (numPoints > 0)
+  {
+    nodes.reserve(2*(numPoints/leafSize + 1));
+    build(0, numPoints, -1);
+  }
+}
+
+void SceneKDTree::fitLeaf(Node& node) const
+{
+  node.minPt = node.maxPt = points[order[node.start]];
+  for (int k = node.start + 1; k < node.end; k++)
+  {
+    const Vec3f& p = points[order[k]];
+    for (int c = 0; c < 3; c++)
+    {
+      node.minPt[c] = std::min(node.minPt[c], p[c]);
+      node.maxPt[c] = std::max(node.maxPt[c], p[c]);
+    }
+  }
+}
+
+int SceneKDTree::build(int start, int end, int parent)
+{
+  const int ni = (int)nodes.size();
+  Node node;
+  node.parent = parent;
+  node.left = node.right = -1;
+  node.start = start;
+  node.end = end;
+  fitLeaf(node);
+  nodes.push_back(node);
+
+  if (end - start <= leafSize)
+  {
+    for (int k = start; k < end; k++)
+      leafOf[order[k]] = ni;
+    return ni;
+  }
+
+  // split the widest side at the median
+  const Vec3f extent = node.maxPt - node.minPt;
+  const int dim = extent[0] >= extent[1] ? (extent[0] >= extent[2] ? 0 : 2) : (extent[1] >= extent[2] ? 1 : 2);
+  const int mid = (start + end) / 2;
+  std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+                   [&](int a, int b) { return points[a][dim] < points[b][dim]; });
+
+  const int left = build(start, mid, ni);
+  const int right = build(mid, end, ni);
+  nodes[ni].left = left;
+  nodes[ni].right = right;
+  return ni;
+}
+
+float SceneKDTree::boxSqDist(const Node& node, const Vec3f& q) const
+{
+  float d = 0;
+  for (int c = 0; c < 3; c++)
+  {
+    const float dc = std::max(std::max(node.minPt[c] - q[c], q[c] - node.maxPt[c]), 0.f);
+    d += dc*dc;
+  }
+  return d;
+}
+
+void SceneKDTree::search(int ni, const Vec3f& q, int& index, float& sqDist) const
+{
+  const Node& node = nodes[ni];
+  if (node.left < 0)
+  {
+    for (int k = node.start; k < node.end; k++)
+    {
+      const Vec3f d = points[order[k]] - q;
+      const float dist = d.dot(d);
+      if (dist < sqDist)
+      {
+        sqDist = dist;
+        index = order[k];
+      }
+    }
+    return;
+  }
+
+  // the closer child first, the other one only if it can still have a closer point
+  const float distLeft = boxSqDist(nodes[node.left], q);
+  const float distRight = boxSqDist(nodes[node.right], q);
+  const bool leftFirst = distLeft <= distRight;
+  const int first = leftFirst ? node.left : node.right;
+  const int second = leftFirst ? node.right : node.left;
+
+  if ((leftFirst ? distLeft : distRight) < sqDist)
+    search(first, q, index, sqDist);
+  if ((leftFirst ? distRight : distLeft) < sqDist)
+    search(second, q, index, sqDist);
+}
+
+void SceneKDTree::nearest(const Vec3f& q, int& index, float& sqDist) const
+{
+  index = -1;
+  sqDist = std::numeric_limits<float>::max();
+  if (!nodes.empty())
+    search(0, q, index, sqDist);
+}
+
+void SceneKDTree::updatePoint(int sceneRow, const Vec3f& p)
+{
+  if (sceneRow % step != 0 || sceneRow / step >= size())
+    return;
+
+  const int i = sceneRow / step;
+  points[i] = p;
+
+  int ni = leafOf[i];
+  fitLeaf(nodes[ni]);
+  for (ni = nodes[ni].parent; ni >= 0; ni = nodes[ni].parent)
+  {
+    Node& node = nodes[ni];
+    const Node& left = nodes[node.left];
+    const Node& right = nodes[node.right];
+    for (int c = 0; c < 3; c++)
+    {
+      node.minPt[c] = std::min(left.minPt[c], right.minPt[c]);
+      node.maxPt[c] = std::max(left.maxPt[c], right.maxPt[c]);
+    }
+  }
+}
+
+class ICPSceneIndex::Impl
+{
+public:
+  // the tree of the sampling step, built on the first request
+  const SceneKDTree& level(int sampleStep);
+
+  Mat scene;
+  Vec3d mean;
+
+  Mutex mutex;
+  std::map<int, Ptr<SceneKDTree> > levels;
+};
+
+const SceneKDTree& ICPSceneIndex::Impl::level(int sampleStep)
+{
+  AutoLock lock(mutex);
+  Ptr<SceneKDTree>& tree = levels[sampleStep];
+  if (tree.empty())
+    tree = makePtr<SceneKDTree>(scene, sampleStep);
+  return *tree;
+}
+
+ICPSceneIndex::ICPSceneIndex()
+{
+}
+
+ICPSceneIndex::ICPSceneIndex(const Mat& scene)
+{
+  build(scene);
+}
+
+void ICPSceneIndex::build(const Mat& scene)
+{
+  CV_Assert(scene.type() == CV_32F || scene.type() == CV_32FC1);
+  CV_Assert(scene.cols >= 3);
+
+  impl = makePtr<Impl>();
+  impl->scene = scene.clone();
+  computeMeanCols(impl->scene, impl->mean);
+}
+
+void ICPSceneIndex::updatePoints(const std::vector<int>& rows, const Mat& points)
+{
+  CV_Assert(!impl.empty());
+  CV_Assert(points.type() == impl->scene.type() && points.cols == impl->scene.cols);
+  CV_Assert(points.rows == (int)rows.size());
+
+  Mat& scene = impl->scene;
+  for (size_t k = 0; k < rows.size(); k++)
+  {
+    const int row = rows[k];
+    CV_Assert(row >= 0 && row < scene.rows);
+
+    const Vec3f oldPt(scene.ptr<float>(row));
+    const Vec3f newPt(points.ptr<float>((int)k));
+    impl->mean += (Vec3d(newPt) - Vec3d(oldPt)) / (double)scene.rows;
+    points.row((int)k).copyTo(scene.row(row));
+
+    for (std::map<int, Ptr<SceneKDTree> >::iterator it = impl->levels.begin(); it != impl->levels.end(); ++it)
+      it->second->updatePoint(row, newPt);
+  }
+}
+
+Mat ICPSceneIndex::getScene() const
+{
+  return impl.empty() ? Mat() : impl->scene;
+}
+
 // source point clouds are assumed to contain their normals
 int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residual, Matx44d& pose)
+{
+  return registerModelToScene(srcPC, ICPSceneIndex(dstPC), residual, pose);
+}
+
+// The scene stays in its own coordinates in the index: the model is normalized as before,
+// its points are moved back to the scene coordinates to be looked up and only the matched
+// scene points are normalized.
+int ICP::registerModelToScene(const Mat& srcPC, const ICPSceneIndex& scene, double& residual, Matx44d& pose)
 {
   int n = srcPC.rows;
   CV_CheckGT(n, 0, "");
+  CV_Assert(!scene.impl.empty());
 
   const bool useRobustReject = m_rejectionScale>0;
 
+  ICPSceneIndex::Impl& sceneImpl = *scene.impl;
+  const Mat& dstPC = sceneImpl.scene;
+
   Mat srcTemp = srcPC.clone();
-  Mat dstTemp = dstPC.clone();
-  Vec3d meanSrc, meanDst;
+  Vec3d meanSrc;
   computeMeanCols(srcTemp, meanSrc);
-  computeMeanCols(dstTemp, meanDst);
-  Vec3d meanAvg = 0.5 * (meanSrc + meanDst);
+  Vec3d meanAvg = 0.5 * (meanSrc + sceneImpl.mean);
   subtractColumns(srcTemp, meanAvg);
-  subtractColumns(dstTemp, meanAvg);
 
   double distSrc = computeDistToOrigin(srcTemp);
-  double distDst = computeDistToOrigin(dstTemp);
+  double distDst = computeDistToPoint(dstPC, meanAvg);
 
   double scale = (double)n / ((distSrc + distDst)*0.5);
 
   srcTemp(cv::Range(0, srcTemp.rows), cv::Range(0,3)) *= scale;
-  dstTemp(cv::Range(0, dstTemp.rows), cv::Range(0,3)) *= scale;
 
   Mat srcPC0 = srcTemp;
-  Mat dstPC0 = dstTemp;
 
   // initialize pose
   pose = Matx44d::eye();
@@ -295,8 +564,9 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
     Tolga Birdal thinks that downsampling the scene points might decrease the accuracy.
     Hamdi Sahloul, however, noticed that accuracy increased (pose residual decreased slightly).
     */
-    Mat dstPCS = samplePCUniform(dstPC0, sampleStep);
-    void* flann = indexPCFlann(dstPCS);
+    const SceneKDTree& dstTree = sceneImpl.level(sampleStep);
+    if (dstTree.size() == 0)
+      continue;
 
     double fval_old=9999999999;
     double fval_perc=0;
@@ -326,12 +596,29 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
     {
       uint di=0, selInd = 0;
 
-      queryPCFlann(flann, Src_Moved, Indices, Distances);
+      // squared distances are scaled to the normalized coordinates
+      parallel_for_(Range(0, Src_Moved.rows), [&](const Range& range)
+      {
+        for (int qi = range.start; qi < range.end; qi++)
+        {
+          const float *srcPt = Src_Moved.ptr<float>(qi);
+          const Vec3f q((float)(srcPt[0]/scale + meanAvg[0]),
+                        (float)(srcPt[1]/scale + meanAvg[1]),
+                        (float)(srcPt[2]/scale + meanAvg[2]));
+          dstTree.nearest(q, indices[qi], distances[qi]);
+          distances[qi] = (float)(distances[qi]*scale*scale);
+        }
+      });
 
+      // a query without the nearest point (NaN coordinates) is not paired
+      size_t numPairs = 0;
       for (di=0; di<numElSrc; di++)
       {
-        newI[di] = di;
-        newJ[di] = indices[di];
+        if (indices[di] < 0)
+          continue;
+        newI[numPairs] = di;
+        newJ[numPairs] = indices[di];
+        numPairs++;
       }
 
       if (useRobustReject)
@@ -343,7 +630,7 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
         uchar *accPtr = (uchar*)acceptInd.data;
         for (int l=0; l<acceptInd.rows; l++)
         {
-          if (accPtr[l])
+          if (accPtr[l] && indices[l] >= 0)
           {
             newI[numInliers] = l;
             newJ[numInliers] = indices[l];
@@ -351,6 +638,7 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
           }
         }
         numElSrc=numInliers;
+        numPairs=numInliers;
       }
 
       // Step 2: Picky ICP
@@ -358,7 +646,7 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
       // is assigned to the same model point m_j, then select p_i that corresponds
       // to the minimum distance
 
-      hashtable_int* duplicateTable = getHashtable(newJ, numElSrc, dstPCS.rows);
+      hashtable_int* duplicateTable = getHashtable(newJ, numPairs, dstTree.size());
 
       for (di=0; di<duplicateTable->size; di++)
       {
@@ -405,7 +693,7 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
           const int indModel = indicesModel[di];
           const int indScene = indicesScene[di];
           const float *srcPt = srcPCT.ptr<float>(indModel);
-          const float *dstPt = dstPCS.ptr<float>(indScene);
+          const float *dstPt = dstPC.ptr<float>(indScene*sampleStep);
           double *srcMatchPt = Src_Match.ptr<double>(di);
           double *dstMatchPt = Dst_Match.ptr<double>(di);
           int ci=0;
@@ -413,7 +701,7 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
           for (ci=0; ci<srcPCT.cols; ci++)
           {
             srcMatchPt[ci] = (double)srcPt[ci];
-            dstMatchPt[ci] = (double)dstPt[ci];
+            dstMatchPt[ci] = ci<3 ? ((double)dstPt[ci] - meanAvg[ci])*scale : (double)dstPt[ci];
           }
         }
 
@@ -453,7 +741,6 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
     delete[] indices;
 
     tempResidual = fval_min;
-    destroyFlann(flann);
   }
 
   Matx33d Rpose;
@@ -469,6 +756,12 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, double& residu
 
 // source point clouds are assumed to contain their normals
 int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, std::vector<Pose3DPtr>& poses)
+{
+  return registerModelToScene(srcPC, ICPSceneIndex(dstPC), poses);
+}
+
+// source point clouds are assumed to contain their normals
+int ICP::registerModelToScene(const Mat& srcPC, const ICPSceneIndex& scene, std::vector<Pose3DPtr>& poses)
 {
   #if defined _OPENMP
   #pragma omp parallel for
@@ -477,7 +770,7 @@ int ICP::registerModelToScene(const Mat& srcPC, const Mat& dstPC, std::vector<Po
   {
     Matx44d poseICP = Matx44d::eye();
     Mat srcTemp = transformPCPose(srcPC, poses[i]->pose);
-    registerModelToScene(srcTemp, dstPC, poses[i]->residual, poseICP);
+    registerModelToScene(srcTemp, scene, poses[i]->residual, poseICP);
     poses[i]->appendPose(poseICP);
   }
   return 0;
@@ -0,0 +1,67 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef __OPENCV_SURFACE_MATCHING_PPF_HASH_TABLE_HPP_
+#define __OPENCV_SURFACE_MATCHING_PPF_HASH_TABLE_HPP_
+
+#include "hash_murmur.hpp"
+
+namespace cv
+{
+namespace ppf_match_3d
+{
+
+// compute per point PPF as in paper
+static inline void computePPF(const Vec3d& p1, const Vec3d& n1,
+                              const Vec3d& p2, const Vec3d& n2,
+                              Vec4d& f)
+{
+  Vec3d d(p2 - p1);
+  f[3] = cv::norm(d);
+  if (f[3] <= EPS)
+    return;
+  d *= 1.0 / f[3];
+
+  f[0] = TAngle3Normalized(n1, d);
+  f[1] = TAngle3Normalized(n2, d);
+  f[2] = TAngle3Normalized(n1, n2);
+}
+
+// quantize ppf and hash it for proper indexing
+static inline KeyType hashPPF(const Vec4d& f, const double AngleStep, const double DistanceStep)
+{
+  Vec4i key(
+      (int)(f[0] / AngleStep),
+      (int)(f[1] / AngleStep),
+      (int)(f[2] / AngleStep),
+      (int)(f[3] / DistanceStep));
+  KeyType hashKey[2] = {0, 0};  // hashMurmurx64() fills two values
+
+  murmurHash(key.val, 4*sizeof(int), 42, &hashKey[0]);
+  return hashKey[0];
+}
+
+// Hash table of the model PPFs which PPF3DDetector::hash_table points to. It's kept
+// in CSR form: bucket b holds rows buckets[b] .. buckets[b+1]-1 of entries, each row
+// is (i, ppfInd). The base only tells the number of buckets, it has no nodes.
+struct PPFHashTable : public hashtable_int
+{
+  PPFHashTable(const Mat& _buckets, const Mat& _entries,
+               const std::shared_ptr<void>& _modelFile = std::shared_ptr<void>())
+    : buckets(_buckets), entries(_entries), modelFile(_modelFile)
+  {
+    size = (size_t)std::max(buckets.rows - 1, 0);
+    nodes = NULL;
+    hashfunc = NULL;
+  }
+
+  Mat buckets, entries;
+  // Memory of the model file loaded by loadModel() which the matrices above refer to
+  std::shared_ptr<void> modelFile;
+};
+
+} // namespace ppf_match_3d
+} // namespace cv
+
+#endif
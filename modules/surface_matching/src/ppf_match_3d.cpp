@@ -39,7 +39,16 @@
 // Author: Tolga Birdal <tbirdal AT gmail.com>
 
 #include "precomp.hpp"
-#include "hash_murmur.hpp"
+#include "ppf_hash_table.hpp"
+#include "scene_point_grid.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PPF_MODEL_USE_MMAP 1
+#endif
 
 namespace cv
 {
@@ -74,20 +83,6 @@ static int sortPoseClusters(const PoseCluster3DPtr& a, const PoseCluster3DPtr& b
   return hashKey;
 }*/
 
-// quantize ppf and hash it for proper indexing
-static KeyType hashPPF(const Vec4d& f, const double AngleStep, const double DistanceStep)
-{
-  Vec4i key(
-      (int)(f[0] / AngleStep),
-      (int)(f[1] / AngleStep),
-      (int)(f[2] / AngleStep),
-      (int)(f[3] / DistanceStep));
-  KeyType hashKey[2] = {0, 0};  // hashMurmurx64() fills two values
-
-  murmurHash(key.val, 4*sizeof(int), 42, &hashKey[0]);
-  return hashKey[0];
-}
-
 /*static size_t hashMurmur(uint key)
 {
   size_t hashKey=0;
@@ -124,10 +119,9 @@ PPF3DDetector::PPF3DDetector()
   angle_step_relative = 30;
   angle_step_radians = (360.0/angle_step_relative)*M_PI/180.0;
   angle_step = angle_step_radians;
-  trained = false;
-
   hash_table = NULL;
   hash_nodes = NULL;
+  trained = false;
 
   setSearchParams();
 }
@@ -140,10 +134,9 @@ PPF3DDetector::PPF3DDetector(const double RelativeSamplingStep, const double Rel
   angle_step_radians = (360.0/angle_step_relative)*M_PI/180.0;
   //SceneSampleStep = 1.0/RelativeSceneSampleStep;
   angle_step = angle_step_radians;
-  trained = false;
-
   hash_table = NULL;
   hash_nodes = NULL;
+  trained = false;
 
   setSearchParams();
 }
@@ -163,35 +156,25 @@ void PPF3DDetector::setSearchParams(const double positionThreshold, const double
   use_weighted_avg = useWeightedClustering;
 }
 
-// compute per point PPF as in paper
 void PPF3DDetector::computePPFFeatures(const Vec3d& p1, const Vec3d& n1,
                                        const Vec3d& p2, const Vec3d& n2,
                                        Vec4d& f)
 {
-  Vec3d d(p2 - p1);
-  f[3] = cv::norm(d);
-  if (f[3] <= EPS)
-    return;
-  d *= 1.0 / f[3];
-
-  f[0] = TAngle3Normalized(n1, d);
-  f[1] = TAngle3Normalized(n2, d);
-  f[2] = TAngle3Normalized(n1, n2);
+  computePPF(p1, n1, p2, n2, f);
 }
 
 void PPF3DDetector::clearTrainingModels()
 {
-  if (this->hash_nodes)
-  {
-    free(this->hash_nodes);
-    this->hash_nodes=0;
-  }
+  // the matrices may refer to the model file, so they go first
+  sampled_pc.release();
+  ppf.release();
 
   if (this->hash_table)
   {
-    hashtableDestroy(this->hash_table);
+    delete static_cast<PPFHashTable*>(this->hash_table);
     this->hash_table=0;
   }
+  trained = false;
 }
 
 PPF3DDetector::~PPF3DDetector()
@@ -199,11 +182,89 @@ PPF3DDetector::~PPF3DDetector()
   clearTrainingModels();
 }
 
+// Builds the same buckets as inserting PPFs in ppfInd order with hashtableInsertHashed()
+// into a table of tableSize entries. That insertion keeps the key of the first PPF
+// that came into the bucket: a PPF with this key adds a new node in front of the bucket,
+// any other PPF replaces the data of the front node. Only the node data is used by
+// matching, so the buckets keep (i, ppfInd) of the node data, front node first.
+static void buildHashBuckets(const std::vector<KeyType>& keys, int numRefPoints, uint tableSize,
+                             Mat& buckets, Mat& entries)
+{
+  const int numPPF = numRefPoints*numRefPoints;
+
+  // stable counting sort of PPFs by bucket keeps insertion order inside buckets
+  std::vector<int> bucketStart(tableSize + 1, 0);
+  for (int ppfInd = 0; ppfInd < numPPF; ppfInd++)
+  {
+    if (ppfInd / numRefPoints != ppfInd % numRefPoints)
+      bucketStart[keys[ppfInd] % tableSize + 1]++;
+  }
+  for (uint b = 0; b < tableSize; b++)
+    bucketStart[b + 1] += bucketStart[b];
+
+  std::vector<int> inserts(bucketStart[tableSize]);
+  std::vector<int> fill(bucketStart.begin(), bucketStart.end() - 1);
+  for (int ppfInd = 0; ppfInd < numPPF; ppfInd++)
+  {
+    if (ppfInd / numRefPoints != ppfInd % numRefPoints)
+      inserts[fill[keys[ppfInd] % tableSize]++] = ppfInd;
+  }
+
+  // replay the insertions of each bucket in place, nodes end up at the bucket start
+  std::vector<int> numNodes(tableSize + 1, 0);
+  parallel_for_(Range(0, (int)tableSize), [&](const Range& range)
+  {
+    for (int b = range.start; b < range.end; b++)
+    {
+      int* bucket = inserts.data() + bucketStart[b];
+      int numInserts = bucketStart[b + 1] - bucketStart[b];
+      if (numInserts == 0)
+        continue;
+
+      const KeyType firstKey = keys[bucket[0]];
+      int n = 0;
+      for (int k = 0; k < numInserts; k++)
+      {
+        if (keys[bucket[k]] == firstKey)
+          bucket[n++] = bucket[k];
+        else
+          bucket[n - 1] = bucket[k];
+      }
+      // the latest node is the front one
+      std::reverse(bucket, bucket + n);
+      numNodes[b + 1] = n;
+    }
+  });
+
+  buckets.create((int)tableSize + 1, 1, CV_32S);
+  int* bucketPtr = buckets.ptr<int>();
+  bucketPtr[0] = 0;
+  for (uint b = 0; b < tableSize; b++)
+    bucketPtr[b + 1] = bucketPtr[b] + numNodes[b + 1];
+
+  entries.create(bucketPtr[tableSize], 1, CV_32SC2);
+  parallel_for_(Range(0, (int)tableSize), [&](const Range& range)
+  {
+    for (int b = range.start; b < range.end; b++)
+    {
+      const int* bucket = inserts.data() + bucketStart[b];
+      for (int k = 0; k < bucketPtr[b + 1] - bucketPtr[b]; k++)
+      {
+        int* entry = entries.ptr<int>(bucketPtr[b] + k);
+        entry[0] = bucket[k] / numRefPoints;
+        entry[1] = bucket[k];
+      }
+    }
+  });
+}
+
 // TODO: Check all step sizes to be positive
 void PPF3DDetector::trainModel(const Mat &PC)
 {
   CV_Assert(PC.type() == CV_32F || PC.type() == CV_32FC1);
 
+  clearTrainingModels();
+
   // compute bbox
   Vec2f xRange, yRange, zRange;
   computeBboxStd(PC, xRange, yRange, zRange);
@@ -220,58 +281,53 @@ void PPF3DDetector::trainModel(const Mat &PC)
 
   int size = sampled.rows*sampled.rows;
 
-  hashtable_int* hashTable = hashtableCreate(size, NULL);
+  // same size as hashtableCreate() would give
+  uint tableSize = size < 16 ? 16 : next_power_of_two((uint)size);
 
   int numPPF = sampled.rows*sampled.rows;
-  ppf = Mat(numPPF, PPF_LENGTH, CV_32FC1);
+  ppf = Mat::zeros(numPPF, PPF_LENGTH, CV_32FC1);
 
   // TODO: Maybe I could sample 1/5th of them here. Check the performance later.
   int numRefPoints = sampled.rows;
 
-  // pre-allocate the hash nodes
-  hash_nodes = (THash*)calloc(numRefPoints*numRefPoints, sizeof(THash));
-
-  // TODO : This can easily be parallelized. But we have to lock hashtable_insert.
-  // I realized that performance drops when this loop is parallelized (unordered
-  // inserts into the hashtable
-  // But it is still there to be investigated. For now, I leave this unparallelized
-  // since this is just a training part.
-  for (int i=0; i<numRefPoints; i++)
+  // features are computed in parallel, the hash table is built from their keys afterwards
+  std::vector<KeyType> keys(numPPF);
+  parallel_for_(Range(0, numRefPoints), [&](const Range& range)
   {
-    const Vec3f p1(sampled.ptr<float>(i));
-    const Vec3f n1(sampled.ptr<float>(i) + 3);
-
-    //printf("///////////////////// NEW REFERENCE ////////////////////////\n");
-    for (int j=0; j<numRefPoints; j++)
+    for (int i = range.start; i < range.end; i++)
     {
-      // cannot compute the ppf with myself
-      if (i!=j)
-      {
-        const Vec3f p2(sampled.ptr<float>(j));
-        const Vec3f n2(sampled.ptr<float>(j) + 3);
+      const Vec3f p1(sampled.ptr<float>(i));
+      const Vec3f n1(sampled.ptr<float>(i) + 3);
 
-        Vec4d f = Vec4d::all(0);
-        computePPFFeatures(p1, n1, p2, n2, f);
-        KeyType hashValue = hashPPF(f, angle_step_radians, distanceStep);
-        double alpha = computeAlpha(p1, n1, p2);
-        uint ppfInd = i*numRefPoints+j;
+      for (int j=0; j<numRefPoints; j++)
+      {
+        // cannot compute the ppf with myself
+        if (i!=j)
+        {
+          const Vec3f p2(sampled.ptr<float>(j));
+          const Vec3f n2(sampled.ptr<float>(j) + 3);
 
-        THash* hashNode = &hash_nodes[i*numRefPoints+j];
-        hashNode->id = hashValue;
-        hashNode->i = i;
-        hashNode->ppfInd = ppfInd;
+          Vec4d f = Vec4d::all(0);
+          computePPFFeatures(p1, n1, p2, n2, f);
+          KeyType hashValue = hashPPF(f, angle_step_radians, distanceStep);
+          double alpha = computeAlpha(p1, n1, p2);
+          uint ppfInd = i*numRefPoints+j;
 
-        hashtableInsertHashed(hashTable, hashValue, (void*)hashNode);
+          keys[ppfInd] = hashValue;
 
-        Mat(f).reshape(1, 1).convertTo(ppf.row(ppfInd).colRange(0, 4), CV_32F);
-        ppf.ptr<float>(ppfInd)[4] = (float)alpha;
+          Mat(f).reshape(1, 1).convertTo(ppf.row(ppfInd).colRange(0, 4), CV_32F);
+          ppf.ptr<float>(ppfInd)[4] = (float)alpha;
+        }
       }
     }
-  }
+  });
+
+  Mat buckets, entries;
+  buildHashBuckets(keys, numRefPoints, tableSize, buckets, entries);
 
   angle_step = angle_step_radians;
   distance_step = distanceStep;
-  hash_table = hashTable;
+  hash_table = new PPFHashTable(buckets, entries);
   num_ref_points = numRefPoints;
   sampled_pc = sampled;
   trained = true;
@@ -282,7 +338,8 @@ void PPF3DDetector::trainModel(const Mat &PC)
 ///////////////////////// MATCHING ////////////////////////////////////////
 
 
-bool PPF3DDetector::matchPose(const Pose3D& sourcePose, const Pose3D& targetPose)
+static bool posesClose(const Pose3D& sourcePose, const Pose3D& targetPose,
+                       double positionThreshold, double rotationThreshold)
 {
   // translational difference
   Vec3d dv = targetPose.t - sourcePose.t;
@@ -290,10 +347,12 @@ bool PPF3DDetector::matchPose(const Pose3D& sourcePose, const Pose3D& targetPose
 
   const double phi = fabs ( sourcePose.angle - targetPose.angle );
 
-  return (phi<this->rotation_threshold && dNorm < this->position_threshold);
+  return (phi<rotationThreshold && dNorm < positionThreshold);
 }
 
-void PPF3DDetector::clusterPoses(std::vector<Pose3DPtr>& poseList, int numPoses, std::vector<Pose3DPtr> &finalPoses)
+static void clusterPoseList(std::vector<Pose3DPtr>& poseList, int numPoses,
+                            double positionThreshold, double rotationThreshold, bool useWeightedAvg,
+                            std::vector<Pose3DPtr> &finalPoses)
 {
   std::vector<PoseCluster3DPtr> poseClusters;
 
@@ -311,7 +370,7 @@ void PPF3DDetector::clusterPoses(std::vector<Pose3DPtr>& poseList, int numPoses,
     for (size_t j=0; j<poseClusters.size() && !assigned; j++)
     {
       const Pose3DPtr poseCenter = poseClusters[j]->poseList[0];
-      if (matchPose(*pose, *poseCenter))
+      if (posesClose(*pose, *poseCenter, positionThreshold, rotationThreshold))
       {
         poseClusters[j]->addPose(pose);
         assigned = true;
@@ -331,82 +390,151 @@ void PPF3DDetector::clusterPoses(std::vector<Pose3DPtr>& poseList, int numPoses,
 
   // TODO: Use MinMatchScore
 
-  if (use_weighted_avg)
+  if (useWeightedAvg)
   {
-#if defined _OPENMP
-#pragma omp parallel for
-#endif
     // uses weighting by the number of votes
-    for (int i=0; i<static_cast<int>(poseClusters.size()); i++)
+    parallel_for_(Range(0, static_cast<int>(poseClusters.size())), [&](const Range& range)
     {
-      // We could only average the quaternions. So I will make use of them here
-      Vec4d qAvg = Vec4d::all(0);
-      Vec3d tAvg = Vec3d::all(0);
+      for (int i = range.start; i < range.end; i++)
+      {
+        // We could only average the quaternions. So I will make use of them here
+        Vec4d qAvg = Vec4d::all(0);
+        Vec3d tAvg = Vec3d::all(0);
 
-      // Perform the final averaging
-      PoseCluster3DPtr curCluster = poseClusters[i];
-      std::vector<Pose3DPtr> curPoses = curCluster->poseList;
-      int curSize = (int)curPoses.size();
-      size_t numTotalVotes = 0;
+        // Perform the final averaging
+        PoseCluster3DPtr curCluster = poseClusters[i];
+        std::vector<Pose3DPtr> curPoses = curCluster->poseList;
+        int curSize = (int)curPoses.size();
+        size_t numTotalVotes = 0;
 
-      for (int j=0; j<curSize; j++)
-        numTotalVotes += curPoses[j]->numVotes;
+        for (int j=0; j<curSize; j++)
+          numTotalVotes += curPoses[j]->numVotes;
 
-      double wSum=0;
+        double wSum=0;
 
-      for (int j=0; j<curSize; j++)
-      {
-        const double w = (double)curPoses[j]->numVotes / (double)numTotalVotes;
+        for (int j=0; j<curSize; j++)
+        {
+          const double w = (double)curPoses[j]->numVotes / (double)numTotalVotes;
 
-        qAvg += w * curPoses[j]->q;
-        tAvg += w * curPoses[j]->t;
-        wSum += w;
-      }
+          qAvg += w * curPoses[j]->q;
+          tAvg += w * curPoses[j]->t;
+          wSum += w;
+        }
 
-      tAvg *= 1.0 / wSum;
-      qAvg *= 1.0 / wSum;
+        tAvg *= 1.0 / wSum;
+        qAvg *= 1.0 / wSum;
 
-      curPoses[0]->updatePoseQuat(qAvg, tAvg);
-      curPoses[0]->numVotes=curCluster->numVotes;
+        curPoses[0]->updatePoseQuat(qAvg, tAvg);
+        curPoses[0]->numVotes=curCluster->numVotes;
 
-      finalPoses[i]=curPoses[0]->clone();
-    }
+        finalPoses[i]=curPoses[0]->clone();
+      }
+    });
   }
   else
   {
-#if defined _OPENMP
-#pragma omp parallel for
-#endif
-    for (int i=0; i<static_cast<int>(poseClusters.size()); i++)
+    parallel_for_(Range(0, static_cast<int>(poseClusters.size())), [&](const Range& range)
     {
-      // We could only average the quaternions. So I will make use of them here
-      Vec4d qAvg = Vec4d::all(0);
-      Vec3d tAvg = Vec3d::all(0);
+      for (int i = range.start; i < range.end; i++)
+      {
+        // We could only average the quaternions. So I will make use of them here
+        Vec4d qAvg = Vec4d::all(0);
+        Vec3d tAvg = Vec3d::all(0);
 
-      // Perform the final averaging
-      PoseCluster3DPtr curCluster = poseClusters[i];
-      std::vector<Pose3DPtr> curPoses = curCluster->poseList;
-      const int curSize = (int)curPoses.size();
+        // Perform the final averaging
+        PoseCluster3DPtr curCluster = poseClusters[i];
+        std::vector<Pose3DPtr> curPoses = curCluster->poseList;
+        const int curSize = (int)curPoses.size();
 
-      for (int j=0; j<curSize; j++)
-      {
-        qAvg += curPoses[j]->q;
-        tAvg += curPoses[j]->t;
-      }
+        for (int j=0; j<curSize; j++)
+        {
+          qAvg += curPoses[j]->q;
+          tAvg += curPoses[j]->t;
+        }
 
-      tAvg *= 1.0 / curSize;
-      qAvg *= 1.0 / curSize;
+        tAvg *= 1.0 / curSize;
+        qAvg *= 1.0 / curSize;
 
-      curPoses[0]->updatePoseQuat(qAvg, tAvg);
-      curPoses[0]->numVotes=curCluster->numVotes;
+        curPoses[0]->updatePoseQuat(qAvg, tAvg);
+        curPoses[0]->numVotes=curCluster->numVotes;
 
-      finalPoses[i]=curPoses[0]->clone();
-    }
+        finalPoses[i]=curPoses[0]->clone();
+      }
+    });
   }
 
   poseClusters.clear();
 }
 
+bool PPF3DDetector::matchPose(const Pose3D& sourcePose, const Pose3D& targetPose)
+{
+  return posesClose(sourcePose, targetPose, position_threshold, rotation_threshold);
+}
+
+void PPF3DDetector::clusterPoses(std::vector<Pose3DPtr>& poseList, int numPoses, std::vector<Pose3DPtr> &finalPoses)
+{
+  clusterPoseList(poseList, numPoses, position_threshold, rotation_threshold, use_weighted_avg, finalPoses);
+}
+
+// Angle of the scene point around x axis after moving the reference point to the origin
+// by (Rsg, tsg), false if it's undefined
+static bool computeSceneAlpha(const Matx33d& Rsg, const Vec3d& tsg, const Vec3f& p2, double& alpha_scene)
+{
+  Vec3d p2t = tsg + Rsg * Vec3d(p2);
+
+  alpha_scene=atan2(-p2t[2], p2t[1]);
+
+  if ( alpha_scene != alpha_scene)
+  {
+    return false;
+  }
+
+  if (sin(alpha_scene)*p2t[2]<0.0)
+    alpha_scene=-alpha_scene;
+
+  alpha_scene=-alpha_scene;
+  return true;
+}
+
+// Pose voted by the scene reference point moved to the origin by (Rsg, tsg)
+// for the model point (pMax, nMax) and quantized rotation angle
+static Pose3DPtr makeVotedPose(const Matx33d& Rsg, const Vec3d& tsg,
+                               const Vec3f& pMax, const Vec3f& nMax,
+                               int alphaIndMax, int numAngles, uint refIndMax, uint maxVotes)
+{
+  // invert Tsg : Luckily rotation is orthogonal: Inverse = Transpose.
+  // We are not required to invert.
+  Vec3d tInv, tmg;
+  Matx33d Rmg, RInv;
+  RInv = Rsg.t();
+  tInv = -RInv * tsg;
+
+  Matx44d TsgInv;
+  rtToPose(RInv, tInv, TsgInv);
+
+  computeTransformRT(pMax, nMax, Rmg, tmg);
+
+  Matx44d Tmg;
+  rtToPose(Rmg, tmg, Tmg);
+
+  // convert alpha_index to alpha
+  int alpha_index = alphaIndMax;
+  double alpha = (alpha_index*(4*M_PI))/numAngles-2*M_PI;
+
+  // Equation 2:
+  Matx44d Talpha;
+  Matx33d R;
+  Vec3d t = Vec3d::all(0);
+  getUnitXRotation(alpha, R);
+  rtToPose(R, t, Talpha);
+
+  Matx44d rawPose = TsgInv * (Talpha * Tmg);
+
+  Pose3DPtr pose(new Pose3D(alpha, refIndMax, maxVotes));
+  pose->updatePose(rawPose);
+  return pose;
+}
+
 void PPF3DDetector::match(const Mat& pc, std::vector<Pose3DPtr>& results, const double relativeSceneSampleStep, const double relativeSceneDistance)
 {
   if (!trained)
@@ -423,6 +551,9 @@ void PPF3DDetector::match(const Mat& pc, std::vector<Pose3DPtr>& results, const
   int numAngles = (int) (floor (2 * M_PI / angle_step));
   float distanceStep = (float)distance_step;
   uint n = num_ref_points;
+  const PPFHashTable* hashTable = static_cast<const PPFHashTable*>(hash_table);
+  const int* hashBuckets = hashTable->buckets.ptr<int>();
+  const uint tableSize = (uint)hashTable->size;
   std::vector<Pose3DPtr> poseList;
   int sceneSamplingStep = scene_sample_step;
 
@@ -438,162 +569,631 @@ void PPF3DDetector::match(const Mat& pc, std::vector<Pose3DPtr>& results, const
   float distanceSampleStep = diameter * RelativeSceneDistance;*/
   Mat sampled = samplePCByQuantization(pc, xRange, yRange, zRange, (float)relativeSceneDistance, 0);
 
-  // allocate the accumulator : Moved this to the inside of the loop
-  /*#if !defined (_OPENMP)
-     uint* accumulator = (uint*)calloc(numAngles*n, sizeof(uint));
-  #endif*/
+  // Pairs farther apart than the model diameter can't be found in the model,
+  // so only the points in the neighboring grid cells are paired
+  const float modelDiameter = (float)(distance_step / sampling_step_relative);
+  const float sqModelDiameter = modelDiameter * modelDiameter;
+  ScenePointGrid grid(sampled, modelDiameter);
 
-  poseList.reserve((sampled.rows/sceneSamplingStep)+4);
+  const int numRefPoints = (sampled.rows + sceneSamplingStep - 1) / sceneSamplingStep;
+  poseList.resize(numRefPoints);
 
-#if defined _OPENMP
-#pragma omp parallel for
-#endif
-  for (int i = 0; i < sampled.rows; i += sceneSamplingStep)
+  parallel_for_(Range(0, numRefPoints), [&](const Range& range)
   {
-    uint refIndMax = 0, alphaIndMax = 0;
-    uint maxVotes = 0;
+    // allocate the accumulator once per stripe, it is cleared while being maximized
+    std::vector<uint> accumulatorBuffer(numAngles*n, 0);
+    uint* accumulator = accumulatorBuffer.data();
+    std::vector<int> neighbors;
+
+    for (int r = range.start; r < range.end; r++)
+    {
+      const int i = r * sceneSamplingStep;
+      uint refIndMax = 0, alphaIndMax = 0;
+      uint maxVotes = 0;
 
-    const Vec3f p1(sampled.ptr<float>(i));
-    const Vec3f n1(sampled.ptr<float>(i) + 3);
-    Vec3d tsg = Vec3d::all(0);
-    Matx33d Rsg = Matx33d::all(0), RInv = Matx33d::all(0);
+      const Vec3f p1(sampled.ptr<float>(i));
+      const Vec3f n1(sampled.ptr<float>(i) + 3);
+      Vec3d tsg = Vec3d::all(0);
+      Matx33d Rsg = Matx33d::all(0);
 
-    uint* accumulator = (uint*)calloc(numAngles*n, sizeof(uint));
-    computeTransformRT(p1, n1, Rsg, tsg);
+      computeTransformRT(p1, n1, Rsg, tsg);
 
-    // Tolga Birdal's notice:
-    // As a later update, we might want to look into a local neighborhood only
-    // To do this, simply search the local neighborhood by radius look up
-    // and collect the neighbors to compute the relative pose
+      grid.getNeighbors(p1, neighbors);
 
-    for (int j = 0; j < sampled.rows; j ++)
+      for (size_t nj = 0; nj < neighbors.size(); nj++)
+      {
+        const int j = neighbors[nj];
+        if (i!=j)
+        {
+          const Vec3f p2(sampled.ptr<float>(j));
+          const Vec3f n2(sampled.ptr<float>(j) + 3);
+          double alpha_scene;
+
+          const Vec3f d12 = p2 - p1;
+          if (d12.dot(d12) > sqModelDiameter)
+            continue;
+
+          Vec4d f = Vec4d::all(0);
+          computePPFFeatures(p1, n1, p2, n2, f);
+          KeyType hashValue = hashPPF(f, angle_step, distanceStep);
+
+          if (!computeSceneAlpha(Rsg, tsg, p2, alpha_scene))
+            continue;
+
+          const uint bucket = hashValue % tableSize;
+
+          for (int k = hashBuckets[bucket]; k < hashBuckets[bucket + 1]; k++)
+          {
+            const int* entry = hashTable->entries.ptr<int>(k);
+            int corrI = entry[0];
+            int ppfInd = entry[1];
+            const float* ppfCorrScene = ppf.ptr<float>(ppfInd);
+            double alpha_model = (double)ppfCorrScene[PPF_LENGTH-1];
+            double alpha = alpha_model - alpha_scene;
+
+            /*  Tolga Birdal's note: Map alpha to the indices:
+                    atan2 generates results in (-pi pi]
+                    That's why alpha should be in range [-2pi 2pi]
+                    So the quantization would be :
+                    numAngles * (alpha+2pi)/(4pi)
+                    */
+
+            //printf("%f\n", alpha);
+            int alpha_index = (int)(numAngles*(alpha + 2*M_PI) / (4*M_PI));
+
+            uint accIndex = corrI * numAngles + alpha_index;
+
+            accumulator[accIndex]++;
+          }
+        }
+      }
+
+      // Maximize the accumulator
+      for (uint k = 0; k < n; k++)
+      {
+        for (int j = 0; j < numAngles; j++)
+        {
+          const uint accInd = k*numAngles + j;
+          const uint accVal = accumulator[ accInd ];
+          if (accVal > maxVotes)
+          {
+            maxVotes = accVal;
+            refIndMax = k;
+            alphaIndMax = j;
+          }
+
+          accumulator[accInd ] = 0;
+        }
+      }
+
+      // TODO : Compute pose
+      const Vec3f pMax(sampled_pc.ptr<float>(refIndMax));
+      const Vec3f nMax(sampled_pc.ptr<float>(refIndMax) + 3);
+
+      poseList[r] = makeVotedPose(Rsg, tsg, pMax, nMax, alphaIndMax, numAngles, refIndMax, maxVotes);
+    }
+  });
+
+  // TODO : Make the parameters relative if not arguments.
+  //double MinMatchScore = 0.5;
+
+  int numPosesAdded = sampled.rows/sceneSamplingStep;
+
+  clusterPoses(poseList, numPosesAdded, results);
+}
+
+///////////////////////// MULTIPLE MODELS ////////////////////////////////////////
+
+PPF3DMultiDetector::PPF3DMultiDetector(const double RelativeSamplingStep, const double RelativeDistanceStep, const double NumAngles)
+{
+  sampling_step_relative = RelativeSamplingStep;
+  distance_step_relative = RelativeDistanceStep;
+  angle_step_relative = NumAngles;
+  angle_step = (360.0/angle_step_relative)*M_PI/180.0;
+  trained = false;
+
+  setSearchParams();
+}
+
+PPF3DMultiDetector::~PPF3DMultiDetector()
+{
+}
+
+void PPF3DMultiDetector::setSearchParams(const double positionThreshold, const double rotationThreshold, const bool useWeightedClustering)
+{
+  if (positionThreshold<0)
+    position_threshold = sampling_step_relative;
+  else
+    position_threshold = positionThreshold;
+
+  if (rotationThreshold<0)
+    rotation_threshold = ((360/angle_step) / 180.0 * M_PI);
+  else
+    rotation_threshold = rotationThreshold;
+
+  use_weighted_avg = useWeightedClustering;
+}
+
+int PPF3DMultiDetector::addModel(const Mat& PC)
+{
+  CV_Assert(PC.type() == CV_32F || PC.type() == CV_32FC1);
+
+  Vec2f xRange, yRange, zRange;
+  computeBboxStd(PC, xRange, yRange, zRange);
+
+  float dx = xRange[1] - xRange[0];
+  float dy = yRange[1] - yRange[0];
+  float dz = zRange[1] - zRange[0];
+
+  Mat sampled = samplePCByQuantization(PC, xRange, yRange, zRange, (float)sampling_step_relative, 0);
+  if (sampled.empty())
+  {
+    CV_Error(Error::StsBadArg, "The model has no points");
+  }
+
+  models.push_back(sampled);
+  model_diameters.push_back(sqrt(dx * dx + dy * dy + dz * dz));
+  trained = false;
+
+  return (int)models.size() - 1;
+}
+
+int PPF3DMultiDetector::numModels() const
+{
+  return (int)models.size();
+}
+
+void PPF3DMultiDetector::trainModels()
+{
+  if (models.empty())
+  {
+    CV_Error(Error::StsError, "No models are added. Nothing to train");
+  }
+
+  const int numModels = (int)models.size();
+  model_starts.assign(numModels + 1, 0);
+  ppf_starts.assign(numModels + 1, 0);
+  distance_steps.clear();
+  model_groups.assign(numModels, 0);
+  for (int m = 0; m < numModels; m++)
+  {
+    model_starts[m + 1] = model_starts[m] + models[m].rows;
+    ppf_starts[m + 1] = ppf_starts[m] + models[m].rows*models[m].rows;
+
+    // each model quantizes distances with its own step as PPF3DDetector does
+    const double distanceStep = (float)(model_diameters[m] * sampling_step_relative);
+    const size_t g = std::find(distance_steps.begin(), distance_steps.end(), distanceStep) - distance_steps.begin();
+    if (g == distance_steps.size())
+      distance_steps.push_back(distanceStep);
+    model_groups[m] = (int)g;
+  }
+  vconcat(models, sampled_pc);
+
+  const double angleStep = angle_step;
+
+  const int numRefPoints = model_starts[numModels];
+  const int numPPF = ppf_starts[numModels];
+  ppf = Mat::zeros(numPPF, PPF_LENGTH, CV_32FC1);
+
+  // PPFs of different models are never paired, only the diagonal blocks are computed
+  std::vector<KeyType> keys(numPPF);
+  std::vector<uchar> valid(numPPF, 0);
+  parallel_for_(Range(0, numRefPoints), [&](const Range& range)
+  {
+    for (int i = range.start; i < range.end; i++)
     {
-      if (i!=j)
+      const int m = (int)(std::upper_bound(model_starts.begin(), model_starts.end(), i) - model_starts.begin()) - 1;
+      const int start = model_starts[m], n = model_starts[m + 1] - start;
+      const double distanceStep = distance_steps[model_groups[m]];
+      const Vec3f p1(sampled_pc.ptr<float>(i));
+      const Vec3f n1(sampled_pc.ptr<float>(i) + 3);
+
+      for (int j = start; j < start + n; j++)
       {
+        if (i != j)
+        {
+          const Vec3f p2(sampled_pc.ptr<float>(j));
+          const Vec3f n2(sampled_pc.ptr<float>(j) + 3);
+
+          Vec4d f = Vec4d::all(0);
+          computePPF(p1, n1, p2, n2, f);
+          const int ppfInd = ppf_starts[m] + (i - start)*n + (j - start);
+
+          keys[ppfInd] = hashPPF(f, angleStep, distanceStep);
+          valid[ppfInd] = 1;
+
+          Mat(f).reshape(1, 1).convertTo(ppf.row(ppfInd).colRange(0, 4), CV_32F);
+          ppf.ptr<float>(ppfInd)[4] = (float)computeAlpha(p1, n1, p2);
+        }
+      }
+    }
+  });
+
+  // stable counting sort of PPFs by bucket, entries keep the key to skip the other keys of the bucket
+  // and the models of other groups which got the same key
+  const uint tableSize = numPPF < 16 ? 16 : next_power_of_two((uint)numPPF);
+  hash_buckets = Mat::zeros((int)tableSize + 1, 1, CV_32S);
+  int* buckets = hash_buckets.ptr<int>();
+  for (int ppfInd = 0; ppfInd < numPPF; ppfInd++)
+  {
+    if (valid[ppfInd])
+      buckets[keys[ppfInd] % tableSize + 1]++;
+  }
+  for (uint b = 0; b < tableSize; b++)
+    buckets[b + 1] += buckets[b];
+
+  hash_entries.create(buckets[tableSize], 1, CV_32SC3);
+  std::vector<int> fill(buckets, buckets + tableSize);
+  for (int m = 0; m < numModels; m++)
+  {
+    const int start = model_starts[m], n = model_starts[m + 1] - start;
+    for (int ppfInd = ppf_starts[m]; ppfInd < ppf_starts[m + 1]; ppfInd++)
+    {
+      if (!valid[ppfInd])
+        continue;
+
+      int* entry = hash_entries.ptr<int>(fill[keys[ppfInd] % tableSize]++);
+      entry[0] = (int)keys[ppfInd];
+      entry[1] = start + (ppfInd - ppf_starts[m]) / n;
+      entry[2] = ppfInd;
+    }
+  }
+
+  trained = true;
+}
+
+void PPF3DMultiDetector::match(const Mat& pc, std::vector< std::vector<Pose3DPtr> >& results, const double relativeSceneSampleStep, const double relativeSceneDistance)
+{
+  if (!trained)
+    trainModels();
+
+  CV_Assert(pc.type() == CV_32F || pc.type() == CV_32FC1);
+  CV_Assert(relativeSceneSampleStep<=1 && relativeSceneSampleStep>0);
+
+  const int sceneSamplingStep = (int)(1.0/relativeSceneSampleStep);
+  const int numModels = (int)models.size();
+  const int numAngles = (int) (floor (2 * M_PI / angle_step));
+  const uint n = (uint)sampled_pc.rows;
+  const int* hashBuckets = hash_buckets.ptr<int>();
+  const uint tableSize = (uint)hash_buckets.rows - 1;
+  const int numGroups = (int)distance_steps.size();
+
+  Vec2f xRange, yRange, zRange;
+  computeBboxStd(pc, xRange, yRange, zRange);
+  Mat sampled = samplePCByQuantization(pc, xRange, yRange, zRange, (float)relativeSceneDistance, 0);
+
+  // group of each model point to skip the entries of other groups with the same key,
+  // and the longest pair of each group
+  std::vector<int> pointGroups(n);
+  std::vector<float> sqGroupDiameters(numGroups, 0.f);
+  for (int m = 0; m < numModels; m++)
+  {
+    std::fill(pointGroups.begin() + model_starts[m], pointGroups.begin() + model_starts[m + 1], model_groups[m]);
+    float& sqDiameter = sqGroupDiameters[model_groups[m]];
+    sqDiameter = std::max(sqDiameter, model_diameters[m] * model_diameters[m]);
+  }
+
+  // the pairs are gathered for the largest model, the smaller ones skip the longer pairs
+  const float maxDiameter = *std::max_element(model_diameters.begin(), model_diameters.end());
+  const float sqMaxDiameter = maxDiameter * maxDiameter;
+  ScenePointGrid grid(sampled, maxDiameter);
+
+  const int numRefPoints = (sampled.rows + sceneSamplingStep - 1) / sceneSamplingStep;
+  std::vector< std::vector<Pose3DPtr> > poseLists(numModels, std::vector<Pose3DPtr>(numRefPoints));
+
+  parallel_for_(Range(0, numRefPoints), [&](const Range& range)
+  {
+    // accumulator of all the models, cleared while being maximized
+    std::vector<uint> accumulatorBuffer(numAngles*n, 0);
+    uint* accumulator = accumulatorBuffer.data();
+    std::vector<int> neighbors;
+
+    for (int r = range.start; r < range.end; r++)
+    {
+      const int i = r * sceneSamplingStep;
+
+      const Vec3f p1(sampled.ptr<float>(i));
+      const Vec3f n1(sampled.ptr<float>(i) + 3);
+      Vec3d tsg = Vec3d::all(0);
+      Matx33d Rsg = Matx33d::all(0);
+
+      computeTransformRT(p1, n1, Rsg, tsg);
+
+      grid.getNeighbors(p1, neighbors);
+
+      for (size_t nj = 0; nj < neighbors.size(); nj++)
+      {
+        const int j = neighbors[nj];
+        if (i == j)
+          continue;
+
         const Vec3f p2(sampled.ptr<float>(j));
         const Vec3f n2(sampled.ptr<float>(j) + 3);
-        Vec3d p2t;
         double alpha_scene;
 
-        Vec4d f = Vec4d::all(0);
-        computePPFFeatures(p1, n1, p2, n2, f);
-        KeyType hashValue = hashPPF(f, angle_step, distanceStep);
+        const Vec3f d12 = p2 - p1;
+        if (d12.dot(d12) > sqMaxDiameter)
+          continue;
 
-        p2t = tsg + Rsg * Vec3d(p2);
+        Vec4d f = Vec4d::all(0);
+        computePPF(p1, n1, p2, n2, f);
 
-        alpha_scene=atan2(-p2t[2], p2t[1]);
+        if (!computeSceneAlpha(Rsg, tsg, p2, alpha_scene))
+          continue;
 
-        if ( alpha_scene != alpha_scene)
+        for (int g = 0; g < numGroups; g++)
         {
-          continue;
-        }
+          if (d12.dot(d12) > sqGroupDiameters[g])
+            continue;
 
-        if (sin(alpha_scene)*p2t[2]<0.0)
-          alpha_scene=-alpha_scene;
+          const KeyType hashValue = hashPPF(f, angle_step, distance_steps[g]);
+          const uint bucket = hashValue % tableSize;
 
-        alpha_scene=-alpha_scene;
+          for (int k = hashBuckets[bucket]; k < hashBuckets[bucket + 1]; k++)
+          {
+            const int* entry = hash_entries.ptr<int>(k);
+            if ((KeyType)entry[0] != hashValue || pointGroups[entry[1]] != g)
+              continue;
 
-        hashnode_i* node = hashtableGetBucketHashed(hash_table, (hashValue));
+            double alpha_model = (double)ppf.ptr<float>(entry[2])[PPF_LENGTH-1];
+            double alpha = alpha_model - alpha_scene;
+            int alpha_index = (int)(numAngles*(alpha + 2*M_PI) / (4*M_PI));
 
-        while (node)
-        {
-          THash* tData = (THash*) node->data;
-          int corrI = (int)tData->i;
-          int ppfInd = (int)tData->ppfInd;
-          float* ppfCorrScene = ppf.ptr<float>(ppfInd);
-          double alpha_model = (double)ppfCorrScene[PPF_LENGTH-1];
-          double alpha = alpha_model - alpha_scene;
-
-          /*  Tolga Birdal's note: Map alpha to the indices:
-                  atan2 generates results in (-pi pi]
-                  That's why alpha should be in range [-2pi 2pi]
-                  So the quantization would be :
-                  numAngles * (alpha+2pi)/(4pi)
-                  */
-
-          //printf("%f\n", alpha);
-          int alpha_index = (int)(numAngles*(alpha + 2*M_PI) / (4*M_PI));
-
-          uint accIndex = corrI * numAngles + alpha_index;
-
-          accumulator[accIndex]++;
-          node = node->next;
+            accumulator[entry[1] * numAngles + alpha_index]++;
+          }
         }
       }
-    }
 
-    // Maximize the accumulator
-    for (uint k = 0; k < n; k++)
-    {
-      for (int j = 0; j < numAngles; j++)
+      // Maximize the accumulator of each model
+      for (int m = 0; m < numModels; m++)
       {
-        const uint accInd = k*numAngles + j;
-        const uint accVal = accumulator[ accInd ];
-        if (accVal > maxVotes)
+        const uint start = (uint)model_starts[m];
+        uint refIndMax = 0, alphaIndMax = 0;
+        uint maxVotes = 0;
+
+        for (uint k = start; k < (uint)model_starts[m + 1]; k++)
         {
-          maxVotes = accVal;
-          refIndMax = k;
-          alphaIndMax = j;
+          for (int a = 0; a < numAngles; a++)
+          {
+            const uint accInd = k*numAngles + a;
+            const uint accVal = accumulator[accInd];
+            if (accVal > maxVotes)
+            {
+              maxVotes = accVal;
+              refIndMax = k - start;
+              alphaIndMax = a;
+            }
+
+            accumulator[accInd] = 0;
+          }
         }
 
-#if !defined (_OPENMP)
-        accumulator[accInd ] = 0;
-#endif
+        const Vec3f pMax(sampled_pc.ptr<float>(start + refIndMax));
+        const Vec3f nMax(sampled_pc.ptr<float>(start + refIndMax) + 3);
+
+        poseLists[m][r] = makeVotedPose(Rsg, tsg, pMax, nMax, alphaIndMax, numAngles, refIndMax, maxVotes);
       }
     }
+  });
 
-    // invert Tsg : Luckily rotation is orthogonal: Inverse = Transpose.
-    // We are not required to invert.
-    Vec3d tInv, tmg;
-    Matx33d Rmg;
-    RInv = Rsg.t();
-    tInv = -RInv * tsg;
+  const int numPosesAdded = sampled.rows/sceneSamplingStep;
 
-    Matx44d TsgInv;
-    rtToPose(RInv, tInv, TsgInv);
+  results.assign(numModels, std::vector<Pose3DPtr>());
+  parallel_for_(Range(0, numModels), [&](const Range& range)
+  {
+    for (int m = range.start; m < range.end; m++)
+      clusterPoseList(poseLists[m], numPosesAdded, position_threshold, rotation_threshold, use_weighted_avg, results[m]);
+  });
+}
 
-    // TODO : Compute pose
-    const Vec3f pMax(sampled_pc.ptr<float>(refIndMax));
-    const Vec3f nMax(sampled_pc.ptr<float>(refIndMax) + 3);
+///////////////////////// MODEL FILE ////////////////////////////////////////
 
-    computeTransformRT(pMax, nMax, Rmg, tmg);
+// Model file is the header followed by the sampled model, PPFs, hash buckets and
+// hash entries, each section starts at PPF_MODEL_ALIGN bytes boundary
+static const char PPF_MODEL_MAGIC[8] = {'C', 'V', 'P', 'P', 'F', '3', 'D', 0};
+static const uint PPF_MODEL_VERSION = 1;
+static const size_t PPF_MODEL_ALIGN = 64;
 
-    Matx44d Tmg;
-    rtToPose(Rmg, tmg, Tmg);
+struct PPFModelHeader
+{
+  char magic[8];
+  uint version;
+  int numRefPoints;
+  double angleStep, distanceStep;
+  double samplingStepRelative, angleStepRelative, distanceStepRelative;
+  // rows, columns and offsets from the file start of the sections
+  int sampledRows, sampledCols;
+  int ppfRows, ppfCols;
+  int numBuckets, numEntries;
+  uint64 sampledOffset, ppfOffset, bucketsOffset, entriesOffset;
+  uint64 fileSize;
+};
+
+static void writeModelSection(std::ofstream& out, uint64& pos, uint64 offset, const Mat& m)
+{
+  static const char padding[PPF_MODEL_ALIGN] = {0};
+  CV_Assert(offset >= pos && offset - pos < PPF_MODEL_ALIGN);
+  out.write(padding, (std::streamsize)(offset - pos));
 
-    // convert alpha_index to alpha
-    int alpha_index = alphaIndMax;
-    double alpha = (alpha_index*(4*M_PI))/numAngles-2*M_PI;
+  const Mat data = m.isContinuous() ? m : m.clone();
+  out.write((const char*)data.data, (std::streamsize)(data.total()*data.elemSize()));
+  pos = offset + data.total()*data.elemSize();
+}
 
-    // Equation 2:
-    Matx44d Talpha;
-    Matx33d R;
-    Vec3d t = Vec3d::all(0);
-    getUnitXRotation(alpha, R);
-    rtToPose(R, t, Talpha);
+void PPF3DDetector::saveModel(const String& filename) const
+{
+  if (!trained)
+  {
+    CV_Error(Error::StsError, "The model is not trained. Nothing to save");
+  }
 
-    Matx44d rawPose = TsgInv * (Talpha * Tmg);
+  PPFModelHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PPF_MODEL_MAGIC, sizeof(header.magic));
+  header.version = PPF_MODEL_VERSION;
+  header.numRefPoints = num_ref_points;
+  header.angleStep = angle_step;
+  header.distanceStep = distance_step;
+  header.samplingStepRelative = sampling_step_relative;
+  header.angleStepRelative = angle_step_relative;
+  header.distanceStepRelative = distance_step_relative;
+  header.sampledRows = sampled_pc.rows;
+  header.sampledCols = sampled_pc.cols;
+  header.ppfRows = ppf.rows;
+  header.ppfCols = ppf.cols;
+
+  const PPFHashTable* hashTable = static_cast<const PPFHashTable*>(hash_table);
+  const Mat& buckets = hashTable->buckets;
+  const Mat& entries = hashTable->entries;
+  header.numBuckets = buckets.rows;
+  header.numEntries = entries.rows;
+
+  header.sampledOffset = alignSize(sizeof(header), (int)PPF_MODEL_ALIGN);
+  header.ppfOffset = alignSize((size_t)(header.sampledOffset + sampled_pc.total()*sizeof(float)), (int)PPF_MODEL_ALIGN);
+  header.bucketsOffset = alignSize((size_t)(header.ppfOffset + ppf.total()*sizeof(float)), (int)PPF_MODEL_ALIGN);
+  header.entriesOffset = alignSize((size_t)(header.bucketsOffset + buckets.total()*sizeof(int)), (int)PPF_MODEL_ALIGN);
+  header.fileSize = header.entriesOffset + entries.total()*2*sizeof(int);
+
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if (!out)
+  {
+    CV_Error(Error::StsError, "Can't open file " + filename + " for writing");
+  }
 
-    Pose3DPtr pose(new Pose3D(alpha, refIndMax, maxVotes));
-    pose->updatePose(rawPose);
-    #if defined (_OPENMP)
-    #pragma omp critical
-    #endif
-    {
-      poseList.push_back(pose);
-    }
+  out.write((const char*)&header, sizeof(header));
+  uint64 pos = sizeof(header);
+  writeModelSection(out, pos, header.sampledOffset, sampled_pc);
+  writeModelSection(out, pos, header.ppfOffset, ppf);
+  writeModelSection(out, pos, header.bucketsOffset, buckets);
+  writeModelSection(out, pos, header.entriesOffset, entries);
+
+  if (!out)
+  {
+    CV_Error(Error::StsError, "Failed to write file " + filename);
+  }
+}
+
+// Maps the whole file into memory, reads it into a buffer if mapping is not available
+static std::shared_ptr<void> mapModelFile(const String& filename, size_t& size)
+{
+#ifdef PPF_MODEL_USE_MMAP
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    CV_Error(Error::StsError, "Can't open file " + filename);
+  }
+
+  struct stat st;
+  void* addr = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    size = (size_t)st.st_size;
+    addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+
+  if (addr == MAP_FAILED)
+  {
+    CV_Error(Error::StsError, "Can't map file " + filename);
+  }
 
-#if defined (_OPENMP)
-    free(accumulator);
+  const size_t mappedSize = size;
+  return std::shared_ptr<void>(addr, [mappedSize](void* p) { munmap(p, mappedSize); });
+#else
+  std::ifstream in(filename.c_str(), std::ios::binary | std::ios::ate);
+  if (!in)
+  {
+    CV_Error(Error::StsError, "Can't open file " + filename);
+  }
+
+  size = (size_t)in.tellg();
+  in.seekg(0);
+  std::shared_ptr<void> buffer(fastMalloc(std::max(size, (size_t)1)), fastFree);
+  in.read((char*)buffer.get(), (std::streamsize)size);
+  if (!in)
+  {
+    CV_Error(Error::StsError, "Failed to read file " + filename);
+  }
+  return buffer;
 #endif
+}
+
+static bool modelSectionFits(uint64 offset, uint64 bytes, uint64 fileSize)
+{
+  return offset % PPF_MODEL_ALIGN == 0 && offset <= fileSize && bytes <= fileSize - offset;
+}
+
+void PPF3DDetector::loadModel(const String& filename)
+{
+  size_t size = 0;
+  std::shared_ptr<void> file = mapModelFile(filename, size);
+  const uchar* data = (const uchar*)file.get();
+
+  PPFModelHeader header;
+  if (size < sizeof(header))
+  {
+    CV_Error(Error::StsParseError, "File " + filename + " is not a PPF model");
   }
+  memcpy(&header, data, sizeof(header));
 
-  // TODO : Make the parameters relative if not arguments.
-  //double MinMatchScore = 0.5;
+  if (memcmp(header.magic, PPF_MODEL_MAGIC, sizeof(header.magic)) != 0)
+  {
+    CV_Error(Error::StsParseError, "File " + filename + " is not a PPF model");
+  }
+  if (header.version != PPF_MODEL_VERSION)
+  {
+    CV_Error(Error::StsParseError, "Unsupported version of PPF model file " + filename);
+  }
 
-  int numPosesAdded = sampled.rows/sceneSamplingStep;
+  const uint64 n = (uint64)std::max(header.numRefPoints, 0);
+  bool valid = header.fileSize == size && header.numRefPoints > 0 &&
+               header.sampledRows == header.numRefPoints && header.sampledCols == 6 &&
+               (uint64)header.ppfRows == n*n && header.ppfCols == (int)PPF_LENGTH &&
+               header.numBuckets > 1 && header.numEntries >= 0 &&
+               modelSectionFits(header.sampledOffset, n*6*sizeof(float), size) &&
+               modelSectionFits(header.ppfOffset, n*n*PPF_LENGTH*sizeof(float), size) &&
+               modelSectionFits(header.bucketsOffset, (uint64)header.numBuckets*sizeof(int), size) &&
+               modelSectionFits(header.entriesOffset, (uint64)header.numEntries*2*sizeof(int), size);
+  if (!valid)
+  {
+    CV_Error(Error::StsParseError, "PPF model file " + filename + " is corrupted");
+  }
 
-  clusterPoses(poseList, numPosesAdded, results);
+  // the buckets must partition the entries and the entries must refer to the model,
+  // match() reads the model through them without further checks
+  const int* buckets = (const int*)(data + header.bucketsOffset);
+  valid = buckets[0] == 0 && buckets[header.numBuckets - 1] == header.numEntries;
+  for (int b = 0; valid && b < header.numBuckets - 1; b++)
+    valid = buckets[b] <= buckets[b + 1];
+
+  const int* entries = (const int*)(data + header.entriesOffset);
+  for (int k = 0; valid && k < header.numEntries; k++)
+  {
+    const int i = entries[2*k], ppfInd = entries[2*k + 1];
+    valid = i >= 0 && (uint64)i < n && ppfInd >= 0 && (uint64)ppfInd < n*n;
+  }
+  if (!valid)
+  {
+    CV_Error(Error::StsParseError, "PPF model file " + filename + " is corrupted");
+  }
+
+  clearTrainingModels();
+
+  // the matrices refer to the file memory, it is kept while they are in use
+  sampled_pc = Mat(header.sampledRows, header.sampledCols, CV_32FC1, (void*)(data + header.sampledOffset));
+  ppf = Mat(header.ppfRows, header.ppfCols, CV_32FC1, (void*)(data + header.ppfOffset));
+  hash_table = new PPFHashTable(Mat(header.numBuckets, 1, CV_32S, (void*)(data + header.bucketsOffset)),
+                                Mat(header.numEntries, 1, CV_32SC2, (void*)(data + header.entriesOffset)),
+                                file);
+
+  angle_step = header.angleStep;
+  distance_step = header.distanceStep;
+  sampling_step_relative = header.samplingStepRelative;
+  angle_step_relative = header.angleStepRelative;
+  distance_step_relative = header.distanceStepRelative;
+  angle_step_radians = header.angleStep;
+  num_ref_points = header.numRefPoints;
+  trained = true;
 }
 
 } // namespace ppf_match_3d
@@ -0,0 +1,109 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#ifndef __OPENCV_SURFACE_MATCHING_SCENE_POINT_GRID_HPP_
+#define __OPENCV_SURFACE_MATCHING_SCENE_POINT_GRID_HPP_
+
+namespace cv
+{
+namespace ppf_match_3d
+{
+
+// Uniform grid over the scene points to look up the points near a given one
+class ScenePointGrid
+{
+public:
+  ScenePointGrid(const Mat& points, float cellSize);
+
+  // Points of the cells around the cell of p, all the points closer than cell size to p are there
+  void getNeighbors(const Vec3f& p, std::vector<int>& neighbors) const;
+
+private:
+  Vec3i cellOf(const Vec3f& p) const;
+  int cellIndex(const Vec3i& c) const { return (c[2]*dims[1] + c[1])*dims[0] + c[0]; }
+
+  Vec3f origin;
+  float cellSize;
+  Vec3i dims;
+  // points of cell k are cellPoints[cellStart[k]] .. cellPoints[cellStart[k+1]-1]
+  std::vector<int> cellStart, cellPoints;
+};
+
+inline ScenePointGrid::ScenePointGrid(const Mat& points, float _cellSize)
+{
+  Vec3f minPt = Vec3f::all(std::numeric_limits<float>::max());
+  Vec3f maxPt = Vec3f::all(-std::numeric_limits<float>::max());
+  for (int i = 0; i < points.rows; i++)
+  {
+    const float* p = points.ptr<float>(i);
+    for (int k = 0; k < 3; k++)
+    {
+      minPt[k] = std::min(minPt[k], p[k]);
+      maxPt[k] = std::max(maxPt[k], p[k]);
+    }
+  }
+  if (points.rows == 0)
+    minPt = maxPt = Vec3f::all(0);
+
+  const Vec3f extent = maxPt - minPt;
+  const float maxExtent = std::max(extent[0], std::max(extent[1], extent[2]));
+
+  // bigger cells keep the grid small for scenes much larger than the model
+  const int maxCellsPerDim = 128;
+  cellSize = std::max(_cellSize, maxExtent / maxCellsPerDim);
+  if (!(cellSize > 0))
+    cellSize = 1.f;
+
+  origin = minPt;
+  for (int k = 0; k < 3; k++)
+    dims[k] = (int)(extent[k] / cellSize) + 1;
+
+  // counting sort of points by cell, points of a cell go in ascending order
+  const int numCells = dims[0]*dims[1]*dims[2];
+  std::vector<int> pointCell(points.rows);
+  cellStart.assign(numCells + 1, 0);
+  for (int i = 0; i < points.rows; i++)
+  {
+    pointCell[i] = cellIndex(cellOf(Vec3f(points.ptr<float>(i))));
+    cellStart[pointCell[i] + 1]++;
+  }
+  for (int k = 0; k < numCells; k++)
+    cellStart[k + 1] += cellStart[k];
+
+  cellPoints.resize(points.rows);
+  std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+  for (int i = 0; i < points.rows; i++)
+    cellPoints[fill[pointCell[i]]++] = i;
+}
+
+inline Vec3i ScenePointGrid::cellOf(const Vec3f& p) const
+{
+  Vec3i c;
+  for (int k = 0; k < 3; k++)
+    c[k] = std::min(std::max(cvFloor((p[k] - origin[k]) / cellSize), 0), dims[k] - 1);
+  return c;
+}
+
+inline void ScenePointGrid::getNeighbors(const Vec3f& p, std::vector<int>& neighbors) const
+{
+  neighbors.clear();
+  const Vec3i c = cellOf(p);
+  for (int z = std::max(c[2] - 1, 0); z <= std::min(c[2] + 1, dims[2] - 1); z++)
+  {
+    for (int y = std::max(c[1] - 1, 0); y <= std::min(c[1] + 1, dims[1] - 1); y++)
+    {
+      for (int x = std::max(c[0] - 1, 0); x <= std::min(c[0] + 1, dims[0] - 1); x++)
+      {
+        const int cell = cellIndex(Vec3i(x, y, z));
+        neighbors.insert(neighbors.end(), cellPoints.begin() + cellStart[cell],
+                         cellPoints.begin() + cellStart[cell + 1]);
+      }
+    }
+  }
+}
+
+} // namespace ppf_match_3d
+} // namespace cv
+
+#endif
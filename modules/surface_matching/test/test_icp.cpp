@@ -0,0 +1,62 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include "test_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+static Mat loadSampleModel(const String& name)
+{
+  String path(__FILE__);
+  path = path.substr(0, path.find_last_of("\\/") + 1) + "../samples/data/" + name;
+
+  Mat pc = loadPLYSimple(path.c_str(), 1);
+  CV_Assert(!pc.empty());
+  return pc;
+}
+
+TEST(ICPSceneIndex, update_points_as_rebuilt)
+{
+  Mat model = loadSampleModel("parasaurolophus_6700.ply");
+  Matx44d scenePose = Matx44d::eye();
+  scenePose(0, 3) = 2;
+  scenePose(1, 3) = -1;
+  Mat scene = transformPCPose(model, scenePose);
+
+  ICP icp(100, 0.005f, 2.5f, 8);
+  ICPSceneIndex updated(scene);
+  double residual = 0;
+  Matx44d pose;
+  // the structures of all the levels are built before the update
+  ASSERT_EQ(0, icp.registerModelToScene(model, updated, residual, pose));
+
+  // move a part of the scene
+  std::vector<int> rows;
+  for (int i = 0; i < scene.rows / 2; i += 3)
+    rows.push_back(i);
+  Mat points(0, scene.cols, CV_32F);
+  for (size_t k = 0; k < rows.size(); k++)
+  {
+    Mat p = scene.row(rows[k]).clone();
+    p.at<float>(0) += 5.f;
+    p.at<float>(1) -= 3.f;
+    p.at<float>(2) += 2.f;
+    points.push_back(p);
+    p.copyTo(scene.row(rows[k]));
+  }
+  updated.updatePoints(rows, points);
+  ASSERT_EQ(0, cvtest::norm(updated.getScene(), scene, NORM_INF));
+
+  ICPSceneIndex rebuilt(scene);
+  double updatedResidual = 0, rebuiltResidual = 0;
+  Matx44d updatedPose, rebuiltPose;
+  ASSERT_EQ(0, icp.registerModelToScene(model, updated, updatedResidual, updatedPose));
+  ASSERT_EQ(0, icp.registerModelToScene(model, rebuilt, rebuiltResidual, rebuiltPose));
+
+  // the scene mean is updated incrementally, so the results may differ by rounding
+  EXPECT_NEAR(rebuiltResidual, updatedResidual, 1e-6);
+  EXPECT_LE(cvtest::norm(Mat(rebuiltPose), Mat(updatedPose), NORM_INF), 1e-6);
+}
+
+}} // namespace
@@ -0,0 +1,329 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html
+
+#include "test_precomp.hpp"
+#include "../src/c_utils.hpp"
+#include "../src/ppf_hash_table.hpp"
+#include "../src/scene_point_grid.hpp"
+
+namespace opencv_test { namespace {
+
+// The module has no test data of its own, the models of the samples are used
+static Mat loadSampleModel(const String& name)
+{
+  String path(__FILE__);
+  path = path.substr(0, path.find_last_of("\\/") + 1) + "../samples/data/" + name;
+
+  Mat pc = loadPLYSimple(path.c_str(), 1);
+  CV_Assert(!pc.empty());
+  return pc;
+}
+
+static Matx44d scenePose()
+{
+  Matx33d R;
+  aaToR(Vec3d(1, 2, 3) * (1.0 / sqrt(14.0)), 0.7, R);
+  Matx44d pose;
+  rtToPose(R, Vec3d(30, -20, 50), pose);
+  return pose;
+}
+
+// rotation angle and translation distance between two poses
+static void poseError(const Matx44d& pose, const Matx44d& expected, double& angle, double& distance)
+{
+  Matx33d R, Re;
+  Vec3d t, te;
+  poseToRT(pose, R, t);
+  poseToRT(expected, Re, te);
+
+  const double c = (trace(Re.t() * R) - 1) / 2;
+  angle = acos(std::min(1.0, std::max(-1.0, c)));
+  distance = cv::norm(t - te);
+}
+
+static double modelDiameter(const Mat& pc)
+{
+  Vec3d size;
+  for (int c = 0; c < 3; c++)
+  {
+    double minVal = 0, maxVal = 0;
+    minMaxIdx(pc.col(c), &minVal, &maxVal);
+    size[c] = maxVal - minVal;
+  }
+  return cv::norm(size);
+}
+
+// Gives the trained tables to the tests
+class PPF3DDetectorInternals : public PPF3DDetector
+{
+public:
+  PPF3DDetectorInternals(double relativeSamplingStep, double relativeDistanceStep)
+    : PPF3DDetector(relativeSamplingStep, relativeDistanceStep) {}
+
+  const Mat& sampledPC() const { return sampled_pc; }
+  double angleStep() const { return angle_step; }
+  double distanceStep() const { return distance_step; }
+  const PPFHashTable& hashTable() const { return *static_cast<const PPFHashTable*>(hash_table); }
+};
+
+TEST(PPF3DDetector, hash_table_as_hashtable_int)
+{
+  Mat model = loadSampleModel("parasaurolophus_6700.ply");
+  PPF3DDetectorInternals detector(0.05, 0.05);
+  detector.trainModel(model);
+
+  const Mat& sampled = detector.sampledPC();
+  const int n = sampled.rows;
+  const PPFHashTable& table = detector.hashTable();
+  ASSERT_GT(n, 1);
+  ASSERT_EQ((size_t)(n*n < 16 ? 16 : next_power_of_two((uint)(n*n))), table.size);
+
+  // nodes of each bucket front to back as hashtableInsertHashed() leaves them
+  // after the inserts of the former training loop, node data is (i, ppfInd)
+  std::vector< std::vector<KeyType> > nodeKeys(table.size);
+  std::vector< std::vector<Vec2i> > nodeData(table.size);
+  for (int i = 0; i < n; i++)
+  {
+    const Vec3f p1(sampled.ptr<float>(i));
+    const Vec3f n1(sampled.ptr<float>(i) + 3);
+    for (int j = 0; j < n; j++)
+    {
+      if (i == j)
+        continue;
+
+      const Vec3f p2(sampled.ptr<float>(j));
+      const Vec3f n2(sampled.ptr<float>(j) + 3);
+      Vec4d f = Vec4d::all(0);
+      computePPF(p1, n1, p2, n2, f);
+      const KeyType key = hashPPF(f, detector.angleStep(), detector.distanceStep());
+
+      const size_t b = key % table.size;
+      std::vector<KeyType>& keys = nodeKeys[b];
+      std::vector<Vec2i>& data = nodeData[b];
+      const Vec2i node(i, i*n + j);
+      size_t k = 0;
+      while (k < keys.size() && keys[k] == key)
+        k++;
+      if (k < keys.size())
+      {
+        data[k] = node;
+      }
+      else
+      {
+        keys.insert(keys.begin(), key);
+        data.insert(data.begin(), node);
+      }
+    }
+  }
+
+  const int* buckets = table.buckets.ptr<int>();
+  ASSERT_EQ((int)table.size + 1, table.buckets.rows);
+  ASSERT_EQ(buckets[table.size], table.entries.rows);
+  for (size_t b = 0; b < table.size; b++)
+  {
+    ASSERT_EQ(nodeData[b].size(), (size_t)(buckets[b + 1] - buckets[b])) << "bucket " << b;
+    for (size_t k = 0; k < nodeData[b].size(); k++)
+    {
+      const Vec2i entry = table.entries.at<Vec2i>(buckets[b] + (int)k);
+      ASSERT_EQ(nodeData[b][k], entry) << "bucket " << b << " node " << k;
+    }
+  }
+}
+
+TEST(PPF3DDetector, match_pose)
+{
+  Mat model = loadSampleModel("parasaurolophus_6700.ply");
+  const Matx44d expected = scenePose();
+  Mat scene = transformPCPose(model, expected);
+
+  PPF3DDetector detector(0.05, 0.05);
+  detector.trainModel(model);
+
+  std::vector<Pose3DPtr> results;
+  detector.match(scene, results, 1.0/5.0, 0.05);
+  ASSERT_FALSE(results.empty());
+
+  double angle = 0, distance = 0;
+  poseError(results[0]->pose, expected, angle, distance);
+  EXPECT_LT(angle, 10 * CV_PI / 180);
+  EXPECT_LT(distance, 0.05 * modelDiameter(model));
+}
+
+// match() pairs a scene point only with the points the grid gives it, among them with the
+// ones within the model diameter. Farther pairs can't be in the model, so the grid must
+// give all the points within the cell size to keep the pairs of the former all-pairs loop.
+static void gridNeighborsTest(const Vec3f& extent, float cellSize)
+{
+  RNG& rng = theRNG();
+  Mat points(3000, 6, CV_32F);
+  for (int i = 0; i < points.rows; i++)
+  {
+    float* p = points.ptr<float>(i);
+    for (int k = 0; k < 3; k++)
+    {
+      p[k] = rng.uniform(0.f, extent[k]);
+      p[k + 3] = 0.f;
+    }
+  }
+
+  ScenePointGrid grid(points, cellSize);
+
+  std::vector<int> neighbors;
+  std::vector<uchar> isNeighbor(points.rows);
+  for (int i = 0; i < points.rows; i += 7)
+  {
+    const Vec3f p1(points.ptr<float>(i));
+    grid.getNeighbors(p1, neighbors);
+
+    std::fill(isNeighbor.begin(), isNeighbor.end(), (uchar)0);
+    for (size_t k = 0; k < neighbors.size(); k++)
+    {
+      ASSERT_EQ(0, isNeighbor[neighbors[k]]) << "point " << neighbors[k] << " given twice";
+      isNeighbor[neighbors[k]] = 1;
+    }
+
+    for (int j = 0; j < points.rows; j++)
+    {
+      const Vec3f d = Vec3f(points.ptr<float>(j)) - p1;
+      if (d.dot(d) < cellSize*cellSize)
+        ASSERT_EQ(1, isNeighbor[j]) << "point " << j << " is missed for point " << i;
+    }
+  }
+}
+
+TEST(PPF3DDetector, scene_grid_all_pairs_within_diameter)
+{
+  gridNeighborsTest(Vec3f(10, 4, 3), 1.f);
+  // the grid is coarser than the given cell size for a large scene
+  gridNeighborsTest(Vec3f(1000, 10, 10), 1.f);
+}
+
+TEST(PPF3DDetector, match_pose_in_clutter)
+{
+  Mat model = loadSampleModel("parasaurolophus_6700.ply");
+  const Matx44d expected = scenePose();
+  const double diameter = modelDiameter(model);
+
+  Mat object = transformPCPose(model, expected);
+  Vec2d range[3];
+  for (int k = 0; k < 3; k++)
+    minMaxIdx(object.col(k), &range[k][0], &range[k][1]);
+
+  // clutter next to the model along x, farther than the model diameter from it,
+  // the grid cuts its pairs with the model
+  Mat clutter(2000, 6, CV_32F);
+  RNG& rng = theRNG();
+  for (int i = 0; i < clutter.rows; i++)
+  {
+    float* p = clutter.ptr<float>(i);
+    Vec3d n(rng.gaussian(1), rng.gaussian(1), rng.gaussian(1));
+    n *= 1.0 / std::max(cv::norm(n), 1e-6);
+    p[0] = (float)rng.uniform(range[0][1] + diameter, range[0][1] + 2*diameter);
+    p[1] = (float)rng.uniform(range[1][0], range[1][1]);
+    p[2] = (float)rng.uniform(range[2][0], range[2][1]);
+    for (int k = 0; k < 3; k++)
+      p[k + 3] = (float)n[k];
+  }
+
+  Mat scene;
+  vconcat(object, clutter, scene);
+
+  PPF3DDetector detector(0.05, 0.05);
+  detector.trainModel(model);
+
+  std::vector<Pose3DPtr> results;
+  detector.match(scene, results, 1.0/5.0, 0.02);
+  ASSERT_FALSE(results.empty());
+
+  double angle = 0, distance = 0;
+  poseError(results[0]->pose, expected, angle, distance);
+  EXPECT_LT(angle, 10 * CV_PI / 180);
+  EXPECT_LT(distance, 0.05 * diameter);
+}
+
+TEST(PPF3DDetector, save_load_model)
+{
+  Mat model = loadSampleModel("parasaurolophus_6700.ply");
+  Mat scene = transformPCPose(model, scenePose());
+
+  PPF3DDetector trained(0.05, 0.05);
+  trained.trainModel(model);
+  std::vector<Pose3DPtr> expected;
+  trained.match(scene, expected, 1.0/5.0, 0.05);
+
+  const String filename = cv::tempfile(".ppf");
+  trained.saveModel(filename);
+
+  std::vector<Pose3DPtr> results;
+  {
+    PPF3DDetector loaded;
+    loaded.loadModel(filename);
+    loaded.match(scene, results, 1.0/5.0, 0.05);
+  }
+  remove(filename.c_str());
+
+  ASSERT_FALSE(expected.empty());
+  ASSERT_EQ(expected.size(), results.size());
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    EXPECT_EQ(expected[i]->numVotes, results[i]->numVotes) << "pose " << i;
+    EXPECT_LE(cvtest::norm(Mat(expected[i]->pose), Mat(results[i]->pose), NORM_INF), 1e-9) << "pose " << i;
+  }
+}
+
+TEST(PPF3DMultiDetector, match_as_separate_detectors)
+{
+  // the same model at two sizes, so they get different distance steps
+  Mat large = loadSampleModel("parasaurolophus_6700.ply");
+  for (int k = 0; k < 3; k++)
+  {
+    double minVal = 0, maxVal = 0;
+    minMaxIdx(large.col(k), &minVal, &maxVal);
+    large.col(k) -= (minVal + maxVal) / 2;
+  }
+  Mat small = large.clone();
+  small.colRange(0, 3) *= 0.5;
+  std::vector<Mat> models;
+  models.push_back(large);
+  models.push_back(small);
+
+  const double largeDiameter = modelDiameter(large);
+  Matx44d poses[2] = {scenePose(), scenePose()};
+  poses[1](0, 3) += largeDiameter;
+
+  Mat scene;
+  vconcat(transformPCPose(large, poses[0]), transformPCPose(small, poses[1]), scene);
+
+  const double sceneSampleStep = 1.0/5.0, sceneDistance = 0.015;
+  PPF3DMultiDetector multiDetector(0.05, 0.05);
+  for (size_t m = 0; m < models.size(); m++)
+    ASSERT_EQ((int)m, multiDetector.addModel(models[m]));
+
+  std::vector< std::vector<Pose3DPtr> > multiResults;
+  multiDetector.match(scene, multiResults, sceneSampleStep, sceneDistance);
+  ASSERT_EQ(models.size(), multiResults.size());
+
+  for (size_t m = 0; m < models.size(); m++)
+  {
+    PPF3DDetector detector(0.05, 0.05);
+    detector.trainModel(models[m]);
+    std::vector<Pose3DPtr> results;
+    detector.match(scene, results, sceneSampleStep, sceneDistance);
+
+    ASSERT_FALSE(results.empty()) << "model " << m;
+    ASSERT_FALSE(multiResults[m].empty()) << "model " << m;
+
+    const double diameter = modelDiameter(models[m]);
+    double angle = 0, distance = 0;
+    poseError(multiResults[m][0]->pose, results[0]->pose, angle, distance);
+    EXPECT_LT(angle, 5 * CV_PI / 180) << "model " << m;
+    EXPECT_LT(distance, 0.05 * diameter) << "model " << m;
+
+    poseError(multiResults[m][0]->pose, poses[m], angle, distance);
+    EXPECT_LT(angle, 10 * CV_PI / 180) << "model " << m;
+    EXPECT_LT(distance, 0.05 * diameter) << "model " << m;
+  }
+}
+
+}} // namespace
@@ -1257,8 +1257,40 @@ public:
     int desc_npca;       //!<  non-compressed descriptors of TrackerKCF::MODE
   };
 
+  /** @brief Features of a frame shared by a group of KCF trackers tracking in it.
+
+  The grayscale and color-names index maps are computed lazily, tile by tile, when a tracker of the group
+  reads a region of the frame for the first time, so the trackers never repeat the conversion of overlapping
+  areas. The half-size frame used by the trackers with TrackerKCF::Params::resize is shared the same way.
+  The trackers of the group may be updated concurrently.
+  */
+  class CV_EXPORTS FrameContext
+  {
+  public:
+    virtual ~FrameContext() {}
+
+    /** @brief Starts a new frame and drops the features of the previous one.
+    It must be called for every frame before updating the trackers of the group. The frame serves one
+    update of each tracker: a tracker updated again before the next call, for instance with a new frame
+    captured into the same buffer, computes its features by itself.
+    @param image the frame, the trackers must be updated with the same Mat
+    */
+    virtual void setFrame(InputArray image) = 0;
+
+    /** @brief Constructor
+    @param tileSize size of the square tiles the features are computed by
+    */
+    static Ptr<FrameContext> create(int tileSize = 64);
+  };
+
   virtual void setFeatureExtractor(void(*)(const Mat, const Rect, Mat&), bool pca_func = false) = 0;
 
+  /** @brief Makes the tracker read its features from a frame context shared with other trackers.
+  The context is used for the frames it was set to only, the tracker processes other frames by itself.
+  @param context the shared context, an empty pointer detaches the tracker
+  */
+  virtual void setFrameContext(const Ptr<FrameContext>& context) = 0;
+
   /** @brief Constructor
   @param parameters KCF parameters TrackerKCF::Params
   */
@@ -1382,6 +1414,20 @@ public:
   */
   CV_WRAP static Ptr<MultiTracker> create();
 
+  /**
+  * \brief Enables the parallel update mode, where every tracker is updated as a separate task.
+  * Trackers only share the read-only input image, so the results are the same as in the serial mode
+  * unless the tracker algorithm draws from the global rand() generator (e.g. TrackerBoosting).
+  * The mode is not copied along with the object.
+  * @param enable true to update the trackers concurrently, false (default) to update them one after another
+  */
+  CV_WRAP void setParallelUpdate(bool enable);
+
+  /**
+  * \brief Returns true if the parallel update mode is enabled
+  */
+  CV_WRAP bool getParallelUpdate() const;
+
 protected:
   //!<  storage for the tracker algorithms.
   std::vector< Ptr<Tracker> > trackerList;
@@ -1421,9 +1467,20 @@ public:
   @return True means that all targets were located and false means that tracker couldn't locate one of the targets in
   current frame. Note, that latter *does not* imply that tracker has failed, maybe target is indeed
   missing from the frame (say, out of sight)
+
+  The update stops at the first tracker which couldn't locate its target.
   */
   bool update(InputArray image);
 
+  /** @brief Update all trackers from the tracking-list, optionally one task per tracker
+  @param image The current frame
+  @param parallel Update the trackers concurrently, see MultiTracker::setParallelUpdate
+
+  @return The same as update(InputArray). The bounding boxes are also the same: in the parallel mode the trackers
+  after the first one which couldn't locate its target are updated too, but their bounding boxes are discarded.
+  */
+  bool update(InputArray image, bool parallel);
+
   /** @brief Current number of targets in tracking-list
   */
   int targetNum;
@@ -402,10 +402,12 @@ public:
 /// detections. The affinity equals to
 ///       appearance_affinity * motion_affinity * shape_affinity.
 /// Where appearance is 1 - distance(tracklet_fast_dscr, detection_fast_dscr).
-/// Second step is to solve the assignment problem using Kuhn-Munkres
-/// algorithm. If correspondence between some tracklet and detection is
-/// established with low confidence (affinity) then the strong descriptor is
-/// used to determine if there is correspondence between tracklet and detection.
+/// Second step is to solve the assignment problem with the Jonker-Volgenant
+/// shortest augmenting path algorithm, separately for each group of tracks and
+/// detections connected by non-zero affinities. If correspondence between some
+/// tracklet and detection is established with low confidence (affinity) then
+/// the strong descriptor is used to determine if there is correspondence
+/// between tracklet and detection.
 ///
 class CV_EXPORTS ITrackerByMatching {
 public:
@@ -0,0 +1,84 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+
+#include "perf_precomp.hpp"
+
+#include <atomic>
+
+namespace opencv_test { namespace {
+
+/** Standard allocator which counts the Mat buffers it allocates */
+class CountingAllocator : public MatAllocator
+{
+public:
+    CountingAllocator() : count(0) {}
+
+    UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                       AccessFlag flags, UMatUsageFlags usageFlags) const CV_OVERRIDE
+    {
+        if(!data)
+            count++;
+        // the buffers are released by the standard allocator, which owns them
+        return Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+    bool allocate(UMatData* u, AccessFlag accessFlags, UMatUsageFlags usageFlags) const CV_OVERRIDE
+    {
+        return Mat::getStdAllocator()->allocate(u, accessFlags, usageFlags);
+    }
+    void deallocate(UMatData* u) const CV_OVERRIDE
+    {
+        Mat::getStdAllocator()->deallocate(u);
+    }
+
+    mutable std::atomic<int> count;
+};
+
+typedef TestBaseWithParam<bool> Perf_TrackerCSRT;
+
+PERF_TEST_P_(Perf_TrackerCSRT, update)
+{
+    const bool segmentation = GetParam();
+    const Size size(640, 480);
+
+    Mat frames[2] = { texturedFrame(size, 0, 0), texturedFrame(size, 2, 1) };
+
+    TrackerCSRT::Params params;
+    params.use_segmentation = segmentation;
+    Ptr<TrackerCSRT> tracker = TrackerCSRT::create(params);
+    Rect2d box(280, 200, 80, 80);
+    ASSERT_TRUE(tracker->init(frames[0], box));
+
+    CountingAllocator allocator;
+    MatAllocator* defaultAllocator = Mat::getDefaultAllocator();
+    Mat::setDefaultAllocator(&allocator);
+
+    // the buffers are sized by the first frames
+    int k = 1;
+    tracker->update(frames[k++ % 2], box);
+    tracker->update(frames[k++ % 2], box);
+
+    allocator.count = 0;
+    int nFrames = 0;
+    while(next())
+    {
+        startTimer();
+        tracker->update(frames[k++ % 2], box);
+        stopTimer();
+        nFrames++;
+    }
+    Mat::setDefaultAllocator(defaultAllocator);
+
+    // steady-state allocations of Mat buffers, by the tracker and the functions it calls
+    const double allocationsPerFrame = nFrames > 0 ? (double)allocator.count/nFrames : 0.;
+    RecordProperty("mat_allocations_per_frame", cv::format("%.2f", allocationsPerFrame));
+
+    // the per-frame buffers are reused, including the patches when the scale of the target changes
+    EXPECT_LE(allocationsPerFrame, 4.);
+
+    SANITY_CHECK_NOTHING();
+}
+
+INSTANTIATE_TEST_CASE_P(/**/, Perf_TrackerCSRT, ::testing::Bool());
+
+}} // namespace
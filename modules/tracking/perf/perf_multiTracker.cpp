@@ -0,0 +1,47 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+
+#include "perf_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+typedef tuple<int, bool> MultiTrackerParams;
+typedef TestBaseWithParam<MultiTrackerParams> Perf_MultiTracker;
+
+PERF_TEST_P_(Perf_MultiTracker, update)
+{
+    const int nTargets = get<0>(GetParam());
+    const bool parallel = get<1>(GetParam());
+    const Size size(1280, 720);
+
+    Mat frames[2] = { texturedFrame(size, 0, 0), texturedFrame(size, 2, 1) };
+
+    // targets are placed on a regular grid
+    MultiTracker multiTracker;
+    multiTracker.setParallelUpdate(parallel);
+    const int cols = cvCeil(std::sqrt((double)nTargets));
+    const int rows = (nTargets + cols - 1)/cols;
+    const Size cell(size.width/(cols + 1), size.height/(rows + 1));
+    for(int i = 0; i < nTargets; i++)
+    {
+        Rect2d box((i % cols + 1)*cell.width - 20, (i / cols + 1)*cell.height - 20, 40, 40);
+        ASSERT_TRUE(multiTracker.add(TrackerKCF::create(), frames[0], box));
+    }
+
+    int k = 1;
+    while(next())
+    {
+        startTimer();
+        multiTracker.update(frames[k++ % 2]);
+        stopTimer();
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+INSTANTIATE_TEST_CASE_P(/**/, Perf_MultiTracker,
+    ::testing::Combine(::testing::Values(1, 8, 32, 64),
+                       ::testing::Bool()));
+
+}} // namespace
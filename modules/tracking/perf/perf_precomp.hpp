@@ -6,6 +6,7 @@
 
 #include "opencv2/ts.hpp"
 #include <opencv2/tracking.hpp>
+#include "../test/test_common.hpp"
 
 namespace opencv_test {
 using namespace perf;
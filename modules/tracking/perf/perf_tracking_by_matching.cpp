@@ -0,0 +1,69 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+
+#include "perf_precomp.hpp"
+#include "opencv2/tracking/tracking_by_matching.hpp"
+
+namespace opencv_test { namespace {
+
+using namespace cv::tbm;
+
+/** Grid of textured people shifted by frameIdx*(2, 1) pixels */
+static void crowdFrame(const std::vector<Mat>& textures, const std::vector<Point>& origins,
+                       int frameIdx, Mat& frame, TrackedObjects& detections)
+{
+    frame.setTo(Scalar::all(0));
+    detections.clear();
+    for(size_t i = 0; i < textures.size(); i++)
+    {
+        Rect rect(origins[i] + Point(2, 1)*frameIdx, textures[i].size());
+        textures[i].copyTo(frame(rect));
+        detections.emplace_back(rect, 1.f, frameIdx, -1);
+    }
+}
+
+typedef TestBaseWithParam<int> Perf_TrackingByMatching;
+
+PERF_TEST_P_(Perf_TrackingByMatching, process)
+{
+    const int nPeople = GetParam();
+    const Size size(1920, 1080), personSize(24, 48);
+    const int cols = 40;
+
+    std::vector<Mat> textures(nPeople);
+    std::vector<Point> origins(nPeople);
+    RNG rng(0);
+    for(int i = 0; i < nPeople; i++)
+    {
+        textures[i].create(personSize, CV_8UC3);
+        rng.fill(textures[i], RNG::UNIFORM, 0, 255);
+        origins[i] = Point(20 + (i % cols)*44, 20 + (i / cols)*60);
+    }
+
+    Ptr<ITrackerByMatching> tracker = createTrackerByMatching();
+    tracker->setDescriptorFast(std::make_shared<ResizedImageDescriptor>(Size(16, 32), INTER_LINEAR));
+    tracker->setDistanceFast(std::make_shared<MatchTemplateDistance>());
+
+    Mat frame(size, CV_8UC3);
+    TrackedObjects detections;
+    crowdFrame(textures, origins, 0, frame, detections);
+    tracker->process(frame, detections, 0);
+
+    // the crowd goes back and forth, so that it stays in the frame
+    int k = 1;
+    while(next())
+    {
+        crowdFrame(textures, origins, k % 2, frame, detections);
+        startTimer();
+        tracker->process(frame, detections, static_cast<uint64_t>(k*40));
+        stopTimer();
+        k++;
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+INSTANTIATE_TEST_CASE_P(/**/, Perf_TrackingByMatching, ::testing::Values(100, 400));
+
+}} // namespace
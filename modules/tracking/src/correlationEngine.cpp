@@ -0,0 +1,266 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+
+#include "precomp.hpp"
+#include "correlationEngine.hpp"
+#include "opencv2/core/hal/intrin.hpp"
+
+namespace cv {
+namespace tracking {
+
+void CorrelationEngine::transform(const Mat& _src, Mat& dst, bool inverse, bool rows)
+{
+    // keeps the input alive when dst is the same Mat
+    Mat src = _src;
+    CV_Assert(src.type() == (inverse ? CV_32FC2 : CV_32FC1));
+    dst.create(src.size(), inverse ? CV_32FC1 : CV_32FC2);
+
+    // the same flags as cv::dft passes to the HAL
+    int flags = inverse ? CV_HAL_DFT_INVERSE | CV_HAL_DFT_SCALE : 0;
+    if(rows)
+        flags |= CV_HAL_DFT_ROWS;
+    if(src.isContinuous() && dst.isContinuous())
+        flags |= CV_HAL_DFT_IS_CONTINUOUS;
+    if(src.data == dst.data)
+        flags |= CV_HAL_DFT_IS_INPLACE;
+
+    Ptr<hal::DFT2D> dft;
+    for(size_t i = 0; i < plans.size(); i++)
+    {
+        if(plans[i].size == src.size() && plans[i].flags == flags)
+        {
+            dft = plans[i].dft;
+            break;
+        }
+    }
+    if(!dft)
+    {
+        dft = hal::DFT2D::create(src.cols, src.rows, CV_32F, src.channels(), dst.channels(), flags);
+        Plan plan = { src.size(), flags, dft };
+        plans.push_back(plan);
+    }
+    dft->apply(src.data, src.step, dst.data, dst.step);
+}
+
+void CorrelationEngine::fft(const Mat& src, Mat& dst)
+{
+    if(src.depth() == CV_32F)
+    {
+        transform(src, dst, false);
+        return;
+    }
+    src.convertTo(layer, CV_32F);
+    transform(layer, dst, false);
+}
+
+void CorrelationEngine::fft(const Mat& src, std::vector<Mat>& dst)
+{
+    const int cn = src.channels();
+    dst.resize(cn);
+    if(cn == 1)
+    {
+        fft(src, dst[0]);
+        return;
+    }
+    for(int c = 0; c < cn; c++)
+    {
+        extractChannel(src, layer, c);
+        if(layer.depth() != CV_32F)
+            layer.convertTo(layer, CV_32F);
+        transform(layer, dst[c], false);
+    }
+}
+
+void CorrelationEngine::fft(const std::vector<Mat>& src, std::vector<Mat>& dst)
+{
+    dst.resize(src.size());
+    for(size_t i = 0; i < src.size(); i++)
+    {
+        CV_Assert(src[i].channels() == 1 && src[i].size() == src[0].size());
+        fft(src[i], dst[i]);
+    }
+}
+
+void CorrelationEngine::fftRows(const Mat& src, Mat& dst)
+{
+    if(src.depth() == CV_32F)
+    {
+        transform(src, dst, false, true);
+        return;
+    }
+    src.convertTo(layer, CV_32F);
+    transform(layer, dst, false, true);
+}
+
+void CorrelationEngine::ifft(const Mat& src, Mat& dst)
+{
+    transform(src, dst, true);
+}
+
+/** Complex products of n elements of a and b, written or added to dst */
+template<bool conjB, bool accumulate>
+static void complexMulRow(const float* a, const float* b, float* dst, int n, float scale)
+{
+    int j = 0;
+#if CV_SIMD
+    const int nlanes = v_float32::nlanes;
+    const v_float32 vscale = vx_setall_f32(scale);
+    for(; j <= n - nlanes; j += nlanes)
+    {
+        v_float32 ar, ai, br, bi;
+        v_load_deinterleave(a + 2*j, ar, ai);
+        v_load_deinterleave(b + 2*j, br, bi);
+        v_float32 re = conjB ? v_muladd(ar, br, ai*bi) : ar*br - ai*bi;
+        v_float32 im = conjB ? ai*br - ar*bi : v_muladd(ai, br, ar*bi);
+        re = re*vscale;
+        im = im*vscale;
+        if(accumulate)
+        {
+            v_float32 dr, di;
+            v_load_deinterleave(dst + 2*j, dr, di);
+            re = dr + re;
+            im = di + im;
+        }
+        v_store_interleave(dst + 2*j, re, im);
+    }
+#endif
+    for(; j < n; j++)
+    {
+        float ar = a[2*j], ai = a[2*j + 1], br = b[2*j], bi = b[2*j + 1];
+        float re = (conjB ? ar*br + ai*bi : ar*br - ai*bi)*scale;
+        float im = (conjB ? ai*br - ar*bi : ai*br + ar*bi)*scale;
+        if(accumulate)
+        {
+            re += dst[2*j];
+            im += dst[2*j + 1];
+        }
+        dst[2*j] = re;
+        dst[2*j + 1] = im;
+    }
+}
+
+/** Rows of spectra of the same size, merged into a single row when they are continuous */
+static inline Size spectrumRows(const Mat& a, const Mat& b, const Mat& dst)
+{
+    Size size = a.size();
+    if(a.isContinuous() && b.isContinuous() && dst.isContinuous())
+    {
+        size.width *= size.height;
+        size.height = 1;
+    }
+    return size;
+}
+
+void complexMul(const Mat& a, const Mat& b, Mat& dst, bool conjB)
+{
+    CV_Assert(a.type() == CV_32FC2 && b.type() == CV_32FC2 && a.size() == b.size());
+    Mat A = a, B = b;
+    dst.create(A.size(), CV_32FC2);
+
+    Size size = spectrumRows(A, B, dst);
+    for(int y = 0; y < size.height; y++)
+    {
+        const float* pa = A.ptr<float>(y);
+        const float* pb = B.ptr<float>(y);
+        float* pd = dst.ptr<float>(y);
+        if(conjB)
+            complexMulRow<true, false>(pa, pb, pd, size.width, 1.f);
+        else
+            complexMulRow<false, false>(pa, pb, pd, size.width, 1.f);
+    }
+#if CV_SIMD
+    vx_cleanup();
+#endif
+}
+
+void complexMulSum(const std::vector<Mat>& a, const std::vector<Mat>& b, Mat& dst, bool conjB,
+                   const std::vector<float>& weights)
+{
+    CV_Assert(!a.empty() && a.size() == b.size());
+    CV_Assert(weights.empty() || weights.size() == a.size());
+    for(size_t i = 0; i < a.size(); i++)
+    {
+        CV_Assert(a[i].type() == CV_32FC2 && b[i].type() == CV_32FC2);
+        CV_Assert(a[i].size() == a[0].size() && b[i].size() == a[0].size());
+    }
+    dst.create(a[0].size(), CV_32FC2);
+
+    bool continuous = dst.isContinuous();
+    for(size_t i = 0; i < a.size(); i++)
+        continuous = continuous && a[i].isContinuous() && b[i].isContinuous();
+    Size size = a[0].size();
+    if(continuous)
+    {
+        size.width *= size.height;
+        size.height = 1;
+    }
+
+    // the channels are summed row by row, so the row of dst stays in the cache
+    for(int y = 0; y < size.height; y++)
+    {
+        float* pd = dst.ptr<float>(y);
+        for(size_t i = 0; i < a.size(); i++)
+        {
+            const float* pa = a[i].ptr<float>(y);
+            const float* pb = b[i].ptr<float>(y);
+            const float w = weights.empty() ? 1.f : weights[i];
+            if(conjB && i == 0)
+                complexMulRow<true, false>(pa, pb, pd, size.width, w);
+            else if(conjB)
+                complexMulRow<true, true>(pa, pb, pd, size.width, w);
+            else if(i == 0)
+                complexMulRow<false, false>(pa, pb, pd, size.width, w);
+            else
+                complexMulRow<false, true>(pa, pb, pd, size.width, w);
+        }
+    }
+#if CV_SIMD
+    vx_cleanup();
+#endif
+}
+
+void complexDiv(const Mat& a, const Mat& b, Mat& dst, bool conjResult)
+{
+    CV_Assert(a.type() == CV_32FC2 && b.type() == CV_32FC2 && a.size() == b.size());
+    Mat A = a, B = b;
+    dst.create(A.size(), CV_32FC2);
+
+    // (a+bi)/(c+di) = [(ac+bd) + i(bc-ad)]/(c^2+d^2)
+    const float sign = conjResult ? -1.f : 1.f;
+    Size size = spectrumRows(A, B, dst);
+    for(int y = 0; y < size.height; y++)
+    {
+        const float* pa = A.ptr<float>(y);
+        const float* pb = B.ptr<float>(y);
+        float* pd = dst.ptr<float>(y);
+        int j = 0;
+#if CV_SIMD
+        const int nlanes = v_float32::nlanes;
+        const v_float32 vsign = vx_setall_f32(sign);
+        for(; j <= size.width - nlanes; j += nlanes)
+        {
+            v_float32 ar, ai, br, bi;
+            v_load_deinterleave(pa + 2*j, ar, ai);
+            v_load_deinterleave(pb + 2*j, br, bi);
+            v_float32 den = v_muladd(br, br, bi*bi);
+            v_float32 re = v_muladd(ar, br, ai*bi)/den;
+            v_float32 im = vsign*(ai*br - ar*bi)/den;
+            v_store_interleave(pd + 2*j, re, im);
+        }
+#endif
+        for(; j < size.width; j++)
+        {
+            float ar = pa[2*j], ai = pa[2*j + 1], br = pb[2*j], bi = pb[2*j + 1];
+            float den = br*br + bi*bi;
+            pd[2*j] = (ar*br + ai*bi)/den;
+            pd[2*j + 1] = sign*(ai*br - ar*bi)/den;
+        }
+    }
+#if CV_SIMD
+    vx_cleanup();
+#endif
+}
+
+} /* namespace tracking */
+} /* namespace cv */
@@ -0,0 +1,62 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+
+#ifndef OPENCV_TRACKER_CORRELATION_ENGINE
+#define OPENCV_TRACKER_CORRELATION_ENGINE
+
+#include "opencv2/core.hpp"
+#include "opencv2/core/hal/hal.hpp"
+#include <vector>
+
+namespace cv {
+namespace tracking {
+
+/** @brief DFTs of the fixed-size patches of the correlation filter trackers (KCF, MOSSE, CSRT).
+
+A DFT plan is created on the first transform of a given size and layout and reused by the following
+ones, which spares the twiddle factors and buffers set up by every cv::dft call. All the transforms
+work on full complex spectra (CV_32FC2), the same as cv::dft with DFT_COMPLEX_OUTPUT.
+An engine is not thread-safe, parallel tasks should use an engine each.
+*/
+class CorrelationEngine
+{
+public:
+    /** Spectrum of a real single-channel image */
+    void fft(const Mat& src, Mat& dst);
+    /** Spectra of every channel of a real image */
+    void fft(const Mat& src, std::vector<Mat>& dst);
+    /** Spectra of a batch of real single-channel images of the same size */
+    void fft(const std::vector<Mat>& src, std::vector<Mat>& dst);
+    /** Spectra of the rows of a real single-channel image, the same as dft with DFT_ROWS | DFT_COMPLEX_OUTPUT */
+    void fftRows(const Mat& src, Mat& dst);
+    /** Scaled real inverse of a spectrum, the same as idft with DFT_SCALE | DFT_REAL_OUTPUT */
+    void ifft(const Mat& src, Mat& dst);
+
+private:
+    void transform(const Mat& src, Mat& dst, bool inverse, bool rows = false);
+
+    struct Plan
+    {
+        Size size;
+        int flags;
+        Ptr<hal::DFT2D> dft;
+    };
+    std::vector<Plan> plans;
+    Mat layer; // continuous single-precision copy of an input channel
+};
+
+/** dst = a*b, or a*conj(b), element-wise for spectra */
+void complexMul(const Mat& a, const Mat& b, Mat& dst, bool conjB = false);
+
+/** dst = sum of weights[i]*a[i]*b[i], or a[i]*conj(b[i]), without weighting if weights are empty */
+void complexMulSum(const std::vector<Mat>& a, const std::vector<Mat>& b, Mat& dst, bool conjB = false,
+                   const std::vector<float>& weights = std::vector<float>());
+
+/** dst = a/b, or conj(a/b), element-wise for spectra */
+void complexDiv(const Mat& a, const Mat& b, Mat& dst, bool conjResult = false);
+
+} /* namespace tracking */
+} /* namespace cv */
+
+#endif
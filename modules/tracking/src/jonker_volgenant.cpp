@@ -0,0 +1,190 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+
+#include "jonker_volgenant.hpp"
+#include "opencv2/core/utility.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace {
+
+// Rows and columns connected by the entries.
+struct Component {
+    std::vector<size_t> rows;
+    std::vector<size_t> cols;
+    cv::Mat dissimilarity;
+    std::vector<size_t> res;
+};
+
+size_t FindRoot(std::vector<size_t> &parent, size_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+}  // anonymous namespace
+
+std::vector<size_t> JonkerVolgenant::Solve(const cv::Mat& dissimilarity_matrix) {
+    CV_Assert(dissimilarity_matrix.type() == CV_32F);
+    CV_Assert(cv::checkRange(dissimilarity_matrix));
+
+    std::vector<size_t> results(static_cast<size_t>(dissimilarity_matrix.rows),
+                                static_cast<size_t>(-1));
+    if (dissimilarity_matrix.empty()) {
+        return results;
+    }
+
+    // Every row is assigned, so the rows have to be the smaller dimension.
+    const bool transposed = dissimilarity_matrix.rows > dissimilarity_matrix.cols;
+    const cv::Mat cost = transposed ? cv::Mat(dissimilarity_matrix.t())
+                                    : dissimilarity_matrix;
+
+    Run(cost);
+
+    for (int j = 1; j <= cost.cols; j++) {
+        if (p_[j] == 0) continue;
+        if (transposed) {
+            results[j - 1] = static_cast<size_t>(p_[j] - 1);
+        } else {
+            results[p_[j] - 1] = static_cast<size_t>(j - 1);
+        }
+    }
+    return results;
+}
+
+void JonkerVolgenant::Run(const cv::Mat &cost) {
+    const int n = cost.rows;
+    const int m = cost.cols;
+    const double inf = std::numeric_limits<double>::infinity();
+
+    // Row and column potentials and the column assignment are 1-based,
+    // the column 0 is the virtual start of the augmenting paths.
+    u_.assign(n + 1, 0.0);
+    v_.assign(m + 1, 0.0);
+    p_.assign(m + 1, 0);
+    way_.assign(m + 1, 0);
+
+    for (int i = 1; i <= n; i++) {
+        p_[0] = i;
+        int j0 = 0;
+        min_v_.assign(m + 1, inf);
+        used_.assign(m + 1, 0);
+
+        // Dijkstra search of the shortest augmenting path from row i
+        // in reduced costs.
+        do {
+            used_[j0] = 1;
+            const int i0 = p_[j0];
+            const float* row = cost.ptr<float>(i0 - 1);
+            double delta = inf;
+            int j1 = 0;
+            for (int j = 1; j <= m; j++) {
+                if (used_[j]) continue;
+                const double cur = row[j - 1] - u_[i0] - v_[j];
+                if (cur < min_v_[j]) {
+                    min_v_[j] = cur;
+                    way_[j] = j0;
+                }
+                if (min_v_[j] < delta) {
+                    delta = min_v_[j];
+                    j1 = j;
+                }
+            }
+            for (int j = 0; j <= m; j++) {
+                if (used_[j]) {
+                    u_[p_[j]] += delta;
+                    v_[j] -= delta;
+                } else {
+                    min_v_[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p_[j0] != 0);
+
+        // Augments the matching along the found path.
+        do {
+            const int j1 = way_[j0];
+            p_[j0] = p_[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+}
+
+std::vector<size_t> JonkerVolgenant::SolveSparse(size_t rows, size_t cols,
+                                                 const std::vector<Entry> &entries) {
+    // The graph is split into connected components. Nodes are the rows
+    // followed by the columns.
+    std::vector<size_t> parent(rows + cols);
+    std::vector<char> has_entries(parent.size(), 0);
+    for (size_t i = 0; i < parent.size(); i++) {
+        parent[i] = i;
+    }
+    for (const auto &entry : entries) {
+        CV_DbgAssert(entry.row < rows && entry.col < cols);
+        has_entries[entry.row] = has_entries[rows + entry.col] = 1;
+        size_t a = FindRoot(parent, entry.row);
+        size_t b = FindRoot(parent, rows + entry.col);
+        if (a != b) parent[std::max(a, b)] = std::min(a, b);
+    }
+
+    std::vector<int> component_idx(parent.size(), -1);
+    std::vector<Component> components;
+    for (size_t i = 0; i < parent.size(); i++) {
+        if (!has_entries[i]) continue;
+        size_t root = FindRoot(parent, i);
+        if (component_idx[root] < 0) {
+            component_idx[root] = static_cast<int>(components.size());
+            components.emplace_back();
+        }
+        int c = component_idx[root];
+        component_idx[i] = c;
+        if (i < rows) {
+            components[c].rows.push_back(i);
+        } else {
+            components[c].cols.push_back(i - rows);
+        }
+    }
+    for (auto &component : components) {
+        component.dissimilarity = cv::Mat(
+            static_cast<int>(component.rows.size()),
+            static_cast<int>(component.cols.size()), CV_32F, cv::Scalar(1));
+    }
+    {
+        // Positions of the rows and the columns in their components.
+        std::vector<int> local_idx(parent.size());
+        for (const auto &component : components) {
+            for (size_t k = 0; k < component.rows.size(); k++)
+                local_idx[component.rows[k]] = static_cast<int>(k);
+            for (size_t k = 0; k < component.cols.size(); k++)
+                local_idx[rows + component.cols[k]] = static_cast<int>(k);
+        }
+        for (const auto &entry : entries) {
+            auto &component = components[component_idx[entry.row]];
+            component.dissimilarity.at<float>(local_idx[entry.row],
+                                              local_idx[rows + entry.col]) =
+                entry.dissimilarity;
+        }
+    }
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(components.size())),
+                      [&](const cv::Range &range) {
+        JonkerVolgenant solver;
+        for (int c = range.start; c < range.end; c++) {
+            components[c].res = solver.Solve(components[c].dissimilarity);
+        }
+    });
+
+    std::vector<size_t> results(rows, static_cast<size_t>(-1));
+    for (const auto &component : components) {
+        for (size_t k = 0; k < component.rows.size(); k++) {
+            if (component.res[k] >= component.cols.size()) continue;
+            results[component.rows[k]] = component.cols[component.res[k]];
+        }
+    }
+    return results;
+}
@@ -0,0 +1,68 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+
+#ifndef __OPENCV_TRACKING_JONKER_VOLGENANT_HPP__
+#define __OPENCV_TRACKING_JONKER_VOLGENANT_HPP__
+
+#include "opencv2/core.hpp"
+
+#include <vector>
+
+
+///
+/// \brief The JonkerVolgenant class
+///
+/// Solves the rectangular assignment problem with the shortest augmenting
+/// path method (Jonker-Volgenant) in O(n^2 * m) for n <= m, where n and m
+/// are the smaller and the larger dimension of the matrix.
+///
+class CV_EXPORTS JonkerVolgenant {
+public:
+    ///
+    /// \brief Entry of a sparse dissimilarity matrix.
+    ///
+    struct Entry {
+        size_t row;
+        size_t col;
+        float dissimilarity;
+    };
+
+    ///
+    /// \brief Solves the assignment problem for given dissimilarity matrix.
+    /// It returns a vector that where each element is a column index for
+    /// corresponding row (e.g. result[0] stores optimal column index for very
+    /// first row in the dissimilarity matrix).
+    /// \param dissimilarity_matrix CV_32F dissimilarity matrix.
+    /// \return Optimal column index for each row. -1 means that there is no
+    /// column for row.
+    ///
+    std::vector<size_t> Solve(const cv::Mat &dissimilarity_matrix);
+
+    ///
+    /// \brief Solves the assignment problem for a sparse dissimilarity
+    /// matrix in [0, 1] whose missing entries are 1. The rows and columns
+    /// connected by the entries form components which are solved separately
+    /// and in parallel. The rows and columns left unassigned can be paired
+    /// arbitrarily at the cost of 1 per pair, which gives the optimal cost
+    /// of the whole matrix.
+    /// \param rows Number of rows of the matrix.
+    /// \param cols Number of columns of the matrix.
+    /// \param entries Entries of the matrix, at most one per row and column pair.
+    /// \return Column index for each row assigned inside its component.
+    /// -1 means that there is no column for row.
+    ///
+    static std::vector<size_t> SolveSparse(size_t rows, size_t cols,
+                                           const std::vector<Entry> &entries);
+
+private:
+    std::vector<double> u_;
+    std::vector<double> v_;
+    std::vector<double> min_v_;
+    std::vector<int> p_;
+    std::vector<int> way_;
+    std::vector<char> used_;
+
+    void Run(const cv::Mat &cost);
+};
+#endif // #ifndef __OPENCV_TRACKING_JONKER_VOLGENANT_HPP__
@@ -14,6 +14,7 @@
 //
 
 #include "opencv2/tracking.hpp"
+#include "correlationEngine.hpp"
 
 namespace cv {
 namespace tracking {
@@ -40,34 +41,15 @@ protected:
     Mat G;          //goal
     Mat H, A, B;    //state
 
-    //  Element-wise division of complex numbers in src1 and src2
+    // DFT plans of the patch size, filled by correlate() too
+    mutable CorrelationEngine correlation;
+
+    //  Element-wise division of complex numbers in src1 and src2, conjugated
+    //  (B is real, this is the conj(A/B) filter correlate() multiplies by)
     Mat divDFTs( const Mat &src1, const Mat &src2 ) const
     {
-        Mat c1[2],c2[2],a1,a2,s1,s2,denom,re,im;
-
-        // split into re and im per src
-        cv::split(src1, c1);
-        cv::split(src2, c2);
-
-        // (Re2*Re2 + Im2*Im2) = denom
-        //   denom is same for both channels
-        cv::multiply(c2[0], c2[0], s1);
-        cv::multiply(c2[1], c2[1], s2);
-        cv::add(s1, s2, denom);
-
-        // (Re1*Re2 + Im1*Im1)/(Re2*Re2 + Im2*Im2) = Re
-        cv::multiply(c1[0], c2[0], a1);
-        cv::multiply(c1[1], c2[1], a2);
-        cv::divide(a1+a2, denom, re, 1.0 );
-
-        // (Im1*Re2 - Re1*Im2)/(Re2*Re2 + Im2*Im2) = Im
-        cv::multiply(c1[1], c2[0], a1);
-        cv::multiply(c1[0], c2[1], a2);
-        cv::divide(a1+a2, denom, im, -1.0);
-
-        // Merge Re and Im back into a complex matrix
-        Mat dst, chn[] = {re,im};
-        cv::merge(chn, 2, dst);
+        Mat dst;
+        complexDiv(src1, src2, dst, true);
         return dst;
     }
 
@@ -91,9 +73,9 @@ protected:
     {
         Mat IMAGE_SUB, RESPONSE, response;
         // filter in dft space
-        dft(image_sub, IMAGE_SUB, DFT_COMPLEX_OUTPUT);
-        mulSpectrums(IMAGE_SUB, H, RESPONSE, 0, true );
-        idft(RESPONSE, response, DFT_SCALE|DFT_REAL_OUTPUT);
+        correlation.fft(image_sub, IMAGE_SUB);
+        complexMul(IMAGE_SUB, H, RESPONSE, true);
+        correlation.ifft(RESPONSE, response);
         // update center position
         double maxVal; Point maxLoc;
         minMaxLoc(response, 0, &maxVal, 0, &maxLoc);
@@ -162,7 +144,7 @@ protected:
         double maxVal;
         minMaxLoc(g, 0, &maxVal);
         g = g / maxVal;
-        dft(g, G, DFT_COMPLEX_OUTPUT);
+        correlation.fft(g, G);
 
         // initial A,B and H
         A = Mat::zeros(G.size(), G.type());
@@ -173,9 +155,9 @@ protected:
             preProcess(window_warp);
 
             Mat WINDOW_WARP, A_i, B_i;
-            dft(window_warp, WINDOW_WARP, DFT_COMPLEX_OUTPUT);
-            mulSpectrums(G          , WINDOW_WARP, A_i, 0, true);
-            mulSpectrums(WINDOW_WARP, WINDOW_WARP, B_i, 0, true);
+            correlation.fft(window_warp, WINDOW_WARP);
+            complexMul(G          , WINDOW_WARP, A_i, true);
+            complexMul(WINDOW_WARP, WINDOW_WARP, B_i, true);
             A+=A_i;
             B+=B_i;
         }
@@ -212,9 +194,9 @@ protected:
 
         // new state for A and B
         Mat F, A_new, B_new;
-        dft(img_sub_new, F, DFT_COMPLEX_OUTPUT);
-        mulSpectrums(G, F, A_new, 0, true );
-        mulSpectrums(F, F, B_new, 0, true );
+        correlation.fft(img_sub_new, F);
+        complexMul(G, F, A_new, true);
+        complexMul(F, F, B_new, true);
 
         // update A ,B, and H
         A = A*(1-rate) + A_new*rate;
@@ -75,10 +75,38 @@ namespace cv
 
     bool MultiTracker_Alt::update(InputArray image)
 	{
-		for (int i = 0; i < (int)trackers.size(); i++)
-			if (!trackers[i]->update(image, boundingBoxes[i]))
-				return false;
+		return update(image, false);
+	}
+
+    bool MultiTracker_Alt::update(InputArray image, bool parallel)
+	{
+		const int n = (int)trackers.size();
+		if (!parallel || n < 2)
+		{
+			for (int i = 0; i < n; i++)
+				if (!trackers[i]->update(image, boundingBoxes[i]))
+					return false;
+
+			return true;
+		}
+
+		//One task per tracker, each one writes its own bounding box only
+		Mat frame = image.getMat();
+		std::vector<Rect2d> boxes(boundingBoxes);
+		std::vector<uchar> statuses(n);
+		parallel_for_(Range(0, n), [&](const Range& range)
+		{
+			for (int i = range.start; i < range.end; i++)
+				statuses[i] = trackers[i]->update(frame, boxes[i]);
+		}, n);
 
+		//Keep the boxes the serial update would give, up to the first lost target
+		for (int i = 0; i < n; i++)
+		{
+			boundingBoxes[i] = boxes[i];
+			if (!statuses[i])
+				return false;
+		}
 		return true;
 	}
 
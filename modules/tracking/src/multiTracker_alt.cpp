@@ -40,14 +40,32 @@
  //M*/
 
 #include "precomp.hpp"
+#include <set>
 
 namespace cv {
 
+  // objects in the parallel update mode, the flag is kept out of the class
+  // so its layout stays the same
+  static Mutex& getParallelUpdateMutex()
+  {
+      static Mutex mutex;
+      return mutex;
+  }
+
+  static std::set<const MultiTracker*>& getParallelUpdateTrackers()
+  {
+      static std::set<const MultiTracker*> trackers;
+      return trackers;
+  }
+
   // constructor
-  MultiTracker::MultiTracker(){};
+  MultiTracker::MultiTracker() {};
 
   // destructor
-  MultiTracker::~MultiTracker(){};
+  MultiTracker::~MultiTracker()
+  {
+      setParallelUpdate(false);
+  };
 
   // add a new tracked object
   bool MultiTracker::add( Ptr<Tracker> newTracker, InputArray image, const Rect2d& boundingBox )
@@ -80,9 +98,29 @@ namespace cv {
   // update position of the tracked objects, the result is stored in internal storage
   bool MultiTracker::update(InputArray image)
   {
+    const int n = (int)trackerList.size();
+    if( !getParallelUpdate() || n < 2 )
+    {
+      bool status = true;
+      for(int i=0;i< n; i++){
+        status &= trackerList[i]->update(image, objects[i]);
+      }
+      return status;
+    }
+
+    // one stripe per tracker lets the backend hand the slow trackers out to idle workers,
+    // each task only writes its own bounding box and status
+    Mat frame = image.getMat();
+    std::vector<uchar> statuses(n);
+    parallel_for_(Range(0, n), [&](const Range& range)
+    {
+      for( int i = range.start; i < range.end; i++ )
+        statuses[i] = trackerList[i]->update(frame, objects[i]);
+    }, n);
+
     bool status = true;
-    for(unsigned i=0;i< trackerList.size(); i++){
-      status &= trackerList[i]->update(image, objects[i]);
+    for(int i=0;i< n; i++){
+      status &= statuses[i] != 0;
     }
     return status;
   };
@@ -105,4 +143,19 @@ namespace cv {
       return makePtr<MultiTracker>();
   }
 
+  void MultiTracker::setParallelUpdate(bool enable)
+  {
+      AutoLock lock(getParallelUpdateMutex());
+      if( enable )
+          getParallelUpdateTrackers().insert(this);
+      else
+          getParallelUpdateTrackers().erase(this);
+  }
+
+  bool MultiTracker::getParallelUpdate() const
+  {
+      AutoLock lock(getParallelUpdateMutex());
+      return getParallelUpdateTrackers().count(this) != 0;
+  }
+
 } /* namespace cv */
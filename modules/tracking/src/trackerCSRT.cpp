@@ -7,6 +7,7 @@
 #include "trackerCSRTSegmentation.hpp"
 #include "trackerCSRTUtils.hpp"
 #include "trackerCSRTScaleEstimation.hpp"
+#include "correlationEngine.hpp"
 
 namespace cv
 {
@@ -24,6 +25,15 @@ protected:
 };
 
 
+/** Buffers of the filter optimization of one channel, reused from frame to frame */
+struct CSRFilterWorkspace
+{
+    tracking::CorrelationEngine correlation;
+    Mat Sxy, Sxx, den, num;
+    Mat H, G, L;    // spectra of the filter, of its constrained estimate and of the Lagrangian multiplier
+    Mat h, Plm;     // spatial filter and scaled mask
+};
+
 class TrackerCSRTImpl : public TrackerCSRT
 {
 public:
@@ -38,16 +48,18 @@ protected:
     virtual void setInitialMask(InputArray mask) CV_OVERRIDE;
     bool updateImpl(const Mat& image, Rect2d& boundingBox) CV_OVERRIDE;
     void update_csr_filter(const Mat &image, const Mat &my_mask);
-    void update_histograms(const Mat &image, const Rect &region);
-    void extract_histograms(const Mat &image, cv::Rect region, Histogram &hf, Histogram &hb);
-    std::vector<Mat> create_csr_filter(const std::vector<cv::Mat>
-            img_features, const cv::Mat Y, const cv::Mat P);
-    Mat calculate_response(const Mat &image, const std::vector<Mat> filter);
-    Mat get_location_prior(const Rect roi, const Size2f target_size, const Size img_sz);
-    Mat segment_region(const Mat &image, const Point2f &object_center,
-            const Size2f &template_size, const Size &target_size, float scale_factor);
+    void update_histograms(std::vector<Mat> &img_channels, const Rect &region);
+    void extract_histograms(std::vector<Mat> &img_channels, cv::Rect region, Histogram &hf, Histogram &hb);
+    void create_csr_filter(const std::vector<cv::Mat> &img_features, const cv::Mat &Y,
+            const cv::Mat &P, std::vector<Mat> &filter);
+    Mat calculate_response(const Mat &image, const std::vector<Mat> &filter);
+    void get_location_prior(const Rect roi, const Size2f target_size, const Size img_sz,
+            Mat &fg_prior);
+    void segment_region(const Mat &image, const Point2f &object_center,
+            const Size2f &template_size, const Size &target_size, float scale_factor, Mat &mask);
+    void set_filter_mask(const Mat &mask);
     Point2f estimate_new_position(const Mat &image);
-    std::vector<Mat> get_features(const Mat &patch, const Size2i &feature_size);
+    void get_features(const Mat &patch, const Size2i &feature_size, std::vector<Mat> &features);
 
 private:
     bool check_mask_area(const Mat &mat, const double obj_area);
@@ -73,6 +85,31 @@ private:
     Mat default_mask;
     float default_mask_area;
     int cell_size;
+    tracking::CorrelationEngine correlation;
+
+    // per-frame buffers, sized by the init and reused by the updates
+    struct Workspace
+    {
+        Mat color;                          // gray frames converted to BGR
+        Mat patch, patch_storage, resized_patch;
+        FeatureBuffers buffers;
+        std::vector<Mat> hog, cn, rgb;
+        Mat gray, gray_resized, gray_feature;
+        std::vector<Mat> features, Ffeatures;
+        std::vector<Mat> filter;            // filter learnt on the current frame
+        std::vector<float> filter_weights;  // channel weights of the current frame
+        Mat channel_response_spectrum, channel_response;
+        Mat response_spectrum, response;
+        Mat hsv;
+        std::vector<Mat> hsv_channels;
+        Mat segmentation_patch, segmentation_patch_storage;
+        std::vector<Mat> segmentation_channels;
+        Mat kernel_weight, fg_prior, bg_prior;
+        Mat mask64, mask, mask_resized, mask_dilated;
+        Histogram hf, hb;                   // histograms of the current frame
+        SegmentationWorkspace segmentation;
+        std::vector<CSRFilterWorkspace> channels;
+    } ws;
 };
 
 Ptr<TrackerCSRT> TrackerCSRT::create(const TrackerCSRT::Params &parameters)
@@ -114,55 +151,44 @@ bool TrackerCSRTImpl::check_mask_area(const Mat &mat, const double obj_area)
     return true;
 }
 
-Mat TrackerCSRTImpl::calculate_response(const Mat &image, const std::vector<Mat> filter)
+Mat TrackerCSRTImpl::calculate_response(const Mat &image, const std::vector<Mat> &filter)
 {
-    Mat patch = get_subwindow(image, object_center, cvFloor(current_scale_factor * template_size.width),
-        cvFloor(current_scale_factor * template_size.height));
-    resize(patch, patch, rescaled_template_size, 0, 0, INTER_CUBIC);
+    get_subwindow(image, object_center, cvFloor(current_scale_factor * template_size.width),
+        cvFloor(current_scale_factor * template_size.height), ws.patch, NULL, &ws.patch_storage);
+    resize(ws.patch, ws.resized_patch, rescaled_template_size, 0, 0, INTER_CUBIC);
 
-    std::vector<Mat> ftrs = get_features(patch, yf.size());
-    std::vector<Mat> Ffeatures = fourier_transform_features(ftrs);
-    Mat resp, res;
+    get_features(ws.resized_patch, yf.size(), ws.features);
+    correlation.fft(ws.features, ws.Ffeatures);
     if(params.use_channel_weights){
-        res = Mat::zeros(Ffeatures[0].size(), CV_32FC2);
-        Mat resp_ch;
-        Mat mul_mat;
-        for(size_t i = 0; i < Ffeatures.size(); ++i) {
-            mulSpectrums(Ffeatures[i], filter[i], resp_ch, 0, true);
-            res += (resp_ch * filter_weights[i]);
-        }
-        idft(res, res, DFT_SCALE | DFT_REAL_OUTPUT);
+        tracking::complexMulSum(ws.Ffeatures, filter, ws.response_spectrum, true, filter_weights);
     } else {
-        res = Mat::zeros(Ffeatures[0].size(), CV_32FC2);
-        Mat resp_ch;
-        for(size_t i = 0; i < Ffeatures.size(); ++i) {
-            mulSpectrums(Ffeatures[i], filter[i], resp_ch, 0 , true);
-            res = res + resp_ch;
-        }
-        idft(res, res, DFT_SCALE | DFT_REAL_OUTPUT);
+        tracking::complexMulSum(ws.Ffeatures, filter, ws.response_spectrum, true);
     }
-    return res;
+    correlation.ifft(ws.response_spectrum, ws.response);
+    return ws.response;
 }
 
 void TrackerCSRTImpl::update_csr_filter(const Mat &image, const Mat &mask)
 {
-    Mat patch = get_subwindow(image, object_center, cvFloor(current_scale_factor * template_size.width),
-        cvFloor(current_scale_factor * template_size.height));
-    resize(patch, patch, rescaled_template_size, 0, 0, INTER_CUBIC);
-
-    std::vector<Mat> ftrs = get_features(patch, yf.size());
-    std::vector<Mat> Fftrs = fourier_transform_features(ftrs);
-    std::vector<Mat> new_csr_filter = create_csr_filter(Fftrs, yf, mask);
+    get_subwindow(image, object_center, cvFloor(current_scale_factor * template_size.width),
+        cvFloor(current_scale_factor * template_size.height), ws.patch, NULL, &ws.patch_storage);
+    resize(ws.patch, ws.resized_patch, rescaled_template_size, 0, 0, INTER_CUBIC);
+
+    get_features(ws.resized_patch, yf.size(), ws.features);
+    std::vector<Mat> &Fftrs = ws.Ffeatures;
+    correlation.fft(ws.features, Fftrs);
+    std::vector<Mat> &new_csr_filter = ws.filter;
+    create_csr_filter(Fftrs, yf, mask, new_csr_filter);
     //calculate per channel weights
     if(params.use_channel_weights) {
-        Mat current_resp;
         double max_val;
         float sum_weights = 0;
-        std::vector<float> new_filter_weights = std::vector<float>(new_csr_filter.size());
+        std::vector<float> &new_filter_weights = ws.filter_weights;
+        new_filter_weights.resize(new_csr_filter.size());
         for(size_t i = 0; i < new_csr_filter.size(); ++i) {
-            mulSpectrums(Fftrs[i], new_csr_filter[i], current_resp, 0, true);
-            idft(current_resp, current_resp, DFT_SCALE | DFT_REAL_OUTPUT);
-            minMaxLoc(current_resp, NULL, &max_val, NULL, NULL);
+            tracking::complexMul(Fftrs[i], new_csr_filter[i], ws.channel_response_spectrum, true);
+            correlation.ifft(ws.channel_response_spectrum, ws.channel_response);
+            minMaxLoc(ws.channel_response, NULL, &max_val, NULL, NULL);
             sum_weights += static_cast<float>(max_val);
             new_filter_weights[i] = static_cast<float>(max_val);
         }
@@ -179,57 +205,56 @@ void TrackerCSRTImpl::update_csr_filter(const Mat &image, const Mat &mask)
         }
     }
     for(size_t i = 0; i < csr_filter.size(); ++i) {
+        // in place, the expression does not reallocate the filter
         csr_filter[i] = (1.0f - params.filter_lr)*csr_filter[i] + params.filter_lr * new_csr_filter[i];
     }
-    std::vector<Mat>().swap(ftrs);
-    std::vector<Mat>().swap(Fftrs);
 }
 
 
-std::vector<Mat> TrackerCSRTImpl::get_features(const Mat &patch, const Size2i &feature_size)
+void TrackerCSRTImpl::get_features(const Mat &patch, const Size2i &feature_size, std::vector<Mat> &features)
 {
-    std::vector<Mat> features;
+    // the features are headers of the workspace buffers
+    features.clear();
     if (params.use_hog) {
-        std::vector<Mat> hog = get_features_hog(patch, cell_size);
-        features.insert(features.end(), hog.begin(),
-                hog.begin()+params.num_hog_channels_used);
+        get_features_hog(patch, cell_size, ws.hog, ws.buffers);
+        features.insert(features.end(), ws.hog.begin(),
+                ws.hog.begin()+params.num_hog_channels_used);
     }
     if (params.use_color_names) {
-        std::vector<Mat> cn;
-        cn = get_features_cn(patch, feature_size);
-        features.insert(features.end(), cn.begin(), cn.end());
+        get_features_cn(patch, feature_size, ws.cn, ws.buffers);
+        features.insert(features.end(), ws.cn.begin(), ws.cn.end());
     }
     if(params.use_gray) {
-        Mat gray_m;
-        cvtColor(patch, gray_m, COLOR_BGR2GRAY);
-        resize(gray_m, gray_m, feature_size, 0, 0, INTER_CUBIC);
-        gray_m.convertTo(gray_m, CV_32FC1, 1.0/255.0, -0.5);
-        features.push_back(gray_m);
+        cvtColor(patch, ws.gray, COLOR_BGR2GRAY);
+        resize(ws.gray, ws.gray_resized, feature_size, 0, 0, INTER_CUBIC);
+        ws.gray_resized.convertTo(ws.gray_feature, CV_32FC1, 1.0/255.0, -0.5);
+        features.push_back(ws.gray_feature);
     }
     if(params.use_rgb) {
-        std::vector<Mat> rgb_features = get_features_rgb(patch, feature_size);
-        features.insert(features.end(), rgb_features.begin(), rgb_features.end());
+        get_features_rgb(patch, feature_size, ws.rgb, ws.buffers);
+        features.insert(features.end(), ws.rgb.begin(), ws.rgb.end());
     }
 
     for (size_t i = 0; i < features.size(); ++i) {
-        features.at(i) = features.at(i).mul(window);
+        multiply(features[i], window, features[i]);
     }
-    return features;
 }
 
 class ParallelCreateCSRFilter : public ParallelLoopBody {
 public:
     ParallelCreateCSRFilter(
-        const std::vector<cv::Mat> img_features,
-        const cv::Mat Y,
-        const cv::Mat P,
+        const std::vector<cv::Mat> &img_features_,
+        const cv::Mat &Y_,
+        const cv::Mat &P_,
         int admm_iterations,
-        std::vector<Mat> &result_filter_):
-        result_filter(result_filter_)
+        std::vector<Mat> &result_filter_,
+        std::vector<CSRFilterWorkspace> &workspace_):
+        img_features(img_features_),
+        Y(Y_),
+        P(P_),
+        result_filter(result_filter_),
+        workspace(workspace_)
     {
-        this->img_features = img_features;
-        this->Y = Y;
-        this->P = P;
         this->admm_iterations = admm_iterations;
     }
     virtual void operator ()(const Range& range) const CV_OVERRIDE
@@ -240,31 +265,40 @@ public:
             float mu_max = 20.0f;
             float lambda = mu / 100.0f;
 
-            Mat F = img_features[i];
+            const Mat &F = img_features[i];
+            CSRFilterWorkspace &w = workspace[i];
+            tracking::CorrelationEngine& engine = w.correlation;
 
-            Mat Sxy, Sxx;
-            mulSpectrums(F, Y, Sxy, 0, true);
-            mulSpectrums(F, F, Sxx, 0, true);
+            tracking::complexMul(F, Y, w.Sxy, true);
+            tracking::complexMul(F, F, w.Sxx, true);
 
-            Mat H;
-            H = divide_complex_matrices(Sxy, (Sxx + lambda));
-            idft(H, H, DFT_SCALE|DFT_REAL_OUTPUT);
-            H = H.mul(P);
-            dft(H, H, DFT_COMPLEX_OUTPUT);
-            Mat L = Mat::zeros(H.size(), H.type()); //Lagrangian multiplier
-            Mat G;
+            add(w.Sxx, Scalar(lambda), w.den);
+            tracking::complexDiv(w.Sxy, w.den, w.H);
+            engine.ifft(w.H, w.h);
+            multiply(w.h, P, w.h);
+            engine.fft(w.h, w.H);
+            w.L.create(w.H.size(), w.H.type()); //Lagrangian multiplier
+            w.L.setTo(0);
             for(int iteration = 0; iteration < admm_iterations; ++iteration) {
-                G = divide_complex_matrices((Sxy + (mu * H) - L) , (Sxx + mu));
-                idft((mu * G) + L, H, DFT_SCALE | DFT_REAL_OUTPUT);
+                // G = (Sxy + mu*H - L) / (Sxx + mu)
+                scaleAdd(w.H, mu, w.Sxy, w.num);
+                subtract(w.num, w.L, w.num);
+                add(w.Sxx, Scalar(mu), w.den);
+                tracking::complexDiv(w.num, w.den, w.G);
+                // H = fft(ifft(mu*G + L) .* P/(lambda+mu))
+                scaleAdd(w.G, mu, w.L, w.num);
+                engine.ifft(w.num, w.h);
                 float lm = 1.0f / (lambda+mu);
-                H = H.mul(P*lm);
-                dft(H, H, DFT_COMPLEX_OUTPUT);
+                P.convertTo(w.Plm, -1, lm);
+                multiply(w.h, w.Plm, w.h);
+                engine.fft(w.h, w.H);
 
                 //Update variables for next iteration
-                L = L + mu * (G - H);
+                addWeighted(w.G, mu, w.H, -mu, 0, w.num);
+                add(w.L, w.num, w.L);
                 mu = min(mu_max, beta*mu);
             }
-            result_filter[i] = H;
+            result_filter[i] = w.H;
         }
     }
 
@@ -274,31 +308,33 @@ public:
 
 private:
     int admm_iterations;
-    Mat Y;
-    Mat P;
-    std::vector<Mat> img_features;
+    const std::vector<Mat> &img_features;
+    const Mat &Y;
+    const Mat &P;
     std::vector<Mat> &result_filter;
+    std::vector<CSRFilterWorkspace> &workspace;
 };
 
 
-std::vector<Mat> TrackerCSRTImpl::create_csr_filter(
-        const std::vector<cv::Mat> img_features,
-        const cv::Mat Y,
-        const cv::Mat P)
+void TrackerCSRTImpl::create_csr_filter(
+        const std::vector<cv::Mat> &img_features,
+        const cv::Mat &Y,
+        const cv::Mat &P,
+        std::vector<Mat> &filter)
 {
-    std::vector<Mat> result_filter;
-    result_filter.resize(img_features.size());
+    // the filter channels are headers of the workspace buffers
+    filter.resize(img_features.size());
+    ws.channels.resize(img_features.size());
     ParallelCreateCSRFilter parallelCreateCSRFilter(img_features, Y, P,
-            params.admm_iterations, result_filter);
-    parallel_for_(Range(0, static_cast<int>(result_filter.size())), parallelCreateCSRFilter);
-
-    return result_filter;
+            params.admm_iterations, filter, ws.channels);
+    parallel_for_(Range(0, static_cast<int>(filter.size())), parallelCreateCSRFilter);
 }
 
-Mat TrackerCSRTImpl::get_location_prior(
+void TrackerCSRTImpl::get_location_prior(
         const Rect roi,
         const Size2f target_size,
-        const Size img_sz)
+        const Size img_sz,
+        Mat &fg_prior)
 {
     int x1 = cvRound(max(min(roi.x-1, img_sz.width-1) , 0));
     int y1 = cvRound(max(min(roi.y-1, img_sz.height-1) , 0));
@@ -314,7 +350,9 @@ Mat TrackerCSRTImpl::get_location_prior(
     double kernel_size_width = 1.0/(0.5*static_cast<double>(target_sz.width)*1.4142+1);
     double kernel_size_height = 1.0/(0.5*static_cast<double>(target_sz.height)*1.4142+1);
 
-    cv::Mat kernel_weight = Mat::zeros(1 + cvFloor(y2 - y1) , 1+cvFloor(-(x1-cx) + (x2-cx)), CV_64FC1);
+    Mat &kernel_weight = ws.kernel_weight;
+    kernel_weight.create(1 + cvFloor(y2 - y1) , 1+cvFloor(-(x1-cx) + (x2-cx)), CV_64FC1);
+    kernel_weight.setTo(0);
     for (int y = y1; y < y2+1; ++y){
         double * weightPtr = kernel_weight.ptr<double>(y);
         double tmp_y = std::pow((cy-y)*kernel_size_height, 2);
@@ -325,65 +363,80 @@ Mat TrackerCSRTImpl::get_location_prior(
 
     double max_val;
     cv::minMaxLoc(kernel_weight, NULL, &max_val, NULL, NULL);
-    Mat fg_prior = kernel_weight / max_val;
-    fg_prior.setTo(0.5, fg_prior < 0.5);
-    fg_prior.setTo(0.9, fg_prior > 0.9);
-    return fg_prior;
+    kernel_weight.convertTo(fg_prior, -1, 1.0 / max_val);
+    // clamped to [0.5, 0.9]
+    max(fg_prior, 0.5, fg_prior);
+    min(fg_prior, 0.9, fg_prior);
 }
 
-Mat TrackerCSRTImpl::segment_region(
+void TrackerCSRTImpl::segment_region(
         const Mat &image,
         const Point2f &object_center,
         const Size2f &template_size,
         const Size &target_size,
-        float scale_factor)
+        float scale_factor,
+        Mat &mask)
 {
     Rect valid_pixels;
-    Mat patch = get_subwindow(image, object_center, cvFloor(scale_factor * template_size.width),
-        cvFloor(scale_factor * template_size.height), &valid_pixels);
+    Mat &patch = ws.segmentation_patch;
+    get_subwindow(image, object_center, cvFloor(scale_factor * template_size.width),
+        cvFloor(scale_factor * template_size.height), patch, &valid_pixels, &ws.segmentation_patch_storage);
     Size2f scaled_target = Size2f(target_size.width * scale_factor,
             target_size.height * scale_factor);
-    Mat fg_prior = get_location_prior(
-            Rect(0,0, patch.size().width, patch.size().height),
-            scaled_target , patch.size());
-
-    std::vector<Mat> img_channels;
-    split(patch, img_channels);
-    std::pair<Mat, Mat> probs = Segment::computePosteriors2(img_channels, 0, 0, patch.cols, patch.rows,
-                    p_b, fg_prior, 1.0-fg_prior, hist_foreground, hist_background);
-
-    Mat mask = Mat::zeros(probs.first.size(), probs.first.type());
-    probs.first(valid_pixels).copyTo(mask(valid_pixels));
-    double max_resp = get_max(mask);
-    threshold(mask, mask, max_resp / 2.0, 1, THRESH_BINARY);
-    mask.convertTo(mask, CV_32FC1, 1.0);
-    return mask;
+    get_location_prior(Rect(0,0, patch.size().width, patch.size().height),
+            scaled_target , patch.size(), ws.fg_prior);
+    subtract(1.0, ws.fg_prior, ws.bg_prior);
+
+    split(patch, ws.segmentation_channels);
+    std::pair<Mat, Mat> probs = Segment::computePosteriors2(ws.segmentation_channels, 0, 0,
+            patch.cols, patch.rows, p_b, ws.fg_prior, ws.bg_prior, hist_foreground, hist_background,
+            ws.segmentation);
+
+    Mat &mask64 = ws.mask64;
+    mask64.create(probs.first.size(), probs.first.type());
+    mask64.setTo(0);
+    probs.first(valid_pixels).copyTo(mask64(valid_pixels));
+    double max_resp = get_max(mask64);
+    threshold(mask64, mask64, max_resp / 2.0, 1, THRESH_BINARY);
+    mask64.convertTo(mask, CV_32FC1, 1.0);
+}
+
+void TrackerCSRTImpl::set_filter_mask(const Mat &mask)
+{
+    // the default mask is only referenced, the buffers of the workspace are never the default mask
+    resize(mask, ws.mask_resized, yf.size(), 0, 0, INTER_NEAREST);
+    if(check_mask_area(ws.mask_resized, default_mask_area)) {
+        dilate(ws.mask_resized, ws.mask_dilated, erode_element);
+        filter_mask = ws.mask_dilated;
+    } else {
+        filter_mask = default_mask;
+    }
 }
 
 
-void TrackerCSRTImpl::extract_histograms(const Mat &image, cv::Rect region, Histogram &hf, Histogram &hb)
+void TrackerCSRTImpl::extract_histograms(std::vector<Mat> &img_channels, cv::Rect region, Histogram &hf, Histogram &hb)
 {
+    const Size img_sz = img_channels[0].size();
+
     // get coordinates of the region
-    int x1 = std::min(std::max(0, region.x), image.cols-1);
-    int y1 = std::min(std::max(0, region.y), image.rows-1);
-    int x2 = std::min(std::max(0, region.x + region.width), image.cols-1);
-    int y2 = std::min(std::max(0, region.y + region.height), image.rows-1);
+    int x1 = std::min(std::max(0, region.x), img_sz.width-1);
+    int y1 = std::min(std::max(0, region.y), img_sz.height-1);
+    int x2 = std::min(std::max(0, region.x + region.width), img_sz.width-1);
+    int y2 = std::min(std::max(0, region.y + region.height), img_sz.height-1);
 
     // calculate coordinates of the background region
     int offsetX = (x2-x1+1) / params.background_ratio;
     int offsetY = (y2-y1+1) / params.background_ratio;
     int outer_y1 = std::max(0, (int)(y1-offsetY));
-    int outer_y2 = std::min(image.rows, (int)(y2+offsetY+1));
+    int outer_y2 = std::min(img_sz.height, (int)(y2+offsetY+1));
     int outer_x1 = std::max(0, (int)(x1-offsetX));
-    int outer_x2 = std::min(image.cols, (int)(x2+offsetX+1));
+    int outer_x2 = std::min(img_sz.width, (int)(x2+offsetX+1));
 
     // calculate probability for the background
     p_b = 1.0 - ((x2-x1+1) * (y2-y1+1)) /
         ((double) (outer_x2-outer_x1+1) * (outer_y2-outer_y1+1));
 
-    // split multi-channel image into the std::vector of matrices
-    std::vector<Mat> img_channels(image.channels());
-    split(image, img_channels);
+    // the channels of the image, as 8-bit matrices
     for(size_t k=0; k<img_channels.size(); k++) {
         img_channels.at(k).convertTo(img_channels.at(k), CV_8UC1);
     }
@@ -391,37 +444,18 @@ void TrackerCSRTImpl::extract_histograms(const Mat &image, cv::Rect region, Hist
     hf.extractForegroundHistogram(img_channels, Mat(), false, x1, y1, x2, y2);
     hb.extractBackGroundHistogram(img_channels, x1, y1, x2, y2,
         outer_x1, outer_y1, outer_x2, outer_y2);
-    std::vector<Mat>().swap(img_channels);
 }
 
-void TrackerCSRTImpl::update_histograms(const Mat &image, const Rect &region)
+void TrackerCSRTImpl::update_histograms(std::vector<Mat> &img_channels, const Rect &region)
 {
-    // create temporary histograms
-    Histogram hf(image.channels(), params.histogram_bins);
-    Histogram hb(image.channels(), params.histogram_bins);
-    extract_histograms(image, region, hf, hb);
-
-    // get histogram vectors from temporary histograms
-    std::vector<double> hf_vect_new = hf.getHistogramVector();
-    std::vector<double> hb_vect_new = hb.getHistogramVector();
-    // get histogram vectors from learned histograms
-    std::vector<double> hf_vect = hist_foreground.getHistogramVector();
-    std::vector<double> hb_vect = hist_background.getHistogramVector();
+    // extract the histograms of the frame into the temporary ones
+    ws.hf.reset();
+    ws.hb.reset();
+    extract_histograms(img_channels, region, ws.hf, ws.hb);
 
     // update histograms - use learning rate
-    for(size_t i=0; i<hf_vect.size(); i++) {
-        hf_vect_new[i] = (1-params.histogram_lr)*hf_vect[i] +
-            params.histogram_lr*hf_vect_new[i];
-        hb_vect_new[i] = (1-params.histogram_lr)*hb_vect[i] +
-            params.histogram_lr*hb_vect_new[i];
-    }
-
-    // set learned histograms
-    hist_foreground.setHistogramVector(&hf_vect_new[0]);
-    hist_background.setHistogramVector(&hb_vect_new[0]);
-
-    std::vector<double>().swap(hf_vect);
-    std::vector<double>().swap(hb_vect);
+    hist_foreground.update(ws.hf, params.histogram_lr);
+    hist_background.update(ws.hb, params.histogram_lr);
 }
 
 Point2f TrackerCSRTImpl::estimate_new_position(const Mat &image)
@@ -466,9 +500,10 @@ Point2f TrackerCSRTImpl::estimate_new_position(const Mat &image)
 bool TrackerCSRTImpl::updateImpl(const Mat& image_, Rect2d& boundingBox)
 {
     Mat image;
-    if(image_.channels() == 1)    //treat gray image as color image
-        cvtColor(image_, image, COLOR_GRAY2BGR);
-    else
+    if(image_.channels() == 1) {    //treat gray image as color image
+        cvtColor(image_, ws.color, COLOR_GRAY2BGR);
+        image = ws.color;
+    } else
         image = image_;
 
     object_center = estimate_new_position(image);
@@ -484,16 +519,11 @@ bool TrackerCSRTImpl::updateImpl(const Mat& image_, Rect2d& boundingBox)
 
     //update tracker
     if(params.use_segmentation) {
-        Mat hsv_img = bgr2hsv(image);
-        update_histograms(hsv_img, bounding_box);
-        filter_mask = segment_region(hsv_img, object_center,
-                template_size,original_target_size, current_scale_factor);
-        resize(filter_mask, filter_mask, yf.size(), 0, 0, INTER_NEAREST);
-        if(check_mask_area(filter_mask, default_mask_area)) {
-            dilate(filter_mask , filter_mask, erode_element);
-        } else {
-            filter_mask = default_mask;
-        }
+        bgr2hsv(image, ws.hsv, ws.hsv_channels);
+        update_histograms(ws.hsv_channels, bounding_box);
+        segment_region(ws.hsv, object_center,
+                template_size,original_target_size, current_scale_factor, ws.mask);
+        set_filter_mask(ws.mask);
     } else {
         filter_mask = default_mask;
     }
@@ -509,9 +539,10 @@ bool TrackerCSRTImpl::updateImpl(const Mat& image_, Rect2d& boundingBox)
 bool TrackerCSRTImpl::initImpl(const Mat& image_, const Rect2d& boundingBox)
 {
     Mat image;
-    if(image_.channels() == 1)    //treat gray image as color image
-        cvtColor(image_, image, COLOR_GRAY2BGR);
-    else
+    if(image_.channels() == 1) {    //treat gray image as color image
+        cvtColor(image_, ws.color, COLOR_GRAY2BGR);
+        image = ws.color;
+    } else
         image = image_;
 
     current_scale_factor = 1.0;
@@ -560,50 +591,51 @@ bool TrackerCSRTImpl::initImpl(const Mat& image_, const Rect2d& boundingBox)
 
     //initalize segmentation
     if(params.use_segmentation) {
-        Mat hsv_img = bgr2hsv(image);
-        hist_foreground = Histogram(hsv_img.channels(), params.histogram_bins);
-        hist_background = Histogram(hsv_img.channels(), params.histogram_bins);
-        extract_histograms(hsv_img, bounding_box, hist_foreground, hist_background);
-        filter_mask = segment_region(hsv_img, object_center, template_size,
-                original_target_size, current_scale_factor);
+        bgr2hsv(image, ws.hsv, ws.hsv_channels);
+        hist_foreground = Histogram(ws.hsv.channels(), params.histogram_bins);
+        hist_background = Histogram(ws.hsv.channels(), params.histogram_bins);
+        ws.hf = Histogram(ws.hsv.channels(), params.histogram_bins);
+        ws.hb = Histogram(ws.hsv.channels(), params.histogram_bins);
+        extract_histograms(ws.hsv_channels, bounding_box, hist_foreground, hist_background);
+        segment_region(ws.hsv, object_center, template_size,
+                original_target_size, current_scale_factor, ws.mask);
         //update calculated mask with preset mask
         if(preset_mask.data){
-            Mat preset_mask_padded = Mat::zeros(filter_mask.size(), filter_mask.type());
+            Mat preset_mask_padded = Mat::zeros(ws.mask.size(), ws.mask.type());
             int sx = std::max((int)cvFloor(preset_mask_padded.cols / 2.0f - preset_mask.cols / 2.0f) - 1, 0);
             int sy = std::max((int)cvFloor(preset_mask_padded.rows / 2.0f - preset_mask.rows / 2.0f) - 1, 0);
             preset_mask.copyTo(preset_mask_padded(
                         Rect(sx, sy, preset_mask.cols, preset_mask.rows)));
-            filter_mask = filter_mask.mul(preset_mask_padded);
+            multiply(ws.mask, preset_mask_padded, ws.mask);
         }
         erode_element = getStructuringElement(MORPH_ELLIPSE, Size(3,3), Point(1,1));
-        resize(filter_mask, filter_mask, yf.size(), 0, 0, INTER_NEAREST);
-        if(check_mask_area(filter_mask, default_mask_area)) {
-            dilate(filter_mask , filter_mask, erode_element);
-        } else {
-            filter_mask = default_mask;
-        }
-
+        set_filter_mask(ws.mask);
     } else {
         filter_mask = default_mask;
     }
 
     //initialize filter
-    Mat patch = get_subwindow(image, object_center, cvFloor(current_scale_factor * template_size.width),
-        cvFloor(current_scale_factor * template_size.height));
-    resize(patch, patch, rescaled_template_size, 0, 0, INTER_CUBIC);
-    std::vector<Mat> patch_ftrs = get_features(patch, yf.size());
-    std::vector<Mat> Fftrs = fourier_transform_features(patch_ftrs);
-    csr_filter = create_csr_filter(Fftrs, yf, filter_mask);
+    get_subwindow(image, object_center, cvFloor(current_scale_factor * template_size.width),
+        cvFloor(current_scale_factor * template_size.height), ws.patch, NULL, &ws.patch_storage);
+    resize(ws.patch, ws.resized_patch, rescaled_template_size, 0, 0, INTER_CUBIC);
+    get_features(ws.resized_patch, yf.size(), ws.features);
+    std::vector<Mat> &Fftrs = ws.Ffeatures;
+    correlation.fft(ws.features, Fftrs);
+    create_csr_filter(Fftrs, yf, filter_mask, ws.filter);
+    // the learnt filter has buffers of its own, the workspace ones are overwritten by the updates
+    csr_filter.resize(ws.filter.size());
+    for (size_t i = 0; i < ws.filter.size(); ++i) {
+        csr_filter[i] = ws.filter[i].clone();
+    }
 
     if(params.use_channel_weights) {
-        Mat current_resp;
         filter_weights = std::vector<float>(csr_filter.size());
         float chw_sum = 0;
         for (size_t i = 0; i < csr_filter.size(); ++i) {
-            mulSpectrums(Fftrs[i], csr_filter[i], current_resp, 0, true);
-            idft(current_resp, current_resp, DFT_SCALE | DFT_REAL_OUTPUT);
+            tracking::complexMul(Fftrs[i], csr_filter[i], ws.channel_response_spectrum, true);
+            correlation.ifft(ws.channel_response_spectrum, ws.channel_response);
             double max_val;
-            minMaxLoc(current_resp, NULL, &max_val, NULL , NULL);
+            minMaxLoc(ws.channel_response, NULL, &max_val, NULL , NULL);
             chw_sum += static_cast<float>(max_val);
             filter_weights[i] = static_cast<float>(max_val);
         }
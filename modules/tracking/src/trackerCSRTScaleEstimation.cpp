@@ -15,40 +15,52 @@ class ParallelGetScaleFeatures : public ParallelLoopBody
 {
 public:
     ParallelGetScaleFeatures(
-        Mat img,
+        const Mat &img_,
         Point2f pos,
         Size2f base_target_sz,
         float current_scale,
-        std::vector<float> &scale_factors,
-        Mat scale_window,
+        const std::vector<float> &scale_factors_,
+        const Mat &scale_window_,
         Size scale_model_sz,
         int col_len,
-        Mat &result)
+        std::vector<ScaleFeatureBuffers> &buffers_,
+        Mat &result_):
+        img(img_),
+        scale_factors(scale_factors_),
+        scale_window(scale_window_),
+        buffers(buffers_),
+        result(result_)
     {
-        this->img = img;
         this->pos = pos;
         this->base_target_sz = base_target_sz;
         this->current_scale = current_scale;
-        this->scale_factors = scale_factors;
-        this->scale_window = scale_window;
         this->scale_model_sz = scale_model_sz;
         this->col_len = col_len;
-        this->result = result;
     }
     virtual void operator ()(const Range& range) const CV_OVERRIDE
     {
         for (int s = range.start; s < range.end; s++) {
+            ScaleFeatureBuffers &b = buffers[s];
             Size patch_sz = Size(static_cast<int>(current_scale * scale_factors[s] * base_target_sz.width),
                     static_cast<int>(current_scale * scale_factors[s] * base_target_sz.height));
-            Mat img_patch = get_subwindow(img, pos, patch_sz.width, patch_sz.height);
-            img_patch.convertTo(img_patch, CV_32FC3);
-            resize(img_patch, img_patch, Size(scale_model_sz.width, scale_model_sz.height),0,0,INTER_LINEAR);
-            std::vector<Mat> hog;
-            hog = get_features_hog(img_patch, 4);
-            for (int i = 0; i < static_cast<int>(hog.size()); ++i) {
-                hog[i] = hog[i].t();
-                hog[i] = scale_window.at<float>(0,s) * hog[i].reshape(0, col_len);
-                hog[i].copyTo(result(Rect(Point(s, i*col_len), hog[i].size())));
+            get_subwindow(img, pos, patch_sz.width, patch_sz.height, b.patch, NULL, &b.patch_storage);
+            if (b.patch32_storage.cols < b.patch.cols || b.patch32_storage.rows < b.patch.rows)
+                b.patch32_storage.create(std::max(b.patch32_storage.rows, b.patch.rows),
+                        std::max(b.patch32_storage.cols, b.patch.cols), CV_32FC3);
+            b.patch32 = b.patch32_storage(Rect(Point(), b.patch.size()));
+            b.patch.convertTo(b.patch32, CV_32FC3);
+            resize(b.patch32, b.resized, Size(scale_model_sz.width, scale_model_sz.height),0,0,INTER_LINEAR);
+            get_features_hog(b.resized, 4, b.hog, b.features);
+            // column s holds the windowed channels, each one transposed and flattened
+            const float weight = scale_window.at<float>(0,s);
+            for (int i = 0; i < static_cast<int>(b.hog.size()); ++i) {
+                const Mat &channel = b.hog[i];
+                CV_Assert(channel.rows * channel.cols == col_len);
+                for (int y = 0; y < channel.rows; ++y) {
+                    const float *src = channel.ptr<float>(y);
+                    for (int x = 0; x < channel.cols; ++x)
+                        result.at<float>(i*col_len + x*channel.rows + y, s) = weight * src[x];
+                }
             }
         }
     }
@@ -58,15 +70,16 @@ public:
     }
 
 private:
-    Mat img;
+    const Mat &img;
     Point2f pos;
     Size2f base_target_sz;
     float current_scale;
-    std::vector<float> scale_factors;
-    Mat scale_window;
+    const std::vector<float> &scale_factors;
+    const Mat &scale_window;
     Size scale_model_sz;
     int col_len;
-    Mat result;
+    std::vector<ScaleFeatureBuffers> &buffers;
+    Mat &result;
 };
 
 
@@ -116,68 +129,49 @@ DSST::DSST(const Mat &image,
     scale_model_sz = Size(cvFloor(template_size.width * scale_model_factor),
             cvFloor(template_size.height * scale_model_factor));
 
-    Mat scale_resp = get_scale_features(image, object_center, original_targ_sz,
-            current_scale_factor, scale_factors, scale_window, scale_model_sz);
-
-    Mat ysf_row = Mat(ys.size(), CV_32FC2);
-    dft(ys, ysf_row, DFT_ROWS | DFT_COMPLEX_OUTPUT, 0);
-    ysf = repeat(ysf_row, scale_resp.rows, 1);
-    Mat Fscale_resp;
-    dft(scale_resp, Fscale_resp, DFT_ROWS | DFT_COMPLEX_OUTPUT);
-    mulSpectrums(ysf, Fscale_resp, sf_num, 0 , true);
-    Mat sf_den_all;
-    mulSpectrums(Fscale_resp, Fscale_resp, sf_den_all, 0, true);
-    reduce(sf_den_all, sf_den, 0, CV_REDUCE_SUM, -1);
+    get_scale_features(image, object_center, original_targ_sz,
+            current_scale_factor, scale_factors, scale_window, scale_model_sz, scale_features);
+
+    Mat ysf_row;
+    correlation.fftRows(ys, ysf_row);
+    ysf = repeat(ysf_row, scale_features.rows, 1);
+    correlation.fftRows(scale_features, Fscale_features);
+    tracking::complexMul(ysf, Fscale_features, sf_num, true);
+    tracking::complexMul(Fscale_features, Fscale_features, new_sf_den_all, true);
+    reduce(new_sf_den_all, sf_den, 0, CV_REDUCE_SUM, -1);
 }
 
 DSST::~DSST()
 {
 }
 
-Mat DSST::get_scale_features(
-        Mat img,
+void DSST::get_scale_features(
+        const Mat &img,
         Point2f pos,
         Size2f base_target_sz,
         float current_scale,
-        std::vector<float> &scale_factors,
-        Mat scale_window,
-        Size scale_model_sz)
+        const std::vector<float> &scale_factors,
+        const Mat &scale_window,
+        Size scale_model_sz,
+        Mat &result)
 {
-    Mat result;
-    int col_len = 0;
-    Size patch_sz = Size(cvFloor(current_scale * scale_factors[0] * base_target_sz.width),
-            cvFloor(current_scale * scale_factors[0] * base_target_sz.height));
-    Mat img_patch = get_subwindow(img, pos, patch_sz.width, patch_sz.height);
-    img_patch.convertTo(img_patch, CV_32FC3);
-    resize(img_patch, img_patch, Size(scale_model_sz.width, scale_model_sz.height),0,0,INTER_LINEAR);
-    std::vector<Mat> hog;
-    hog = get_features_hog(img_patch, 4);
-    result = Mat(Size((int)scale_factors.size(), hog[0].cols * hog[0].rows * (int)hog.size()), CV_32F);
-    col_len = hog[0].cols * hog[0].rows;
-    for (int i = 0; i < static_cast<int>(hog.size()); ++i) {
-        hog[i] = hog[i].t();
-        hog[i] = scale_window.at<float>(0,0) * hog[i].reshape(0, col_len);
-        hog[i].copyTo(result(Rect(Point(0, i*col_len), hog[i].size())));
-    }
+    // the HOG cells of the resized patches, with their 32 channels
+    const int col_len = (scale_model_sz.width / 4) * (scale_model_sz.height / 4);
+    result.create(Size((int)scale_factors.size(), col_len * 32), CV_32F);
+    scale_buffers.resize(scale_factors.size());
 
     ParallelGetScaleFeatures parallelGetScaleFeatures(img, pos, base_target_sz,
-            current_scale, scale_factors, scale_window, scale_model_sz, col_len, result);
-    parallel_for_(Range(1, static_cast<int>(scale_factors.size())), parallelGetScaleFeatures);
-    return result;
+            current_scale, scale_factors, scale_window, scale_model_sz, col_len, scale_buffers, result);
+    parallel_for_(Range(0, static_cast<int>(scale_factors.size())), parallelGetScaleFeatures);
 }
 
 void DSST::update(const Mat &image, const Point2f object_center)
 {
-    Mat scale_features = get_scale_features(image, object_center, original_targ_sz,
-            current_scale_factor, scale_factors, scale_window, scale_model_sz);
-    Mat Fscale_features;
-    dft(scale_features, Fscale_features, DFT_ROWS | DFT_COMPLEX_OUTPUT);
-    Mat new_sf_num;
-    Mat new_sf_den;
-    Mat new_sf_den_all;
-    mulSpectrums(ysf, Fscale_features, new_sf_num, DFT_ROWS, true);
-    Mat sf_den_all;
-    mulSpectrums(Fscale_features, Fscale_features, new_sf_den_all, DFT_ROWS, true);
+    get_scale_features(image, object_center, original_targ_sz,
+            current_scale_factor, scale_factors, scale_window, scale_model_sz, scale_features);
+    correlation.fftRows(scale_features, Fscale_features);
+    tracking::complexMul(ysf, Fscale_features, new_sf_num, true);
+    tracking::complexMul(Fscale_features, Fscale_features, new_sf_den_all, true);
     reduce(new_sf_den_all, new_sf_den, 0, CV_REDUCE_SUM, -1);
 
     sf_num = (1 - learn_rate) * sf_num + learn_rate * new_sf_num;
@@ -186,19 +180,17 @@ void DSST::update(const Mat &image, const Point2f object_center)
 
 float DSST::getScale(const Mat &image, const Point2f object_center)
 {
-    Mat scale_features = get_scale_features(image, object_center, original_targ_sz,
-            current_scale_factor, scale_factors, scale_window, scale_model_sz);
-
-    Mat Fscale_features;
-    dft(scale_features, Fscale_features, DFT_ROWS | DFT_COMPLEX_OUTPUT);
+    get_scale_features(image, object_center, original_targ_sz,
+            current_scale_factor, scale_factors, scale_window, scale_model_sz, scale_features);
+    correlation.fftRows(scale_features, Fscale_features);
 
-    mulSpectrums(Fscale_features, sf_num, Fscale_features, 0, false);
-    Mat scale_resp;
+    tracking::complexMul(Fscale_features, sf_num, Fscale_features);
     reduce(Fscale_features, scale_resp, 0, CV_REDUCE_SUM, -1);
-    scale_resp = divide_complex_matrices(scale_resp, sf_den + 0.01f);
-    idft(scale_resp, scale_resp, DFT_REAL_OUTPUT|DFT_SCALE);
+    add(sf_den, Scalar(0.01f), scale_den);
+    tracking::complexDiv(scale_resp, scale_den, scale_resp);
+    correlation.ifft(scale_resp, scale_resp_real);
     Point max_loc;
-    minMaxLoc(scale_resp, NULL, NULL, NULL, &max_loc);
+    minMaxLoc(scale_resp_real, NULL, NULL, NULL, &max_loc);
 
     current_scale_factor *= scale_factors[max_loc.x];
     if(current_scale_factor < min_scale_factor)
@@ -5,9 +5,21 @@
 #ifndef OPENCV_TRACKER_CSRT_SCALE_ESTIMATION
 #define OPENCV_TRACKER_CSRT_SCALE_ESTIMATION
 
+#include "trackerCSRTUtils.hpp"
+#include "correlationEngine.hpp"
+
 namespace cv
 {
 
+/** Buffers of the features of one scale, reused from frame to frame */
+struct ScaleFeatureBuffers
+{
+    // the patches follow the scale of the target, they are views of the storages
+    Mat patch, patch_storage, patch32, patch32_storage, resized;
+    std::vector<Mat> hog;
+    FeatureBuffers features;
+};
+
 class DSST {
 public:
     DSST() {};
@@ -17,8 +29,9 @@ public:
     void update(const Mat &image, const Point2f objectCenter);
     float getScale(const Mat &image, const Point2f objecCenter);
 private:
-    Mat get_scale_features(Mat img, Point2f pos, Size2f base_target_sz, float current_scale,
-            std::vector<float> &scale_factors, Mat scale_window, Size scale_model_sz);
+    void get_scale_features(const Mat &img, Point2f pos, Size2f base_target_sz, float current_scale,
+            const std::vector<float> &scale_factors, const Mat &scale_window, Size scale_model_sz,
+            Mat &result);
 
     Size scale_model_sz;
     Mat ys;
@@ -38,6 +51,14 @@ private:
     float learn_rate;
 
     Size original_targ_sz;
+
+    // per-frame buffers
+    std::vector<ScaleFeatureBuffers> scale_buffers;
+    Mat scale_features;
+    Mat Fscale_features;
+    Mat new_sf_num, new_sf_den, new_sf_den_all;
+    Mat scale_resp, scale_den, scale_resp_real;
+    tracking::CorrelationEngine correlation;
 };
 
 } /* namespace cv */
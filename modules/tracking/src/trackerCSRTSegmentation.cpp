@@ -30,42 +30,32 @@ Histogram::Histogram(int numDimensions, int numBinsPerDimension)
 void Histogram::extractForegroundHistogram(std::vector<cv::Mat> & imgChannels,
         cv::Mat weights, bool useMatWeights, int x1, int y1, int x2, int y2)
 {
-    //just for code clarity
-    cv::Mat & img = imgChannels[0];
-
-    if (!useMatWeights){
-        //weights are epanechnikov distr. with peek at the center of the image;
-        double cx = x1 + (x2-x1)/2.;
-        double cy = y1 + (y2-y1)/2.;
-        double kernelSize_width = 1.0/(0.5*static_cast<double>(x2-x1)*1.4142+1);  //sqrt(2)
-        double kernelSize_height = 1.0/(0.5*static_cast<double>(y2-y1)*1.4142+1);
-
-        cv::Mat kernelWeight(img.rows, img.cols, CV_64FC1);
-        for (int y = y1; y < y2+1; ++y){
-            double * weightPtr = kernelWeight.ptr<double>(y);
-            double tmp_y = std::pow((cy-y)*kernelSize_height, 2);
-            for (int x = x1; x < x2+1; ++x){
-                weightPtr[x] = kernelProfile_Epanechnikov(std::pow((cx-x)*kernelSize_width,2) + tmp_y);
-            }
-        }
-        weights = kernelWeight;
-    }
+    //without given weights, they are epanechnikov distr. with peek at the center of the image,
+    //computed along the way
+    double cx = x1 + (x2-x1)/2.;
+    double cy = y1 + (y2-y1)/2.;
+    double kernelSize_width = 1.0/(0.5*static_cast<double>(x2-x1)*1.4142+1);  //sqrt(2)
+    double kernelSize_height = 1.0/(0.5*static_cast<double>(y2-y1)*1.4142+1);
+
     //extract pixel values and compute histogram
     double rangePerBinInverse = static_cast<double>(m_numBinsPerDim)/256.0;  // 1 / (imgRange/numBinsPerDim)
     double sum = 0;
+    cv::AutoBuffer<const uchar *> dataPtr(m_numDim);
     for (int y = y1; y < y2+1; ++y){
-        std::vector<const uchar *> dataPtr(m_numDim);
         for (int dim = 0; dim < m_numDim; ++dim)
             dataPtr[dim] = imgChannels[dim].ptr<uchar>(y);
-        const double * weightPtr = weights.ptr<double>(y);
+        const double * weightPtr = useMatWeights ? weights.ptr<double>(y) : NULL;
+        double tmp_y = std::pow((cy-y)*kernelSize_height, 2);
 
         for (int x = x1; x < x2+1; ++x){
             int id = 0;
             for (int dim = 0; dim < m_numDim; ++dim){
                 id += p_dimIdCoef[dim]*cvFloor(rangePerBinInverse*dataPtr[dim][x]);
             }
-            p_bins[id] += weightPtr[x];
-            sum += weightPtr[x];
+            double weight = useMatWeights ? weightPtr[x] :
+                kernelProfile_Epanechnikov(std::pow((cx-x)*kernelSize_width,2) + tmp_y);
+            p_bins[id] += weight;
+            sum += weight;
         }
     }
     //normalize
@@ -82,9 +72,9 @@ void Histogram::extractBackGroundHistogram(
     //extract pixel values and compute histogram
     double rangePerBinInverse = static_cast<double>(m_numBinsPerDim)/256.0;  // 1 / (imgRange/numBinsPerDim)
     double sum = 0;
+    cv::AutoBuffer<const uchar *> dataPtr(m_numDim);
     for (int y = outer_y1; y < outer_y2; ++y){
 
-        std::vector<const uchar *> dataPtr(m_numDim);
         for (int dim = 0; dim < m_numDim; ++dim)
             dataPtr[dim] = imgChannels[dim].ptr<uchar>(y);
 
@@ -107,16 +97,23 @@ void Histogram::extractBackGroundHistogram(
 }
 
 cv::Mat Histogram::backProject(std::vector<cv::Mat> & imgChannels)
+{
+    cv::Mat backProjection;
+    backProject(imgChannels, backProjection);
+    return backProjection;
+}
+
+void Histogram::backProject(const std::vector<cv::Mat> & imgChannels, cv::Mat & backProject) const
 {
     //just for code clarity
-    cv::Mat & img = imgChannels[0];
+    const cv::Mat & img = imgChannels[0];
 
-    cv::Mat backProject(img.rows, img.cols, CV_64FC1);
+    backProject.create(img.rows, img.cols, CV_64FC1);
     double rangePerBinInverse = static_cast<double>(m_numBinsPerDim)/256.0;  // 1 / (imgRange/numBinsPerDim)
 
+    cv::AutoBuffer<const uchar *> dataPtr(m_numDim);
     for (int y = 0; y < img.rows; ++y){
         double * backProjectPtr = backProject.ptr<double>(y);
-        std::vector<const uchar *> dataPtr(m_numDim);
         for (int dim = 0; dim < m_numDim; ++dim)
             dataPtr[dim] = imgChannels[dim].ptr<uchar>(y);
 
@@ -128,7 +125,6 @@ cv::Mat Histogram::backProject(std::vector<cv::Mat> & imgChannels)
             backProjectPtr[x] = p_bins[id];
         }
     }
-    return backProject;
 }
 
 // add new methods
@@ -142,6 +138,17 @@ void Histogram::setHistogramVector(double *vector) {
     }
 }
 
+void Histogram::reset() {
+    std::fill(p_bins.begin(), p_bins.end(), 0.0);
+}
+
+void Histogram::update(const Histogram &recent, float learningRate) {
+    CV_Assert(recent.p_bins.size() == p_bins.size());
+    for (size_t i=0; i<p_bins.size(); i++) {
+        p_bins[i] = (1-learningRate)*p_bins[i] + learningRate*recent.p_bins[i];
+    }
+}
+
 //-------------------- SEGMENT CLASS --------------------
 std::pair<cv::Mat, cv::Mat> Segment::computePosteriors(
         std::vector<cv::Mat> &imgChannels,
@@ -227,7 +234,8 @@ std::pair<cv::Mat, cv::Mat> Segment::computePosteriors(
 
 std::pair<cv::Mat, cv::Mat> Segment::computePosteriors2(
     std::vector<cv::Mat> &imgChannels, int x1, int y1, int x2, int y2, double p_b,
-    cv::Mat fgPrior, cv::Mat bgPrior, Histogram hist_target, Histogram hist_background)
+    cv::Mat fgPrior, cv::Mat bgPrior, const Histogram &hist_target, const Histogram &hist_background,
+    SegmentationWorkspace &ws)
 {
     //preprocess and normalize all data
     CV_Assert(imgChannels.size() > 0);
@@ -255,41 +263,41 @@ std::pair<cv::Mat, cv::Mat> Segment::computePosteriors2(
 
     //rescale input data
     cv::Rect roiRect_inner = cv::Rect(x1, y1, w, h);
-    std::vector<cv::Mat> imgChannelsROI_inner(imgChannels.size());
+    ws.imgChannelsROI.resize(imgChannels.size());
     for (size_t i = 0; i < imgChannels.size(); ++i)
-        cv::resize(imgChannels[i](roiRect_inner), imgChannelsROI_inner[i], newSize);
+        cv::resize(imgChannels[i](roiRect_inner), ws.imgChannelsROI[i], newSize);
 
     //initialize priors if there is no external source and rescale
-    cv::Mat fgPriorScaled;
-    if (fgPrior.cols == 0)
-        fgPriorScaled = 0.5*cv::Mat::ones(newSize, CV_64FC1);
-    else
-        cv::resize(fgPrior(roiRect_inner), fgPriorScaled, newSize);
-    cv::Mat bgPriorScaled;
-    if (bgPrior.cols == 0)
-        bgPriorScaled = 0.5*cv::Mat::ones(newSize, CV_64FC1);
-    else
-        cv::resize(bgPrior(roiRect_inner), bgPriorScaled, newSize);
+    if (fgPrior.cols == 0) {
+        ws.fgPrior.create(newSize, CV_64FC1);
+        ws.fgPrior.setTo(0.5);
+    } else
+        cv::resize(fgPrior(roiRect_inner), ws.fgPrior, newSize);
+    if (bgPrior.cols == 0) {
+        ws.bgPrior.create(newSize, CV_64FC1);
+        ws.bgPrior.setTo(0.5);
+    } else
+        cv::resize(bgPrior(roiRect_inner), ws.bgPrior, newSize);
 
     //backproject pixels likelihood
-    cv::Mat foregroundLikelihood = hist_target.backProject(imgChannelsROI_inner).mul(fgPriorScaled);
-    cv::Mat backgroundLikelihood = hist_background.backProject(imgChannelsROI_inner).mul(bgPriorScaled);
+    hist_target.backProject(ws.imgChannelsROI, ws.fgLikelihood);
+    hist_background.backProject(ws.imgChannelsROI, ws.bgLikelihood);
+    cv::multiply(ws.fgLikelihood, ws.fgPrior, ws.fgLikelihood);
+    cv::multiply(ws.bgLikelihood, ws.bgPrior, ws.bgLikelihood);
 
     //convert likelihoods to posterior prob. (Bayes rule)
-    cv::Mat prob_o(newSize, foregroundLikelihood.type());
-    prob_o = p_o*foregroundLikelihood / (p_o*foregroundLikelihood + p_b*backgroundLikelihood);
-    cv::Mat prob_b = 1.0 - prob_o;
+    ws.fgLikelihood.convertTo(ws.prob_o, -1, p_o);
+    cv::addWeighted(ws.fgLikelihood, p_o, ws.bgLikelihood, p_b, 0, ws.prob_b);
+    cv::divide(ws.prob_o, ws.prob_b, ws.prob_o);
+    cv::subtract(1.0, ws.prob_o, ws.prob_b);
 
-    std::pair<cv::Mat, cv::Mat> sizedProbs = getRegularizedSegmentation(prob_o, prob_b,
-            fgPriorScaled, bgPriorScaled);
-    //std::pair<cv::Mat, cv::Mat> sizedProbs = std::pair<cv::Mat, cv::Mat>(prob_o, prob_b);
+    getRegularizedSegmentation(ws.prob_o, ws.prob_b, ws.fgPrior, ws.bgPrior, ws);
 
     //resize probs to original size
-    std::pair<cv::Mat, cv::Mat> probs;
-    cv::resize(sizedProbs.first, probs.first, cv::Size(roiRect_inner.width, roiRect_inner.height));
-    cv::resize(sizedProbs.second, probs.second, cv::Size(roiRect_inner.width, roiRect_inner.height));
+    cv::resize(ws.Qsum_o, ws.probs.first, cv::Size(roiRect_inner.width, roiRect_inner.height));
+    cv::resize(ws.Qsum_b, ws.probs.second, cv::Size(roiRect_inner.width, roiRect_inner.height));
 
-    return probs;
+    return ws.probs;
 }
 
 std::pair<cv::Mat, cv::Mat> Segment::computePosteriors2(std::vector<cv::Mat> &imgChannels,
@@ -355,95 +363,114 @@ std::pair<cv::Mat, cv::Mat> Segment::computePosteriors2(std::vector<cv::Mat> &im
 
 std::pair<cv::Mat, cv::Mat> Segment::getRegularizedSegmentation(
         cv::Mat &prob_o, cv::Mat &prob_b, cv::Mat & prior_o, cv::Mat & prior_b)
+{
+    SegmentationWorkspace ws;
+    getRegularizedSegmentation(prob_o, prob_b, prior_o, prior_b, ws);
+    return std::pair<cv::Mat, cv::Mat>(ws.Qsum_o, ws.Qsum_b);
+}
+
+void Segment::getRegularizedSegmentation(cv::Mat &prob_o, cv::Mat &prob_b,
+        cv::Mat & prior_o, cv::Mat & prior_b, SegmentationWorkspace &ws)
 {
     int hsize = cvFloor(std::max(1.0, (double)cvFloor(static_cast<double>(prob_b.cols)*3./50. + 0.5)));
     int lambdaSize = hsize*2+1;
 
-    //compute gaussian kernel
-    cv::Mat lambda(lambdaSize, lambdaSize, CV_64FC1);
-    double std2 = std::pow(hsize/3.0, 2);
-    double sumLambda = 0.0;
-    for (int y = -hsize; y < hsize + 1; ++y){
-        double * lambdaPtr = lambda.ptr<double>(y+hsize);
-        double tmp_y = y*y;
-        for (int x = -hsize; x < hsize +1; ++x){
-            double tmp_gauss = gaussian(x*x, tmp_y, std2);
-            lambdaPtr[x+hsize] = tmp_gauss;
-            sumLambda += tmp_gauss;
+    //compute gaussian kernel, unless it is cached for this size
+    cv::Mat & lambda = ws.lambda;
+    cv::Mat & lambda2 = ws.lambda2;
+    if (ws.lambdaHalfSize != hsize || lambda.empty()) {
+        lambda.create(lambdaSize, lambdaSize, CV_64FC1);
+        double std2 = std::pow(hsize/3.0, 2);
+        double sumLambda = 0.0;
+        for (int y = -hsize; y < hsize + 1; ++y){
+            double * lambdaPtr = lambda.ptr<double>(y+hsize);
+            double tmp_y = y*y;
+            for (int x = -hsize; x < hsize +1; ++x){
+                double tmp_gauss = gaussian(x*x, tmp_y, std2);
+                lambdaPtr[x+hsize] = tmp_gauss;
+                sumLambda += tmp_gauss;
+            }
         }
+        sumLambda -= lambda.at<double>(hsize, hsize);
+        //set center of kernel to 0
+        lambda.at<double>(hsize, hsize) = 0.0;
+        sumLambda = 1.0/sumLambda;
+        //normalize kernel to sum to 1
+        lambda.convertTo(lambda, -1, sumLambda);
+
+        //create lambda2 kernel
+        lambda.copyTo(lambda2);
+        lambda2.at<double>(hsize, hsize) = 1.0;
+        ws.lambdaHalfSize = hsize;
     }
-    sumLambda -= lambda.at<double>(hsize, hsize);
-    //set center of kernel to 0
-    lambda.at<double>(hsize, hsize) = 0.0;
-    sumLambda = 1.0/sumLambda;
-    //normalize kernel to sum to 1
-    lambda = lambda*sumLambda;
-
-    //create lambda2 kernel
-    cv::Mat lambda2 = lambda.clone();
-    lambda2.at<double>(hsize, hsize) = 1.0;
 
     double terminateThr = 1e-1;
     double logLike = std::numeric_limits<double>::max();
     int maxIter = 50;
 
     //return values
-    cv::Mat Qsum_o(prior_o.rows, prior_o.cols, prior_o.type());
-    cv::Mat Qsum_b(prior_o.rows, prior_o.cols, prior_o.type());
+    cv::Mat & Qsum_o = ws.Qsum_o;
+    cv::Mat & Qsum_b = ws.Qsum_b;
 
     //algorithm temporal
-    cv::Mat Si_o(prior_o.rows, prior_o.cols, prior_o.type());
-    cv::Mat Si_b(prior_o.rows, prior_o.cols, prior_o.type());
-    cv::Mat Ssum_o(prior_o.rows, prior_o.cols, prior_o.type());
-    cv::Mat Ssum_b(prior_o.rows, prior_o.cols, prior_o.type());
-    cv::Mat Qi_o(prior_o.rows, prior_o.cols, prior_o.type());
-    cv::Mat Qi_b(prior_o.rows, prior_o.cols, prior_o.type());
-    cv::Mat logQo(prior_o.rows, prior_o.cols, prior_o.type());
-    cv::Mat logQb(prior_o.rows, prior_o.cols, prior_o.type());
+    cv::Mat & P_Io = ws.P_Io;
+    cv::Mat & P_Ib = ws.P_Ib;
+    cv::Mat & Si_o = ws.Si_o;
+    cv::Mat & Si_b = ws.Si_b;
+    cv::Mat & Ssum_o = ws.Ssum_o;
+    cv::Mat & Ssum_b = ws.Ssum_b;
+    cv::Mat & Qi_o = ws.Qi_o;
+    cv::Mat & Qi_b = ws.Qi_b;
+    cv::Mat & norm = ws.norm;
 
     int i;
     for (i = 0; i < maxIter; ++i){
         //follows the equations from Kristan et al. ACCV2014 paper
         //"A graphical model for rapid obstacle image-map estimation from unmanned surface vehicles"
-        cv::Mat P_Io = prior_o.mul(prob_o) + std::numeric_limits<double>::epsilon();
-        cv::Mat P_Ib = prior_b.mul(prob_b) + std::numeric_limits<double>::epsilon();
+        cv::multiply(prior_o, prob_o, P_Io);
+        cv::add(P_Io, std::numeric_limits<double>::epsilon(), P_Io);
+        cv::multiply(prior_b, prob_b, P_Ib);
+        cv::add(P_Ib, std::numeric_limits<double>::epsilon(), P_Ib);
 
         cv::filter2D(prior_o, Si_o, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
         cv::filter2D(prior_b, Si_b, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
-        Si_o = Si_o.mul(prior_o);
-        Si_b = Si_b.mul(prior_b);
-        cv::Mat normSi = 1.0/(Si_o + Si_b);
-        Si_o = Si_o.mul(normSi);
-        Si_b = Si_b.mul(normSi);
+        cv::multiply(Si_o, prior_o, Si_o);
+        cv::multiply(Si_b, prior_b, Si_b);
+        cv::add(Si_o, Si_b, norm);
+        cv::divide(1.0, norm, norm);
+        cv::multiply(Si_o, norm, Si_o);
+        cv::multiply(Si_b, norm, Si_b);
         cv::filter2D(Si_o, Ssum_o, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
         cv::filter2D(Si_b, Ssum_b, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
 
         cv::filter2D(P_Io, Qi_o, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
         cv::filter2D(P_Ib, Qi_b, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
-        Qi_o = Qi_o.mul(P_Io);
-        Qi_b = Qi_b.mul(P_Ib);
-        cv::Mat normQi = 1.0/(Qi_o + Qi_b);
-        Qi_o = Qi_o.mul(normQi);
-        Qi_b = Qi_b.mul(normQi);
+        cv::multiply(Qi_o, P_Io, Qi_o);
+        cv::multiply(Qi_b, P_Ib, Qi_b);
+        cv::add(Qi_o, Qi_b, norm);
+        cv::divide(1.0, norm, norm);
+        cv::multiply(Qi_o, norm, Qi_o);
+        cv::multiply(Qi_b, norm, Qi_b);
         cv::filter2D(Qi_o, Qsum_o, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
         cv::filter2D(Qi_b, Qsum_b, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
 
-        prior_o = (Qsum_o + Ssum_o)*0.25;
-        prior_b = (Qsum_b + Ssum_b)*0.25;
-        cv::Mat normPI = 1.0/(prior_o + prior_b);
-        prior_o = prior_o.mul(normPI);
-        prior_b = prior_b.mul(normPI);
+        cv::addWeighted(Qsum_o, 0.25, Ssum_o, 0.25, 0, prior_o);
+        cv::addWeighted(Qsum_b, 0.25, Ssum_b, 0.25, 0, prior_b);
+        cv::add(prior_o, prior_b, norm);
+        cv::divide(1.0, norm, norm);
+        cv::multiply(prior_o, norm, prior_o);
+        cv::multiply(prior_b, norm, prior_b);
 
         //converge ?
-        cv::log(Qsum_o, logQo);
-        cv::log(Qsum_b, logQb);
-        cv::Scalar mean = cv::sum(logQo+logQb);
+        cv::log(Qsum_o, ws.logQo);
+        cv::log(Qsum_b, ws.logQb);
+        cv::add(ws.logQo, ws.logQb, ws.logQo);
+        cv::Scalar mean = cv::sum(ws.logQo);
         double logLikeNew = -mean.val[0]/(2*Qsum_o.rows*Qsum_o.cols);
         if (std::abs(logLike - logLikeNew) < terminateThr)
             break;
         logLike = logLikeNew;
     }
-    return std::pair<cv::Mat, cv::Mat>(Qsum_o, Qsum_b);
 }
 
 } //cv namespace
@@ -21,8 +21,13 @@ public:
             int x1, int y1, int x2, int y2, int outer_x1, int outer_y1,
             int outer_x2, int outer_y2);
     cv::Mat backProject(std::vector<cv::Mat> & imgChannels);
+    void backProject(const std::vector<cv::Mat> & imgChannels, cv::Mat & dst) const;
     std::vector<double> getHistogramVector();
     void setHistogramVector(double *vector);
+    //zeroes the bins before a new extraction
+    void reset();
+    //blends the bins of a recent histogram of the same size in, with the given learning rate
+    void update(const Histogram &recent, float learningRate);
 
 private:
     int p_size;
@@ -34,21 +39,41 @@ private:
 };
 
 
+/** Buffers of the segmentation, reused from frame to frame */
+struct SegmentationWorkspace
+{
+    std::vector<cv::Mat> imgChannelsROI;    //channels rescaled to the segmentation size
+    cv::Mat fgPrior, bgPrior;               //priors rescaled to the segmentation size
+    cv::Mat fgLikelihood, bgLikelihood;
+    cv::Mat prob_o, prob_b;
+    int lambdaHalfSize;                     //half size of the cached kernels below
+    cv::Mat lambda, lambda2;
+    cv::Mat P_Io, P_Ib, Si_o, Si_b, Ssum_o, Ssum_b, Qi_o, Qi_b, Qsum_o, Qsum_b;
+    cv::Mat norm, logQo, logQb;
+    std::pair<cv::Mat, cv::Mat> probs;
+
+    SegmentationWorkspace() : lambdaHalfSize(0) {}
+};
+
 class Segment
 {
 public:
     static std::pair<cv::Mat, cv::Mat> computePosteriors(std::vector<cv::Mat> & imgChannels,
             int x1, int y1, int x2, int y2, cv::Mat weights, cv::Mat fgPrior,
             cv::Mat bgPrior, const Histogram &fgHistPrior, int numBinsPerChannel = 16);
+    //the returned probabilities are stored in the workspace
     static std::pair<cv::Mat, cv::Mat> computePosteriors2(std::vector<cv::Mat> & imgChannels,
             int x1, int y1, int x2, int y2, double p_b, cv::Mat fgPrior,
-            cv::Mat bgPrior, Histogram hist_target, Histogram hist_background);
+            cv::Mat bgPrior, const Histogram &hist_target, const Histogram &hist_background,
+            SegmentationWorkspace &ws);
     static std::pair<cv::Mat, cv::Mat> computePosteriors2(std::vector<cv::Mat> &imgChannels,
             cv::Mat fgPrior, cv::Mat bgPrior, Histogram hist_target, Histogram hist_background);
 
 private:
     static std::pair<cv::Mat, cv::Mat> getRegularizedSegmentation(cv::Mat & prob_o,
             cv::Mat & prob_b, cv::Mat &prior_o, cv::Mat &prior_b);
+    static void getRegularizedSegmentation(cv::Mat & prob_o, cv::Mat & prob_b,
+            cv::Mat &prior_o, cv::Mat &prior_b, SegmentationWorkspace &ws);
 
     inline static double gaussian(double x2, double y2, double std2){
         return exp(-(x2 + y2)/(2*std2))/(2*CV_PI*std2);
@@ -5,6 +5,7 @@
 #include "precomp.hpp"
 
 #include "trackerCSRTUtils.hpp"
+#include "correlationEngine.hpp"
 
 namespace cv {
 
@@ -43,50 +44,21 @@ Mat gaussian_shaped_labels(const float sigma, const int w, const int h)
     return yf;
 }
 
-std::vector<Mat> fourier_transform_features(const std::vector<Mat> &M)
-{
-    std::vector<Mat> out(M.size());
-    Mat channel;
-    // iterate over channels and convert them to Fourier domain
-    for(size_t k = 0; k < M.size(); k++) {
-        M[k].convertTo(channel, CV_32F);
-        dft(channel, channel, DFT_COMPLEX_OUTPUT);
-        out[k] = (channel);
-    }
-    return out;
-}
-
 Mat divide_complex_matrices(const Mat &A, const Mat &B)
 {
-    std::vector<Mat> va,vb;
-    split(A, va);
-    split(B, vb);
-
-    Mat a = va.at(0);
-    Mat b = va.at(1);
-    Mat c = vb.at(0);
-    Mat d = vb.at(1);
-
-    Mat div = c.mul(c) + d.mul(d);
-    Mat real_part = (a.mul(c) + b.mul(d));
-    Mat im_part = (b.mul(c) - a.mul(d));
-    divide(real_part, div, real_part);
-    divide(im_part, div, im_part);
-
-    std::vector<Mat> tmp(2);
-    tmp[0] = real_part;
-    tmp[1] = im_part;
     Mat res;
-    merge(tmp, res);
+    tracking::complexDiv(A, B, res);
     return res;
 }
 
-Mat get_subwindow(
+void get_subwindow(
         const Mat &image,
         const Point2f center,
         const int w,
         const int h,
-        Rect *valid_pixels)
+        Mat &subwin,
+        Rect *valid_pixels,
+        Mat *storage)
 {
     int startx = cvFloor(center.x) + 1 - (cvFloor(w/2));
     int starty = cvFloor(center.y) + 1 - (cvFloor(h/2));
@@ -110,13 +82,18 @@ Mat get_subwindow(
         padding_bottom = roi.y + roi.height - image.rows;
         roi.height = image.rows - roi.y;
     }
-    Mat subwin = image(roi).clone();
-    copyMakeBorder(subwin, subwin, padding_top, padding_bottom, padding_left, padding_right, BORDER_REPLICATE);
+    if(storage != NULL && w > 0 && h > 0) {
+        if(storage->type() != image.type() || storage->cols < w || storage->rows < h)
+            storage->create(std::max(storage->rows, h), std::max(storage->cols, w), image.type());
+        subwin = (*storage)(Rect(0, 0, w, h));
+    }
+    // isolated, the border replicates the roi only, as it did for a copy of the roi
+    copyMakeBorder(image(roi), subwin, padding_top, padding_bottom, padding_left, padding_right,
+            BORDER_REPLICATE | BORDER_ISOLATED);
 
     if(valid_pixels != NULL) {
         *valid_pixels = Rect(padding_left, padding_top, roi.width, roi.height);
     }
-    return subwin;
 }
 
 float subpixel_peak(const Mat &response, const std::string &s, const Point2f &p)
@@ -264,7 +241,8 @@ Mat get_chebyshev_win(Size sz, float attenuation)
     return cheb_rows * cheb_cols;
 }
 
-static void computeHOG32D(const Mat &imageM, Mat &featM, const int sbin, const int pad_x, const int pad_y)
+static void computeHOG32D(const Mat &imageM, Mat &featM, Mat &histM, Mat &normM,
+        const int sbin, const int pad_x, const int pad_y)
 {
     const int dimHOG = 32;
     CV_Assert(pad_x >= 0);
@@ -296,9 +274,12 @@ static void computeHOG32D(const Mat &imageM, Mat &featM, const int sbin, const i
     const Size visible = blockSize*sbin;
 
     // initialize historgram, norm, output feature matrices
-    Mat histM = Mat::zeros(Size(blockSize.width*numOrient, blockSize.height), CV_64F);
-    Mat normM = Mat::zeros(Size(blockSize.width, blockSize.height), CV_64F);
-    featM = Mat::zeros(Size(outSize.width*dimHOG, outSize.height), CV_64F);
+    histM.create(Size(blockSize.width*numOrient, blockSize.height), CV_64F);
+    normM.create(Size(blockSize.width, blockSize.height), CV_64F);
+    featM.create(Size(outSize.width*dimHOG, outSize.height), CV_64F);
+    histM.setTo(0);
+    normM.setTo(0);
+    featM.setTo(0);
 
     // get the stride of each matrix
     const size_t imStride = imageM.step1();
@@ -479,60 +460,62 @@ static void computeHOG32D(const Mat &imageM, Mat &featM, const int sbin, const i
     }// for y
 }
 
-std::vector<Mat> get_features_hog(const Mat &im, const int bin_size)
+void get_features_hog(const Mat &im, const int bin_size, std::vector<Mat> &features,
+        FeatureBuffers &buffers)
 {
-    Mat hogmatrix;
-    Mat im_;
-    im.convertTo(im_, CV_64FC3, 1.0/255.0);
-    computeHOG32D(im_,hogmatrix,bin_size,1,1);
-    hogmatrix.convertTo(hogmatrix, CV_32F);
+    im.convertTo(buffers.image, CV_64FC3, 1.0/255.0);
+    computeHOG32D(buffers.image, buffers.hog, buffers.hist, buffers.norm, bin_size, 1, 1);
+    buffers.hog.convertTo(buffers.hog32, CV_32F);
     Size hog_size = im.size();
     hog_size.width /= bin_size;
     hog_size.height /= bin_size;
-    Mat hogc(hog_size, CV_32FC(32), hogmatrix.data);
-    std::vector<Mat> features;
-    split(hogc, features);
-    return features;
+    Mat hogc(hog_size, CV_32FC(32), buffers.hog32.data);
+    split(hogc, buffers.hog_channels);
+    features.assign(buffers.hog_channels.begin(), buffers.hog_channels.end());
 }
 
-std::vector<Mat> get_features_cn(const Mat &ppatch_data, const Size &output_size) {
-    Mat patch_data = ppatch_data.clone();
-    Vec3b & pixel = patch_data.at<Vec3b>(0,0);
-    unsigned index;
-
-    Mat cnFeatures = Mat::zeros(patch_data.rows,patch_data.cols,CV_32FC(10));
+void get_features_cn(const Mat &patch_data, const Size &output_size, std::vector<Mat> &features,
+        FeatureBuffers &buffers)
+{
+    Mat &cnFeatures = buffers.cn;
+    cnFeatures.create(patch_data.rows, patch_data.cols, CV_32FC(10));
 
     for(int i=0;i<patch_data.rows;i++){
+        const Vec3b *pixel = patch_data.ptr<Vec3b>(i);
+        Vec<float,10> *cn = cnFeatures.ptr<Vec<float,10> >(i);
         for(int j=0;j<patch_data.cols;j++){
-            pixel=patch_data.at<Vec3b>(i,j);
-            index=(unsigned)(cvFloor((float)pixel[2]/8)+32*cvFloor((float)pixel[1]/8)+32*32*cvFloor((float)pixel[0]/8));
+            unsigned index=(unsigned)(cvFloor((float)pixel[j][2]/8)+32*cvFloor((float)pixel[j][1]/8)+32*32*cvFloor((float)pixel[j][0]/8));
 
             //copy the values
             for(int k=0;k<10;k++){
-                cnFeatures.at<Vec<float,10> >(i,j)[k]=(float)ColorNames[index][k];
+                cn[j][k]=(float)ColorNames[index][k];
             }
         }
     }
-    std::vector<Mat> result;
-    split(cnFeatures, result);
-    for (size_t i = 0; i < result.size(); i++) {
+    split(cnFeatures, buffers.cn_channels);
+    features.resize(buffers.cn_channels.size());
+    for (size_t i = 0; i < features.size(); i++) {
         if (output_size.width > 0 && output_size.height > 0) {
-            resize(result.at(i), result.at(i), output_size, INTER_CUBIC);
+            resize(buffers.cn_channels[i], features[i], output_size, 0, 0, INTER_LINEAR);
+        } else {
+            features[i] = buffers.cn_channels[i];
         }
     }
-    return result;
 }
 
-std::vector<Mat> get_features_rgb(const Mat &patch, const Size &output_size)
+void get_features_rgb(const Mat &patch, const Size &output_size, std::vector<Mat> &features,
+        FeatureBuffers &buffers)
 {
-    std::vector<Mat> channels;
+    std::vector<Mat> &channels = buffers.rgb_channels;
     split(patch, channels);
+    buffers.rgb_float.resize(channels.size());
+    features.resize(channels.size());
     for(size_t k=0; k<channels.size(); k++) {
-        channels[k].convertTo(channels[k], CV_32F, 1.0/255.0, -0.5);
-        channels[k] = channels[k] - mean(channels[k])[0];
-        resize(channels[k], channels[k], output_size, INTER_CUBIC);
+        Mat &channel = buffers.rgb_float[k];
+        channels[k].convertTo(channel, CV_32F, 1.0/255.0, -0.5);
+        channel -= mean(channel)[0];
+        resize(channel, features[k], output_size, 0, 0, INTER_LINEAR);
     }
-    return channels;
 }
 
 double get_max(const Mat &m)
@@ -549,15 +532,12 @@ double get_min(const Mat &m)
     return val;
 }
 
-Mat bgr2hsv(const Mat &img)
+void bgr2hsv(const Mat &img, Mat &hsv_img, std::vector<Mat> &hsv_img_channels)
 {
-    Mat hsv_img;
     cvtColor(img, hsv_img, COLOR_BGR2HSV);
-    std::vector<Mat> hsv_img_channels;
     split(hsv_img, hsv_img_channels);
     hsv_img_channels.at(0).convertTo(hsv_img_channels.at(0), CV_8UC1, 255.0 / 180.0);
     merge(hsv_img_channels, hsv_img);
-    return hsv_img;
 }
 
 } //cv namespace
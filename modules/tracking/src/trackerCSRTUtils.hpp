@@ -26,12 +26,25 @@ inline double kernel_epan(double x)
     return (x <= 1) ? (2.0/3.14)*(1-x) : 0;
 }
 
+/** Buffers of the feature extraction, reused from frame to frame */
+struct FeatureBuffers
+{
+    Mat image;                      // HOG input in double precision
+    Mat hist, norm;                 // HOG cell histograms and energies
+    Mat hog, hog32;                 // HOG features in double and single precision
+    std::vector<Mat> hog_channels;
+    Mat cn;                         // color-names features of the patch
+    std::vector<Mat> cn_channels;
+    std::vector<Mat> rgb_channels, rgb_float;
+};
+
 Mat circshift(Mat matrix, int dx, int dy);
 Mat gaussian_shaped_labels(const float sigma, const int w, const int h);
-std::vector<Mat> fourier_transform_features(const std::vector<Mat> &M);
 Mat divide_complex_matrices(const Mat &A, const Mat &B);
-Mat get_subwindow(const Mat &image, const Point2f center,
-        const int w, const int h,Rect *valid_pixels = NULL);
+// storage, when given, holds subwin; it only grows, so the windows whose size follows
+// the target scale are not reallocated when the scale changes
+void get_subwindow(const Mat &image, const Point2f center,
+        const int w, const int h, Mat &subwin, Rect *valid_pixels = NULL, Mat *storage = NULL);
 
 float subpixel_peak(const Mat &response, const std::string &s, const Point2f &p);
 double get_max(const Mat &m);
@@ -41,11 +54,15 @@ Mat get_hann_win(Size sz);
 Mat get_kaiser_win(Size sz, float alpha);
 Mat get_chebyshev_win(Size sz, float attenuation);
 
-std::vector<Mat> get_features_rgb(const Mat &patch, const Size &output_size);
-std::vector<Mat> get_features_hog(const Mat &im, const int bin_size);
-std::vector<Mat> get_features_cn(const Mat &im, const Size &output_size);
+// the features are stored in the buffers or in the Mats of features, which are reused when they fit
+void get_features_rgb(const Mat &patch, const Size &output_size, std::vector<Mat> &features,
+        FeatureBuffers &buffers);
+void get_features_hog(const Mat &im, const int bin_size, std::vector<Mat> &features,
+        FeatureBuffers &buffers);
+void get_features_cn(const Mat &im, const Size &output_size, std::vector<Mat> &features,
+        FeatureBuffers &buffers);
 
-Mat bgr2hsv(const Mat &img);
+void bgr2hsv(const Mat &img, Mat &hsv_img, std::vector<Mat> &hsv_img_channels);
 
 } //cv namespace
 
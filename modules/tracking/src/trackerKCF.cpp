@@ -41,8 +41,10 @@
 
 #include "precomp.hpp"
 #include "opencl_kernels_tracking.hpp"
+#include "correlationEngine.hpp"
 #include <complex>
 #include <cmath>
+#include <atomic>
 
 /*---------------------------
 |  TrackerKCFModel
@@ -62,6 +64,156 @@ namespace cv{
 } /* namespace cv */
 
 
+/*---------------------------
+|  TrackerKCF::FrameContext
+|---------------------------*/
+namespace cv{
+
+  /*
+ * Grayscale and color-names index maps of a frame, computed by tiles on demand
+ */
+  class TrackerKCFFrameContextImpl CV_FINAL : public TrackerKCF::FrameContext {
+  public:
+    TrackerKCFFrameContextImpl(int _tileSize);
+    void setFrame(InputArray image) CV_OVERRIDE;
+
+    // true if the features of this image are cached by the context
+    bool contains(const Mat& image) const;
+    // the number of the frames set so far, identifies the current frame of the context
+    uint64 getGeneration() const { return generation; }
+    // the frame, or its half-size version for the trackers working on resized images
+    const Mat& getImage(bool half);
+    // the grayscale (CV_8U) or color-names index (CV_16U) map restricted to the region of getImage(half)
+    Mat getMap(bool half, TrackerKCF::MODE desc, const Rect& region);
+
+  private:
+    struct Level {
+      Mat image;
+      Mat maps[2]; // grayscale, color-names indices
+      std::vector<std::atomic<uchar> > ready[2]; // computed tiles of the maps
+      int tilesX;
+    };
+
+    void resetLevel(Level& level) const;
+    void computeTile(Level& level, int map, const Rect& tile) const;
+
+    enum { LOCKS_NUM = 16 };
+
+    int tileSize;
+    Mat frame;
+    uint64 generation;
+    Level levels[2];
+    std::atomic<bool> halfReady;
+    Mutex halfLock;
+    Mutex tileLocks[LOCKS_NUM]; // a tile is computed under the lock of its index modulo LOCKS_NUM
+  };
+
+  Ptr<TrackerKCF::FrameContext> TrackerKCF::FrameContext::create(int tileSize){
+      return makePtr<TrackerKCFFrameContextImpl>(tileSize);
+  }
+
+  TrackerKCFFrameContextImpl::TrackerKCFFrameContextImpl(int _tileSize) :
+      tileSize(_tileSize), generation(0), halfReady(false)
+  {
+    CV_Assert(tileSize > 0);
+  }
+
+  void TrackerKCFFrameContextImpl::setFrame(InputArray image){
+    CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+    frame = image.getMat();
+    levels[0].image = frame;
+    resetLevel(levels[0]);
+    levels[1].image.release();
+    halfReady = false;
+    generation++;
+  }
+
+  bool TrackerKCFFrameContextImpl::contains(const Mat& image) const {
+    return !frame.empty() && image.data == frame.data && image.step == frame.step
+        && image.size() == frame.size() && image.type() == frame.type();
+  }
+
+  const Mat& TrackerKCFFrameContextImpl::getImage(bool half){
+    if(!half)
+      return levels[0].image;
+
+    if(!halfReady.load(std::memory_order_acquire)){
+      AutoLock lock(halfLock);
+      if(!halfReady.load(std::memory_order_relaxed)){
+        resize(frame,levels[1].image,Size(frame.cols/2,frame.rows/2),0,0,INTER_LINEAR_EXACT);
+        resetLevel(levels[1]);
+        halfReady.store(true, std::memory_order_release);
+      }
+    }
+    return levels[1].image;
+  }
+
+  void TrackerKCFFrameContextImpl::resetLevel(Level& level) const {
+    const Mat& img = level.image;
+    level.tilesX = (img.cols + tileSize - 1) / tileSize;
+    const size_t tilesNum = (size_t)level.tilesX * ((img.rows + tileSize - 1) / tileSize);
+
+    level.maps[0].create(img.size(), CV_8U);
+    if(img.channels() == 3)
+      level.maps[1].create(img.size(), CV_16U);
+
+    for(int m = 0; m < 2; m++){
+      if(level.ready[m].size() != tilesNum){
+        std::vector<std::atomic<uchar> > ready(tilesNum);
+        level.ready[m].swap(ready);
+      }
+      for(size_t t = 0; t < tilesNum; t++)
+        level.ready[m][t].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void TrackerKCFFrameContextImpl::computeTile(Level& level, int map, const Rect& tile) const {
+    const Mat src = level.image(tile);
+    Mat dst = level.maps[map](tile);
+    if(map == 0){
+      cvtColor(src, dst, COLOR_BGR2GRAY);
+      return;
+    }
+
+    // the same index as TrackerKCFImpl::extractCN computes
+    for(int i = 0; i < src.rows; i++){
+      const Vec3b* pixel = src.ptr<Vec3b>(i);
+      ushort* index = dst.ptr<ushort>(i);
+      for(int j = 0; j < src.cols; j++)
+        index[j] = (ushort)((pixel[j][2] >> 3) + ((pixel[j][1] >> 3) << 5) + ((pixel[j][0] >> 3) << 10));
+    }
+  }
+
+  Mat TrackerKCFFrameContextImpl::getMap(bool half, TrackerKCF::MODE desc, const Rect& region){
+    getImage(half);
+    Level& level = levels[half ? 1 : 0];
+    const int map = desc == TrackerKCF::CN ? 1 : 0;
+    CV_Assert(map == 0 || level.image.channels() == 3);
+    if(map == 0 && level.image.channels() == 1)
+      return level.image(region);
+
+    const int tx0 = region.x / tileSize, tx1 = (region.x + region.width - 1) / tileSize;
+    const int ty0 = region.y / tileSize, ty1 = (region.y + region.height - 1) / tileSize;
+    for(int ty = ty0; ty <= ty1; ty++){
+      for(int tx = tx0; tx <= tx1; tx++){
+        const int t = ty * level.tilesX + tx;
+        if(level.ready[map][t].load(std::memory_order_acquire))
+          continue;
+
+        AutoLock lock(tileLocks[t % LOCKS_NUM]);
+        if(!level.ready[map][t].load(std::memory_order_relaxed)){
+          Rect tile = Rect(tx * tileSize, ty * tileSize, tileSize, tileSize) & Rect(0, 0, level.image.cols, level.image.rows);
+          computeTile(level, map, tile);
+          level.ready[map][t].store(1, std::memory_order_release);
+        }
+      }
+    }
+    return level.maps[map](region);
+  }
+
+} /* namespace cv */
+
+
 /*---------------------------
 |  TrackerKCF
 |---------------------------*/
@@ -76,6 +228,7 @@ namespace cv{
     void read( const FileNode& /*fn*/ ) CV_OVERRIDE;
     void write( FileStorage& /*fs*/ ) const CV_OVERRIDE;
     void setFeatureExtractor(void (*f)(const Mat, const Rect, Mat&), bool pca_func = false) CV_OVERRIDE;
+    void setFrameContext(const Ptr<FrameContext>& context) CV_OVERRIDE;
 
   protected:
      /*
@@ -90,19 +243,18 @@ namespace cv{
     * KCF functions and vars
     */
     void createHanningWindow(OutputArray dest, const cv::Size winSize, const int type) const;
-    void inline fft2(const Mat src, std::vector<Mat> & dest, std::vector<Mat> & layers_data) const;
+    void inline fft2(const Mat src, std::vector<Mat> & dest) const;
     void inline fft2(const Mat src, Mat & dest) const;
     void inline ifft2(const Mat src, Mat & dest) const;
-    void inline pixelWiseMult(const std::vector<Mat> src1, const std::vector<Mat>  src2, std::vector<Mat>  & dest, const int flags, const bool conjB=false) const;
-    void inline sumChannels(std::vector<Mat> src, Mat & dest) const;
     void inline updateProjectionMatrix(const Mat src, Mat & old_cov,Mat &  proj_matrix,float pca_rate, int compressed_sz,
                                        std::vector<Mat> & layers_pca,std::vector<Scalar> & average, Mat pca_data, Mat new_cov, Mat w, Mat u, Mat v);
     void inline compress(const Mat proj_matrix, const Mat src, Mat & dest, Mat & data, Mat & compressed) const;
     bool getSubWindow(const Mat img, const Rect roi, Mat& feat, Mat& patch, TrackerKCF::MODE desc = GRAY) const;
     bool getSubWindow(const Mat img, const Rect roi, Mat& feat, void (*f)(const Mat, const Rect, Mat& )) const;
     void extractCN(Mat patch_data, Mat & cnFeatures) const;
+    void lookupCN(Mat index_data, Mat & cnFeatures) const;
     void denseGaussKernel(const float sigma, const Mat , const Mat y_data, Mat & k_data,
-                          std::vector<Mat> & layers_data,std::vector<Mat> & xf_data,std::vector<Mat> & yf_data, std::vector<Mat> xyf_v, Mat xy, Mat xyf ) const;
+                          std::vector<Mat> & xf_data,std::vector<Mat> & yf_data, Mat xy, Mat xyf ) const;
     void calcResponse(const Mat alphaf_data, const Mat kf_data, Mat & response_data, Mat & spec_data) const;
     void calcResponse(const Mat alphaf_data, const Mat alphaf_den_data, const Mat kf_data, Mat & response_data, Mat & spec_data, Mat & spec2_data) const;
 
@@ -131,8 +283,10 @@ namespace cv{
 
     // pre-defined Mat variables for optimization of private functions
     Mat spec, spec2;
-    std::vector<Mat> layers;
-    std::vector<Mat> vxf,vyf,vxyf;
+    std::vector<Mat> vxf,vyf;
+
+    // DFT plans of the patch size, filled by the const transforms
+    mutable tracking::CorrelationEngine correlation;
     Mat xy_data,xyf_data;
     Mat data_temp, compress_data;
     std::vector<Mat> layers_pca_data;
@@ -158,6 +312,12 @@ namespace cv{
     std::vector<void(*)(const Mat img, const Rect roi, Mat& output)> extractor_npca;
 
     bool resizeImage; // resize the image whenever needed and the patch size is large
+    Mat resized_img; // the resized frame if it is not read from the shared context
+
+    // features shared with the other trackers, used for the frames the context is set to
+    Ptr<TrackerKCFFrameContextImpl> frame_context;
+    bool use_frame_context;
+    uint64 frame_context_generation; // the frame of the context used by the last update
 
 #ifdef HAVE_OPENCL
     ocl::Kernel transpose_mm_ker; // OCL kernel to compute transpose matrix multiply matrix.
@@ -180,6 +340,8 @@ namespace cv{
   {
     isInit = false;
     resizeImage = false;
+    use_frame_context = false;
+    frame_context_generation = 0;
     use_custom_extractor_pca = false;
     use_custom_extractor_npca = false;
 
@@ -301,12 +463,24 @@ namespace cv{
     double minVal, maxVal;	// min-max response
     Point minLoc,maxLoc;	// min-max location
 
-    Mat img=image.clone();
     // check the channels of the input image, grayscale is preferred
-    CV_Assert(img.channels() == 1 || img.channels() == 3);
-
-    // resize the image whenever needed
-    if(resizeImage)resize(img,img,Size(img.cols/2,img.rows/2),0,0,INTER_LINEAR_EXACT);
+    CV_Assert(image.channels() == 1 || image.channels() == 3);
+
+    // resize the image whenever needed, the shared context does it once for all its trackers.
+    // A frame of the context serves one update only: the same buffer may hold a new frame that
+    // was not set to the context yet
+    Mat img;
+    use_frame_context = frame_context && frame_context->contains(image)
+        && frame_context->getGeneration() != frame_context_generation;
+    if(use_frame_context){
+      frame_context_generation = frame_context->getGeneration();
+      img=frame_context->getImage(resizeImage);
+    }
+    else if(resizeImage){
+      resize(image,resized_img,Size(image.cols/2,image.rows/2),0,0,INTER_LINEAR_EXACT);
+      img=resized_img;
+    }else
+      img=image;
 
     // detection part
     if(frame>0){
@@ -354,7 +528,7 @@ namespace cv{
       }
 
       //compute the gaussian kernel
-      denseGaussKernel(params.sigma,x,z,k,layers,vxf,vyf,vxyf,xy_data,xyf_data);
+      denseGaussKernel(params.sigma,x,z,k,vxf,vyf,xy_data,xyf_data);
 
       // compute the fourier transform of the kernel
       fft2(k,kf);
@@ -432,37 +606,18 @@ namespace cv{
     else
       merge(X,2,x);
 
-    // initialize some required Mat variables
-    if(frame==0){
-      layers.resize(x.channels());
-      vxf.resize(x.channels());
-      vyf.resize(x.channels());
-      vxyf.resize(vyf.size());
-      new_alphaf=Mat_<Vec2f >(yf.rows, yf.cols);
-    }
-
     // Kernel Regularized Least-Squares, calculate alphas
-    denseGaussKernel(params.sigma,x,x,k,layers,vxf,vyf,vxyf,xy_data,xyf_data);
+    denseGaussKernel(params.sigma,x,x,k,vxf,vyf,xy_data,xyf_data);
 
     // compute the fourier transform of the kernel and add a small value
     fft2(k,kf);
     kf_lambda=kf+params.lambda;
 
-    float den;
     if(params.split_coeff){
-      mulSpectrums(yf,kf,new_alphaf,0);
-      mulSpectrums(kf,kf_lambda,new_alphaf_den,0);
+      tracking::complexMul(yf,kf,new_alphaf);
+      tracking::complexMul(kf,kf_lambda,new_alphaf_den);
     }else{
-      for(int i=0;i<yf.rows;i++){
-        for(int j=0;j<yf.cols;j++){
-          den = 1.0f/(kf_lambda.at<Vec2f>(i,j)[0]*kf_lambda.at<Vec2f>(i,j)[0]+kf_lambda.at<Vec2f>(i,j)[1]*kf_lambda.at<Vec2f>(i,j)[1]);
-
-          new_alphaf.at<Vec2f>(i,j)[0]=
-          (yf.at<Vec2f>(i,j)[0]*kf_lambda.at<Vec2f>(i,j)[0]+yf.at<Vec2f>(i,j)[1]*kf_lambda.at<Vec2f>(i,j)[1])*den;
-          new_alphaf.at<Vec2f>(i,j)[1]=
-          (yf.at<Vec2f>(i,j)[1]*kf_lambda.at<Vec2f>(i,j)[0]-yf.at<Vec2f>(i,j)[0]*kf_lambda.at<Vec2f>(i,j)[1])*den;
-        }
-      }
+      tracking::complexDiv(yf,kf_lambda,new_alphaf);
     }
 
     // update the RLS model
@@ -526,41 +681,19 @@ namespace cv{
    * simplification of fourier transform function in opencv
    */
   void inline TrackerKCFImpl::fft2(const Mat src, Mat & dest) const {
-    dft(src,dest,DFT_COMPLEX_OUTPUT);
+    correlation.fft(src,dest);
   }
 
-  void inline TrackerKCFImpl::fft2(const Mat src, std::vector<Mat> & dest, std::vector<Mat> & layers_data) const {
-    split(src, layers_data);
-
-    for(int i=0;i<src.channels();i++){
-      dft(layers_data[i],dest[i],DFT_COMPLEX_OUTPUT);
-    }
+  // all the channels are transformed with the same plan
+  void inline TrackerKCFImpl::fft2(const Mat src, std::vector<Mat> & dest) const {
+    correlation.fft(src,dest);
   }
 
   /*
    * simplification of inverse fourier transform function in opencv
    */
   void inline TrackerKCFImpl::ifft2(const Mat src, Mat & dest) const {
-    idft(src,dest,DFT_SCALE+DFT_REAL_OUTPUT);
-  }
-
-  /*
-   * Point-wise multiplication of two Multichannel Mat data
-   */
-  void inline TrackerKCFImpl::pixelWiseMult(const std::vector<Mat> src1, const std::vector<Mat>  src2, std::vector<Mat>  & dest, const int flags, const bool conjB) const {
-    for(unsigned i=0;i<src1.size();i++){
-      mulSpectrums(src1[i], src2[i], dest[i],flags,conjB);
-    }
-  }
-
-  /*
-   * Combines all channels in a multi-channels Mat data into a single channel
-   */
-  void inline TrackerKCFImpl::sumChannels(std::vector<Mat> src, Mat & dest) const {
-    dest=src[0].clone();
-    for(unsigned i=1;i<src.size();i++){
-      dest+=src[i];
-    }
+    correlation.ifft(src,dest);
   }
 
 #ifdef HAVE_OPENCL
@@ -679,7 +812,8 @@ namespace cv{
     if (region.empty())
         return false;
 
-    patch=img(region).clone();
+    // the features of the shared context are read before the padding, which commutes with them
+    Mat src=use_frame_context ? frame_context->getMap(resizeImage,desc,region) : img(region);
 
     // add some padding to compensate when the patch is outside image border
     int addTop,addBottom, addLeft, addRight;
@@ -688,18 +822,21 @@ namespace cv{
     addLeft=region.x-_roi.x;
     addRight=(_roi.width+_roi.x>img.cols?_roi.width+_roi.x-img.cols:0);
 
-    copyMakeBorder(patch,patch,addTop,addBottom,addLeft,addRight,BORDER_REPLICATE);
+    copyMakeBorder(src,patch,addTop,addBottom,addLeft,addRight,BORDER_REPLICATE|BORDER_ISOLATED);
     if(patch.rows==0 || patch.cols==0)return false;
 
     // extract the desired descriptors
     switch(desc){
       case CN:
         CV_Assert(img.channels() == 3);
-        extractCN(patch,feat);
+        if(use_frame_context)
+          lookupCN(patch,feat);
+        else
+          extractCN(patch,feat);
         feat=feat.mul(hann_cn); // hann window filter
         break;
       default: // GRAY
-        if(img.channels()>1)
+        if(img.channels()>1 && !use_frame_context)
           cvtColor(patch,feat, COLOR_BGR2GRAY);
         else
           feat=patch;
@@ -769,23 +906,37 @@ namespace cv{
 
   }
 
+  /* Convert ColorNames indices computed by the frame context to ColorNames
+   */
+  void TrackerKCFImpl::lookupCN(Mat index_data, Mat & cnFeatures) const {
+    if(cnFeatures.type() != CV_32FC(10) || cnFeatures.size() != index_data.size())
+      cnFeatures.create(index_data.rows,index_data.cols,CV_32FC(10));
+
+    for(int i=0;i<index_data.rows;i++){
+      const ushort* index = index_data.ptr<ushort>(i);
+      float* dst = cnFeatures.ptr<float>(i);
+      for(int j=0;j<index_data.cols;j++,dst+=10)
+        memcpy(dst, ColorNames[index[j]], 10*sizeof(float));
+    }
+  }
+
   /*
    *  dense gauss kernel function
    */
   void TrackerKCFImpl::denseGaussKernel(const float sigma, const Mat x_data, const Mat y_data, Mat & k_data,
-                                        std::vector<Mat> & layers_data,std::vector<Mat> & xf_data,std::vector<Mat> & yf_data, std::vector<Mat> xyf_v, Mat xy, Mat xyf ) const {
+                                        std::vector<Mat> & xf_data,std::vector<Mat> & yf_data, Mat xy, Mat xyf ) const {
     double normX, normY;
 
-    fft2(x_data,xf_data,layers_data);
-    fft2(y_data,yf_data,layers_data);
+    fft2(x_data,xf_data);
+    fft2(y_data,yf_data);
 
     normX=norm(x_data);
     normX*=normX;
     normY=norm(y_data);
     normY*=normY;
 
-    pixelWiseMult(xf_data,yf_data,xyf_v,0,true);
-    sumChannels(xyf_v,xyf);
+    // sum of the per-channel correlations
+    tracking::complexMulSum(xf_data,yf_data,xyf,true);
     ifft2(xyf,xyf);
 
     if(params.wrap_kernel){
@@ -866,7 +1017,7 @@ namespace cv{
    */
   void TrackerKCFImpl::calcResponse(const Mat alphaf_data, const Mat kf_data, Mat & response_data, Mat & spec_data) const {
     //alpha f--> 2channels ; k --> 1 channel;
-    mulSpectrums(alphaf_data,kf_data,spec_data,0,false);
+    tracking::complexMul(alphaf_data,kf_data,spec_data);
     ifft2(spec_data,response_data);
   }
 
@@ -875,19 +1026,10 @@ namespace cv{
    */
   void TrackerKCFImpl::calcResponse(const Mat alphaf_data, const Mat _alphaf_den, const Mat kf_data, Mat & response_data, Mat & spec_data, Mat & spec2_data) const {
 
-    mulSpectrums(alphaf_data,kf_data,spec_data,0,false);
+    tracking::complexMul(alphaf_data,kf_data,spec_data);
 
     //z=(a+bi)/(c+di)=[(ac+bd)+i(bc-ad)]/(c^2+d^2)
-    float den;
-    for(int i=0;i<kf_data.rows;i++){
-      for(int j=0;j<kf_data.cols;j++){
-        den=1.0f/(_alphaf_den.at<Vec2f>(i,j)[0]*_alphaf_den.at<Vec2f>(i,j)[0]+_alphaf_den.at<Vec2f>(i,j)[1]*_alphaf_den.at<Vec2f>(i,j)[1]);
-        spec2_data.at<Vec2f>(i,j)[0]=
-          (spec_data.at<Vec2f>(i,j)[0]*_alphaf_den.at<Vec2f>(i,j)[0]+spec_data.at<Vec2f>(i,j)[1]*_alphaf_den.at<Vec2f>(i,j)[1])*den;
-        spec2_data.at<Vec2f>(i,j)[1]=
-          (spec_data.at<Vec2f>(i,j)[1]*_alphaf_den.at<Vec2f>(i,j)[0]-spec_data.at<Vec2f>(i,j)[0]*_alphaf_den.at<Vec2f>(i,j)[1])*den;
-      }
-    }
+    tracking::complexDiv(spec_data,_alphaf_den,spec2_data);
 
     ifft2(spec2_data,response_data);
   }
@@ -901,6 +1043,12 @@ namespace cv{
       use_custom_extractor_npca = true;
     }
   }
+
+  void TrackerKCFImpl::setFrameContext(const Ptr<FrameContext>& context){
+    frame_context = context.dynamicCast<TrackerKCFFrameContextImpl>();
+    CV_Assert(frame_context || !context);
+    frame_context_generation = 0;
+  }
   /*----------------------------------------------------------------------*/
 
   /*
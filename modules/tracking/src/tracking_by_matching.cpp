@@ -2,6 +2,7 @@
 // It is subject to the license terms in the LICENSE file found in the top-level directory
 // of this distribution and at http://opencv.org/license.html.
 
+#include <cmath>
 #include <map>
 #include <set>
 #include <string>
@@ -14,7 +15,7 @@
 
 #include "opencv2/tracking/tracking_by_matching.hpp"
 #include "opencv2/core/check.hpp"
-#include "kuhn_munkres.hpp"
+#include "jonker_volgenant.hpp"
 
 #define TBM_CHECK(cond) CV_Assert(cond)
 
@@ -81,6 +82,9 @@ std::vector<float> MatchTemplateDistance::compute(const std::vector<cv::Mat> &de
 }
 
 namespace {
+// Fast affinities below this value are rounded to zero.
+const float kMinAffinity = 1e-6f;
+
 cv::Point Center(const cv::Rect& rect) {
     return cv::Point((int)(rect.x + rect.width * .5), (int)(rect.y + rect.height * .5));
 }
@@ -194,10 +198,12 @@ void ValidateParams(const TrackerParams &p) {
 /// detections. The affinity equals to
 ///       appearance_affinity * motion_affinity * shape_affinity.
 /// Where appearance is 1 - distance(tracklet_fast_dscr, detection_fast_dscr).
-/// Second step is to solve the assignment problem using Kuhn-Munkres
-/// algorithm. If correspondence between some tracklet and detection is
-/// established with low confidence (affinity) then the strong descriptor is
-/// used to determine if there is correspondence between tracklet and detection.
+/// Second step is to solve the assignment problem with the Jonker-Volgenant
+/// shortest augmenting path algorithm, separately for each group of tracks and
+/// detections connected by non-zero affinities. If correspondence between some
+/// tracklet and detection is established with low confidence (affinity) then
+/// the strong descriptor is used to determine if there is correspondence
+/// between tracklet and detection.
 ///
 class TrackerByMatching: public ITrackerByMatching {
 public:
@@ -402,10 +408,14 @@ private:
                                const TrackedObjects &detections,
                                CV_OUT std::vector<cv::Mat>& desriptors);
 
-    void ComputeDissimilarityMatrix(const std::set<size_t> &active_track_ids,
-                                    const TrackedObjects &detections,
-                                    const std::vector<cv::Mat> &fast_descriptors,
-                                    CV_OUT cv::Mat& dissimilarity_matrix);
+    // Pair of a track (row, index in the active tracks) and a detection
+    // (column, index in the detections) with non-zero fast affinity.
+    using AffinityEdge = JonkerVolgenant::Entry;
+
+    void ComputeAffinityGraph(const std::vector<size_t> &active_track_ids,
+                              const TrackedObjects &detections,
+                              const std::vector<cv::Mat> &fast_descriptors,
+                              CV_OUT std::vector<AffinityEdge>& edges);
 
     std::vector<float> ComputeDistances(
         const cv::Mat &frame,
@@ -681,24 +691,49 @@ void TrackerByMatching::SolveAssignmentProblem(
     TBM_CHECK(descriptors.size() == detections.size());
     matches.clear();
 
-    cv::Mat dissimilarity;
-    ComputeDissimilarityMatrix(track_ids, detections, descriptors,
-                               dissimilarity);
+    const std::vector<size_t> ids(track_ids.begin(), track_ids.end());
+    std::vector<AffinityEdge> edges;
+    ComputeAffinityGraph(ids, detections, descriptors, edges);
 
-    auto res = KuhnMunkres().Solve(dissimilarity);
+    // Tracks and detections which can't be matched to each other with
+    // non-zero affinity are solved independently.
+    const size_t num_tracks = ids.size();
+    const std::vector<size_t> res =
+        JonkerVolgenant::SolveSparse(num_tracks, detections.size(), edges);
 
     for (size_t i = 0; i < detections.size(); i++) {
         unmatched_detections.insert(i);
     }
 
-    int i = 0;
-    for (auto id : track_ids) {
-        if (res[i] < detections.size()) {
-            matches.emplace(id, res[i], 1 - dissimilarity.at<float>(i, static_cast<int>(res[i])));
+    // A component may pair a track and a detection without an edge.
+    std::vector<float> affinities(num_tracks, 0.0f);
+    for (const auto &edge : edges) {
+        if (res[edge.row] == edge.col) {
+            affinities[edge.row] = 1 - edge.dissimilarity;
+        }
+    }
+
+    std::vector<char> is_track_matched(num_tracks, 0);
+    std::vector<char> is_det_matched(detections.size(), 0);
+    for (size_t i = 0; i < num_tracks; i++) {
+        if (res[i] >= detections.size()) continue;
+        matches.emplace(ids[i], res[i], affinities[i]);
+        is_track_matched[i] = 1;
+        is_det_matched[res[i]] = 1;
+    }
+
+    // The full assignment pairs as many tracks as possible with
+    // detections, so the rest of them are paired with zero affinity.
+    size_t j = 0;
+    for (size_t i = 0; i < num_tracks; i++) {
+        if (is_track_matched[i]) continue;
+        while (j < detections.size() && is_det_matched[j]) j++;
+        if (j < detections.size()) {
+            matches.emplace(ids[i], j, 0.0f);
+            j++;
         } else {
-            unmatched_tracks.insert(id);
+            unmatched_tracks.insert(ids[i]);
         }
-        i++;
     }
 }
 
@@ -985,23 +1020,60 @@ void TrackerByMatching::ComputeFastDesciptors(
     }
 }
 
-void TrackerByMatching::ComputeDissimilarityMatrix(
-    const std::set<size_t> &active_tracks, const TrackedObjects &detections,
+void TrackerByMatching::ComputeAffinityGraph(
+    const std::vector<size_t> &active_tracks, const TrackedObjects &detections,
     const std::vector<cv::Mat> &descriptors_fast,
-    cv::Mat& dissimilarity_matrix) {
-    cv::Mat am(static_cast<int>(active_tracks.size()), static_cast<int>(detections.size()), CV_32F, cv::Scalar(0));
-    int i = 0;
-    for (auto id : active_tracks) {
-        auto ptr = am.ptr<float>(i);
-        for (size_t j = 0; j < descriptors_fast.size(); j++) {
-            auto last_det = tracks_.at(id).objects.back();
-            last_det.rect = tracks_.at(id).predicted_rect;
-            ptr[j] = AffinityFast(tracks_.at(id).descriptor_fast, last_det,
-                                  descriptors_fast[j], detections[j]);
+    std::vector<AffinityEdge>& edges) {
+    edges.clear();
+
+    TrackedObjects last_dets(active_tracks.size());
+    std::vector<std::pair<int, size_t>> x_order(active_tracks.size());
+    for (size_t i = 0; i < active_tracks.size(); i++) {
+        const auto &track = tracks_.at(active_tracks[i]);
+        last_dets[i] = track.objects.back();
+        last_dets[i].rect = track.predicted_rect;
+        x_order[i] = std::make_pair(last_dets[i].rect.x, i);
+    }
+    std::sort(x_order.begin(), x_order.end());
+
+    // The motion affinity is below kMinAffinity, which makes the fast
+    // affinity zero, if (dx / det.width)^2 + (dy / det.height)^2 exceeds
+    // -log(kMinAffinity) / motion_affinity_w. Only the tracks inside
+    // of the slightly enlarged bounding box of this ellipse are compared
+    // with a detection.
+    const bool use_gating = params_.motion_affinity_w > 0;
+    const double radius = use_gating ?
+        std::sqrt(-1.01 * std::log(kMinAffinity) / params_.motion_affinity_w) : 0.0;
+
+    for (size_t j = 0; j < detections.size(); j++) {
+        const cv::Rect &det = detections[j].rect;
+        auto begin = x_order.begin();
+        auto end = x_order.end();
+        double max_dy = 0;
+        if (use_gating) {
+            double max_dx = radius * det.width + 1;
+            max_dy = radius * det.height + 1;
+            begin = std::lower_bound(
+                x_order.begin(), x_order.end(),
+                std::make_pair(cvFloor(det.x - max_dx), size_t(0)));
+            end = std::upper_bound(
+                begin, x_order.end(),
+                std::make_pair(cvCeil(det.x + max_dx),
+                               std::numeric_limits<size_t>::max()));
+        }
+        for (auto it = begin; it != end; ++it) {
+            size_t i = it->second;
+            if (use_gating && std::abs(last_dets[i].rect.y - det.y) > max_dy) {
+                continue;
+            }
+            float affinity = AffinityFast(
+                tracks_.at(active_tracks[i]).descriptor_fast, last_dets[i],
+                descriptors_fast[j], detections[j]);
+            if (affinity > 0) {
+                edges.push_back({i, j, 1.0f - affinity});
+            }
         }
-        i++;
     }
-    dissimilarity_matrix = 1.0 - am;
 }
 
 std::vector<float> TrackerByMatching::ComputeDistances(
@@ -1196,17 +1268,16 @@ float TrackerByMatching::AffinityFast(const cv::Mat &descriptor1,
                                       const TrackedObject &obj1,
                                       const cv::Mat &descriptor2,
                                       const TrackedObject &obj2) {
-    const float eps = static_cast<float>(1e-6);
     float shp_aff = ShapeAffinity(params_.shape_affinity_w, obj1.rect, obj2.rect);
-    if (shp_aff < eps) return 0.0;
+    if (shp_aff < kMinAffinity) return 0.0;
 
     float mot_aff =
         MotionAffinity(params_.motion_affinity_w, obj1.rect, obj2.rect);
-    if (mot_aff < eps) return 0.0;
+    if (mot_aff < kMinAffinity) return 0.0;
     float time_aff =
         TimeAffinity(params_.time_affinity_w, static_cast<float>(obj1.frame_idx), static_cast<float>(obj2.frame_idx));
 
-    if (time_aff < eps) return 0.0;
+    if (time_aff < kMinAffinity) return 0.0;
 
     float app_aff = static_cast<float>(1.0 - distance_fast_->compute(descriptor1, descriptor2));
 
@@ -0,0 +1,26 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#ifndef __OPENCV_TRACKING_TEST_COMMON_HPP__
+#define __OPENCV_TRACKING_TEST_COMMON_HPP__
+
+#include "opencv2/imgproc.hpp"
+
+namespace opencv_test {
+
+/** Blurred random texture shifted by (dx, dy) pixels, the same texture for every call */
+static inline Mat texturedFrame(Size size, double dx, double dy)
+{
+    Mat texture(size, CV_8UC3);
+    RNG rng(0);
+    rng.fill(texture, RNG::UNIFORM, 0, 255);
+    GaussianBlur(texture, texture, Size(5, 5), 1.5);
+
+    Mat frame;
+    warpAffine(texture, frame, Matx23d(1, 0, dx, 0, 1, dy), size, INTER_LINEAR, BORDER_REFLECT);
+    return frame;
+}
+
+}
+
+#endif
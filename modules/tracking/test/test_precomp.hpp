@@ -6,5 +6,6 @@
 
 #include "opencv2/ts.hpp"
 #include "opencv2/tracking.hpp"
+#include "test_common.hpp"
 
 #endif
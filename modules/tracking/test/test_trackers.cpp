@@ -570,5 +570,213 @@ TEST_P(DistanceAndOverlap, Scaled_Data_CSRT)
 
 INSTANTIATE_TEST_CASE_P( Tracking, DistanceAndOverlap, TESTSET_NAMES);
 
+/***************************************************************************************/
+//Parallel update of MultiTracker
+
+static Mat multiTrackerFrame(double dx, double dy)
+{
+  return texturedFrame(Size(640, 480), dx, dy);
+}
+
+TEST(MultiTracker, parallel_update_matches_serial)
+{
+  MultiTracker serial, parallel;
+  parallel.setParallelUpdate(true);
+  ASSERT_TRUE(parallel.getParallelUpdate());
+
+  Mat frame = multiTrackerFrame(0, 0);
+  for( int i = 0; i < 12; i++ )
+  {
+    Rect2d box(60 + (i % 4) * 140, 60 + (i / 4) * 140, 48, 48);
+    if( i % 2 )
+    {
+      ASSERT_TRUE(serial.add(TrackerKCF::create(), frame, box));
+      ASSERT_TRUE(parallel.add(TrackerKCF::create(), frame, box));
+    }
+    else
+    {
+      ASSERT_TRUE(serial.add(TrackerMOSSE::create(), frame, box));
+      ASSERT_TRUE(parallel.add(TrackerMOSSE::create(), frame, box));
+    }
+  }
+
+  for( int k = 1; k <= 5; k++ )
+  {
+    frame = multiTrackerFrame(2 * k, k);
+    std::vector<Rect2d> serialBoxes, parallelBoxes;
+    bool serialStatus = serial.update(frame, serialBoxes);
+    bool parallelStatus = parallel.update(frame, parallelBoxes);
+
+    EXPECT_EQ(serialStatus, parallelStatus);
+    ASSERT_EQ(serialBoxes.size(), parallelBoxes.size());
+    for( size_t i = 0; i < serialBoxes.size(); i++ )
+      EXPECT_EQ(serialBoxes[i], parallelBoxes[i]) << "frame " << k << ", target " << i;
+  }
+}
+
+TEST(MultiTracker_Alt, parallel_update_matches_serial)
+{
+  MultiTracker_Alt serial, parallel;
+
+  Mat frame = multiTrackerFrame(0, 0);
+  for( int i = 0; i < 12; i++ )
+  {
+    Rect2d box(60 + (i % 4) * 140, 60 + (i / 4) * 140, 48, 48);
+    ASSERT_TRUE(serial.addTarget(frame, box, TrackerMOSSE::create()));
+    ASSERT_TRUE(parallel.addTarget(frame, box, TrackerMOSSE::create()));
+  }
+
+  // the 6th target is covered by another texture in the last frame, the serial update stops there;
+  // the trackers after it have seen the frame in the parallel mode only, so the frames after are not compared
+  const int lostTarget = 5, lostFrame = 4;
+  for( int k = 1; k <= lostFrame; k++ )
+  {
+    frame = multiTrackerFrame(2 * k, k);
+    if( k == lostFrame )
+    {
+      Mat cover(150, 150, CV_8UC3);
+      RNG rng(1);
+      rng.fill(cover, RNG::UNIFORM, 0, 255);
+      GaussianBlur(cover, cover, Size(5, 5), 1.5);
+      Rect2d box = serial.boundingBoxes[lostTarget];
+      cover.copyTo(frame(Rect(cvRound(box.x + box.width / 2) - 75, cvRound(box.y + box.height / 2) - 75, 150, 150)));
+    }
+
+    bool serialStatus = serial.update(frame);
+    bool parallelStatus = parallel.update(frame, true);
+
+    EXPECT_EQ(k < lostFrame, serialStatus);
+    EXPECT_EQ(serialStatus, parallelStatus);
+    ASSERT_EQ(serial.boundingBoxes.size(), parallel.boundingBoxes.size());
+    for( size_t i = 0; i < serial.boundingBoxes.size(); i++ )
+      EXPECT_EQ(serial.boundingBoxes[i], parallel.boundingBoxes[i]) << "frame " << k << ", target " << i;
+  }
+}
+
+TEST(TrackerKCF, shared_frame_context)
+{
+  TrackerKCF::Params params;
+  params.desc_pca = TrackerKCF::GRAY | TrackerKCF::CN;
+  params.desc_npca = 0;
+
+  TrackerKCF::Params resizeParams = params;
+  resizeParams.max_patch_size = 40 * 40;
+
+  Ptr<TrackerKCF::FrameContext> context = TrackerKCF::FrameContext::create(32);
+  std::vector<Ptr<Tracker> > alone, shared;
+  std::vector<Rect2d> aloneBoxes, sharedBoxes;
+
+  Mat frame = multiTrackerFrame(0, 0);
+  for( int i = 0; i < 6; i++ )
+  {
+    // overlapping targets, half of them tracked on the resized frame
+    Rect2d box(100 + i * 60, 120 + (i % 2) * 30, 80, 64);
+    const TrackerKCF::Params& p = i % 2 ? resizeParams : params;
+    Ptr<TrackerKCF> tracker = TrackerKCF::create(p);
+    tracker->setFrameContext(context);
+    ASSERT_TRUE(tracker->init(frame, box));
+    shared.push_back(tracker);
+    alone.push_back(TrackerKCF::create(p));
+    ASSERT_TRUE(alone.back()->init(frame, box));
+  }
+  aloneBoxes.resize(alone.size());
+  sharedBoxes.resize(shared.size());
+
+  for( int k = 0; k <= 5; k++ )
+  {
+    frame = multiTrackerFrame(2 * k, k);
+    context->setFrame(frame);
+    for( size_t i = 0; i < alone.size(); i++ )
+    {
+      bool aloneStatus = alone[i]->update(frame, aloneBoxes[i]);
+      bool sharedStatus = shared[i]->update(frame, sharedBoxes[i]);
+      EXPECT_EQ(aloneStatus, sharedStatus);
+      EXPECT_EQ(aloneBoxes[i], sharedBoxes[i]) << "frame " << k << ", target " << i;
+    }
+  }
+}
+
+TEST(TrackerKCF, frame_context_reused_buffer)
+{
+  TrackerKCF::Params params;
+  params.desc_pca = TrackerKCF::GRAY | TrackerKCF::CN;
+  params.desc_npca = 0;
+
+  Ptr<TrackerKCF::FrameContext> context = TrackerKCF::FrameContext::create(32);
+  Rect2d box(200, 160, 80, 64), aloneBox, sharedBox;
+  Ptr<TrackerKCF> shared = TrackerKCF::create(params);
+  shared->setFrameContext(context);
+  Ptr<Tracker> alone = TrackerKCF::create(params);
+
+  // the frames are captured into the same buffer, the context is only set to the even ones
+  Mat buffer = multiTrackerFrame(0, 0);
+  const uchar* data = buffer.data;
+  ASSERT_TRUE(shared->init(buffer, box));
+  ASSERT_TRUE(alone->init(buffer, box));
+  for( int k = 1; k <= 6; k++ )
+  {
+    multiTrackerFrame(3 * k, 2 * k).copyTo(buffer);
+    ASSERT_EQ(data, buffer.data);
+    if( k % 2 == 0 )
+      context->setFrame(buffer);
+
+    bool aloneStatus = alone->update(buffer, aloneBox);
+    bool sharedStatus = shared->update(buffer, sharedBox);
+    EXPECT_EQ(aloneStatus, sharedStatus);
+    EXPECT_EQ(aloneBox, sharedBox) << "frame " << k;
+  }
+}
+
+/***************************************************************************************/
+//Correlation filter trackers on their shared spectrum kernels
+
+static void correlationTrackerTest(const Ptr<Tracker>& tracker)
+{
+  const Rect2d box(280, 200, 64, 48);
+  ASSERT_TRUE(tracker->init(multiTrackerFrame(0, 0), box));
+  for( int k = 1; k <= 8; k++ )
+  {
+    // the whole frame moves, so the target is at a known place
+    const double dx = 2.5 * k, dy = -1.5 * k;
+    Rect2d result;
+    ASSERT_TRUE(tracker->update(multiTrackerFrame(dx, dy), result)) << "frame " << k;
+    EXPECT_NEAR(box.x + box.width / 2 + dx, result.x + result.width / 2, 2.) << "frame " << k;
+    EXPECT_NEAR(box.y + box.height / 2 + dy, result.y + result.height / 2, 2.) << "frame " << k;
+    EXPECT_NEAR(box.width, result.width, box.width * 0.1) << "frame " << k;
+    EXPECT_NEAR(box.height, result.height, box.height * 0.1) << "frame " << k;
+  }
+}
+
+TEST(CorrelationTrackers, KCF_gray)
+{
+  TrackerKCF::Params params;
+  params.desc_pca = TrackerKCF::GRAY;
+  params.desc_npca = 0;
+  correlationTrackerTest(TrackerKCF::create(params));
+}
+
+TEST(CorrelationTrackers, KCF_color_names)
+{
+  // multi-channel features, compressed and not
+  TrackerKCF::Params params;
+  params.desc_pca = TrackerKCF::CN;
+  params.desc_npca = TrackerKCF::GRAY;
+  params.compress_feature = true;
+  correlationTrackerTest(TrackerKCF::create(params));
+
+  params.compress_feature = false;
+  correlationTrackerTest(TrackerKCF::create(params));
+}
+
+TEST(CorrelationTrackers, MOSSE)
+{
+  correlationTrackerTest(TrackerMOSSE::create());
+}
+
+TEST(CorrelationTrackers, CSRT)
+{
+  correlationTrackerTest(TrackerCSRT::create());
+}
+
 }} // namespace
 /* End of file. */
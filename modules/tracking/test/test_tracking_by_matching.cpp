@@ -0,0 +1,159 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+
+#include "test_precomp.hpp"
+#include "opencv2/tracking/tracking_by_matching.hpp"
+#include "../src/jonker_volgenant.hpp"
+
+namespace opencv_test { namespace {
+
+using namespace cv::tbm;
+
+/** Grid of textured people moving by (dx, dy) pixels per frame */
+class CrowdScene
+{
+public:
+    CrowdScene(Size frameSize, Size personSize, int cols, int rows)
+        : frameSize_(frameSize)
+    {
+        RNG rng(0);
+        for(int y = 0; y < rows; y++)
+        {
+            for(int x = 0; x < cols; x++)
+            {
+                Mat texture(personSize, CV_8UC3);
+                rng.fill(texture, RNG::UNIFORM, 0, 255);
+                textures_.push_back(texture);
+                origins_.push_back(Point(20 + x*(personSize.width*8/3), 20 + y*(personSize.height*2)));
+            }
+        }
+    }
+
+    size_t size() const { return textures_.size(); }
+
+    void render(int frameIdx, Point shift, Mat& frame, TrackedObjects& detections) const
+    {
+        frame.create(frameSize_, CV_8UC3);
+        frame.setTo(Scalar::all(0));
+        detections.clear();
+        for(size_t i = 0; i < textures_.size(); i++)
+        {
+            Rect rect(origins_[i] + shift*frameIdx, textures_[i].size());
+            textures_[i].copyTo(frame(rect));
+            detections.emplace_back(rect, 1.f, frameIdx, -1);
+        }
+    }
+
+private:
+    Size frameSize_;
+    std::vector<Mat> textures_;
+    std::vector<Point> origins_;
+};
+
+static void runCrowd(float motionAffinityW)
+{
+    const int nFrames = 6;
+    CrowdScene scene(Size(640, 480), Size(24, 48), 9, 5);
+
+    TrackerParams params;
+    params.motion_affinity_w = motionAffinityW;
+    Ptr<ITrackerByMatching> tracker = createTrackerByMatching(params);
+    tracker->setDescriptorFast(std::make_shared<ResizedImageDescriptor>(Size(16, 32), INTER_LINEAR));
+    tracker->setDistanceFast(std::make_shared<MatchTemplateDistance>());
+
+    Mat frame;
+    TrackedObjects detections;
+    for(int i = 0; i < nFrames; i++)
+    {
+        scene.render(i, Point(2, 1), frame, detections);
+        tracker->process(frame, detections, static_cast<uint64_t>(i*40));
+    }
+
+    // Every person is followed by a single track through all the frames
+    ASSERT_EQ(scene.size(), tracker->tracks().size());
+    for(const auto& track : tracker->tracks())
+    {
+        EXPECT_EQ((size_t)nFrames, track.second.size()) << "track " << track.first;
+    }
+}
+
+TEST(TrackingByMatching, crowd)
+{
+    runCrowd(TrackerParams().motion_affinity_w);
+}
+
+TEST(TrackingByMatching, crowd_without_motion_gating)
+{
+    runCrowd(0.f);
+}
+
+/** Smallest cost of pairing min(rows, cols) rows and columns of the matrix */
+static float bruteForceAssignmentCost(const Mat& cost, int row, std::vector<char>& usedCols, int pairsLeft)
+{
+    if(pairsLeft == 0)
+        return 0.f;
+    float best = std::numeric_limits<float>::max();
+    // the row is left unpaired if there are enough rows below it
+    if(cost.rows - row - 1 >= pairsLeft)
+        best = bruteForceAssignmentCost(cost, row + 1, usedCols, pairsLeft);
+    for(int j = 0; j < cost.cols; j++)
+    {
+        if(usedCols[j])
+            continue;
+        usedCols[j] = 1;
+        best = std::min(best, cost.at<float>(row, j) + bruteForceAssignmentCost(cost, row + 1, usedCols, pairsLeft - 1));
+        usedCols[j] = 0;
+    }
+    return best;
+}
+
+TEST(TrackingByMatching, sparse_assignment_matches_brute_force)
+{
+    RNG rng(0);
+    for(int iter = 0; iter < 200; iter++)
+    {
+        const int rows = rng.uniform(1, 7), cols = rng.uniform(1, 7);
+        const double density = rng.uniform(0.1, 0.6);
+
+        // the missing entries of the sparse matrix are 1
+        Mat dense(rows, cols, CV_32F, Scalar(1));
+        std::vector<JonkerVolgenant::Entry> entries;
+        for(int i = 0; i < rows; i++)
+            for(int j = 0; j < cols; j++)
+                if(rng.uniform(0., 1.) < density)
+                {
+                    // ties are frequent in tracking, e.g. of zero dissimilarity
+                    float d = rng.uniform(0, 4) == 0 ? 0.f : rng.uniform(0.f, 1.f);
+                    dense.at<float>(i, j) = d;
+                    entries.push_back({(size_t)i, (size_t)j, d});
+                }
+
+        std::vector<size_t> res = JonkerVolgenant::SolveSparse(rows, cols, entries);
+        ASSERT_EQ((size_t)rows, res.size());
+
+        // the unassigned rows and columns are paired at the cost of 1
+        const int pairs = std::min(rows, cols);
+        std::vector<char> usedCols(cols, 0);
+        float cost = 0.f;
+        int assigned = 0;
+        for(int i = 0; i < rows; i++)
+        {
+            if(res[i] == (size_t)-1)
+                continue;
+            ASSERT_LT(res[i], (size_t)cols);
+            ASSERT_FALSE(usedCols[res[i]]) << "column " << res[i] << " is assigned twice";
+            usedCols[res[i]] = 1;
+            cost += dense.at<float>(i, (int)res[i]);
+            assigned++;
+        }
+        ASSERT_LE(assigned, pairs);
+        cost += (float)(pairs - assigned);
+
+        std::fill(usedCols.begin(), usedCols.end(), 0);
+        float expected = bruteForceAssignmentCost(dense, 0, usedCols, pairs);
+        EXPECT_NEAR(expected, cost, 1e-4) << "iteration " << iter << ", " << rows << "x" << cols;
+    }
+}
+
+}} // namespace